@@ -2,4 +2,4 @@
 
 set -xe
 
-cc -Wall -Wextra -ggdb -o example example.c
+cc -Wall -Wextra -ggdb -O2 -fno-math-errno -pthread -o example example.c -lm
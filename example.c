@@ -6,8 +6,16 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <errno.h>
 #include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "opencad.c"
 
 #define WIDTH 800
@@ -22,6 +30,9 @@
 #define FOREGROUND_COLOR 0xFF2020FF
 
 static uint32_t pixels[WIDTH*HEIGHT];
+static float depth[WIDTH*HEIGHT];
+static float accum[WIDTH*HEIGHT*4];
+static float revealage[WIDTH*HEIGHT];
 
 /**
  * Linearly interpolates between two values.
@@ -151,34 +162,1790 @@ bool lines_example(void)
  */
 bool brick_example(void)
 {
-    opencad_fill(pixels, WIDTH, HEIGHT, 0xFF000000); // Black background
+    Opencad_Canvas canvas = opencad_canvas(pixels, depth, WIDTH, HEIGHT);
+    opencad_clear(canvas, 0xFF000000); // Black background
 
-    // Front face
-    opencad_draw_line(pixels, WIDTH, HEIGHT, 200, 400, 400, 400, 0xFFFFFFFF); // White lines
-    opencad_draw_line(pixels, WIDTH, HEIGHT, 400, 400, 400, 300, 0xFFFFFFFF);
-    opencad_draw_line(pixels, WIDTH, HEIGHT, 400, 300, 200, 300, 0xFFFFFFFF);
-    opencad_draw_line(pixels, WIDTH, HEIGHT, 200, 300, 200, 400, 0xFFFFFFFF);
+    Opencad_Solid brick = { .kind = OPENCAD_SOLID_BOX, .size = {2.0f, 1.0f, 0.6f} };
+    Opencad_Solid_Cache cache = {0};
+    const Opencad_Mesh *mesh = NULL;
+    Errno err = opencad_solid_cache_get(&cache, &brick, 0.0f, &mesh);
+    Opencad_Edges edges = {0};
+    if (!err) err = opencad_edges_build(&edges, mesh, 30.0f*(float) M_PI/180.0f);
+    if (err) {
+        fprintf(stderr, "ERROR: could not build brick: %s\n", strerror(err));
+        opencad_solid_cache_free(&cache);
+        return false;
+    }
+
+    Opencad_Camera camera = {
+        .view = opencad_mat4_look_at(opencad_vec3(2.5f, -3.5f, 2.0f), opencad_vec3(0, 0, 0), opencad_vec3(0, 0, 1)),
+        .projection = opencad_mat4_perspective(40.0f*(float) M_PI/180.0f, (float) WIDTH/HEIGHT, 0.1f, 100.0f),
+    };
+    Opencad_Material material = {
+        .shading = OPENCAD_SHADING_FLAT,
+        .color = 0xFF3050B0,
+        .ambient = 0.4f,
+        .lights = {{ .direction = {0.3f, 0.6f, 1.0f}, .intensity = 0.6f }},
+        .light_count = 1,
+    };
+    Opencad_Mat4 model = opencad_mat4_identity();
+    err = opencad_render_solid(canvas, &cache, &brick, model, &camera, &material);
+    if (!err) opencad_draw_edges(canvas, mesh, &edges, model, &camera, 0xFFFFFFFF); // White lines
+    opencad_edges_free(&edges);
+    opencad_solid_cache_free(&cache);
+    if (err) {
+        fprintf(stderr, "ERROR: could not render brick: %s\n", strerror(err));
+        return false;
+    }
+
+    const char *file_path = "brick.ppm";
+    err = opencad_save_to_ppm_file(pixels, WIDTH, HEIGHT, file_path);
+    if (err) {
+        fprintf(stderr, "ERROR: could not save file %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * Builds a torus around the z axis.
+ * @param mesh Receives the mesh. Must be freed with opencad_mesh_free.
+ * @param major The distance from the center of the tube to the center of the torus.
+ * @param minor The radius of the tube.
+ * @param rings The number of segments around the torus.
+ * @param sides The number of segments around the tube.
+ * @return True if the operation was successful, false otherwise.
+ */
+bool make_torus(Opencad_Mesh *mesh, float major, float minor, size_t rings, size_t sides)
+{
+    mesh->vertex_count = rings*sides;
+    mesh->triangle_count = rings*sides*2;
+    mesh->vertices = malloc(mesh->vertex_count*sizeof(*mesh->vertices));
+    mesh->normals = NULL;
+    mesh->indices = malloc(mesh->triangle_count*3*sizeof(*mesh->indices));
+    if (mesh->vertices == NULL || mesh->indices == NULL) {
+        opencad_mesh_free(mesh);
+        return false;
+    }
+
+    for (size_t i = 0; i < rings; ++i) {
+        float u = 2.0f*(float) M_PI*(float) i/(float) rings;
+        for (size_t j = 0; j < sides; ++j) {
+            float v = 2.0f*(float) M_PI*(float) j/(float) sides;
+            mesh->vertices[i*sides + j] = opencad_vec3((major + minor*cosf(v))*cosf(u),
+                                                       (major + minor*cosf(v))*sinf(u),
+                                                       minor*sinf(v));
+        }
+    }
+
+    uint32_t *out = mesh->indices;
+    for (size_t i = 0; i < rings; ++i) {
+        for (size_t j = 0; j < sides; ++j) {
+            uint32_t a = (uint32_t) (i*sides + j);
+            uint32_t b = (uint32_t) (((i + 1)%rings)*sides + j);
+            uint32_t c = (uint32_t) (((i + 1)%rings)*sides + (j + 1)%sides);
+            uint32_t d = (uint32_t) (i*sides + (j + 1)%sides);
+            *out++ = a; *out++ = b; *out++ = c;
+            *out++ = a; *out++ = c; *out++ = d;
+        }
+    }
+    return true;
+}
+
+/**
+ * Renders a torus with flat shading on the left and Gouraud shading on the right and saves it to a PPM file.
+ * @return True if the operation was successful, false otherwise.
+ */
+bool shaded_example(void)
+{
+    Opencad_Mesh torus = {0};
+    if (!make_torus(&torus, 1.0f, 0.4f, 48, 24)) return false;
+
+    Opencad_Canvas canvas = opencad_canvas(pixels, depth, WIDTH, HEIGHT);
+    opencad_clear(canvas, BACKGROUND_COLOR);
+
+    Opencad_Camera camera = {
+        .view = opencad_mat4_look_at(opencad_vec3(0, -3, 2), opencad_vec3(0, 0, 0), opencad_vec3(0, 0, 1)),
+        .projection = opencad_mat4_ortho(-1.6f, 1.6f, -2.4f, 2.4f, 0.1f, 10.0f),
+    };
+    Opencad_Material material = {
+        .shading = OPENCAD_SHADING_FLAT,
+        .color = 0xFF3080E0,
+        .ambient = 0.2f,
+        .lights = {{ .direction = {0.5f, 0.7f, 1.0f}, .intensity = 0.8f }},
+        .light_count = 1,
+    };
+
+    Errno err = opencad_render_mesh(opencad_subcanvas(canvas, 0, 0, WIDTH/2, HEIGHT), &torus, opencad_mat4_identity(), &camera, &material);
+    if (!err) {
+        material.shading = OPENCAD_SHADING_GOURAUD;
+        err = opencad_render_mesh(opencad_subcanvas(canvas, WIDTH/2, 0, WIDTH/2, HEIGHT), &torus, opencad_mat4_identity(), &camera, &material);
+    }
+    opencad_mesh_free(&torus);
+    if (err) {
+        fprintf(stderr, "ERROR: could not render torus: %s\n", strerror(err));
+        return false;
+    }
+
+    const char *file_path = "shaded.ppm";
+    err = opencad_save_to_ppm_file(pixels, WIDTH, HEIGHT, file_path);
+    if (err) {
+        fprintf(stderr, "ERROR: could not save file %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Renders a torus with each built-in matcap, side by side, and saves it to a PPM file.
+ * @return True if the operation was successful, false otherwise.
+ */
+bool matcap_example(void)
+{
+    Opencad_Mesh torus = {0};
+    if (!make_torus(&torus, 1.0f, 0.4f, 48, 24)) return false;
+
+    Opencad_Canvas canvas = opencad_canvas(pixels, depth, WIDTH, HEIGHT);
+    opencad_clear(canvas, BACKGROUND_COLOR);
+
+    Opencad_Camera camera = {
+        .view = opencad_mat4_look_at(opencad_vec3(0, -3, 2), opencad_vec3(0, 0, 0), opencad_vec3(0, 0, 1)),
+        .projection = opencad_mat4_ortho(-1.5f, 1.5f, -2.4f, 2.4f, 0.1f, 10.0f),
+    };
+    Opencad_Material material = {
+        .shading = OPENCAD_SHADING_MATCAP,
+        .color = 0xFFFFFFFF,
+    };
+
+    Errno err = 0;
+    uint32_t tints[COUNT_OPENCAD_MATCAPS] = {0xFFFFFFFF, 0xFF4060E0, 0xFFFFFFFF};
+    for (size_t i = 0; i < COUNT_OPENCAD_MATCAPS && !err; ++i) {
+        material.matcap = (Opencad_Matcap) i;
+        material.color = tints[i];
+        Opencad_Canvas view = opencad_subcanvas(canvas, i*WIDTH/COUNT_OPENCAD_MATCAPS, 0, WIDTH/COUNT_OPENCAD_MATCAPS, HEIGHT);
+        err = opencad_render_mesh(view, &torus, opencad_mat4_identity(), &camera, &material);
+    }
+    opencad_mesh_free(&torus);
+    if (err) {
+        fprintf(stderr, "ERROR: could not render torus: %s\n", strerror(err));
+        return false;
+    }
+
+    const char *file_path = "matcap.ppm";
+    err = opencad_save_to_ppm_file(pixels, WIDTH, HEIGHT, file_path);
+    if (err) {
+        fprintf(stderr, "ERROR: could not save file %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Renders the front, top, right and isometric views of a torus into one image and saves it to a PPM file.
+ * @return True if the operation was successful, false otherwise.
+ */
+bool views_example(void)
+{
+    Opencad_Mesh torus = {0};
+    if (!make_torus(&torus, 1.0f, 0.4f, 48, 24)) return false;
+
+    Opencad_Canvas canvas = opencad_canvas(pixels, depth, WIDTH, HEIGHT);
+    opencad_clear(canvas, BACKGROUND_COLOR);
+
+    Opencad_Mat4 model = opencad_mat4_rotate(opencad_vec3(1, 0, 0), 0.5f);
+    Opencad_Vec3 min, max;
+    opencad_mesh_bounds(&torus, &min, &max);
+
+    Opencad_Camera cameras[COUNT_OPENCAD_VIEWS];
+    for (size_t i = 0; i < COUNT_OPENCAD_VIEWS; ++i) {
+        cameras[i] = opencad_camera_view((Opencad_View) i, min, max, (float) WIDTH/HEIGHT);
+    }
+    Opencad_Material material = {
+        .shading = OPENCAD_SHADING_MATCAP,
+        .matcap = OPENCAD_MATCAP_CLAY,
+        .color = 0xFFFFFFFF,
+    };
+
+    Errno err = opencad_render_mesh_views(canvas, &torus, model, cameras, COUNT_OPENCAD_VIEWS, &material);
+    opencad_mesh_free(&torus);
+    if (err) {
+        fprintf(stderr, "ERROR: could not render views: %s\n", strerror(err));
+        return false;
+    }
+
+    const char *file_path = "views.ppm";
+    err = opencad_save_to_ppm_file(pixels, WIDTH, HEIGHT, file_path);
+    if (err) {
+        fprintf(stderr, "ERROR: could not save file %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Draws a dense torus into thumbnails of shrinking size, each picking its level of detail from
+ * the projected size, and saves the result to a PPM file.
+ * @return True if the operation was successful, false otherwise.
+ */
+bool lod_example(void)
+{
+    Opencad_Mesh torus = {0};
+    if (!make_torus(&torus, 1.0f, 0.4f, 400, 200)) return false;
+
+    Opencad_Lod lod = {0};
+    Errno err = opencad_lod_build(&lod, &torus);
+    if (err) {
+        fprintf(stderr, "ERROR: could not build levels of detail: %s\n", strerror(err));
+        opencad_mesh_free(&torus);
+        return false;
+    }
+
+    Opencad_Canvas canvas = opencad_canvas(pixels, depth, WIDTH, HEIGHT);
+    opencad_clear(canvas, BACKGROUND_COLOR);
+
+    Opencad_Mat4 model = opencad_mat4_rotate(opencad_vec3(1, 0, 0), 0.5f);
+    Opencad_Vec3 min, max;
+    opencad_mesh_bounds(&torus, &min, &max);
+    Opencad_Camera camera = opencad_camera_view(OPENCAD_VIEW_ISOMETRIC, min, max, 1.0f);
+    Opencad_Material material = {
+        .shading = OPENCAD_SHADING_MATCAP,
+        .matcap = OPENCAD_MATCAP_PLASTIC,
+        .color = 0xFF3080E0,
+    };
+
+    size_t x = 0;
+    for (size_t size = HEIGHT/2; size >= 25 && err == 0; size /= 2) {
+        Opencad_Canvas thumbnail = opencad_subcanvas(canvas, x, (HEIGHT - size)/2, size, size);
+        err = opencad_render_lod(thumbnail, &lod, model, &camera, &material);
+        x += size;
+    }
+    opencad_lod_free(&lod);
+    opencad_mesh_free(&torus);
+    if (err) {
+        fprintf(stderr, "ERROR: could not render levels of detail: %s\n", strerror(err));
+        return false;
+    }
+
+    const char *file_path = "lod.ppm";
+    err = opencad_save_to_ppm_file(pixels, WIDTH, HEIGHT, file_path);
+    if (err) {
+        fprintf(stderr, "ERROR: could not save file %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Draws a coarse torus in four views, shaded with its crease and silhouette edges on top, and saves it to a PPM file.
+ * @return True if the operation was successful, false otherwise.
+ */
+bool edges_example(void)
+{
+    Opencad_Mesh torus = {0};
+    if (!make_torus(&torus, 1.0f, 0.4f, 64, 8)) return false;
+
+    Opencad_Edges edges = {0};
+    Errno err = opencad_edges_build(&edges, &torus, 30.0f*(float) M_PI/180.0f);
+    if (err) {
+        fprintf(stderr, "ERROR: could not find edges: %s\n", strerror(err));
+        opencad_mesh_free(&torus);
+        return false;
+    }
+
+    Opencad_Canvas canvas = opencad_canvas(pixels, depth, WIDTH, HEIGHT);
+    opencad_clear(canvas, 0xFFFFFFFF);
+
+    Opencad_Mat4 model = opencad_mat4_rotate(opencad_vec3(1, 0, 0), 0.5f);
+    Opencad_Vec3 min, max;
+    opencad_mesh_bounds(&torus, &min, &max);
+    Opencad_Material material = {
+        .shading = OPENCAD_SHADING_FLAT,
+        .color = 0xFFE0C0A0,
+        .ambient = 0.5f,
+        .lights = {{ .direction = {0.3f, 0.5f, 1.0f}, .intensity = 0.5f }},
+        .light_count = 1,
+    };
+    for (size_t i = 0; i < COUNT_OPENCAD_VIEWS && err == 0; ++i) {
+        Opencad_Canvas view = opencad_subcanvas(canvas, (i%2)*WIDTH/2, (i/2)*HEIGHT/2, WIDTH/2, HEIGHT/2);
+        Opencad_Camera camera = opencad_camera_view((Opencad_View) i, min, max, (float) WIDTH/HEIGHT);
+        err = opencad_render_mesh(view, &torus, model, &camera, &material);
+        opencad_draw_edges(view, &torus, &edges, model, &camera, 0xFF000000);
+    }
+    opencad_edges_free(&edges);
+    opencad_mesh_free(&torus);
+    if (err) {
+        fprintf(stderr, "ERROR: could not render edges: %s\n", strerror(err));
+        return false;
+    }
+
+    const char *file_path = "edges.ppm";
+    err = opencad_save_to_ppm_file(pixels, WIDTH, HEIGHT, file_path);
+    if (err) {
+        fprintf(stderr, "ERROR: could not save file %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Flies a wide-angle perspective camera through a torus, so the near plane cuts the surface, and saves
+ * the shaded view with its edges to a PPM file.
+ * @return True if the operation was successful, false otherwise.
+ */
+bool perspective_example(void)
+{
+    Opencad_Mesh torus = {0};
+    if (!make_torus(&torus, 1.0f, 0.4f, 64, 8)) return false;
+
+    Opencad_Edges edges = {0};
+    Errno err = opencad_edges_build(&edges, &torus, 30.0f*(float) M_PI/180.0f);
+    if (err) {
+        fprintf(stderr, "ERROR: could not find edges: %s\n", strerror(err));
+        opencad_mesh_free(&torus);
+        return false;
+    }
+
+    Opencad_Canvas canvas = opencad_canvas(pixels, depth, WIDTH, HEIGHT);
+    opencad_clear(canvas, BACKGROUND_COLOR);
+
+    Opencad_Camera camera = {
+        .view = opencad_mat4_look_at(opencad_vec3(0.3f, -1.45f, 0.3f), opencad_vec3(1.0f, 0.4f, 0.0f), opencad_vec3(0, 0, 1)),
+        .projection = opencad_mat4_perspective(100.0f*(float) M_PI/180.0f, (float) WIDTH/HEIGHT, 0.15f, 10.0f),
+    };
+    Opencad_Material material = {
+        .shading = OPENCAD_SHADING_FLAT,
+        .color = 0xFFE0C0A0,
+        .ambient = 0.4f,
+        .lights = {{ .direction = {0.0f, 0.0f, 1.0f}, .intensity = 0.6f }},
+        .light_count = 1,
+        .double_sided = true,
+    };
+    err = opencad_render_mesh(canvas, &torus, opencad_mat4_identity(), &camera, &material);
+    if (!err) opencad_draw_edges(canvas, &torus, &edges, opencad_mat4_identity(), &camera, 0xFF000000);
+    opencad_edges_free(&edges);
+    opencad_mesh_free(&torus);
+    if (err) {
+        fprintf(stderr, "ERROR: could not render perspective view: %s\n", strerror(err));
+        return false;
+    }
+
+    const char *file_path = "perspective.ppm";
+    err = opencad_save_to_ppm_file(pixels, WIDTH, HEIGHT, file_path);
+    if (err) {
+        fprintf(stderr, "ERROR: could not save file %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Ghosts the housing of a small assembly to reveal the part inside, using order-independent transparency,
+ * and saves the result to a PPM file.
+ * @return True if the operation was successful, false otherwise.
+ */
+bool ghost_example(void)
+{
+    Opencad_Mesh housing = {0}, shaft = {0}, ring = {0};
+    bool ok = make_torus(&housing, 1.0f, 0.45f, 96, 48)
+           && make_torus(&shaft, 1.0f, 0.15f, 96, 24)
+           && make_torus(&ring, 0.9f, 0.08f, 96, 24);
+    if (!ok) {
+        opencad_mesh_free(&housing);
+        opencad_mesh_free(&shaft);
+        return false;
+    }
+
+    Opencad_Canvas canvas = opencad_canvas_oit(opencad_canvas(pixels, depth, WIDTH, HEIGHT), accum, revealage);
+    opencad_clear(canvas, BACKGROUND_COLOR);
+
+    Opencad_Camera camera = {
+        .view = opencad_mat4_look_at(opencad_vec3(0, -3, 2), opencad_vec3(0, 0, 0), opencad_vec3(0, 0, 1)),
+        .projection = opencad_mat4_perspective(0.8f, (float) WIDTH/HEIGHT, 0.1f, 10.0f),
+    };
+    Opencad_Material solid = {
+        .shading = OPENCAD_SHADING_MATCAP,
+        .matcap = OPENCAD_MATCAP_PLASTIC,
+        .color = 0xFF3080E0,
+    };
+    Opencad_Material ghost = {
+        .shading = OPENCAD_SHADING_MATCAP,
+        .matcap = OPENCAD_MATCAP_CLAY,
+        .color = 0xFFFFE0C0,
+        .double_sided = true,
+        .transparency = 0.75f,
+    };
+    Opencad_Material tinted = ghost;
+    tinted.color = 0xFF60FF60;
+    tinted.transparency = 0.5f;
+
+    // Opaque parts first so they occlude; the transparent ones can then come in any order.
+    Opencad_Mat4 tilt = opencad_mat4_rotate(opencad_vec3(1, 0, 0), (float) M_PI/2);
+    Errno err = opencad_render_mesh(canvas, &shaft, opencad_mat4_identity(), &camera, &solid);
+    if (!err) err = opencad_render_mesh(canvas, &housing, opencad_mat4_identity(), &camera, &ghost);
+    if (!err) err = opencad_render_mesh(canvas, &ring, tilt, &camera, &tinted);
+    if (!err) opencad_resolve_transparency(canvas);
+    opencad_mesh_free(&housing);
+    opencad_mesh_free(&shaft);
+    opencad_mesh_free(&ring);
+    if (err) {
+        fprintf(stderr, "ERROR: could not render ghosted view: %s\n", strerror(err));
+        return false;
+    }
+
+    const char *file_path = "ghost.ppm";
+    err = opencad_save_to_ppm_file(pixels, WIDTH, HEIGHT, file_path);
+    if (err) {
+        fprintf(stderr, "ERROR: could not save file %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Draws a pair of linked tori with image-space outlines from the depth and normal buffers and saves
+ * the result to a PPM file.
+ * @return True if the operation was successful, false otherwise.
+ */
+bool outline_example(void)
+{
+    static uint32_t normals[WIDTH*HEIGHT];
+
+    Opencad_Mesh a = {0}, b = {0};
+    if (!make_torus(&a, 1.0f, 0.3f, 64, 16) || !make_torus(&b, 1.0f, 0.3f, 64, 16)) {
+        opencad_mesh_free(&a);
+        return false;
+    }
+
+    Opencad_Canvas canvas = opencad_canvas(pixels, depth, WIDTH, HEIGHT);
+    canvas.normals = normals;
+    opencad_clear(canvas, 0xFFFFFFFF);
+
+    Opencad_Camera camera = {
+        .view = opencad_mat4_look_at(opencad_vec3(1.5f, -4, 2.5f), opencad_vec3(0.5f, 0, 0), opencad_vec3(0, 0, 1)),
+        .projection = opencad_mat4_perspective(0.8f, (float) WIDTH/HEIGHT, 0.1f, 20.0f),
+    };
+    Opencad_Material material = {
+        .shading = OPENCAD_SHADING_MATCAP,
+        .matcap = OPENCAD_MATCAP_CLAY,
+        .color = 0xFFE0E0E0,
+    };
+    Opencad_Mat4 link = opencad_mat4_mul(opencad_mat4_translate(1, 0, 0),
+                                         opencad_mat4_rotate(opencad_vec3(1, 0, 0), (float) M_PI/2));
+    Opencad_Outline outline = {
+        .color = 0xFF000000,
+        .depth_threshold = 0.02f,
+        .normal_threshold = 2.0f,
+    };
+    Errno err = opencad_render_mesh(canvas, &a, opencad_mat4_identity(), &camera, &material);
+    if (!err) err = opencad_render_mesh(canvas, &b, link, &camera, &material);
+    if (!err) err = opencad_draw_outlines(canvas, &camera, &outline);
+    opencad_mesh_free(&a);
+    opencad_mesh_free(&b);
+    if (err) {
+        fprintf(stderr, "ERROR: could not render outlines: %s\n", strerror(err));
+        return false;
+    }
+
+    const char *file_path = "outline.ppm";
+    err = opencad_save_to_ppm_file(pixels, WIDTH, HEIGHT, file_path);
+    if (err) {
+        fprintf(stderr, "ERROR: could not save file %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Renders tori resting on a floor twice, plainly on the left and with screen-space ambient occlusion
+ * on the right, and saves the result to a PPM file.
+ * @return True if the operation was successful, false otherwise.
+ */
+bool occlusion_example(void)
+{
+    Opencad_Mesh torus = {0}, floor = {0};
+    const Opencad_Vec3 corners[] = {
+        {-6, -6, -0.3f}, {6, -6, -0.3f}, {6, 6, -0.3f},
+        {-6, -6, -0.3f}, {6, 6, -0.3f}, {-6, 6, -0.3f},
+    };
+    if (!make_torus(&torus, 1.0f, 0.3f, 96, 32)) return false;
+    Errno err = opencad_mesh_from_soup(corners, 2, &floor);
+    if (err) {
+        fprintf(stderr, "ERROR: could not build floor: %s\n", strerror(err));
+        opencad_mesh_free(&torus);
+        return false;
+    }
+
+    Opencad_Canvas canvas = opencad_canvas(pixels, depth, WIDTH, HEIGHT);
+    opencad_clear(canvas, BACKGROUND_COLOR);
+
+    Opencad_Camera camera = {
+        .view = opencad_mat4_look_at(opencad_vec3(0.5f, -6.0f, 4.5f), opencad_vec3(0.5f, 0.3f, 0.2f), opencad_vec3(0, 0, 1)),
+        .projection = opencad_mat4_perspective(0.8f, (float) (WIDTH/2)/HEIGHT, 0.1f, 20.0f),
+    };
+    Opencad_Material material = {
+        .shading = OPENCAD_SHADING_FLAT,
+        .color = 0xFFE8E8E8,
+        .ambient = 0.5f,
+        .lights = {{ .direction = {0.3f, -0.5f, 1.0f}, .intensity = 0.5f }},
+        .light_count = 1,
+        .double_sided = true,
+    };
+    const Opencad_Mat4 models[] = {
+        opencad_mat4_identity(),
+        opencad_mat4_translate(1.7f, 0.9f, 0),
+        opencad_mat4_mul(opencad_mat4_translate(0.85f, 0.45f, 0.7f), opencad_mat4_rotate(opencad_vec3(-0.47f, 0.88f, 0), 1.4f)),
+    };
+    Opencad_Occlusion occlusion = {
+        .radius = 0.5f,
+        .strength = 1.0f,
+    };
+    for (size_t i = 0; i < 2 && err == 0; ++i) {
+        Opencad_Canvas half = opencad_subcanvas(canvas, i*WIDTH/2, 0, WIDTH/2, HEIGHT);
+        err = opencad_render_mesh(half, &floor, opencad_mat4_identity(), &camera, &material);
+        for (size_t k = 0; k < sizeof(models)/sizeof(models[0]) && err == 0; ++k) {
+            err = opencad_render_mesh(half, &torus, models[k], &camera, &material);
+        }
+        if (!err && i == 1) err = opencad_apply_occlusion(half, &camera, &occlusion);
+    }
+    opencad_mesh_free(&torus);
+    opencad_mesh_free(&floor);
+    if (err) {
+        fprintf(stderr, "ERROR: could not render occlusion: %s\n", strerror(err));
+        return false;
+    }
+
+    const char *file_path = "occlusion.ppm";
+    err = opencad_save_to_ppm_file(pixels, WIDTH, HEIGHT, file_path);
+    if (err) {
+        fprintf(stderr, "ERROR: could not save file %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Cuts a shaft inside a housing with section planes, once with one hatched plane and once with two
+ * solid ones, and saves the result to a PPM file.
+ * @return True if the operation was successful, false otherwise.
+ */
+bool section_example(void)
+{
+    static uint8_t stencil[WIDTH*HEIGHT];
+
+    Opencad_Mesh housing = {0}, shaft = {0};
+    if (!make_torus(&housing, 1.0f, 0.45f, 96, 48) || !make_torus(&shaft, 1.0f, 0.2f, 96, 24)) {
+        opencad_mesh_free(&housing);
+        return false;
+    }
+
+    Opencad_Canvas canvas = opencad_canvas(pixels, depth, WIDTH, HEIGHT);
+    canvas.stencil = stencil;
+    opencad_clear(canvas, BACKGROUND_COLOR);
+
+    Opencad_Camera camera = {
+        .view = opencad_mat4_look_at(opencad_vec3(-2.0f, -4.5f, 3.5f), opencad_vec3(0, 0, 0), opencad_vec3(0, 0, 1)),
+        .projection = opencad_mat4_perspective(0.8f, (float) (WIDTH/2)/HEIGHT, 0.1f, 20.0f),
+    };
+    const Opencad_Section sections[] = {
+        {
+            .planes = {{0, 1, 0, 0}},
+            .plane_count = 1,
+            .cap_color = 0xFFB0B0B0,
+            .hatch_color = 0xFF404040,
+            .hatch_spacing = 8,
+        },
+        {
+            .planes = {{0, 1, 0, 0}, {0, 0, -1, 0.1f}},
+            .plane_count = 2,
+            .cap_color = 0xFFB0B0B0,
+        },
+    };
+    Errno err = 0;
+    for (size_t i = 0; i < 2 && err == 0; ++i) {
+        Opencad_Section shaft_section = sections[i];
+        shaft_section.cap_color = 0xFF3080E0;
+        shaft_section.hatch_spacing = 0;
+        Opencad_Material inner = {
+            .shading = OPENCAD_SHADING_FLAT,
+            .color = 0xFF3080E0,
+            .ambient = 0.4f,
+            .lights = {{ .direction = {0.3f, 0.5f, 1.0f}, .intensity = 0.6f }},
+            .light_count = 1,
+            .section = &shaft_section,
+        };
+        Opencad_Material outer = inner;
+        outer.color = 0xFFE0E0E0;
+        outer.section = &sections[i];
+
+        // Inner parts first, so their caps win over the housing's cap at the same depth.
+        Opencad_Canvas half = opencad_subcanvas(canvas, i*WIDTH/2, 0, WIDTH/2, HEIGHT);
+        err = opencad_render_mesh(half, &shaft, opencad_mat4_identity(), &camera, &inner);
+        if (!err) err = opencad_render_mesh(half, &housing, opencad_mat4_identity(), &camera, &outer);
+    }
+    opencad_mesh_free(&housing);
+    opencad_mesh_free(&shaft);
+    if (err) {
+        fprintf(stderr, "ERROR: could not render section: %s\n", strerror(err));
+        return false;
+    }
+
+    const char *file_path = "section.ppm";
+    err = opencad_save_to_ppm_file(pixels, WIDTH, HEIGHT, file_path);
+    if (err) {
+        fprintf(stderr, "ERROR: could not save file %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Draws a checkered floor running to the horizon and an upright panel with a framed grid, both
+ * textured, and saves the result to a PPM file.
+ * @return True if the operation was successful, false otherwise.
+ */
+bool texture_example(void)
+{
+    enum { SIZE = 256 };
+    static uint32_t image[SIZE*SIZE];
+    for (size_t y = 0; y < SIZE; ++y) {
+        for (size_t x = 0; x < SIZE; ++x) {
+            bool frame = x < 8 || y < 8 || x >= SIZE - 8 || y >= SIZE - 8;
+            bool dark = ((x/32) + (y/32))%2 == 0;
+            image[y*SIZE + x] = frame ? 0xFF2020C0 : dark ? 0xFF404040 : 0xFFF0F0F0;
+        }
+    }
+
+    Opencad_Texture floor_texture = {0}, panel_texture = {0};
+    Errno err = opencad_texture_build(&floor_texture, image, SIZE, SIZE);
+    if (!err) err = opencad_texture_build(&panel_texture, image, SIZE, SIZE);
+    if (err) {
+        fprintf(stderr, "ERROR: could not build texture: %s\n", strerror(err));
+        opencad_texture_free(&floor_texture);
+        return false;
+    }
+    panel_texture.clamp = true;
+
+    // The floor repeats the image 40 times each way; the panel clamps, so its frame stretches over the margin.
+    Opencad_Vec3 floor_vertices[] = {{-40, -2, 0}, {40, -2, 0}, {40, 80, 0}, {-40, 80, 0}};
+    Opencad_Vec2 floor_uvs[] = {{0, 0}, {40, 0}, {40, 41}, {0, 41}};
+    Opencad_Vec3 panel_vertices[] = {{-1.5f, 2, 0.2f}, {1.5f, 2, 0.2f}, {1.5f, 2, 3.2f}, {-1.5f, 2, 3.2f}};
+    Opencad_Vec2 panel_uvs[] = {{-0.1f, 1.1f}, {1.1f, 1.1f}, {1.1f, -0.1f}, {-0.1f, -0.1f}};
+    uint32_t indices[] = {0, 1, 2, 0, 2, 3};
+    Opencad_Mesh floor = { .vertices = floor_vertices, .uvs = floor_uvs, .vertex_count = 4, .indices = indices, .triangle_count = 2 };
+    Opencad_Mesh panel = { .vertices = panel_vertices, .uvs = panel_uvs, .vertex_count = 4, .indices = indices, .triangle_count = 2 };
+
+    Opencad_Canvas canvas = opencad_canvas(pixels, depth, WIDTH, HEIGHT);
+    opencad_clear(canvas, 0xFFE0C0A0);
+
+    Opencad_Camera camera = {
+        .view = opencad_mat4_look_at(opencad_vec3(-2.5f, -4, 1.5f), opencad_vec3(0, 4, 1.0f), opencad_vec3(0, 0, 1)),
+        .projection = opencad_mat4_perspective(1.0f, (float) WIDTH/HEIGHT, 0.1f, 200.0f),
+    };
+    Opencad_Material material = {
+        .shading = OPENCAD_SHADING_UNLIT,
+        .color = 0xFFFFFFFF,
+        .double_sided = true,
+        .texture = &floor_texture,
+    };
+    err = opencad_render_mesh(canvas, &floor, opencad_mat4_identity(), &camera, &material);
+    material.texture = &panel_texture;
+    if (!err) err = opencad_render_mesh(canvas, &panel, opencad_mat4_identity(), &camera, &material);
+    opencad_texture_free(&floor_texture);
+    opencad_texture_free(&panel_texture);
+    if (err) {
+        fprintf(stderr, "ERROR: could not render textures: %s\n", strerror(err));
+        return false;
+    }
+
+    const char *file_path = "texture.ppm";
+    err = opencad_save_to_ppm_file(pixels, WIDTH, HEIGHT, file_path);
+    if (err) {
+        fprintf(stderr, "ERROR: could not save file %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Draws a plate covered by a grid of 1600 washers, all sharing one mesh, and saves the result to a PPM file.
+ * Washers outside the view are culled before any of their vertices are touched.
+ * @return True if the operation was successful, false otherwise.
+ */
+bool instances_example(void)
+{
+    enum { GRID = 40 };
+    static Opencad_Mat4 transforms[GRID*GRID];
+
+    Opencad_Mesh washer = {0}, plate = {0};
+    const Opencad_Vec3 corners[] = {
+        {-1, -1, 0}, {GRID, -1, 0}, {GRID, GRID, 0},
+        {-1, -1, 0}, {GRID, GRID, 0}, {-1, GRID, 0},
+    };
+    if (!make_torus(&washer, 0.3f, 0.1f, 24, 12)) return false;
+    Errno err = opencad_mesh_from_soup(corners, 2, &plate);
+    if (err) {
+        fprintf(stderr, "ERROR: could not build plate: %s\n", strerror(err));
+        opencad_mesh_free(&washer);
+        return false;
+    }
+    for (size_t y = 0; y < GRID; ++y) {
+        for (size_t x = 0; x < GRID; ++x) {
+            transforms[y*GRID + x] = opencad_mat4_translate((float) x, (float) y, 0.1f);
+        }
+    }
+
+    Opencad_Canvas canvas = opencad_canvas(pixels, depth, WIDTH, HEIGHT);
+    opencad_clear(canvas, BACKGROUND_COLOR);
+
+    Opencad_Camera camera = {
+        .view = opencad_mat4_look_at(opencad_vec3(-1.5f, -1.5f, 3.0f), opencad_vec3(4, 4, 0), opencad_vec3(0, 0, 1)),
+        .projection = opencad_mat4_perspective(0.9f, (float) WIDTH/HEIGHT, 0.1f, 100.0f),
+    };
+    Opencad_Material material = {
+        .shading = OPENCAD_SHADING_FLAT,
+        .color = 0xFFC0C0C0,
+        .ambient = 0.4f,
+        .lights = {{ .direction = {0.3f, 0.5f, 1.0f}, .intensity = 0.6f }},
+        .light_count = 1,
+    };
+    Opencad_Material steel = material;
+    steel.color = 0xFF806050;
+    err = opencad_render_mesh(canvas, &plate, opencad_mat4_identity(), &camera, &steel);
+    if (!err) err = opencad_render_instances(canvas, &washer, transforms, GRID*GRID, &camera, &material);
+    opencad_mesh_free(&washer);
+    opencad_mesh_free(&plate);
+    if (err) {
+        fprintf(stderr, "ERROR: could not render instances: %s\n", strerror(err));
+        return false;
+    }
+
+    const char *file_path = "instances.ppm";
+    err = opencad_save_to_ppm_file(pixels, WIDTH, HEIGHT, file_path);
+    if (err) {
+        fprintf(stderr, "ERROR: could not save file %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Simulates a laser scan of a torus with a dented region, two million noisy points colored by their
+ * deviation from the nominal surface, and saves the nominal mesh next to the scan to a PPM file.
+ * @return True if the operation was successful, false otherwise.
+ */
+bool points_example(void)
+{
+    enum { COUNT = 2000000 };
+    const float major = 1.0f, minor = 0.4f;
+    Opencad_Vec3 *positions = malloc(COUNT*sizeof(*positions));
+    uint32_t *colors = malloc(COUNT*sizeof(*colors));
+    Opencad_Mesh torus = {0};
+    if (positions == NULL || colors == NULL || !make_torus(&torus, major, minor, 64, 32)) {
+        free(positions);
+        free(colors);
+        return false;
+    }
+
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < COUNT; ++i) {
+        float r[3];
+        for (int k = 0; k < 3; ++k) {
+            seed = seed*1664525u + 1013904223u;
+            r[k] = (float) (seed >> 8)/(float) (1 << 24);
+        }
+        float u = 2.0f*(float) M_PI*r[0], v = 2.0f*(float) M_PI*r[1];
+        float du = u - 0.8f, dv = v - 1.2f;
+        float dent = -0.06f*expf(-(du*du + dv*dv)*8.0f);
+        float deviation = dent + (r[2] - 0.5f)*0.01f;
+        float radius = minor + deviation;
+        positions[i] = opencad_vec3((major + radius*cosf(v))*cosf(u), (major + radius*cosf(v))*sinf(u), radius*sinf(v));
+
+        // Blue for material missing, green within tolerance, red for excess.
+        float t = deviation/0.06f;
+        t = t < -1.0f ? -1.0f : t > 1.0f ? 1.0f : t;
+        uint32_t red = t > 0.0f ? (uint32_t) (255*t) : 0;
+        uint32_t blue = t < 0.0f ? (uint32_t) (-255*t) : 0;
+        uint32_t green = (uint32_t) (255*(1.0f - fabsf(t)));
+        colors[i] = 0xFF000000 | (blue << 16) | (green << 8) | red;
+    }
+
+    Opencad_Canvas canvas = opencad_canvas(pixels, depth, WIDTH, HEIGHT);
+    opencad_clear(canvas, BACKGROUND_COLOR);
+
+    Opencad_Camera camera = {
+        .view = opencad_mat4_look_at(opencad_vec3(3.2f, 1.8f, 3.2f), opencad_vec3(0, 0, 0), opencad_vec3(0, 0, 1)),
+        .projection = opencad_mat4_perspective(0.9f, (float) (WIDTH/2)/HEIGHT, 0.1f, 20.0f),
+    };
+    Opencad_Material material = {
+        .shading = OPENCAD_SHADING_FLAT,
+        .color = 0xFFC0C0C0,
+        .ambient = 0.4f,
+        .lights = {{ .direction = {0.3f, 0.5f, 1.0f}, .intensity = 0.6f }},
+        .light_count = 1,
+    };
+    Opencad_Points scan = {
+        .positions = positions,
+        .colors = colors,
+        .count = COUNT,
+        .splat_size = 2,
+    };
+    Errno err = opencad_render_mesh(opencad_subcanvas(canvas, 0, 0, WIDTH/2, HEIGHT), &torus,
+                                    opencad_mat4_identity(), &camera, &material);
+    if (!err) err = opencad_render_points(opencad_subcanvas(canvas, WIDTH/2, 0, WIDTH/2, HEIGHT), &scan,
+                                          opencad_mat4_identity(), &camera);
+    free(positions);
+    free(colors);
+    opencad_mesh_free(&torus);
+    if (err) {
+        fprintf(stderr, "ERROR: could not render points: %s\n", strerror(err));
+        return false;
+    }
+
+    const char *file_path = "points.ppm";
+    err = opencad_save_to_ppm_file(pixels, WIDTH, HEIGHT, file_path);
+    if (err) {
+        fprintf(stderr, "ERROR: could not save file %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+    return true;
+}
 
-    // Top face
-    opencad_draw_line(pixels, WIDTH, HEIGHT, 200, 300, 250, 250, 0xFFFFFFFF);
-    opencad_draw_line(pixels, WIDTH, HEIGHT, 250, 250, 450, 250, 0xFFFFFFFF);
+bool solids_example(void)
+{
+    Opencad_Canvas canvas = opencad_canvas(pixels, depth, WIDTH, HEIGHT);
+    opencad_clear(canvas, 0xFFFFFFFF);
 
-    // Right face
-    opencad_draw_line(pixels, WIDTH, HEIGHT, 400, 400, 450, 350, 0xFFFFFFFF);
-    opencad_draw_line(pixels, WIDTH, HEIGHT, 450, 350, 450, 250, 0xFFFFFFFF);
-    opencad_draw_line(pixels, WIDTH, HEIGHT, 450, 250, 400, 300, 0xFFFFFFFF);
-    opencad_draw_line(pixels, WIDTH, HEIGHT, 400, 300, 400, 400, 0xFFFFFFFF);
+    const Opencad_Solid solids[] = {
+        { .kind = OPENCAD_SOLID_BOX, .size = {1.2f, 1.2f, 1.2f} },
+        { .kind = OPENCAD_SOLID_CYLINDER, .radius = 0.6f, .height = 1.2f },
+        { .kind = OPENCAD_SOLID_SPHERE, .radius = 0.7f },
+        { .kind = OPENCAD_SOLID_CONE, .radius = 0.7f, .radius2 = 0.2f, .height = 1.2f },
+        { .kind = OPENCAD_SOLID_TORUS, .radius = 0.55f, .radius2 = 0.2f },
+    };
+    const float offsets[] = {0.0f, -0.6f, 0.0f, -0.6f, 0.0f};
+    size_t solid_count = sizeof(solids)/sizeof(solids[0]);
+    Opencad_Material material = {
+        .shading = OPENCAD_SHADING_GOURAUD,
+        .color = 0xFFB08050,
+        .ambient = 0.35f,
+        .lights = {{ .direction = {0.3f, 0.7f, 1.0f}, .intensity = 0.65f }},
+        .light_count = 1,
+    };
 
-    const char *file_path = "brick.ppm";
-    Errno err = opencad_save_to_ppm_file(pixels, WIDTH, HEIGHT, file_path);
+    // Two rows walking away from the camera: the far copies get coarser meshes. The camera then
+    // creeps forward for a few frames, which keeps hitting the cache instead of re-tessellating.
+    Opencad_Solid_Cache cache = {0};
+    Errno err = 0;
+    size_t first_count = 0;
+    for (int frame = 0; frame < 4 && err == 0; ++frame) {
+        opencad_clear(canvas, 0xFFFFFFFF);
+        Opencad_Camera camera = {
+            .view = opencad_mat4_look_at(opencad_vec3(0.0f, -7.0f + 0.05f*(float) frame, 3.0f),
+                                         opencad_vec3(0.0f, 6.0f, 0.0f), opencad_vec3(0, 0, 1)),
+            .projection = opencad_mat4_perspective(50.0f*(float) M_PI/180.0f, (float) WIDTH/HEIGHT, 0.1f, 100.0f),
+        };
+        for (size_t row = 0; row < 2 && err == 0; ++row) {
+            for (size_t i = 0; i < solid_count && err == 0; ++i) {
+                Opencad_Mat4 model = opencad_mat4_translate(((float) i - 2.0f)*1.7f, 12.0f*(float) row, offsets[i]);
+                err = opencad_render_solid(canvas, &cache, &solids[i], model, &camera, &material);
+            }
+        }
+        if (frame == 0) first_count = cache.count;
+    }
+    size_t count = cache.count;
+    opencad_solid_cache_free(&cache);
+    if (err) {
+        fprintf(stderr, "ERROR: could not render solids: %s\n", strerror(err));
+        return false;
+    }
+    if (count != first_count) {
+        fprintf(stderr, "ERROR: moving the camera re-tessellated %zu solids\n", count - first_count);
+        return false;
+    }
+
+    const char *file_path = "solids.ppm";
+    err = opencad_save_to_ppm_file(pixels, WIDTH, HEIGHT, file_path);
+    if (err) {
+        fprintf(stderr, "ERROR: could not save file %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool boolean_example(void)
+{
+    Opencad_Canvas canvas = opencad_canvas(pixels, depth, WIDTH, HEIGHT);
+    opencad_clear(canvas, 0xFFFFFFFF);
+
+    // A box with a sphere bitten out of one corner, and the other two ways to combine them.
+    const Opencad_Solid box = { .kind = OPENCAD_SOLID_BOX, .size = {1.6f, 1.6f, 1.6f} };
+    const Opencad_Solid sphere = { .kind = OPENCAD_SOLID_SPHERE, .radius = 0.9f };
+    Opencad_Mesh a = {0}, b = {0}, results[COUNT_OPENCAD_BOOLEANS] = {0};
+    Errno err = opencad_solid_tessellate(&box, 0.0f, &a);
+    if (!err) err = opencad_solid_tessellate(&sphere, 0.01f, &b);
+    for (size_t i = 0; i < b.vertex_count; ++i) {
+        b.vertices[i] = opencad_vec3_add(b.vertices[i], opencad_vec3(0.6f, -0.6f, 0.6f));
+    }
+    for (int op = 0; op < COUNT_OPENCAD_BOOLEANS && !err; ++op) {
+        err = opencad_mesh_boolean(&a, &b, (Opencad_Boolean) op, &results[op]);
+    }
+
+    Opencad_Camera camera = {
+        .view = opencad_mat4_look_at(opencad_vec3(4.5f, -6.0f, 4.0f), opencad_vec3(0, 0, 0), opencad_vec3(0, 0, 1)),
+        .projection = opencad_mat4_perspective(40.0f*(float) M_PI/180.0f, (float) (WIDTH/3)/HEIGHT, 0.1f, 100.0f),
+    };
+    Opencad_Material material = {
+        .shading = OPENCAD_SHADING_FLAT,
+        .color = 0xFF5080B0,
+        .ambient = 0.35f,
+        .lights = {{ .direction = {0.3f, 0.7f, 1.0f}, .intensity = 0.65f }},
+        .light_count = 1,
+    };
+    for (int op = 0; op < COUNT_OPENCAD_BOOLEANS && !err; ++op) {
+        Opencad_Canvas panel = opencad_subcanvas(canvas, (size_t) op*(WIDTH/3), 0, WIDTH/3, HEIGHT);
+        err = opencad_render_mesh(panel, &results[op], opencad_mat4_identity(), &camera, &material);
+    }
+    opencad_mesh_free(&a);
+    opencad_mesh_free(&b);
+    for (int op = 0; op < COUNT_OPENCAD_BOOLEANS; ++op) opencad_mesh_free(&results[op]);
+    if (err) {
+        fprintf(stderr, "ERROR: could not combine meshes: %s\n", strerror(err));
+        return false;
+    }
+
+    const char *file_path = "boolean.ppm";
+    err = opencad_save_to_ppm_file(pixels, WIDTH, HEIGHT, file_path);
+    if (err) {
+        fprintf(stderr, "ERROR: could not save file %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+static int compare_edges(const void *a, const void *b)
+{
+    uint64_t u = *(const uint64_t *) a, v = *(const uint64_t *) b;
+    return (u > v) - (u < v);
+}
+
+/**
+ * Checks that a mesh is the closed boundary of a solid: every directed edge appears exactly once and
+ * is matched by exactly one edge running the other way.
+ * @param mesh The mesh to check.
+ * @return true if the mesh is closed, false otherwise.
+ */
+bool mesh_is_closed(const Opencad_Mesh *mesh)
+{
+    size_t count = mesh->triangle_count*3;
+    uint64_t *edges = malloc((count + 1)*sizeof(*edges));
+    if (edges == NULL) return false;
+    for (size_t t = 0; t < mesh->triangle_count; ++t) {
+        for (int k = 0; k < 3; ++k) {
+            uint64_t from = mesh->indices[t*3 + k], to = mesh->indices[t*3 + (k + 1)%3];
+            edges[t*3 + k] = from << 32 | to;
+        }
+    }
+    qsort(edges, count, sizeof(*edges), compare_edges);
+    bool closed = true;
+    for (size_t i = 0; i < count && closed; ++i) {
+        uint64_t twin = edges[i] << 32 | edges[i] >> 32;
+        if (i > 0 && edges[i] == edges[i - 1]) closed = false;
+        if (bsearch(&twin, edges, count, sizeof(*edges), compare_edges) == NULL) closed = false;
+    }
+    free(edges);
+    return closed;
+}
+
+bool closed_example(void)
+{
+    // A fine sphere with a cylinder pushed through slightly off its axis, so that the crossing curve
+    // runs close to many vertices and edges; then the degenerate cases, where the operands share faces.
+    const Opencad_Solid sphere = { .kind = OPENCAD_SOLID_SPHERE, .radius = 1.0f };
+    const Opencad_Solid cylinder = { .kind = OPENCAD_SOLID_CYLINDER, .radius = 0.4f, .height = 3.0f };
+    const Opencad_Solid cube = { .kind = OPENCAD_SOLID_BOX, .size = {1.0f, 1.0f, 1.0f} };
+    Opencad_Mesh ball = {0}, rod = {0}, left = {0}, right = {0};
+    Errno err = opencad_solid_tessellate(&sphere, 0.001f, &ball);
+    if (!err) err = opencad_solid_tessellate(&cylinder, 0.001f, &rod);
+    if (!err) err = opencad_solid_tessellate(&cube, 0.0f, &left);
+    if (!err) err = opencad_solid_tessellate(&cube, 0.0f, &right);
+    for (size_t i = 0; i < rod.vertex_count; ++i) {
+        rod.vertices[i] = opencad_vec3_add(rod.vertices[i], opencad_vec3(0.0123f, 0.0371f, -1.5f));
+    }
+    for (size_t i = 0; i < right.vertex_count; ++i) {
+        right.vertices[i] = opencad_vec3_add(right.vertices[i], opencad_vec3(1.0f, 0.0f, 0.0f));
+    }
+
+    const size_t any = SIZE_MAX;
+    const struct {
+        const char *name;
+        const Opencad_Mesh *a, *b;
+        Opencad_Boolean op;
+        size_t triangles;   // The triangle count to expect, or any for any nonempty result.
+    } cases[] = {
+        { "sphere minus cylinder", &ball, &rod, OPENCAD_BOOLEAN_DIFFERENCE, any },
+        { "sphere plus cylinder", &ball, &rod, OPENCAD_BOOLEAN_UNION, any },
+        { "sphere and cylinder", &ball, &rod, OPENCAD_BOOLEAN_INTERSECTION, any },
+        { "cylinder minus sphere", &rod, &ball, OPENCAD_BOOLEAN_DIFFERENCE, any },
+        { "sphere minus itself", &ball, &ball, OPENCAD_BOOLEAN_DIFFERENCE, 0 },
+        { "cubes side by side", &left, &right, OPENCAD_BOOLEAN_UNION, 20 },
+    };
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(cases)/sizeof(cases[0]) && !err; ++i) {
+        Opencad_Mesh result = {0};
+        err = opencad_mesh_boolean(cases[i].a, cases[i].b, cases[i].op, &result);
+        if (err) break;
+        if (cases[i].triangles == any ? result.triangle_count == 0 : result.triangle_count != cases[i].triangles) {
+            fprintf(stderr, "ERROR: %s has %zu triangles\n", cases[i].name, result.triangle_count);
+            ok = false;
+        } else if (!mesh_is_closed(&result)) {
+            fprintf(stderr, "ERROR: %s is not closed\n", cases[i].name);
+            ok = false;
+        }
+        opencad_mesh_free(&result);
+    }
+    opencad_mesh_free(&ball);
+    opencad_mesh_free(&rod);
+    opencad_mesh_free(&left);
+    opencad_mesh_free(&right);
+    if (err) {
+        fprintf(stderr, "ERROR: could not combine meshes: %s\n", strerror(err));
+        return false;
+    }
+    return ok;
+}
+
+/**
+ * Builds the flange the distance field examples draw: a rounded plate with a boss blended on top,
+ * a bore through both and four bolt holes.
+ * @param sdf The field to add the nodes to.
+ * @return The root node.
+ */
+uint32_t flange_sdf(Opencad_Sdf *sdf)
+{
+    uint32_t plate = opencad_sdf_offset(sdf, opencad_sdf_box(sdf, opencad_vec3(3.6f, 3.6f, 0.4f)), 0.1f);
+    uint32_t boss = opencad_sdf_transform(sdf, opencad_sdf_cylinder(sdf, 1.0f, 1.6f), opencad_mat4_translate(0, 0, 0.8f));
+    uint32_t part = opencad_sdf_boolean(sdf, OPENCAD_BOOLEAN_UNION, plate, boss, 0.4f);
+    part = opencad_sdf_boolean(sdf, OPENCAD_BOOLEAN_DIFFERENCE, part, opencad_sdf_cylinder(sdf, 0.6f, 4.0f), 0.1f);
+    for (int i = 0; i < 4; ++i) {
+        Opencad_Mat4 at = opencad_mat4_translate(i & 1 ? 1.4f : -1.4f, i & 2 ? 1.4f : -1.4f, 0.0f);
+        uint32_t hole = opencad_sdf_transform(sdf, opencad_sdf_cylinder(sdf, 0.25f, 2.0f), at);
+        part = opencad_sdf_boolean(sdf, OPENCAD_BOOLEAN_DIFFERENCE, part, hole, 0.0f);
+    }
+    uint32_t ring = opencad_sdf_transform(sdf, opencad_sdf_torus(sdf, 1.0f, 0.15f), opencad_mat4_translate(0, 0, 1.6f));
+    part = opencad_sdf_boolean(sdf, OPENCAD_BOOLEAN_UNION, part, ring, 0.2f);
+    return part;
+}
+
+bool sdf_example(void)
+{
+    Opencad_Canvas canvas = opencad_canvas(pixels, depth, WIDTH, HEIGHT);
+    opencad_clear(canvas, 0xFFFFFFFF);
+
+    Opencad_Sdf sdf = {0};
+    uint32_t part = flange_sdf(&sdf);
+
+    Opencad_Camera camera = {
+        .view = opencad_mat4_look_at(opencad_vec3(4.0f, -5.0f, 4.5f), opencad_vec3(0, 0, 0.3f), opencad_vec3(0, 0, 1)),
+        .projection = opencad_mat4_perspective(45.0f*(float) M_PI/180.0f, (float) WIDTH/HEIGHT, 0.1f, 100.0f),
+    };
+    Opencad_Material material = {
+        .shading = OPENCAD_SHADING_FLAT,
+        .color = 0xFF9090A0,
+        .ambient = 0.3f,
+        .lights = {{ .direction = {0.3f, 0.7f, 1.0f}, .intensity = 0.55f }, { .direction = {-0.6f, 0.2f, 0.5f}, .intensity = 0.25f }},
+        .light_count = 2,
+    };
+    Errno err = opencad_render_sdf(canvas, &sdf, part, &camera, &material);
+    opencad_sdf_free(&sdf);
+    if (err) {
+        fprintf(stderr, "ERROR: could not render the distance field: %s\n", strerror(err));
+        return false;
+    }
+
+    const char *file_path = "sdf.ppm";
+    err = opencad_save_to_ppm_file(pixels, WIDTH, HEIGHT, file_path);
+    if (err) {
+        fprintf(stderr, "ERROR: could not save file %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool contour_example(void)
+{
+    Opencad_Canvas canvas = opencad_canvas(pixels, depth, WIDTH, HEIGHT);
+    opencad_clear(canvas, 0xFFFFFFFF);
+
+    Opencad_Sdf sdf = {0};
+    uint32_t part = flange_sdf(&sdf);
+    Opencad_Mesh mesh = {0};
+    Errno err = opencad_sdf_mesh(&sdf, part, 0.04f, &mesh);
+    opencad_sdf_free(&sdf);
+
+    Opencad_Camera camera = {
+        .view = opencad_mat4_look_at(opencad_vec3(4.0f, -5.0f, 4.5f), opencad_vec3(0, 0, 0.3f), opencad_vec3(0, 0, 1)),
+        .projection = opencad_mat4_perspective(45.0f*(float) M_PI/180.0f, (float) WIDTH/HEIGHT, 0.1f, 100.0f),
+    };
+    Opencad_Material material = {
+        .shading = OPENCAD_SHADING_FLAT,
+        .color = 0xFF60A0C0,
+        .ambient = 0.3f,
+        .lights = {{ .direction = {0.3f, 0.7f, 1.0f}, .intensity = 0.55f }, { .direction = {-0.6f, 0.2f, 0.5f}, .intensity = 0.25f }},
+        .light_count = 2,
+    };
+    if (!err) err = opencad_render_mesh(canvas, &mesh, opencad_mat4_identity(), &camera, &material);
+    opencad_mesh_free(&mesh);
+    if (err) {
+        fprintf(stderr, "ERROR: could not mesh the distance field: %s\n", strerror(err));
+        return false;
+    }
+
+    const char *file_path = "contour.ppm";
+    err = opencad_save_to_ppm_file(pixels, WIDTH, HEIGHT, file_path);
+    if (err) {
+        fprintf(stderr, "ERROR: could not save file %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Draws the lines, circles and arcs of a sketch whose units are pixels, with y pointing up.
+ * @param sketch The sketch.
+ * @param color The color of the curves.
+ */
+void draw_sketch(const Opencad_Sketch *sketch, uint32_t color)
+{
+    for (size_t i = 0; i < sketch->entity_count; ++i) {
+        const Opencad_Sketch_Entity *e = &sketch->entities[i];
+        if (e->kind == OPENCAD_SKETCH_LINE) {
+            Opencad_Vec2 a = opencad_sketch_position(sketch, e->a), b = opencad_sketch_position(sketch, e->b);
+            opencad_draw_line(pixels, WIDTH, HEIGHT, (int) a.x, HEIGHT - (int) a.y, (int) b.x, HEIGHT - (int) b.y, color);
+        } else if (e->kind != OPENCAD_SKETCH_POINT) {
+            Opencad_Vec2 c = opencad_sketch_position(sketch, e->a);
+            float r = opencad_sketch_radius(sketch, (uint32_t) i), start = 0.0f, sweep = 2.0f*(float) M_PI;
+            if (e->kind == OPENCAD_SKETCH_ARC) {
+                Opencad_Vec2 s = opencad_sketch_position(sketch, e->b), t = opencad_sketch_position(sketch, e->c);
+                start = atan2f(s.y - c.y, s.x - c.x);
+                sweep = atan2f(t.y - c.y, t.x - c.x) - start;
+                if (sweep <= 0.0f) sweep += 2.0f*(float) M_PI;
+            }
+            for (int k = 0; k < 48; ++k) {
+                float a0 = start + sweep*(float) k/48.0f, a1 = start + sweep*(float) (k + 1)/48.0f;
+                opencad_draw_line(pixels, WIDTH, HEIGHT,
+                                  (int) (c.x + r*cosf(a0)), HEIGHT - (int) (c.y + r*sinf(a0)),
+                                  (int) (c.x + r*cosf(a1)), HEIGHT - (int) (c.y + r*sinf(a1)), color);
+            }
+        }
+    }
+}
+
+/**
+ * Sketches six slots with a hole each from rough strokes, solves their constraints and draws the strokes
+ * in grey under the solved sketches.
+ * @return True if the operation was successful, false otherwise.
+ */
+bool sketch_example(void)
+{
+    opencad_fill(pixels, WIDTH, HEIGHT, 0xFFFFFFFF);
+
+    Opencad_Sketch sketch = {0};
+    for (int n = 0; n < 6; ++n) {
+        float ox = 80.0f + (float) (n%3)*260.0f, oy = 420.0f - (float) (n/3)*240.0f;
+        float r = 28.0f + 5.0f*(float) n, length = 140.0f - 12.0f*(float) n;
+        // Strokes as drawn by hand: roughly right, nothing quite aligned.
+        float j[12];
+        for (int k = 0; k < 12; ++k) j[k] = 14.0f*sinf((float) (n*12 + k)*2.4f);
+        uint32_t c1 = opencad_sketch_point(&sketch, (Opencad_Vec2) {ox + j[0], oy + j[1]});
+        uint32_t c2 = opencad_sketch_point(&sketch, (Opencad_Vec2) {ox + length + j[2], oy + j[3]});
+        uint32_t p1 = opencad_sketch_point(&sketch, (Opencad_Vec2) {ox + j[4], oy - r + j[5]});
+        uint32_t p2 = opencad_sketch_point(&sketch, (Opencad_Vec2) {ox + length + j[6], oy - r + j[7]});
+        uint32_t p3 = opencad_sketch_point(&sketch, (Opencad_Vec2) {ox + length + j[8], oy + r + j[9]});
+        uint32_t p4 = opencad_sketch_point(&sketch, (Opencad_Vec2) {ox + j[10], oy + r + j[11]});
+        uint32_t bottom = opencad_sketch_line(&sketch, p1, p2), top = opencad_sketch_line(&sketch, p3, p4);
+        uint32_t right = opencad_sketch_arc(&sketch, c2, p2, p3), left = opencad_sketch_arc(&sketch, c1, p4, p1);
+        uint32_t hole = opencad_sketch_circle(&sketch, c2, 0.3f*r);
+        opencad_sketch_constrain(&sketch, OPENCAD_SKETCH_HORIZONTAL, bottom, 0, 0.0);
+        opencad_sketch_constrain(&sketch, OPENCAD_SKETCH_TANGENT, bottom, right, 0.0);
+        opencad_sketch_constrain(&sketch, OPENCAD_SKETCH_TANGENT, top, right, 0.0);
+        opencad_sketch_constrain(&sketch, OPENCAD_SKETCH_TANGENT, bottom, left, 0.0);
+        opencad_sketch_constrain(&sketch, OPENCAD_SKETCH_TANGENT, top, left, 0.0);
+        opencad_sketch_constrain(&sketch, OPENCAD_SKETCH_RADIUS, left, 0, r);
+        opencad_sketch_constrain(&sketch, OPENCAD_SKETCH_EQUAL, left, right, 0.0);
+        opencad_sketch_constrain(&sketch, OPENCAD_SKETCH_DISTANCE, c1, c2, length);
+        opencad_sketch_constrain(&sketch, OPENCAD_SKETCH_RADIUS, hole, 0, 0.5f*r);
+        opencad_sketch_fix(&sketch, c1, true);
+    }
+    if (sketch.failed) {
+        fprintf(stderr, "ERROR: could not build the sketch: %s\n", strerror(ENOMEM));
+        opencad_sketch_free(&sketch);
+        return false;
+    }
+
+    double *drawn = malloc(sketch.variable_count*sizeof(*drawn));
+    if (drawn) memcpy(drawn, sketch.values, sketch.variable_count*sizeof(*drawn));
+    Errno err = drawn ? opencad_sketch_solve(&sketch) : ENOMEM;
+    if (!err) {
+        OPENCAD_SWAP(double *, drawn, sketch.values);
+        draw_sketch(&sketch, 0xFFB0B0B0);
+        OPENCAD_SWAP(double *, drawn, sketch.values);
+        draw_sketch(&sketch, 0xFFC06020);
+    }
+    free(drawn);
+    opencad_sketch_free(&sketch);
+    if (err) {
+        fprintf(stderr, "ERROR: could not solve the sketch: %s\n", strerror(err));
+        return false;
+    }
+
+    const char *file_path = "sketch.ppm";
+    err = opencad_save_to_ppm_file(pixels, WIDTH, HEIGHT, file_path);
     if (err) {
         fprintf(stderr, "ERROR: could not save file %s: %s\n", file_path, strerror(errno));
         return false;
     }
+    return true;
+}
+
+/**
+ * Extrudes a bracket outlined by lines, arcs and a spline with two holes, and revolves a knob profile
+ * three quarters of a turn next to it so the caps show.
+ * @return True if the operation was successful, false otherwise.
+ */
+bool extrude_example(void)
+{
+    Opencad_Canvas canvas = opencad_canvas(pixels, depth, WIDTH, HEIGHT);
+    opencad_clear(canvas, 0xFFFFFFFF);
+
+    const Opencad_Path_Segment bracket_segments[] = {
+        { .kind = OPENCAD_PATH_LINE, .end = {1.2f, -0.6f} },
+        { .kind = OPENCAD_PATH_ARC, .end = {1.2f, 0.6f}, .control = {{1.2f, 0.0f}} },
+        { .kind = OPENCAD_PATH_SPLINE, .end = {-0.6f, 1.2f}, .control = {{0.4f, 0.6f}, {0.0f, 1.2f}} },
+        { .kind = OPENCAD_PATH_ARC, .end = {-0.6f, -0.6f}, .control = {{-0.6f, 0.3f}} },
+        { .kind = OPENCAD_PATH_ARC, .end = {1.5f, 0.0f}, .control = {{1.2f, 0.0f}} },
+        { .kind = OPENCAD_PATH_ARC, .end = {-0.45f, 0.9f}, .control = {{-0.6f, 0.9f}} },
+    };
+    const size_t bracket_ends[] = {4, 5, 6};
+    const Opencad_Path bracket = { bracket_segments, bracket_ends, 3 };
+
+    const Opencad_Path_Segment knob_segments[] = {
+        { .kind = OPENCAD_PATH_LINE, .end = {0.9f, 0.0f} },
+        { .kind = OPENCAD_PATH_ARC, .end = {0.9f, 0.3f}, .control = {{0.9f, 0.15f}} },
+        { .kind = OPENCAD_PATH_SPLINE, .end = {0.3f, 1.2f}, .control = {{0.5f, 0.5f}, {0.3f, 0.8f}} },
+        { .kind = OPENCAD_PATH_ARC, .end = {0.0f, 1.5f}, .control = {{0.0f, 1.2f}} },
+        { .kind = OPENCAD_PATH_LINE, .end = {0.0f, 0.0f} },
+    };
+    const size_t knob_ends[] = {5};
+    const Opencad_Path knob = { knob_segments, knob_ends, 1 };
+
+    Opencad_Camera camera = {
+        .view = opencad_mat4_look_at(opencad_vec3(3.0f, -5.0f, 4.0f), opencad_vec3(0.6f, 0.0f, 0.4f), opencad_vec3(0, 0, 1)),
+        .projection = opencad_mat4_perspective(45.0f*(float) M_PI/180.0f, (float) WIDTH/HEIGHT, 0.1f, 100.0f),
+    };
+    Opencad_Material material = {
+        .shading = OPENCAD_SHADING_GOURAUD,
+        .color = 0xFF60A0C0,
+        .ambient = 0.3f,
+        .lights = {{ .direction = {0.3f, 0.7f, 1.0f}, .intensity = 0.55f }, { .direction = {-0.6f, 0.2f, 0.5f}, .intensity = 0.25f }},
+        .light_count = 2,
+    };
+    Opencad_Mesh mesh = {0};
+    Errno err = opencad_path_extrude(&bracket, 0.4f, 0.002f, &mesh);
+    if (!err) err = opencad_render_mesh(canvas, &mesh, opencad_mat4_translate(-0.6f, 0.0f, 0.0f), &camera, &material);
+    opencad_mesh_free(&mesh);
+    if (!err) err = opencad_path_revolve(&knob, 1.5f*(float) M_PI, 0.002f, &mesh);
+    material.color = 0xFFC06020;
+    if (!err) err = opencad_render_mesh(canvas, &mesh, opencad_mat4_translate(2.2f, 0.6f, 0.0f), &camera, &material);
+    opencad_mesh_free(&mesh);
+    if (err) {
+        fprintf(stderr, "ERROR: could not sweep the profiles: %s\n", strerror(err));
+        return false;
+    }
 
+    const char *file_path = "extrude.ppm";
+    err = opencad_save_to_ppm_file(pixels, WIDTH, HEIGHT, file_path);
+    if (err) {
+        fprintf(stderr, "ERROR: could not save file %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
     return true;
 }
 
+/**
+ * Saves a triangle soup to an STL file, the way other programs write them.
+ * @param corners The triangle corners, three per triangle.
+ * @param triangle_count The number of triangles.
+ * @param header The first bytes of a binary file, or NULL to write an ASCII file.
+ * @param file_path The path to the file to save to.
+ * @return True if the operation was successful, false otherwise.
+ */
+bool save_soup_to_stl(const Opencad_Vec3 *corners, size_t triangle_count, const char *header, const char *file_path)
+{
+    FILE *f = fopen(file_path, "wb");
+    if (f == NULL) return false;
+    if (header != NULL) {
+        char banner[80] = {0};
+        memcpy(banner, header, strlen(header));
+        uint32_t count = (uint32_t) triangle_count;
+        fwrite(banner, sizeof(banner), 1, f);
+        fwrite(&count, sizeof(count), 1, f);
+        for (size_t t = 0; t < triangle_count; ++t) {
+            const float normal[3] = {0};
+            const uint16_t attributes = 0;
+            fwrite(normal, sizeof(normal), 1, f);
+            fwrite(&corners[t*3], sizeof(*corners), 3, f);
+            fwrite(&attributes, sizeof(attributes), 1, f);
+        }
+    } else {
+        fprintf(f, "solid example\n");
+        for (size_t t = 0; t < triangle_count; ++t) {
+            fprintf(f, "  facet normal 0 0 0\n    outer loop\n");
+            for (int k = 0; k < 3; ++k) {
+                Opencad_Vec3 v = corners[t*3 + k];
+                fprintf(f, "      vertex %.9g %.9g %.9g\n", v.x, v.y, v.z);
+            }
+            fprintf(f, "    endloop\n  endfacet\n");
+        }
+        fprintf(f, "endsolid example\n");
+    }
+    bool ok = !ferror(f);
+    return fclose(f) == 0 && ok;
+}
+
+/**
+ * Builds a torus around the z axis as a triangle soup, the way STL files store it.
+ * @param rings The number of segments around the torus.
+ * @param sides The number of segments around the tube.
+ * @return The malloc'ed corners, three per triangle and rings*sides*2 triangles, or NULL if out of memory.
+ */
+Opencad_Vec3 *torus_soup(size_t rings, size_t sides)
+{
+    Opencad_Vec3 *grid = malloc(rings*sides*sizeof(*grid));
+    Opencad_Vec3 *corners = malloc(rings*sides*6*sizeof(*corners));
+    if (grid == NULL || corners == NULL) {
+        free(grid);
+        free(corners);
+        return NULL;
+    }
+    for (size_t i = 0; i < rings; ++i) {
+        float u = 2.0f*(float) M_PI*(float) i/(float) rings;
+        for (size_t j = 0; j < sides; ++j) {
+            float v = 2.0f*(float) M_PI*(float) j/(float) sides;
+            grid[i*sides + j] = (Opencad_Vec3) {(1.0f + 0.35f*cosf(v))*cosf(u), (1.0f + 0.35f*cosf(v))*sinf(u),
+                                                0.35f*sinf(v)};
+        }
+    }
+    Opencad_Vec3 *out = corners;
+    for (size_t i = 0; i < rings; ++i) {
+        for (size_t j = 0; j < sides; ++j) {
+            Opencad_Vec3 a = grid[i*sides + j], b = grid[(i + 1)%rings*sides + j];
+            Opencad_Vec3 c = grid[(i + 1)%rings*sides + (j + 1)%sides], d = grid[i*sides + (j + 1)%sides];
+            *out++ = a; *out++ = b; *out++ = c;
+            *out++ = a; *out++ = c; *out++ = d;
+        }
+    }
+    free(grid);
+    return corners;
+}
+
+/**
+ * Loads a torus saved as binary STL, as binary STL whose header starts with "solid" like an ASCII
+ * file, and as ASCII STL. Each load must weld the triangle soup back into the shared vertices.
+ * @return True if the operation was successful, false otherwise.
+ */
+bool stl_example(void)
+{
+    const size_t rings = 48, sides = 24;
+    Opencad_Vec3 *corners = torus_soup(rings, sides);
+    if (corners == NULL) {
+        fprintf(stderr, "ERROR: could not build the torus\n");
+        return false;
+    }
+
+    const char *headers[] = {"binary torus", "solid torus", NULL};
+    const char *file_paths[] = {"torus.stl", "torus_solid.stl", "torus_ascii.stl"};
+    bool ok = true;
+    for (int i = 0; i < 3 && ok; ++i) {
+        Opencad_Mesh mesh = {0};
+        if (!save_soup_to_stl(corners, rings*sides*2, headers[i], file_paths[i])) {
+            fprintf(stderr, "ERROR: could not save file %s: %s\n", file_paths[i], strerror(errno));
+            ok = false;
+            break;
+        }
+        Errno err = opencad_load_from_stl_file(file_paths[i], &mesh);
+        if (err) {
+            fprintf(stderr, "ERROR: could not load file %s: %s\n", file_paths[i], strerror(err));
+            ok = false;
+        } else if (mesh.vertex_count != rings*sides || mesh.triangle_count != rings*sides*2) {
+            fprintf(stderr, "ERROR: %s loaded as %zu vertices and %zu triangles, expected %zu and %zu\n",
+                    file_paths[i], mesh.vertex_count, mesh.triangle_count, rings*sides, rings*sides*2);
+            ok = false;
+        }
+        opencad_mesh_free(&mesh);
+    }
+    free(corners);
+    return ok;
+}
+
+/**
+ * Loads the vertices and triangles of a Wavefront OBJ file written by opencad_save_to_obj_file.
+ * @param file_path The path to the file to load.
+ * @param mesh Receives the mesh. Must be freed with opencad_mesh_free.
+ * @return True if the operation was successful, false otherwise.
+ */
+bool load_obj(const char *file_path, Opencad_Mesh *mesh)
+{
+    memset(mesh, 0, sizeof(*mesh));
+    FILE *f = fopen(file_path, "r");
+    if (f == NULL) return false;
+    size_t vertex_capacity = 0, index_capacity = 0;
+    bool ok = true;
+    char line[256];
+    while (ok && fgets(line, sizeof(line), f) != NULL) {
+        char *p = line + 2;
+        if (line[0] == 'v' && line[1] == ' ') {
+            if (mesh->vertex_count == vertex_capacity) {
+                vertex_capacity = vertex_capacity ? vertex_capacity*2 : 1024;
+                Opencad_Vec3 *grown = realloc(mesh->vertices, vertex_capacity*sizeof(*grown));
+                if (grown == NULL) ok = false;
+                else mesh->vertices = grown;
+            }
+            if (!ok) break;
+            Opencad_Vec3 *v = &mesh->vertices[mesh->vertex_count++];
+            v->x = strtof(p, &p);
+            v->y = strtof(p, &p);
+            v->z = strtof(p, &p);
+        } else if (line[0] == 'f' && line[1] == ' ') {
+            if (mesh->triangle_count*3 == index_capacity) {
+                index_capacity = index_capacity ? index_capacity*2 : 3072;
+                uint32_t *grown = realloc(mesh->indices, index_capacity*sizeof(*grown));
+                if (grown == NULL) ok = false;
+                else mesh->indices = grown;
+            }
+            if (!ok) break;
+            for (int k = 0; k < 3; ++k) {
+                unsigned long index = strtoul(p, &p, 10);
+                if (index == 0 || index > mesh->vertex_count) ok = false;
+                mesh->indices[mesh->triangle_count*3 + k] = (uint32_t) (index - 1);
+            }
+            mesh->triangle_count += 1;
+        }
+    }
+    if (ferror(f)) ok = false;
+    fclose(f);
+    if (!ok) opencad_mesh_free(mesh);
+    return ok;
+}
+
+/**
+ * Saves a torus as STL and as OBJ and loads both again. The coordinates must come back unchanged,
+ * only negative zero may come back as zero: STL stores the floats as they are and OBJ prints the
+ * shortest decimal that reads back to each. The scales push the coordinates through very large, very
+ * small and subnormal magnitudes.
+ * @return True if the operation was successful, false otherwise.
+ */
+bool export_example(void)
+{
+    const float scales[] = {1.0f, 3.0e30f, 1.0e-30f, 1.0e-40f};
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(scales)/sizeof(scales[0]) && ok; ++i) {
+        Opencad_Mesh torus = {0}, stl = {0}, obj = {0};
+        Opencad_Vec3 *corners = torus_soup(48, 24);
+        Errno err = corners != NULL ? opencad_mesh_from_soup(corners, 48*24*2, &torus) : ENOMEM;
+        free(corners);
+        if (err) {
+            fprintf(stderr, "ERROR: could not build the torus: %s\n", strerror(err));
+            return false;
+        }
+        for (size_t v = 0; v < torus.vertex_count; ++v) {
+            torus.vertices[v].x *= scales[i];
+            torus.vertices[v].y *= scales[i];
+            torus.vertices[v].z *= scales[i];
+        }
+
+        err = opencad_save_to_stl_file(&torus, "export.stl");
+        if (!err) err = opencad_load_from_stl_file("export.stl", &stl);
+        if (err) {
+            fprintf(stderr, "ERROR: could not save and load export.stl: %s\n", strerror(err));
+            ok = false;
+        } else if (stl.triangle_count != torus.triangle_count || stl.vertex_count != torus.vertex_count) {
+            fprintf(stderr, "ERROR: export.stl at scale %g came back as %zu vertices and %zu triangles\n",
+                    scales[i], stl.vertex_count, stl.triangle_count);
+            ok = false;
+        } else {
+            for (size_t c = 0; c < torus.triangle_count*3 && ok; ++c) {
+                Opencad_Vec3 u = torus.vertices[torus.indices[c]], v = stl.vertices[stl.indices[c]];
+                if (u.x != v.x || u.y != v.y || u.z != v.z) {
+                    fprintf(stderr, "ERROR: export.stl at scale %g moved corner %zu\n", scales[i], c);
+                    ok = false;
+                }
+            }
+        }
+
+        err = opencad_save_to_obj_file(&torus, "export.obj");
+        if (err || !load_obj("export.obj", &obj)) {
+            fprintf(stderr, "ERROR: could not save and load export.obj: %s\n", strerror(err ? err : errno));
+            ok = false;
+        } else if (obj.triangle_count != torus.triangle_count || obj.vertex_count != torus.vertex_count) {
+            fprintf(stderr, "ERROR: export.obj at scale %g came back as %zu vertices and %zu triangles\n",
+                    scales[i], obj.vertex_count, obj.triangle_count);
+            ok = false;
+        } else if (memcmp(obj.indices, torus.indices, torus.triangle_count*3*sizeof(*torus.indices)) != 0) {
+            fprintf(stderr, "ERROR: export.obj at scale %g did not read back the same triangles\n", scales[i]);
+            ok = false;
+        } else {
+            for (size_t v = 0; v < torus.vertex_count && ok; ++v) {
+                Opencad_Vec3 a = torus.vertices[v], b = obj.vertices[v];
+                if (a.x != b.x || a.y != b.y || a.z != b.z) {
+                    fprintf(stderr, "ERROR: export.obj at scale %g moved vertex %zu\n", scales[i], v);
+                    ok = false;
+                }
+            }
+        }
+        opencad_mesh_free(&torus);
+        opencad_mesh_free(&stl);
+        opencad_mesh_free(&obj);
+    }
+    return ok;
+}
+
+/**
+ * Builds a model that touches every kind of node and instruction: transforms chained with a
+ * non-uniform scale, every boolean both sharp and blended, and an offset.
+ * @param sdf The field to add the nodes to.
+ * @return The root node.
+ */
+uint32_t gadget_sdf(Opencad_Sdf *sdf)
+{
+    uint32_t box = opencad_sdf_box(sdf, opencad_vec3(1.6f, 1.2f, 0.8f));
+    box = opencad_sdf_transform(sdf, box, opencad_mat4_scale(1.0f, 1.5f, 0.75f));
+    box = opencad_sdf_transform(sdf, box, opencad_mat4_rotate(opencad_vec3(1, 1, 0), 0.6f));
+    box = opencad_sdf_transform(sdf, box, opencad_mat4_translate(0.2f, -0.1f, 0.3f));
+    uint32_t ball = opencad_sdf_sphere(sdf, 1.1f);
+    uint32_t part = opencad_sdf_boolean(sdf, OPENCAD_BOOLEAN_INTERSECTION, box, ball, 0.2f);
+    uint32_t ring = opencad_sdf_transform(sdf, opencad_sdf_torus(sdf, 0.8f, 0.2f), opencad_mat4_translate(0, 0, 0.4f));
+    part = opencad_sdf_boolean(sdf, OPENCAD_BOOLEAN_DIFFERENCE, part, ring, 0.15f);
+    part = opencad_sdf_boolean(sdf, OPENCAD_BOOLEAN_DIFFERENCE, part, opencad_sdf_cylinder(sdf, 0.3f, 3.0f), 0.0f);
+    uint32_t peg = opencad_sdf_transform(sdf, opencad_sdf_cylinder(sdf, 0.2f, 1.0f), opencad_mat4_translate(0.9f, 0, 0));
+    part = opencad_sdf_boolean(sdf, OPENCAD_BOOLEAN_UNION, part, peg, 0.1f);
+    part = opencad_sdf_boolean(sdf, OPENCAD_BOOLEAN_UNION, part, opencad_sdf_sphere(sdf, 0.25f), 0.0f);
+    uint32_t cap = opencad_sdf_transform(sdf, opencad_sdf_box(sdf, opencad_vec3(4, 4, 4)), opencad_mat4_translate(0, 0, 2.6f));
+    part = opencad_sdf_boolean(sdf, OPENCAD_BOOLEAN_INTERSECTION, part, cap, 0.0f);
+    return opencad_sdf_offset(sdf, part, 0.05f);
+}
+
+/**
+ * Checks the compiled programs against walking the tree on a grid around two models. They must agree
+ * apart from rounding: transforms are folded into one matrix and booleans evaluate their operands in
+ * another order.
+ * @return True if the operation was successful, false otherwise.
+ */
+bool bytecode_example(void)
+{
+    Opencad_Sdf sdf = {0};
+    const uint32_t roots[] = {flange_sdf(&sdf), gadget_sdf(&sdf)};
+    const size_t steps = 24;
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(roots)/sizeof(roots[0]) && ok; ++i) {
+        Opencad_Sdf_Program program = {0};
+        Errno err = opencad_sdf_compile(&sdf, roots[i], &program);
+        if (err) {
+            fprintf(stderr, "ERROR: could not compile the distance field: %s\n", strerror(err));
+            ok = false;
+            break;
+        }
+        Opencad_Vec3 min, max;
+        opencad_sdf_bounds(&sdf, roots[i], &min, &max);
+        // A grid over the bounds grown by a quarter on every side, so points outside are checked too.
+        Opencad_Vec3 size = opencad_vec3_sub(max, min);
+        min = opencad_vec3_sub(min, opencad_vec3_scale(size, 0.25f));
+        size = opencad_vec3_scale(size, 1.5f/(float) (steps - 1));
+        float x[OPENCAD_SDF_LANES], y[OPENCAD_SDF_LANES], z[OPENCAD_SDF_LANES], d[OPENCAD_SDF_LANES];
+        size_t total = steps*steps*steps, worst = 0;
+        float worst_error = 0.0f;
+        for (size_t first = 0; first < total; first += OPENCAD_SDF_LANES) {
+            for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) {
+                size_t n = first + l < total ? first + l : total - 1;
+                x[l] = min.x + size.x*(float) (n%steps);
+                y[l] = min.y + size.y*(float) (n/steps%steps);
+                z[l] = min.z + size.z*(float) (n/steps/steps);
+            }
+            opencad_sdf_program_eval(&program, x, y, z, d);
+            for (size_t l = 0; l < OPENCAD_SDF_LANES && first + l < total; ++l) {
+                float expected = opencad_sdf_eval(&sdf, roots[i], opencad_vec3(x[l], y[l], z[l]));
+                float error = fabsf(d[l] - expected)/(1.0f + fabsf(expected));
+                if (!(error <= worst_error)) {
+                    worst_error = error;
+                    worst = first + l;
+                }
+            }
+        }
+        opencad_sdf_program_free(&program);
+        if (!(worst_error <= 1e-5f)) {
+            fprintf(stderr, "ERROR: the compiled distance field is off by %g at point %zu\n", worst_error, worst);
+            ok = false;
+        }
+    }
+    opencad_sdf_free(&sdf);
+    return ok;
+}
+
+/**
+ * Specializes a program to a box, checks it against the original program on a grid of points in the
+ * box, and recurses into the eight octants with the specialized program, the way octree walks use it.
+ * @param original The program compiled from the model.
+ * @param program The program specialized to the enclosing box, or the original at the top.
+ * @param min The minimum corner of the box.
+ * @param max The maximum corner of the box.
+ * @param depth How many more times to split the box.
+ * @param worst Receives the largest relative error seen so far.
+ * @param dropped Counts the instructions specialization removed, summed over all boxes.
+ * @return An error code indicating the result of the operation.
+ */
+Errno check_specialized(const Opencad_Sdf_Program *original, const Opencad_Sdf_Program *program,
+                        Opencad_Vec3 min, Opencad_Vec3 max, int depth, float *worst, size_t *dropped)
+{
+    Opencad_Sdf_Program specialized = {0};
+    float lo, hi;
+    Errno err = opencad_sdf_program_specialize(program, min, max, &specialized, &lo, &hi);
+    if (err) return err;
+    *dropped += original->count - specialized.count;
+
+    // Four points along each axis, corners included, so every lane of a batch is a sample.
+    float x[OPENCAD_SDF_LANES], y[OPENCAD_SDF_LANES], z[OPENCAD_SDF_LANES];
+    float d[OPENCAD_SDF_LANES], e[OPENCAD_SDF_LANES];
+    for (size_t layer = 0; layer < 4; ++layer) {
+        for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) {
+            x[l] = lerpf(min.x, max.x, (float) (l%4)/3.0f);
+            y[l] = lerpf(min.y, max.y, (float) (l/4)/3.0f);
+            z[l] = lerpf(min.z, max.z, (float) layer/3.0f);
+        }
+        opencad_sdf_program_eval(original, x, y, z, d);
+        opencad_sdf_program_eval(&specialized, x, y, z, e);
+        for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) {
+            // The specialized value must match, and both must lie in the bounds, up to rounding.
+            float scale = 1.0f + fabsf(d[l]);
+            float error = fabsf(e[l] - d[l])/scale;
+            if (d[l] < lo) error = fmaxf(error, (lo - d[l])/scale);
+            if (d[l] > hi) error = fmaxf(error, (d[l] - hi)/scale);
+            if (!(error <= *worst)) *worst = error;
+        }
+    }
+
+    for (int octant = 0; octant < 8 && depth > 0 && !err; ++octant) {
+        Opencad_Vec3 mid = opencad_vec3_scale(opencad_vec3_add(min, max), 0.5f);
+        Opencad_Vec3 a = {octant & 1 ? mid.x : min.x, octant & 2 ? mid.y : min.y, octant & 4 ? mid.z : min.z};
+        Opencad_Vec3 b = {octant & 1 ? max.x : mid.x, octant & 2 ? max.y : mid.y, octant & 4 ? max.z : mid.z};
+        err = check_specialized(original, &specialized, a, b, depth - 1, worst, dropped);
+    }
+    opencad_sdf_program_free(&specialized);
+    return err;
+}
+
+/**
+ * Specializes the programs of two models over an octree. Specializing only drops code that cannot
+ * change the result inside the box, so the pruned programs must give the original's distances
+ * everywhere in their boxes.
+ * @return True if the operation was successful, false otherwise.
+ */
+bool specialize_example(void)
+{
+    Opencad_Sdf sdf = {0};
+    const uint32_t roots[] = {flange_sdf(&sdf), gadget_sdf(&sdf)};
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(roots)/sizeof(roots[0]) && ok; ++i) {
+        Opencad_Sdf_Program program = {0};
+        Errno err = opencad_sdf_compile(&sdf, roots[i], &program);
+        Opencad_Vec3 min, max;
+        opencad_sdf_bounds(&sdf, roots[i], &min, &max);
+        Opencad_Vec3 margin = opencad_vec3_scale(opencad_vec3_sub(max, min), 0.25f);
+        float worst = 0.0f;
+        size_t dropped = 0;
+        if (!err) {
+            err = check_specialized(&program, &program, opencad_vec3_sub(min, margin),
+                                    opencad_vec3_add(max, margin), 3, &worst, &dropped);
+        }
+        opencad_sdf_program_free(&program);
+        if (err) {
+            fprintf(stderr, "ERROR: could not specialize the distance field: %s\n", strerror(err));
+            ok = false;
+        } else if (dropped == 0) {
+            fprintf(stderr, "ERROR: specialization never pruned the distance field\n");
+            ok = false;
+        } else if (!(worst <= 1e-5f)) {
+            fprintf(stderr, "ERROR: a specialized distance field is off by %g\n", worst);
+            ok = false;
+        }
+    }
+    opencad_sdf_free(&sdf);
+    return ok;
+}
+
+/**
+ * Tests points a few units in the last place away from a line, plane or circle, so close that the
+ * floating point determinant cannot be trusted and the predicates redo it in exact arithmetic. Each
+ * expected sign follows from how far the point was moved.
+ * @return True if the operation was successful, false otherwise.
+ */
+bool predicates_example(void)
+{
+    size_t wrong = 0;
+
+    // Points next to the diagonal y = x, tested against the line through (12, 12) and (24, 24).
+    const Opencad_Vec2 b2 = {12.0f, 12.0f}, c2 = {24.0f, 24.0f};
+    for (int i = 0; i < 8; ++i) {
+        for (int j = 0; j < 8; ++j) {
+            Opencad_Vec2 p = {0.5f + ldexpf((float) i, -24), 0.5f + ldexpf((float) j, -24)};
+            double det = opencad_orient2d(p, b2, c2);
+            wrong += (det > 0.0) - (det < 0.0) != (j > i) - (j < i);
+        }
+    }
+
+    // Points next to the plane z = 3x + 5y, tested against the triangle abc in it, whose normal is
+    // (-3, -5, 1). A step of one unit in the last place along z is eight along x or y.
+    const double a3[3] = {0.5, 0.25, 2.75}, b3[3] = {1.5, 0.25, 5.75}, c3[3] = {0.5, 1.25, 7.75};
+    const double step = ldexp(1.0, -52);
+    for (int i = -2; i <= 2; ++i) {
+        for (int j = -2; j <= 2; ++j) {
+            for (int k = -2; k <= 2; ++k) {
+                const double d3[3] = {1.25 + i*step, 1.5 + j*step, 11.25 + 8*k*step};
+                int expected = (8*k > 3*i + 5*j) - (8*k < 3*i + 5*j);
+                double det = opencad_orient3d(a3, b3, c3, d3);
+                wrong += (det > 0.0) - (det < 0.0) != expected;
+                // Moving d or the plane only decides ties, and moving all four decides nothing.
+                wrong += expected != 0 && opencad_orient3d_sign(a3, b3, c3, d3, 0x8) != expected;
+                wrong += expected != 0 && opencad_orient3d_sign(a3, b3, c3, d3, 0x7) != expected;
+                wrong += opencad_orient3d_sign(a3, b3, c3, d3, 0xF) != expected;
+            }
+        }
+    }
+    // On the plane, moving d along opencad_perturbation puts it below, as the normal points away
+    // from that direction, and moving the plane instead puts d above.
+    const double on[3] = {1.25, 1.5, 11.25};
+    wrong += opencad_orient3d_sign(a3, b3, c3, on, 0x8) != -1;
+    wrong += opencad_orient3d_sign(a3, b3, c3, on, 0x7) != 1;
+    wrong += opencad_orient3d_sign(a3, b3, c3, on, 0x0) != 0;
+
+    // Points next to (0, -5) on the circle of radius 5 through a counter-clockwise abc: inside when
+    // moved up towards the center, outside when moved sideways only.
+    const Opencad_Vec2 a4 = {5.0f, 0.0f}, b4 = {3.0f, 4.0f}, c4 = {-4.0f, 3.0f};
+    for (int i = -2; i <= 2; ++i) {
+        for (int j = -2; j <= 2; ++j) {
+            Opencad_Vec2 d4 = {ldexpf((float) i, -21), -5.0f + ldexpf((float) j, -21)};
+            int expected = j != 0 ? (j > 0) - (j < 0) : -(i != 0);
+            double det = opencad_incircle(a4, b4, c4, d4);
+            wrong += (det > 0.0) - (det < 0.0) != expected;
+        }
+    }
+
+    if (wrong > 0) {
+        fprintf(stderr, "ERROR: %zu predicates returned the wrong sign\n", wrong);
+        return false;
+    }
+    return true;
+}
 
 /**
  * The main entry point of the program.
@@ -190,5 +1957,30 @@ int main(void)
     if (!circle_example()) return -1;
     if (!lines_example()) return -1;
     if (!brick_example()) return -1;
+    if (!shaded_example()) return -1;
+    if (!matcap_example()) return -1;
+    if (!views_example()) return -1;
+    if (!lod_example()) return -1;
+    if (!edges_example()) return -1;
+    if (!perspective_example()) return -1;
+    if (!ghost_example()) return -1;
+    if (!outline_example()) return -1;
+    if (!occlusion_example()) return -1;
+    if (!section_example()) return -1;
+    if (!texture_example()) return -1;
+    if (!instances_example()) return -1;
+    if (!points_example()) return -1;
+    if (!solids_example()) return -1;
+    if (!boolean_example()) return -1;
+    if (!closed_example()) return -1;
+    if (!sdf_example()) return -1;
+    if (!contour_example()) return -1;
+    if (!sketch_example()) return -1;
+    if (!extrude_example()) return -1;
+    if (!stl_example()) return -1;
+    if (!export_example()) return -1;
+    if (!bytecode_example()) return -1;
+    if (!specialize_example()) return -1;
+    if (!predicates_example()) return -1;
     return 0;
 }
@@ -1,6 +1,7 @@
 /**
  * Initial OpenCAD library: provides functions for drawing and saving pixel buffers.
  * This library provides basic drawing functions and a function to save the pixel buffer to a PPM file.
+ * The includer provides the C standard, math, POSIX threads and mmap headers (see example.c).
  */
 
 #ifndef OPENCAD_C_
@@ -151,36 +152,10355 @@ void opencad_draw_line(uint32_t *pixels, size_t pixels_width, size_t pixels_heig
                       int x1, int y1, int x2, int y2,
                       uint32_t color)
 {
-    int dx = x2 - x1;
-    int dy = y2 - y1;
+    // 64-bit math and loops clamped to the buffer, so far-away endpoints neither overflow nor cost time.
+    int64_t dx = (int64_t) x2 - x1;
+    int64_t dy = (int64_t) y2 - y1;
+    int64_t width = (int64_t) pixels_width, height = (int64_t) pixels_height;
 
     if (dx != 0) {
-        int c = y1 - dy*x1/dx;
+        int64_t c = y1 - dy*x1/dx;
 
         if (x1 > x2) OPENCAD_SWAP(int, x1, x2);
-        for (int x = x1; x <= x2; ++x) {
-            if (0 <= x && x < (int) pixels_width) {
-                int sy1 = dy*x/dx + c;
-                int sy2 = dy*(x + 1)/dx + c;
-                if (sy1 > sy2) OPENCAD_SWAP(int, sy1, sy2);
-                for (int y = sy1; y <= sy2; ++y) {
-                    if (0 <= y && y < (int) pixels_height) {
-                        pixels[y*pixels_width + x] = color;
+        int64_t x_begin = x1 > 0 ? x1 : 0;
+        int64_t x_end = x2 < width - 1 ? x2 : width - 1;
+        for (int64_t x = x_begin; x <= x_end; ++x) {
+            int64_t sy1 = dy*x/dx + c;
+            int64_t sy2 = dy*(x + 1)/dx + c;
+            if (sy1 > sy2) OPENCAD_SWAP(int64_t, sy1, sy2);
+            if (sy1 < 0) sy1 = 0;
+            if (sy2 > height - 1) sy2 = height - 1;
+            for (int64_t y = sy1; y <= sy2; ++y) {
+                pixels[y*width + x] = color;
+            }
+        }
+    } else {
+        int64_t x = x1;
+        if (0 <= x && x < width) {
+            if (y1 > y2) OPENCAD_SWAP(int, y1, y2);
+            int64_t y_begin = y1 > 0 ? y1 : 0;
+            int64_t y_end = y2 < height - 1 ? y2 : height - 1;
+            for (int64_t y = y_begin; y <= y_end; ++y) {
+                pixels[y*width + x] = color;
+            }
+        }
+    }
+}
+
+#define OPENCAD_MAX_THREADS 64
+
+/**
+ * A point in 2D space, such as texture coordinates.
+ */
+typedef struct {
+    float x, y;
+} Opencad_Vec2;
+
+/**
+ * A point in 2D space in double precision, for geometry derived from float input that has to stay exact.
+ */
+typedef struct {
+    double x, y;
+} Opencad_Vec2d;
+
+/**
+ * A point or direction in 3D space.
+ */
+typedef struct {
+    float x, y, z;
+} Opencad_Vec3;
+
+/**
+ * Indexed triangle mesh. Every three consecutive indices form one counter-clockwise triangle.
+ */
+typedef struct {
+    Opencad_Vec3 *vertices;
+    Opencad_Vec3 *normals;  // Optional per-vertex normals, see opencad_mesh_compute_normals.
+    Opencad_Vec2 *uvs;      // Optional per-vertex texture coordinates, see Opencad_Texture.
+    size_t vertex_count;
+    uint32_t *indices;
+    size_t triangle_count;
+} Opencad_Mesh;
+
+/**
+ * Releases the memory owned by a mesh and resets it to the empty mesh.
+ * @param mesh The mesh to free.
+ */
+void opencad_mesh_free(Opencad_Mesh *mesh)
+{
+    free(mesh->vertices);
+    free(mesh->normals);
+    free(mesh->uvs);
+    free(mesh->indices);
+    memset(mesh, 0, sizeof(*mesh));
+}
+
+/**
+ * A unit of parallel work. Receives the index of the worker thread running it and a half-open range.
+ */
+typedef void (*Opencad_Task)(void *ctx, size_t thread, size_t begin, size_t end);
+
+typedef struct {
+    Opencad_Task task;
+    void *ctx;
+    size_t count;
+    size_t grain;
+    size_t next;
+    pthread_mutex_t lock;
+} Opencad_Parallel;
+
+typedef struct {
+    Opencad_Parallel *parallel;
+    size_t thread;
+} Opencad_Worker;
+
+/**
+ * Returns the number of worker threads used by the parallel routines.
+ * @return The number of online processors, clamped to OPENCAD_MAX_THREADS.
+ */
+size_t opencad_thread_count(void)
+{
+    static size_t count = 0;
+    if (count == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        if (n < 1) n = 1;
+        if (n > OPENCAD_MAX_THREADS) n = OPENCAD_MAX_THREADS;
+        count = (size_t) n;
+    }
+    return count;
+}
+
+/**
+ * Worker loop of opencad_parallel_for: keeps grabbing chunks until the range is exhausted.
+ * @param arg The Opencad_Worker of this thread.
+ * @return Always NULL.
+ */
+static void *opencad_parallel_worker(void *arg)
+{
+    Opencad_Worker *worker = arg;
+    Opencad_Parallel *parallel = worker->parallel;
+    for (;;) {
+        pthread_mutex_lock(&parallel->lock);
+        size_t begin = parallel->next;
+        if (begin < parallel->count) parallel->next += parallel->grain;
+        pthread_mutex_unlock(&parallel->lock);
+        if (begin >= parallel->count) break;
+
+        size_t end = begin + parallel->grain;
+        if (end > parallel->count) end = parallel->count;
+        parallel->task(parallel->ctx, worker->thread, begin, end);
+    }
+    return NULL;
+}
+
+/**
+ * Runs a task over [0, count) in chunks of at most grain items, spread over the worker threads.
+ * The calling thread takes part as thread 0. Returns once every chunk is done.
+ * @param count The number of items.
+ * @param grain The maximum number of items handed to the task at once.
+ * @param task The task to run.
+ * @param ctx The context passed to the task.
+ */
+void opencad_parallel_for(size_t count, size_t grain, Opencad_Task task, void *ctx)
+{
+    if (count == 0) return;
+    if (grain == 0) grain = 1;
+
+    size_t threads = opencad_thread_count();
+    size_t chunks = (count + grain - 1)/grain;
+    if (threads > chunks) threads = chunks;
+
+    Opencad_Parallel parallel = {
+        .task = task,
+        .ctx = ctx,
+        .count = count,
+        .grain = grain,
+        .next = 0,
+    };
+    if (threads <= 1) {
+        for (size_t begin = 0; begin < count; begin += grain) {
+            task(ctx, 0, begin, begin + grain < count ? begin + grain : count);
+        }
+        return;
+    }
+
+    pthread_mutex_init(&parallel.lock, NULL);
+    pthread_t handles[OPENCAD_MAX_THREADS];
+    Opencad_Worker workers[OPENCAD_MAX_THREADS];
+    bool started[OPENCAD_MAX_THREADS] = {0};
+    for (size_t i = 0; i < threads; ++i) {
+        workers[i].parallel = &parallel;
+        workers[i].thread = i;
+    }
+    for (size_t i = 1; i < threads; ++i) {
+        started[i] = pthread_create(&handles[i], NULL, opencad_parallel_worker, &workers[i]) == 0;
+    }
+    opencad_parallel_worker(&workers[0]);
+    for (size_t i = 1; i < threads; ++i) {
+        if (started[i]) pthread_join(handles[i], NULL);
+    }
+    pthread_mutex_destroy(&parallel.lock);
+}
+
+/**
+ * Maps a whole file read-only into memory.
+ * @param file_path The path to the file to map.
+ * @param data Receives the mapped bytes, or NULL for an empty file.
+ * @param size Receives the size of the file.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_map_file(const char *file_path, const uint8_t **data, size_t *size)
+{
+    int result = 0;
+    int fd = -1;
+
+    {
+        *data = NULL;
+        *size = 0;
+
+        fd = open(file_path, O_RDONLY);
+        if (fd < 0) return_defer(errno);
+
+        struct stat statbuf;
+        if (fstat(fd, &statbuf) < 0) return_defer(errno);
+        if (statbuf.st_size == 0) return_defer(0);
+
+        void *mapped = mmap(NULL, (size_t) statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) return_defer(errno);
+        madvise(mapped, (size_t) statbuf.st_size, MADV_SEQUENTIAL);
+
+        *data = mapped;
+        *size = (size_t) statbuf.st_size;
+    }
+
+defer:
+    if (fd >= 0) close(fd);
+    return result;
+}
+
+/**
+ * Unmaps a file mapped by opencad_map_file.
+ * @param data The mapped bytes.
+ * @param size The size of the mapping.
+ */
+void opencad_unmap_file(const uint8_t *data, size_t size)
+{
+    if (data) munmap((void *) data, size);
+}
+
+/**
+ * Canonicalizes a position for bitwise comparison: turns -0.0 into 0.0.
+ * @param v The position.
+ * @return The canonical position.
+ */
+static Opencad_Vec3 opencad_vec3_canonical(Opencad_Vec3 v)
+{
+    v.x += 0.0f;
+    v.y += 0.0f;
+    v.z += 0.0f;
+    return v;
+}
+
+/**
+ * Murmur3 finalizer: mixes every input bit into every output bit.
+ * @param h The value to mix.
+ * @return The mixed value.
+ */
+static uint32_t opencad_mix32(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+/**
+ * Hashes the bit pattern of a canonical position.
+ * Each coordinate goes through a full mix because float bit patterns of round numbers
+ * carry all their entropy in the top bits.
+ * @param v The canonical position.
+ * @return The hash.
+ */
+static uint32_t opencad_hash_vec3(Opencad_Vec3 v)
+{
+    uint32_t bits[3];
+    memcpy(bits, &v, sizeof(bits));
+    uint32_t h = opencad_mix32(bits[0] + 0x9e3779b9u);
+    h = opencad_mix32(h ^ bits[1]);
+    return opencad_mix32(h ^ bits[2]);
+}
+
+typedef struct {
+    const Opencad_Vec3 *corners;
+    size_t corner_count;
+    size_t partition_count;
+    uint32_t *hashes;
+    uint32_t *remap;
+    size_t *offsets;      // [chunk*partition_count + partition]: corner counts, then scatter positions
+    size_t *starts;       // per partition: its first slot in order, plus the end of the last
+    uint32_t *order;      // corner indices grouped by partition, in corner order within each
+    uint32_t **uniques;   // per partition: corner index of each unique vertex
+    size_t *unique_counts;
+    size_t *bases;
+    Opencad_Mesh *mesh;
+    atomic_bool failed;   // set by any thread that runs out of memory
+} Opencad_Weld;
+
+/**
+ * Maps a hash to the partition that owns it.
+ * @param hash The hash.
+ * @param partition_count The number of partitions.
+ * @return The partition index.
+ */
+static size_t opencad_weld_partition(uint32_t hash, size_t partition_count)
+{
+    return (size_t) (((uint64_t) hash*partition_count) >> 32);
+}
+
+#define OPENCAD_WELD_CHUNK (1 << 16)
+
+/**
+ * Weld pass 1: hashes every corner and counts how many corners of the chunk fall into each partition.
+ */
+static void opencad_weld_hash_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    Opencad_Weld *weld = ctx;
+    size_t *counts = weld->offsets + begin/OPENCAD_WELD_CHUNK*weld->partition_count;
+    (void) thread;
+    for (size_t i = begin; i < end; ++i) {
+        uint32_t h = opencad_hash_vec3(opencad_vec3_canonical(weld->corners[i]));
+        weld->hashes[i] = h;
+        counts[opencad_weld_partition(h, weld->partition_count)] += 1;
+    }
+}
+
+/**
+ * Weld pass 2: moves the corners of a chunk into their partitions' slices of the order array.
+ */
+static void opencad_weld_scatter_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    Opencad_Weld *weld = ctx;
+    size_t *offsets = weld->offsets + begin/OPENCAD_WELD_CHUNK*weld->partition_count;
+    (void) thread;
+    for (size_t i = begin; i < end; ++i) {
+        weld->order[offsets[opencad_weld_partition(weld->hashes[i], weld->partition_count)]++] = (uint32_t) i;
+    }
+}
+
+typedef struct {
+    uint32_t hash;
+    uint32_t id;
+} Opencad_Weld_Slot;
+
+#define OPENCAD_WELD_RECENT 1024
+
+/**
+ * Weld pass 3: every partition deduplicates the corners it owns in a private open-addressing table.
+ * STL writers emit neighbouring triangles together, so a small direct-mapped cache of recently
+ * seen vertices answers most lookups before they reach the big table.
+ */
+static void opencad_weld_dedup_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    Opencad_Weld *weld = ctx;
+    (void) thread;
+
+    for (size_t p = begin; p < end; ++p) {
+        const uint32_t *slice = weld->order + weld->starts[p];
+        size_t owned = weld->starts[p + 1] - weld->starts[p];
+
+        size_t capacity = 64;
+        while (capacity < owned/2) capacity *= 2;
+        Opencad_Weld_Slot *table = malloc(capacity*sizeof(*table));
+        uint32_t *uniques = malloc((owned ? owned : 1)*sizeof(*uniques));
+        if (table == NULL || uniques == NULL) {
+            free(table);
+            free(uniques);
+            weld->failed = true;
+            continue;
+        }
+        memset(table, 0xFF, capacity*sizeof(*table));
+        Opencad_Weld_Slot recent[OPENCAD_WELD_RECENT];
+        memset(recent, 0xFF, sizeof(recent));
+
+        size_t count = 0;
+        for (size_t k = 0; k < owned; ++k) {
+            if (k + 16 < owned) __builtin_prefetch(&table[weld->hashes[slice[k + 16]] & (capacity - 1)]);
+            size_t i = slice[k];
+            uint32_t h = weld->hashes[i];
+
+            Opencad_Vec3 v = opencad_vec3_canonical(weld->corners[i]);
+            Opencad_Weld_Slot *cached = &recent[h%OPENCAD_WELD_RECENT];
+            if (cached->hash == h && cached->id != UINT32_MAX) {
+                Opencad_Vec3 u = opencad_vec3_canonical(weld->corners[uniques[cached->id]]);
+                if (memcmp(&u, &v, sizeof(v)) == 0) {
+                    weld->remap[i] = cached->id;
+                    continue;
+                }
+            }
+
+            if (count*2 >= capacity) {
+                size_t grown_capacity = capacity*2;
+                Opencad_Weld_Slot *grown = malloc(grown_capacity*sizeof(*grown));
+                if (grown == NULL) {
+                    weld->failed = true;
+                    break;
+                }
+                memset(grown, 0xFF, grown_capacity*sizeof(*grown));
+                for (size_t s = 0; s < capacity; ++s) {
+                    if (table[s].id == UINT32_MAX) continue;
+                    size_t slot = table[s].hash & (grown_capacity - 1);
+                    while (grown[slot].id != UINT32_MAX) slot = (slot + 1) & (grown_capacity - 1);
+                    grown[slot] = table[s];
+                }
+                free(table);
+                table = grown;
+                capacity = grown_capacity;
+            }
+
+            size_t slot = h & (capacity - 1);
+            for (;;) {
+                Opencad_Weld_Slot *entry = &table[slot];
+                if (entry->id == UINT32_MAX) {
+                    entry->hash = h;
+                    entry->id = (uint32_t) count;
+                    uniques[count] = (uint32_t) i;
+                    count += 1;
+                    break;
+                }
+                if (entry->hash == h) {
+                    Opencad_Vec3 u = opencad_vec3_canonical(weld->corners[uniques[entry->id]]);
+                    if (memcmp(&u, &v, sizeof(v)) == 0) break;
+                }
+                slot = (slot + 1) & (capacity - 1);
+            }
+            weld->remap[i] = table[slot].id;
+            *cached = table[slot];
+        }
+
+        free(table);
+        weld->uniques[p] = uniques;
+        weld->unique_counts[p] = count;
+    }
+}
+
+/**
+ * Weld pass 4: every partition writes its unique vertices at its offset in the final vertex array.
+ */
+static void opencad_weld_vertices_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    Opencad_Weld *weld = ctx;
+    (void) thread;
+    for (size_t p = begin; p < end; ++p) {
+        Opencad_Vec3 *out = weld->mesh->vertices + weld->bases[p];
+        for (size_t i = 0; i < weld->unique_counts[p]; ++i) {
+            out[i] = opencad_vec3_canonical(weld->corners[weld->uniques[p][i]]);
+        }
+    }
+}
+
+/**
+ * Weld pass 5: translates partition-local vertex ids into global indices.
+ */
+static void opencad_weld_indices_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    Opencad_Weld *weld = ctx;
+    (void) thread;
+    for (size_t i = begin; i < end; ++i) {
+        size_t p = opencad_weld_partition(weld->hashes[i], weld->partition_count);
+        weld->mesh->indices[i] = (uint32_t) (weld->bases[p] + weld->remap[i]);
+    }
+}
+
+/**
+ * Builds an indexed mesh from a triangle soup by merging bitwise-equal positions.
+ * Deduplication is partitioned by hash, so every thread owns a private hash table and no locks are needed.
+ * The corners are scattered into their partitions once, so each partition reads only its own.
+ * @param corners The triangle corners, three per triangle.
+ * @param triangle_count The number of triangles.
+ * @param mesh Receives the indexed mesh. Must be freed with opencad_mesh_free.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_mesh_from_soup(const Opencad_Vec3 *corners, size_t triangle_count, Opencad_Mesh *mesh)
+{
+    int result = 0;
+    size_t threads = opencad_thread_count();
+    Opencad_Weld weld = {
+        .corners = corners,
+        .corner_count = triangle_count*3,
+        .partition_count = threads,
+    };
+
+    {
+        memset(mesh, 0, sizeof(*mesh));
+        if (weld.corner_count > UINT32_MAX) return_defer(EOVERFLOW);
+
+        weld.hashes = malloc((weld.corner_count + 1)*sizeof(*weld.hashes));
+        weld.remap = malloc((weld.corner_count + 1)*sizeof(*weld.remap));
+        size_t chunks = (weld.corner_count + OPENCAD_WELD_CHUNK - 1)/OPENCAD_WELD_CHUNK;
+        weld.offsets = calloc(chunks*weld.partition_count + 1, sizeof(*weld.offsets));
+        weld.starts = malloc((weld.partition_count + 1)*sizeof(*weld.starts));
+        weld.order = malloc((weld.corner_count + 1)*sizeof(*weld.order));
+        weld.uniques = calloc(weld.partition_count, sizeof(*weld.uniques));
+        weld.unique_counts = calloc(weld.partition_count, sizeof(*weld.unique_counts));
+        weld.bases = calloc(weld.partition_count, sizeof(*weld.bases));
+        if (!weld.hashes || !weld.remap || !weld.offsets || !weld.starts || !weld.order || !weld.uniques ||
+            !weld.unique_counts || !weld.bases) {
+            return_defer(ENOMEM);
+        }
+
+        opencad_parallel_for(weld.corner_count, OPENCAD_WELD_CHUNK, opencad_weld_hash_task, &weld);
+
+        // Partition by partition and chunk by chunk, so every partition's slice keeps the corner order.
+        size_t offset = 0;
+        for (size_t p = 0; p < weld.partition_count; ++p) {
+            weld.starts[p] = offset;
+            for (size_t c = 0; c < chunks; ++c) {
+                size_t count = weld.offsets[c*weld.partition_count + p];
+                weld.offsets[c*weld.partition_count + p] = offset;
+                offset += count;
+            }
+        }
+        weld.starts[weld.partition_count] = offset;
+        opencad_parallel_for(weld.corner_count, OPENCAD_WELD_CHUNK, opencad_weld_scatter_task, &weld);
+        opencad_parallel_for(weld.partition_count, 1, opencad_weld_dedup_task, &weld);
+        if (weld.failed) return_defer(ENOMEM);
+
+        size_t total = 0;
+        for (size_t p = 0; p < weld.partition_count; ++p) {
+            weld.bases[p] = total;
+            total += weld.unique_counts[p];
+        }
+
+        mesh->vertices = malloc((total + 1)*sizeof(*mesh->vertices));
+        mesh->indices = malloc((weld.corner_count + 1)*sizeof(*mesh->indices));
+        if (!mesh->vertices || !mesh->indices) return_defer(ENOMEM);
+        mesh->vertex_count = total;
+        mesh->triangle_count = triangle_count;
+        weld.mesh = mesh;
+
+        opencad_parallel_for(weld.partition_count, 1, opencad_weld_vertices_task, &weld);
+        opencad_parallel_for(weld.corner_count, OPENCAD_WELD_CHUNK, opencad_weld_indices_task, &weld);
+    }
+
+defer:
+    if (weld.uniques) {
+        for (size_t p = 0; p < weld.partition_count; ++p) free(weld.uniques[p]);
+    }
+    free(weld.hashes);
+    free(weld.remap);
+    free(weld.offsets);
+    free(weld.starts);
+    free(weld.order);
+    free(weld.uniques);
+    free(weld.unique_counts);
+    free(weld.bases);
+    if (result != 0) opencad_mesh_free(mesh);
+    return result;
+}
+
+#define OPENCAD_STL_HEADER_SIZE 84
+#define OPENCAD_STL_TRIANGLE_SIZE 50
+
+typedef struct {
+    const uint8_t *data;
+    Opencad_Vec3 *corners;
+} Opencad_Stl_Decode;
+
+/**
+ * Decodes a chunk of binary STL triangles (little-endian) into corners, skipping the facet normals.
+ */
+static void opencad_stl_decode_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    Opencad_Stl_Decode *decode = ctx;
+    (void) thread;
+    for (size_t i = begin; i < end; ++i) {
+        const uint8_t *record = decode->data + OPENCAD_STL_HEADER_SIZE + i*OPENCAD_STL_TRIANGLE_SIZE;
+        memcpy(&decode->corners[i*3], record + 12, 3*sizeof(Opencad_Vec3));
+    }
+}
+
+/**
+ * Parses a decimal floating point number from a bounded buffer.
+ * @param cursor The parse position. Advanced past the number on success.
+ * @param end The end of the buffer.
+ * @param out Receives the number.
+ * @return True if a number was parsed, false otherwise.
+ */
+static bool opencad_parse_float(const char **cursor, const char *end, float *out)
+{
+    const char *p = *cursor;
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) ++p;
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+
+    double mantissa = 0.0;
+    int exponent = 0;
+    bool digits = false;
+    while (p < end && '0' <= *p && *p <= '9') {
+        mantissa = mantissa*10.0 + (*p - '0');
+        digits = true;
+        ++p;
+    }
+    if (p < end && *p == '.') {
+        ++p;
+        while (p < end && '0' <= *p && *p <= '9') {
+            mantissa = mantissa*10.0 + (*p - '0');
+            exponent -= 1;
+            digits = true;
+            ++p;
+        }
+    }
+    if (!digits) return false;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool exponent_negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            exponent_negative = *p == '-';
+            ++p;
+        }
+        int e = 0;
+        while (p < end && '0' <= *p && *p <= '9') {
+            if (e < 10000) e = e*10 + (*p - '0');
+            ++p;
+        }
+        exponent += exponent_negative ? -e : e;
+    }
+
+    double value = exponent == 0 ? mantissa : mantissa*pow(10.0, exponent);
+    *out = (float) (negative ? -value : value);
+    *cursor = p;
+    return true;
+}
+
+/**
+ * Collects the vertices of an ASCII STL file into a triangle soup.
+ * @param data The file contents.
+ * @param size The size of the file contents.
+ * @param corners Receives the malloc'ed corners, three per triangle.
+ * @param triangle_count Receives the number of triangles.
+ * @return An error code indicating the result of the operation.
+ */
+static Errno opencad_stl_parse_ascii(const uint8_t *data, size_t size, Opencad_Vec3 **corners, size_t *triangle_count)
+{
+    int result = 0;
+    const char *p = (const char *) data;
+    const char *end = p + size;
+    Opencad_Vec3 *items = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+
+    {
+        while (p < end) {
+            while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) ++p;
+            const char *word = p;
+            while (p < end && !(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) ++p;
+            if (p - word != 6 || memcmp(word, "vertex", 6) != 0) continue;
+
+            if (count == capacity) {
+                capacity = capacity ? capacity*2 : 1024;
+                Opencad_Vec3 *grown = realloc(items, capacity*sizeof(*items));
+                if (grown == NULL) return_defer(ENOMEM);
+                items = grown;
+            }
+            Opencad_Vec3 *v = &items[count++];
+            if (!opencad_parse_float(&p, end, &v->x)) return_defer(EINVAL);
+            if (!opencad_parse_float(&p, end, &v->y)) return_defer(EINVAL);
+            if (!opencad_parse_float(&p, end, &v->z)) return_defer(EINVAL);
+        }
+        if (count%3 != 0) return_defer(EINVAL);
+    }
+
+defer:
+    if (result != 0) {
+        free(items);
+        items = NULL;
+        count = 0;
+    }
+    *corners = items;
+    *triangle_count = count/3;
+    return result;
+}
+
+/**
+ * Loads a binary or ASCII STL file into an indexed mesh.
+ * The file is memory-mapped; binary triangles are decoded in parallel chunks and
+ * welded by opencad_mesh_from_soup. ASCII files go through a slower sequential parser.
+ * @param file_path The path to the file to load.
+ * @param mesh Receives the mesh. Must be freed with opencad_mesh_free.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_load_from_stl_file(const char *file_path, Opencad_Mesh *mesh)
+{
+    int result = 0;
+    const uint8_t *data = NULL;
+    size_t size = 0;
+    Opencad_Vec3 *corners = NULL;
+
+    {
+        memset(mesh, 0, sizeof(*mesh));
+
+        Errno err = opencad_map_file(file_path, &data, &size);
+        if (err) return_defer(err);
+
+        uint32_t binary_count = 0;
+        if (size >= OPENCAD_STL_HEADER_SIZE) memcpy(&binary_count, data + 80, sizeof(binary_count));
+        size_t binary_size = OPENCAD_STL_HEADER_SIZE + (size_t) binary_count*OPENCAD_STL_TRIANGLE_SIZE;
+
+        size_t skip = 0;
+        while (skip < size && (data[skip] == ' ' || data[skip] == '\t' || data[skip] == '\r' || data[skip] == '\n')) ++skip;
+        bool ascii = size - skip >= 5 && memcmp(data + skip, "solid", 5) == 0;
+
+        size_t triangle_count = 0;
+        if (size >= OPENCAD_STL_HEADER_SIZE && (binary_size == size || (!ascii && binary_size <= size))) {
+            triangle_count = binary_count;
+            corners = malloc((triangle_count*3 + 1)*sizeof(*corners));
+            if (corners == NULL) return_defer(ENOMEM);
+
+            Opencad_Stl_Decode decode = {
+                .data = data,
+                .corners = corners,
+            };
+            opencad_parallel_for(triangle_count, 1 << 15, opencad_stl_decode_task, &decode);
+        } else if (ascii) {
+            err = opencad_stl_parse_ascii(data, size, &corners, &triangle_count);
+            if (err) return_defer(err);
+        } else {
+            return_defer(EINVAL);
+        }
+
+        err = opencad_mesh_from_soup(corners, triangle_count, mesh);
+        if (err) return_defer(err);
+    }
+
+defer:
+    free(corners);
+    opencad_unmap_file(data, size);
+    return result;
+}
+
+#define OPENCAD_EXPORT_BLOCK (1 << 16)
+
+/**
+ * Writes a whole buffer at an absolute file offset, retrying short writes.
+ * @param fd The file descriptor.
+ * @param data The bytes to write.
+ * @param size The number of bytes.
+ * @param offset The file offset to write at.
+ * @return An error code indicating the result of the operation.
+ */
+static Errno opencad_pwrite_all(int fd, const uint8_t *data, size_t size, off_t offset)
+{
+    while (size > 0) {
+        ssize_t n = pwrite(fd, data, size, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+        data += n;
+        size -= (size_t) n;
+        offset += n;
+    }
+    return 0;
+}
+
+/**
+ * Computes the unit normal of a counter-clockwise triangle.
+ * @param a The first corner.
+ * @param b The second corner.
+ * @param c The third corner.
+ * @return The normal, or the zero vector for degenerate triangles.
+ */
+Opencad_Vec3 opencad_triangle_normal(Opencad_Vec3 a, Opencad_Vec3 b, Opencad_Vec3 c)
+{
+    float ux = b.x - a.x, uy = b.y - a.y, uz = b.z - a.z;
+    float vx = c.x - a.x, vy = c.y - a.y, vz = c.z - a.z;
+    Opencad_Vec3 n = {
+        uy*vz - uz*vy,
+        uz*vx - ux*vz,
+        ux*vy - uy*vx,
+    };
+    float length = sqrtf(n.x*n.x + n.y*n.y + n.z*n.z);
+    if (length > 0.0f) {
+        n.x /= length;
+        n.y /= length;
+        n.z /= length;
+    }
+    return n;
+}
+
+typedef struct {
+    const Opencad_Mesh *mesh;
+    int fd;
+    uint8_t *buffers[OPENCAD_MAX_THREADS];
+    Errno errors[OPENCAD_MAX_THREADS];
+} Opencad_Stl_Export;
+
+/**
+ * Serializes a block of triangles into the thread's buffer and writes it at its precomputed file offset.
+ */
+static void opencad_stl_export_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    Opencad_Stl_Export *export = ctx;
+    const Opencad_Mesh *mesh = export->mesh;
+    uint8_t *out = export->buffers[thread];
+
+    for (size_t i = begin; i < end; ++i) {
+        Opencad_Vec3 corners[3] = {
+            mesh->vertices[mesh->indices[i*3 + 0]],
+            mesh->vertices[mesh->indices[i*3 + 1]],
+            mesh->vertices[mesh->indices[i*3 + 2]],
+        };
+        Opencad_Vec3 normal = opencad_triangle_normal(corners[0], corners[1], corners[2]);
+        uint8_t *record = out + (i - begin)*OPENCAD_STL_TRIANGLE_SIZE;
+        memcpy(record, &normal, sizeof(normal));
+        memcpy(record + 12, corners, sizeof(corners));
+        memset(record + 48, 0, 2);
+    }
+
+    off_t offset = OPENCAD_STL_HEADER_SIZE + (off_t) begin*OPENCAD_STL_TRIANGLE_SIZE;
+    Errno err = opencad_pwrite_all(export->fd, out, (end - begin)*OPENCAD_STL_TRIANGLE_SIZE, offset);
+    if (err) export->errors[thread] = err;
+}
+
+/**
+ * Saves a mesh to a binary STL file (little-endian).
+ * Every record lives at a precomputed offset, so blocks of triangles are serialized and
+ * written by all worker threads at once.
+ * @param mesh The mesh to save.
+ * @param file_path The path to the file to save to.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_save_to_stl_file(const Opencad_Mesh *mesh, const char *file_path)
+{
+    int result = 0;
+    Opencad_Stl_Export export = {
+        .mesh = mesh,
+        .fd = -1,
+    };
+    size_t threads = opencad_thread_count();
+
+    {
+        if (mesh->triangle_count > UINT32_MAX) return_defer(EOVERFLOW);
+
+        export.fd = open(file_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (export.fd < 0) return_defer(errno);
+
+        uint8_t header[OPENCAD_STL_HEADER_SIZE] = {0};
+        const char *banner = "OpenCAD binary STL";
+        memcpy(header, banner, strlen(banner));
+        uint32_t count = (uint32_t) mesh->triangle_count;
+        memcpy(header + 80, &count, sizeof(count));
+        Errno err = opencad_pwrite_all(export.fd, header, sizeof(header), 0);
+        if (err) return_defer(err);
+
+        for (size_t t = 0; t < threads; ++t) {
+            export.buffers[t] = malloc(OPENCAD_EXPORT_BLOCK*OPENCAD_STL_TRIANGLE_SIZE);
+            if (export.buffers[t] == NULL) return_defer(ENOMEM);
+        }
+
+        opencad_parallel_for(mesh->triangle_count, OPENCAD_EXPORT_BLOCK, opencad_stl_export_task, &export);
+        for (size_t t = 0; t < threads; ++t) {
+            if (export.errors[t]) return_defer(export.errors[t]);
+        }
+    }
+
+defer:
+    for (size_t t = 0; t < threads; ++t) free(export.buffers[t]);
+    if (export.fd >= 0 && close(export.fd) < 0 && result == 0) result = errno;
+    return result;
+}
+
+/**
+ * Formats an unsigned integer in decimal, two digits at a time.
+ * @param out The output buffer. Must hold at least 20 bytes.
+ * @param value The value to format.
+ * @return The number of bytes written.
+ */
+size_t opencad_format_uint(char *out, uint64_t value)
+{
+    static const char pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    char digits[20];
+    size_t n = sizeof(digits);
+    while (value >= 100) {
+        size_t pair = (size_t) (value%100)*2;
+        value /= 100;
+        digits[--n] = pairs[pair + 1];
+        digits[--n] = pairs[pair];
+    }
+    if (value >= 10) {
+        digits[--n] = pairs[value*2 + 1];
+        digits[--n] = pairs[value*2];
+    } else {
+        digits[--n] = (char) ('0' + value);
+    }
+    memcpy(out, digits + n, sizeof(digits) - n);
+    return sizeof(digits) - n;
+}
+
+#define OPENCAD_FLOAT_MAX_DECIMALS 9
+
+static const double opencad_powers_of_ten[OPENCAD_FLOAT_MAX_DECIMALS + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+};
+
+/**
+ * Tells whether the decimal digits/10^decimals reads back as value, judging by the correctly rounded
+ * double quotient. A quotient exactly halfway between two floats only counts when it is the decimal
+ * itself, since otherwise the decimal may round either way. Value must be a normal float.
+ */
+static bool opencad_decimal_round_trips(uint64_t digits, int decimals, float value)
+{
+    double quotient = (double) digits/opencad_powers_of_ten[decimals];
+    float rounded = (float) quotient;
+    if (rounded != value) return false;
+    // Halfway between normal floats, the 29 mantissa bits a float lacks read 1 followed by zeros.
+    uint64_t bits;
+    memcpy(&bits, &quotient, sizeof(bits));
+    if ((bits & 0x1FFFFFFF) != 0x10000000) return true;
+    return fma(quotient, opencad_powers_of_ten[decimals], -(double) digits) == 0.0;
+}
+
+/**
+ * Formats a float with the fewest digits that read back as the same float: in fixed point with up to
+ * OPENCAD_FLOAT_MAX_DECIMALS fractional digits where that suffices, otherwise with snprintf and the
+ * fewest significant digits, nine at most.
+ * @param out The output buffer. Must hold at least 32 bytes.
+ * @param value The value to format.
+ * @return The number of bytes written.
+ */
+size_t opencad_format_float(char *out, float value)
+{
+    if (isnan(value)) {
+        memcpy(out, "nan", 3);
+        return 3;
+    }
+    float magnitude = fabsf(value);
+    if (magnitude == 0.0f) {
+        out[0] = '0';
+        return 1;
+    }
+
+    for (int decimals = 0; decimals <= OPENCAD_FLOAT_MAX_DECIMALS; ++decimals) {
+        double scaled = (double) magnitude*opencad_powers_of_ten[decimals];
+        if (scaled >= 0x1p53) break;
+        uint64_t digits = (uint64_t) (scaled + 0.5);
+        if (digits == 0 || !opencad_decimal_round_trips(digits, decimals, magnitude)) continue;
+
+        size_t n = 0;
+        if (value < 0.0f) out[n++] = '-';
+        uint64_t unit = (uint64_t) opencad_powers_of_ten[decimals];
+        n += opencad_format_uint(out + n, digits/unit);
+        uint64_t fraction = digits%unit;
+        if (fraction != 0) {
+            out[n++] = '.';
+            uint64_t divisor = unit/10;
+            while (fraction != 0) {
+                out[n++] = (char) ('0' + fraction/divisor);
+                fraction %= divisor;
+                divisor /= 10;
+            }
+        }
+        return n;
+    }
+
+    for (int precision = 1; precision < 9; ++precision) {
+        int n = snprintf(out, 32, "%.*g", precision, value);
+        if (strtof(out, NULL) == value) return (size_t) n;
+    }
+    return (size_t) snprintf(out, 32, "%.9g", value);
+}
+
+#define OPENCAD_OBJ_VERTEX_LINE_MAX (2 + 3*32 + 3)
+
+typedef struct {
+    const Opencad_Mesh *mesh;
+    size_t first;
+    bool faces;
+    char *buffers[OPENCAD_MAX_THREADS*2];
+    size_t sizes[OPENCAD_MAX_THREADS*2];
+} Opencad_Obj_Export;
+
+/**
+ * Formats one block of "v" or "f" lines of the current batch into that block's buffer.
+ */
+static void opencad_obj_export_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    Opencad_Obj_Export *export = ctx;
+    const Opencad_Mesh *mesh = export->mesh;
+    (void) thread;
+
+    for (size_t block = begin; block < end; ++block) {
+        size_t first = export->first + block*OPENCAD_EXPORT_BLOCK;
+        size_t total = export->faces ? mesh->triangle_count : mesh->vertex_count;
+        size_t last = first + OPENCAD_EXPORT_BLOCK < total ? first + OPENCAD_EXPORT_BLOCK : total;
+        char *out = export->buffers[block];
+        size_t n = 0;
+
+        for (size_t i = first; i < last; ++i) {
+            if (export->faces) {
+                out[n++] = 'f';
+                for (size_t k = 0; k < 3; ++k) {
+                    out[n++] = ' ';
+                    n += opencad_format_uint(out + n, (uint64_t) mesh->indices[i*3 + k] + 1);
+                }
+            } else {
+                Opencad_Vec3 v = mesh->vertices[i];
+                out[n++] = 'v';
+                out[n++] = ' ';
+                n += opencad_format_float(out + n, v.x);
+                out[n++] = ' ';
+                n += opencad_format_float(out + n, v.y);
+                out[n++] = ' ';
+                n += opencad_format_float(out + n, v.z);
+            }
+            out[n++] = '\n';
+        }
+        export->sizes[block] = n;
+    }
+}
+
+/**
+ * Saves a mesh to a Wavefront OBJ file.
+ * Batches of blocks are formatted in parallel and then written in order as large buffers.
+ * @param mesh The mesh to save.
+ * @param file_path The path to the file to save to.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_save_to_obj_file(const Opencad_Mesh *mesh, const char *file_path)
+{
+    int result = 0;
+    FILE *f = NULL;
+    Opencad_Obj_Export export = {
+        .mesh = mesh,
+    };
+    size_t blocks = opencad_thread_count()*2;
+
+    {
+        f = fopen(file_path, "wb");
+        if (f == NULL) return_defer(errno);
+
+        for (size_t b = 0; b < blocks; ++b) {
+            export.buffers[b] = malloc((size_t) OPENCAD_EXPORT_BLOCK*OPENCAD_OBJ_VERTEX_LINE_MAX);
+            if (export.buffers[b] == NULL) return_defer(ENOMEM);
+        }
+
+        for (int pass = 0; pass < 2; ++pass) {
+            export.faces = pass == 1;
+            size_t total = export.faces ? mesh->triangle_count : mesh->vertex_count;
+            for (export.first = 0; export.first < total; export.first += blocks*OPENCAD_EXPORT_BLOCK) {
+                size_t remaining = (total - export.first + OPENCAD_EXPORT_BLOCK - 1)/OPENCAD_EXPORT_BLOCK;
+                size_t batch = remaining < blocks ? remaining : blocks;
+                opencad_parallel_for(batch, 1, opencad_obj_export_task, &export);
+                for (size_t b = 0; b < batch; ++b) {
+                    fwrite(export.buffers[b], export.sizes[b], 1, f);
+                    if (ferror(f)) return_defer(errno);
+                }
+            }
+        }
+    }
+
+defer:
+    for (size_t b = 0; b < blocks; ++b) free(export.buffers[b]);
+    if (f && fclose(f) != 0 && result == 0) result = errno;
+    return result;
+}
+
+/**
+ * A point in homogeneous coordinates.
+ */
+typedef struct {
+    float x, y, z, w;
+} Opencad_Vec4;
+
+/**
+ * A 4x4 matrix stored row by row. Points are column vectors: p' = M*p.
+ */
+typedef struct {
+    float m[4][4];
+} Opencad_Mat4;
+
+/**
+ * Constructs a vector.
+ * @param x The x component.
+ * @param y The y component.
+ * @param z The z component.
+ * @return The vector.
+ */
+Opencad_Vec3 opencad_vec3(float x, float y, float z)
+{
+    Opencad_Vec3 v = {x, y, z};
+    return v;
+}
+
+/**
+ * Adds two vectors.
+ * @param a The first vector.
+ * @param b The second vector.
+ * @return a + b.
+ */
+Opencad_Vec3 opencad_vec3_add(Opencad_Vec3 a, Opencad_Vec3 b)
+{
+    return opencad_vec3(a.x + b.x, a.y + b.y, a.z + b.z);
+}
+
+/**
+ * Subtracts two vectors.
+ * @param a The first vector.
+ * @param b The second vector.
+ * @return a - b.
+ */
+Opencad_Vec3 opencad_vec3_sub(Opencad_Vec3 a, Opencad_Vec3 b)
+{
+    return opencad_vec3(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+/**
+ * Scales a vector.
+ * @param a The vector.
+ * @param s The scale factor.
+ * @return a*s.
+ */
+Opencad_Vec3 opencad_vec3_scale(Opencad_Vec3 a, float s)
+{
+    return opencad_vec3(a.x*s, a.y*s, a.z*s);
+}
+
+/**
+ * Computes the dot product of two vectors.
+ * @param a The first vector.
+ * @param b The second vector.
+ * @return The dot product.
+ */
+float opencad_vec3_dot(Opencad_Vec3 a, Opencad_Vec3 b)
+{
+    return a.x*b.x + a.y*b.y + a.z*b.z;
+}
+
+/**
+ * Computes the cross product of two vectors.
+ * @param a The first vector.
+ * @param b The second vector.
+ * @return The cross product.
+ */
+Opencad_Vec3 opencad_vec3_cross(Opencad_Vec3 a, Opencad_Vec3 b)
+{
+    return opencad_vec3(a.y*b.z - a.z*b.y, a.z*b.x - a.x*b.z, a.x*b.y - a.y*b.x);
+}
+
+/**
+ * Computes the length of a vector.
+ * @param a The vector.
+ * @return The length.
+ */
+float opencad_vec3_length(Opencad_Vec3 a)
+{
+    return sqrtf(opencad_vec3_dot(a, a));
+}
+
+/**
+ * Scales a vector to unit length.
+ * @param a The vector.
+ * @return The unit vector, or the zero vector if a has no length.
+ */
+Opencad_Vec3 opencad_vec3_normalize(Opencad_Vec3 a)
+{
+    float length = opencad_vec3_length(a);
+    return length > 0.0f ? opencad_vec3_scale(a, 1.0f/length) : a;
+}
+
+/**
+ * Returns the identity matrix.
+ * @return The identity matrix.
+ */
+Opencad_Mat4 opencad_mat4_identity(void)
+{
+    Opencad_Mat4 r = {0};
+    for (int i = 0; i < 4; ++i) r.m[i][i] = 1.0f;
+    return r;
+}
+
+/**
+ * Multiplies two matrices. The result applies b first, then a.
+ * @param a The left matrix.
+ * @param b The right matrix.
+ * @return a*b.
+ */
+Opencad_Mat4 opencad_mat4_mul(Opencad_Mat4 a, Opencad_Mat4 b)
+{
+    Opencad_Mat4 r = {0};
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            for (int k = 0; k < 4; ++k) {
+                r.m[i][j] += a.m[i][k]*b.m[k][j];
+            }
+        }
+    }
+    return r;
+}
+
+/**
+ * Returns a translation matrix.
+ * @param x The translation along x.
+ * @param y The translation along y.
+ * @param z The translation along z.
+ * @return The translation matrix.
+ */
+Opencad_Mat4 opencad_mat4_translate(float x, float y, float z)
+{
+    Opencad_Mat4 r = opencad_mat4_identity();
+    r.m[0][3] = x;
+    r.m[1][3] = y;
+    r.m[2][3] = z;
+    return r;
+}
+
+/**
+ * Returns a scaling matrix.
+ * @param x The scale along x.
+ * @param y The scale along y.
+ * @param z The scale along z.
+ * @return The scaling matrix.
+ */
+Opencad_Mat4 opencad_mat4_scale(float x, float y, float z)
+{
+    Opencad_Mat4 r = opencad_mat4_identity();
+    r.m[0][0] = x;
+    r.m[1][1] = y;
+    r.m[2][2] = z;
+    return r;
+}
+
+/**
+ * Returns a matrix rotating counter-clockwise around an axis.
+ * @param axis The rotation axis. Does not need to be normalized.
+ * @param angle The rotation angle in radians.
+ * @return The rotation matrix.
+ */
+Opencad_Mat4 opencad_mat4_rotate(Opencad_Vec3 axis, float angle)
+{
+    Opencad_Vec3 u = opencad_vec3_normalize(axis);
+    float c = cosf(angle);
+    float s = sinf(angle);
+    float t = 1.0f - c;
+    Opencad_Mat4 r = opencad_mat4_identity();
+    r.m[0][0] = c + u.x*u.x*t;
+    r.m[0][1] = u.x*u.y*t - u.z*s;
+    r.m[0][2] = u.x*u.z*t + u.y*s;
+    r.m[1][0] = u.y*u.x*t + u.z*s;
+    r.m[1][1] = c + u.y*u.y*t;
+    r.m[1][2] = u.y*u.z*t - u.x*s;
+    r.m[2][0] = u.z*u.x*t - u.y*s;
+    r.m[2][1] = u.z*u.y*t + u.x*s;
+    r.m[2][2] = c + u.z*u.z*t;
+    return r;
+}
+
+/**
+ * Returns a view matrix looking from eye towards target. The camera looks down its -z axis.
+ * @param eye The camera position.
+ * @param target The point to look at.
+ * @param up The approximate up direction.
+ * @return The view matrix.
+ */
+Opencad_Mat4 opencad_mat4_look_at(Opencad_Vec3 eye, Opencad_Vec3 target, Opencad_Vec3 up)
+{
+    Opencad_Vec3 f = opencad_vec3_normalize(opencad_vec3_sub(target, eye));
+    Opencad_Vec3 s = opencad_vec3_normalize(opencad_vec3_cross(f, up));
+    Opencad_Vec3 u = opencad_vec3_cross(s, f);
+    Opencad_Mat4 r = opencad_mat4_identity();
+    r.m[0][0] = s.x;  r.m[0][1] = s.y;  r.m[0][2] = s.z;  r.m[0][3] = -opencad_vec3_dot(s, eye);
+    r.m[1][0] = u.x;  r.m[1][1] = u.y;  r.m[1][2] = u.z;  r.m[1][3] = -opencad_vec3_dot(u, eye);
+    r.m[2][0] = -f.x; r.m[2][1] = -f.y; r.m[2][2] = -f.z; r.m[2][3] = opencad_vec3_dot(f, eye);
+    return r;
+}
+
+/**
+ * Returns an orthographic projection mapping the box to the [-1, 1] clip cube.
+ * @param left The left edge of the view volume.
+ * @param right The right edge of the view volume.
+ * @param bottom The bottom edge of the view volume.
+ * @param top The top edge of the view volume.
+ * @param near The distance to the near plane.
+ * @param far The distance to the far plane.
+ * @return The projection matrix.
+ */
+Opencad_Mat4 opencad_mat4_ortho(float left, float right, float bottom, float top, float near, float far)
+{
+    Opencad_Mat4 r = opencad_mat4_identity();
+    r.m[0][0] = 2.0f/(right - left);
+    r.m[1][1] = 2.0f/(top - bottom);
+    r.m[2][2] = -2.0f/(far - near);
+    r.m[0][3] = -(right + left)/(right - left);
+    r.m[1][3] = -(top + bottom)/(top - bottom);
+    r.m[2][3] = -(far + near)/(far - near);
+    return r;
+}
+
+/**
+ * Returns a perspective projection.
+ * @param fovy The vertical field of view in radians.
+ * @param aspect The width to height ratio of the viewport.
+ * @param near The distance to the near plane.
+ * @param far The distance to the far plane.
+ * @return The projection matrix.
+ */
+Opencad_Mat4 opencad_mat4_perspective(float fovy, float aspect, float near, float far)
+{
+    float f = 1.0f/tanf(fovy*0.5f);
+    Opencad_Mat4 r = {0};
+    r.m[0][0] = f/aspect;
+    r.m[1][1] = f;
+    r.m[2][2] = (far + near)/(near - far);
+    r.m[2][3] = 2.0f*far*near/(near - far);
+    r.m[3][2] = -1.0f;
+    return r;
+}
+
+/**
+ * Transforms a homogeneous point.
+ * @param m The matrix.
+ * @param v The point.
+ * @return m*v.
+ */
+Opencad_Vec4 opencad_mat4_apply(Opencad_Mat4 m, Opencad_Vec4 v)
+{
+    Opencad_Vec4 r = {
+        m.m[0][0]*v.x + m.m[0][1]*v.y + m.m[0][2]*v.z + m.m[0][3]*v.w,
+        m.m[1][0]*v.x + m.m[1][1]*v.y + m.m[1][2]*v.z + m.m[1][3]*v.w,
+        m.m[2][0]*v.x + m.m[2][1]*v.y + m.m[2][2]*v.z + m.m[2][3]*v.w,
+        m.m[3][0]*v.x + m.m[3][1]*v.y + m.m[3][2]*v.z + m.m[3][3]*v.w,
+    };
+    return r;
+}
+
+/**
+ * Transforms a point, ignoring the projective row.
+ * @param m The matrix.
+ * @param v The point.
+ * @return The transformed point.
+ */
+Opencad_Vec3 opencad_mat4_transform_point(Opencad_Mat4 m, Opencad_Vec3 v)
+{
+    Opencad_Vec4 r = opencad_mat4_apply(m, (Opencad_Vec4) {v.x, v.y, v.z, 1.0f});
+    return opencad_vec3(r.x, r.y, r.z);
+}
+
+/**
+ * Returns the matrix that transforms normals: the cofactor matrix of the upper 3x3 block.
+ * It equals the inverse transpose up to a positive scale, so normals stay correct under
+ * non-uniform scaling once renormalized.
+ * @param m The matrix transforming points.
+ * @return The normal matrix.
+ */
+Opencad_Mat4 opencad_mat4_normal_matrix(Opencad_Mat4 m)
+{
+    Opencad_Mat4 r = opencad_mat4_identity();
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            int i1 = (i + 1)%3, i2 = (i + 2)%3;
+            int j1 = (j + 1)%3, j2 = (j + 2)%3;
+            r.m[i][j] = m.m[i1][j1]*m.m[i2][j2] - m.m[i1][j2]*m.m[i2][j1];
+        }
+    }
+    float det = m.m[0][0]*r.m[0][0] + m.m[0][1]*r.m[0][1] + m.m[0][2]*r.m[0][2];
+    if (det < 0.0f) {
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) r.m[i][j] = -r.m[i][j];
+        }
+    }
+    return r;
+}
+
+/**
+ * Inverts a matrix through its 2x2 sub-determinants.
+ * @param m The matrix.
+ * @return The inverse, or the zero matrix if m is singular.
+ */
+Opencad_Mat4 opencad_mat4_inverse(Opencad_Mat4 m)
+{
+    const float (*a)[4] = m.m;
+    float s0 = a[0][0]*a[1][1] - a[1][0]*a[0][1];
+    float s1 = a[0][0]*a[1][2] - a[1][0]*a[0][2];
+    float s2 = a[0][0]*a[1][3] - a[1][0]*a[0][3];
+    float s3 = a[0][1]*a[1][2] - a[1][1]*a[0][2];
+    float s4 = a[0][1]*a[1][3] - a[1][1]*a[0][3];
+    float s5 = a[0][2]*a[1][3] - a[1][2]*a[0][3];
+    float c0 = a[2][0]*a[3][1] - a[3][0]*a[2][1];
+    float c1 = a[2][0]*a[3][2] - a[3][0]*a[2][2];
+    float c2 = a[2][0]*a[3][3] - a[3][0]*a[2][3];
+    float c3 = a[2][1]*a[3][2] - a[3][1]*a[2][2];
+    float c4 = a[2][1]*a[3][3] - a[3][1]*a[2][3];
+    float c5 = a[2][2]*a[3][3] - a[3][2]*a[2][3];
+    float det = s0*c5 - s1*c4 + s2*c3 + s3*c2 - s4*c1 + s5*c0;
+
+    Opencad_Mat4 r = {0};
+    if (det == 0.0f) return r;
+    float inv = 1.0f/det;
+    r.m[0][0] = ( a[1][1]*c5 - a[1][2]*c4 + a[1][3]*c3)*inv;
+    r.m[0][1] = (-a[0][1]*c5 + a[0][2]*c4 - a[0][3]*c3)*inv;
+    r.m[0][2] = ( a[3][1]*s5 - a[3][2]*s4 + a[3][3]*s3)*inv;
+    r.m[0][3] = (-a[2][1]*s5 + a[2][2]*s4 - a[2][3]*s3)*inv;
+    r.m[1][0] = (-a[1][0]*c5 + a[1][2]*c2 - a[1][3]*c1)*inv;
+    r.m[1][1] = ( a[0][0]*c5 - a[0][2]*c2 + a[0][3]*c1)*inv;
+    r.m[1][2] = (-a[3][0]*s5 + a[3][2]*s2 - a[3][3]*s1)*inv;
+    r.m[1][3] = ( a[2][0]*s5 - a[2][2]*s2 + a[2][3]*s1)*inv;
+    r.m[2][0] = ( a[1][0]*c4 - a[1][1]*c2 + a[1][3]*c0)*inv;
+    r.m[2][1] = (-a[0][0]*c4 + a[0][1]*c2 - a[0][3]*c0)*inv;
+    r.m[2][2] = ( a[3][0]*s4 - a[3][1]*s2 + a[3][3]*s0)*inv;
+    r.m[2][3] = (-a[2][0]*s4 + a[2][1]*s2 - a[2][3]*s0)*inv;
+    r.m[3][0] = (-a[1][0]*c3 + a[1][1]*c1 - a[1][2]*c0)*inv;
+    r.m[3][1] = ( a[0][0]*c3 - a[0][1]*c1 + a[0][2]*c0)*inv;
+    r.m[3][2] = (-a[3][0]*s3 + a[3][1]*s1 - a[3][2]*s0)*inv;
+    r.m[3][3] = ( a[2][0]*s3 - a[2][1]*s1 + a[2][2]*s0)*inv;
+    return r;
+}
+
+/**
+ * Expresses a plane given in the coordinates m maps to in the coordinates m maps from, so that
+ * points p on the returned plane are exactly those with m*p on the given one.
+ * @param plane The plane (a, b, c, d), holding the points where a*x + b*y + c*z + d = 0.
+ * @param m The transform.
+ * @return The plane in the source coordinates of m.
+ */
+Opencad_Vec4 opencad_plane_transform(Opencad_Vec4 plane, Opencad_Mat4 m)
+{
+    const float p[4] = {plane.x, plane.y, plane.z, plane.w};
+    float r[4];
+    for (int j = 0; j < 4; ++j) r[j] = p[0]*m.m[0][j] + p[1]*m.m[1][j] + p[2]*m.m[2][j] + p[3]*m.m[3][j];
+    return (Opencad_Vec4) {r[0], r[1], r[2], r[3]};
+}
+
+/**
+ * Computes area-weighted vertex normals and stores them in mesh->normals.
+ * @param mesh The mesh.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_mesh_compute_normals(Opencad_Mesh *mesh)
+{
+    Opencad_Vec3 *normals = calloc(mesh->vertex_count + 1, sizeof(*normals));
+    if (normals == NULL) return ENOMEM;
+
+    for (size_t t = 0; t < mesh->triangle_count; ++t) {
+        const uint32_t *tri = &mesh->indices[t*3];
+        Opencad_Vec3 a = mesh->vertices[tri[0]];
+        Opencad_Vec3 n = opencad_vec3_cross(opencad_vec3_sub(mesh->vertices[tri[1]], a),
+                                            opencad_vec3_sub(mesh->vertices[tri[2]], a));
+        for (int k = 0; k < 3; ++k) normals[tri[k]] = opencad_vec3_add(normals[tri[k]], n);
+    }
+    for (size_t i = 0; i < mesh->vertex_count; ++i) normals[i] = opencad_vec3_normalize(normals[i]);
+
+    free(mesh->normals);
+    mesh->normals = normals;
+    return 0;
+}
+
+/**
+ * A render target: a color buffer and a matching depth buffer, plus an optional normal buffer for
+ * outlines (see opencad_draw_outlines), an optional stencil buffer for section caps (see Opencad_Section)
+ * and optional buffers for order-independent transparency (see opencad_canvas_oit).
+ * All are addressed as buffer[y*stride + x], so a canvas can view a sub-rectangle of a larger one.
+ */
+typedef struct {
+    uint32_t *pixels;
+    float *depth;
+    uint32_t *normals;  // Optional: view-space face normals packed by opencad_pack_normal, 0 where nothing was drawn.
+    uint8_t *stencil;   // Optional: one parity bit per section plane, 0 between draws.
+    float *accum;       // Optional: four floats per pixel, weighted premultiplied RGB and weighted alpha.
+    float *revealage;   // Optional: the product of (1 - alpha) over the transparent fragments of a pixel.
+    size_t width;
+    size_t height;
+    size_t stride;
+} Opencad_Canvas;
+
+/**
+ * Constructs a canvas over whole pixel and depth buffers.
+ * @param pixels The pixel buffer.
+ * @param depth The depth buffer, width*height floats.
+ * @param width The width of the buffers.
+ * @param height The height of the buffers.
+ * @return The canvas.
+ */
+Opencad_Canvas opencad_canvas(uint32_t *pixels, float *depth, size_t width, size_t height)
+{
+    Opencad_Canvas canvas = {
+        .pixels = pixels,
+        .depth = depth,
+        .width = width,
+        .height = height,
+        .stride = width,
+    };
+    return canvas;
+}
+
+/**
+ * Returns a canvas viewing a sub-rectangle of another canvas. The rectangle is clamped to the canvas.
+ * @param canvas The parent canvas.
+ * @param x The x-coordinate of the top-left corner of the rectangle.
+ * @param y The y-coordinate of the top-left corner of the rectangle.
+ * @param w The width of the rectangle.
+ * @param h The height of the rectangle.
+ * @return The sub-canvas.
+ */
+Opencad_Canvas opencad_subcanvas(Opencad_Canvas canvas, size_t x, size_t y, size_t w, size_t h)
+{
+    if (x > canvas.width) x = canvas.width;
+    if (y > canvas.height) y = canvas.height;
+    if (w > canvas.width - x) w = canvas.width - x;
+    if (h > canvas.height - y) h = canvas.height - y;
+    canvas.pixels += y*canvas.stride + x;
+    canvas.depth += y*canvas.stride + x;
+    if (canvas.normals) canvas.normals += y*canvas.stride + x;
+    if (canvas.stencil) canvas.stencil += y*canvas.stride + x;
+    if (canvas.accum) canvas.accum += (y*canvas.stride + x)*4;
+    if (canvas.revealage) canvas.revealage += y*canvas.stride + x;
+    canvas.width = w;
+    canvas.height = h;
+    return canvas;
+}
+
+/**
+ * Attaches weighted blended order-independent transparency buffers to a canvas. Transparent
+ * materials need them; see opencad_resolve_transparency.
+ * @param canvas The canvas, usually a whole one: sub-canvases taken afterwards share the buffers.
+ * @param accum The accumulation buffer, 4*stride*height floats.
+ * @param revealage The revealage buffer, stride*height floats.
+ * @return The canvas with the buffers attached.
+ */
+Opencad_Canvas opencad_canvas_oit(Opencad_Canvas canvas, float *accum, float *revealage)
+{
+    canvas.accum = accum;
+    canvas.revealage = revealage;
+    return canvas;
+}
+
+/**
+ * Fills the canvas with a solid color, resets its depth buffer to the far plane and empties its
+ * normal, stencil and transparency buffers, if any.
+ * @param canvas The canvas.
+ * @param color The color to fill with.
+ */
+void opencad_clear(Opencad_Canvas canvas, uint32_t color)
+{
+    for (size_t y = 0; y < canvas.height; ++y) {
+        for (size_t x = 0; x < canvas.width; ++x) {
+            canvas.pixels[y*canvas.stride + x] = color;
+            canvas.depth[y*canvas.stride + x] = 1.0f;
+        }
+        if (canvas.normals) memset(&canvas.normals[y*canvas.stride], 0, canvas.width*sizeof(*canvas.normals));
+        if (canvas.stencil) memset(&canvas.stencil[y*canvas.stride], 0, canvas.width*sizeof(*canvas.stencil));
+    }
+    if (canvas.accum == NULL || canvas.revealage == NULL) return;
+    for (size_t y = 0; y < canvas.height; ++y) {
+        memset(&canvas.accum[y*canvas.stride*4], 0, canvas.width*4*sizeof(*canvas.accum));
+        for (size_t x = 0; x < canvas.width; ++x) canvas.revealage[y*canvas.stride + x] = 1.0f;
+    }
+}
+
+/**
+ * World-to-view and view-to-clip transforms of a camera.
+ */
+typedef struct {
+    Opencad_Mat4 view;
+    Opencad_Mat4 projection;
+} Opencad_Camera;
+
+typedef enum {
+    OPENCAD_SHADING_UNLIT = 0,
+    OPENCAD_SHADING_FLAT,
+    OPENCAD_SHADING_GOURAUD,
+    OPENCAD_SHADING_MATCAP,
+} Opencad_Shading;
+
+/**
+ * Built-in material captures for OPENCAD_SHADING_MATCAP.
+ */
+typedef enum {
+    OPENCAD_MATCAP_CLAY = 0,
+    OPENCAD_MATCAP_PLASTIC,
+    OPENCAD_MATCAP_METAL,
+    COUNT_OPENCAD_MATCAPS,
+} Opencad_Matcap;
+
+/**
+ * A directional light. The direction points towards the light, in view space,
+ * so {0, 0, 1} is a headlight.
+ */
+typedef struct {
+    Opencad_Vec3 direction;
+    float intensity;
+} Opencad_Light;
+
+#define OPENCAD_MAX_LIGHTS 4
+#define OPENCAD_MAX_SECTION_PLANES 4
+#define OPENCAD_MAX_MIP_LEVELS 16
+
+/**
+ * An image with its mipmap chain, see opencad_texture_build. Texture coordinates (0, 0) and (1, 1) are
+ * the top-left and bottom-right corners of the image; outside that range it repeats unless clamped.
+ */
+typedef struct {
+    uint32_t *texels;       // All levels, largest first.
+    size_t offsets[OPENCAD_MAX_MIP_LEVELS];
+    size_t widths[OPENCAD_MAX_MIP_LEVELS];
+    size_t heights[OPENCAD_MAX_MIP_LEVELS];
+    size_t level_count;
+    bool clamp;
+} Opencad_Texture;
+
+/**
+ * Section planes cutting away part of a mesh while it is drawn. Each plane (a, b, c, d) is in world
+ * space and keeps the points where a*x + b*y + c*z + d >= 0. Where a plane cuts through the inside
+ * of a closed mesh the cut face is filled with a cap, found by counting the mesh's surfaces behind
+ * each pixel in the canvas' stencil buffer, which the canvas then needs.
+ */
+typedef struct {
+    Opencad_Vec4 planes[OPENCAD_MAX_SECTION_PLANES];
+    size_t plane_count;
+    uint32_t cap_color;
+    uint32_t hatch_color;
+    size_t hatch_spacing;   // Pixels between diagonal hatch lines, 0 for a solid cap.
+} Opencad_Section;
+
+/**
+ * How the triangles of a mesh are colored. A zero-initialized material draws unlit back-face-culled triangles.
+ * Matcap shading ignores the lights and tints the matcap with the color.
+ * Transparent materials are depth-tested against the opaque scene but do not write depth; they go to the
+ * canvas' transparency buffers in any order and show up after opencad_resolve_transparency.
+ */
+typedef struct {
+    Opencad_Shading shading;
+    uint32_t color;
+    Opencad_Matcap matcap;
+    float ambient;
+    Opencad_Light lights[OPENCAD_MAX_LIGHTS];
+    size_t light_count;
+    bool double_sided;
+    float transparency;     // 0 is opaque, 1 is invisible.
+    const Opencad_Section *section;     // Optional.
+    const Opencad_Texture *texture;     // Optional, multiplies the shaded color. Needs mesh->uvs.
+} Opencad_Material;
+
+#define OPENCAD_TILE_SIZE 64
+#define OPENCAD_LANES 8
+#define OPENCAD_SUBPIXEL_BITS 4
+#define OPENCAD_SUBPIXEL (1 << OPENCAD_SUBPIXEL_BITS)
+#define OPENCAD_GUARD_BAND 8192.0f  // Pixels a vertex may lie outside the canvas before its triangle is clipped.
+#define OPENCAD_MAX_VARYINGS 12
+
+enum {
+    OPENCAD_VARYING_SHADE = 0,
+    OPENCAD_VARYING_NORMAL_X,
+    OPENCAD_VARYING_NORMAL_Y,
+};
+
+/**
+ * A vertex after projection: screen position in pixels, depth in [0, 1], clip w and the interpolated attributes.
+ */
+typedef struct {
+    float x, y, z, w;
+    float varyings[OPENCAD_MAX_VARYINGS];
+} Opencad_Raster_Vertex;
+
+typedef struct {
+    uint32_t *items;
+    size_t count;
+    size_t capacity;
+} Opencad_Bin;
+
+/**
+ * A piece of a triangle that had to be clipped. Bins refer to it by its index with OPENCAD_CLIPPED_BIT set.
+ */
+typedef struct {
+    Opencad_Raster_Vertex v[3];
+    uint32_t face;
+} Opencad_Clipped;
+
+typedef struct {
+    Opencad_Clipped *items;
+    size_t count;
+    size_t capacity;
+} Opencad_Clipped_List;
+
+#define OPENCAD_CLIPPED_BIT 0x80000000u
+
+/**
+ * Transforms of one copy of a mesh as seen by one pass.
+ */
+typedef struct {
+    Opencad_Mat4 mvp;
+    Opencad_Mat4 normal_matrix;
+    Opencad_Vec4 section_model[OPENCAD_MAX_SECTION_PLANES];    // The section planes in model space.
+} Opencad_Instance;
+
+/**
+ * State of one mesh being drawn into one canvas with one camera, once per instance. Vertex i of
+ * instance k is vertices[k*vertex_count + i] and triangle t of it has id k*triangle_count + t.
+ */
+typedef struct {
+    Opencad_Canvas canvas;
+    const Opencad_Mesh *mesh;
+    const Opencad_Vec3 *normals;
+    const Opencad_Material *material;
+    Opencad_Instance *instances;
+    size_t instance_count;
+    size_t varying_count;
+    Opencad_Raster_Vertex *vertices;
+    uint32_t *face_colors;
+    uint32_t *face_normals;     // Only when the canvas has a normal buffer.
+    const uint32_t *matcap;
+    size_t tiles_x, tiles_y;
+    Opencad_Bin *bins;
+    Opencad_Clipped_List *clipped;  // One list per thread, like the bins.
+    float guard_x, guard_y;         // The guard band in normalized device coordinates.
+    size_t texture_varying;         // Varyings from here on are divided by w: u/w, v/w and 1/w if textured, then...
+    size_t section_count;
+    size_t section_varying;         // ...the distance/w of each section plane.
+    Opencad_Vec4 section_ndc[OPENCAD_MAX_SECTION_PLANES];       // The section planes in normalized device coordinates.
+    uint32_t cap_colors[OPENCAD_MAX_SECTION_PLANES];
+    uint32_t cap_normals[OPENCAD_MAX_SECTION_PLANES];
+    atomic_bool failed;             // Set by any thread that runs out of memory.
+} Opencad_Pass;
+
+#define OPENCAD_MAX_VIEWS 16
+
+/**
+ * Passes drawing the same mesh with the same material, sharing vertex loads and normals.
+ */
+typedef struct {
+    const Opencad_Mesh *mesh;
+    const Opencad_Vec3 *normals;
+    const Opencad_Material *material;
+    Opencad_Pass *passes;
+    size_t pass_count;
+    size_t *tile_offsets;
+    Opencad_Vec3 *owned_normals;
+    uint32_t *tinted_matcap;
+} Opencad_Frame;
+
+/**
+ * Standard engineering views, z up.
+ */
+typedef enum {
+    OPENCAD_VIEW_FRONT = 0,
+    OPENCAD_VIEW_TOP,
+    OPENCAD_VIEW_RIGHT,
+    OPENCAD_VIEW_ISOMETRIC,
+    COUNT_OPENCAD_VIEWS,
+} Opencad_View;
+
+/**
+ * Copies an image into a texture and builds its mipmap chain down to 1x1, each level averaging 2x2
+ * texels of the one above. Odd sizes round down; their last row and column fold into the one before.
+ * @param texture The texture to fill. Release it with opencad_texture_free.
+ * @param pixels The image, 0xAABBGGRR, row by row from the top.
+ * @param width The width of the image.
+ * @param height The height of the image.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_texture_build(Opencad_Texture *texture, const uint32_t *pixels, size_t width, size_t height)
+{
+    memset(texture, 0, sizeof(*texture));
+    if (width == 0 || height == 0 || width > UINT32_MAX || height > UINT32_MAX) return EINVAL;
+
+    size_t total = 0;
+    size_t w = width, h = height;
+    for (;;) {
+        if (texture->level_count == OPENCAD_MAX_MIP_LEVELS) break;
+        texture->offsets[texture->level_count] = total;
+        texture->widths[texture->level_count] = w;
+        texture->heights[texture->level_count] = h;
+        texture->level_count += 1;
+        total += w*h;
+        if (w == 1 && h == 1) break;
+        w = w > 1 ? w/2 : 1;
+        h = h > 1 ? h/2 : 1;
+    }
+
+    texture->texels = malloc(total*sizeof(*texture->texels));
+    if (texture->texels == NULL) {
+        texture->level_count = 0;
+        return ENOMEM;
+    }
+    memcpy(texture->texels, pixels, width*height*sizeof(*pixels));
+
+    for (size_t level = 1; level < texture->level_count; ++level) {
+        const uint32_t *src = texture->texels + texture->offsets[level - 1];
+        uint32_t *dst = texture->texels + texture->offsets[level];
+        size_t sw = texture->widths[level - 1], sh = texture->heights[level - 1];
+        size_t dw = texture->widths[level], dh = texture->heights[level];
+        for (size_t y = 0; y < dh; ++y) {
+            size_t y0 = y*sh/dh, y1 = (y + 1)*sh/dh;
+            for (size_t x = 0; x < dw; ++x) {
+                size_t x0 = x*sw/dw, x1 = (x + 1)*sw/dw;
+                uint32_t sum[4] = {0};
+                for (size_t sy = y0; sy < y1; ++sy) {
+                    for (size_t sx = x0; sx < x1; ++sx) {
+                        for (int c = 0; c < 4; ++c) sum[c] += (src[sy*sw + sx] >> (8*c)) & 0xFF;
+                    }
+                }
+                uint32_t n = (uint32_t) ((y1 - y0)*(x1 - x0));
+                uint32_t result = 0;
+                for (int c = 0; c < 4; ++c) result |= ((sum[c] + n/2)/n) << (8*c);
+                dst[y*dw + x] = result;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * Releases the memory held by a texture.
+ * @param texture The texture.
+ */
+void opencad_texture_free(Opencad_Texture *texture)
+{
+    free(texture->texels);
+    memset(texture, 0, sizeof(*texture));
+}
+
+/**
+ * Scales the RGB channels of a 0xAABBGGRR color, saturating at 0 and 255.
+ * @param color The color.
+ * @param s The scale factor. Negative or NaN factors, such as from a negative ambient term, give black.
+ * @return The scaled color, with the alpha of the original.
+ */
+uint32_t opencad_shade_color(uint32_t color, float s)
+{
+    // Clamped to the channel range before the conversion: converting a negative or NaN float to an
+    // unsigned integer is undefined. fmaxf returns 0 for NaN.
+    float r = fminf(fmaxf((float) ((color >> (8*0)) & 0xFF)*s, 0.0f), 255.0f);
+    float g = fminf(fmaxf((float) ((color >> (8*1)) & 0xFF)*s, 0.0f), 255.0f);
+    float b = fminf(fmaxf((float) ((color >> (8*2)) & 0xFF)*s, 0.0f), 255.0f);
+    uint32_t ri = (uint32_t) r, gi = (uint32_t) g, bi = (uint32_t) b;
+    return (color & 0xFF000000) | (bi << (8*2)) | (gi << (8*1)) | (ri << (8*0));
+}
+
+/**
+ * Evaluates ambient plus Lambertian lighting for a view-space unit normal.
+ * @param material The material holding the lights.
+ * @param n The normal.
+ * @return The light intensity.
+ */
+static float opencad_light_intensity(const Opencad_Material *material, Opencad_Vec3 n)
+{
+    float s = material->ambient;
+    for (size_t i = 0; i < material->light_count; ++i) {
+        float d = opencad_vec3_dot(n, opencad_vec3_normalize(material->lights[i].direction));
+        if (d > 0.0f) s += d*material->lights[i].intensity;
+    }
+    return s;
+}
+
+#define OPENCAD_MATCAP_SIZE 256
+
+static uint32_t opencad_matcaps[COUNT_OPENCAD_MATCAPS][OPENCAD_MATCAP_SIZE*OPENCAD_MATCAP_SIZE];
+static pthread_once_t opencad_matcaps_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Packs linear RGB in [0, 1] into an opaque 0xAABBGGRR color.
+ * @param r The red channel.
+ * @param g The green channel.
+ * @param b The blue channel.
+ * @return The color.
+ */
+static uint32_t opencad_rgb(float r, float g, float b)
+{
+    uint32_t ri = r <= 0.0f ? 0 : r >= 1.0f ? 255 : (uint32_t) (r*255.0f + 0.5f);
+    uint32_t gi = g <= 0.0f ? 0 : g >= 1.0f ? 255 : (uint32_t) (g*255.0f + 0.5f);
+    uint32_t bi = b <= 0.0f ? 0 : b >= 1.0f ? 255 : (uint32_t) (b*255.0f + 0.5f);
+    return 0xFF000000 | (bi << (8*2)) | (gi << (8*1)) | (ri << (8*0));
+}
+
+/**
+ * Bakes the built-in matcaps. Each texel holds the lit color of a sphere whose view-space normal
+ * projects onto that texel.
+ */
+static void opencad_matcaps_generate(void)
+{
+    Opencad_Vec3 key = opencad_vec3_normalize(opencad_vec3(-0.4f, 0.6f, 0.7f));
+    Opencad_Vec3 half = opencad_vec3_normalize(opencad_vec3_add(key, opencad_vec3(0, 0, 1)));
+
+    for (size_t y = 0; y < OPENCAD_MATCAP_SIZE; ++y) {
+        for (size_t x = 0; x < OPENCAD_MATCAP_SIZE; ++x) {
+            float nx = 2.0f*(float) x/(OPENCAD_MATCAP_SIZE - 1) - 1.0f;
+            float ny = 1.0f - 2.0f*(float) y/(OPENCAD_MATCAP_SIZE - 1);
+            float r2 = nx*nx + ny*ny;
+            if (r2 > 1.0f) {
+                float inv = 1.0f/sqrtf(r2);
+                nx *= inv;
+                ny *= inv;
+                r2 = 1.0f;
+            }
+            Opencad_Vec3 n = opencad_vec3(nx, ny, sqrtf(1.0f - r2));
+            float diffuse = fmaxf(opencad_vec3_dot(n, key), 0.0f);
+            float specular = powf(fmaxf(opencad_vec3_dot(n, half), 0.0f), 48.0f);
+            float rim = powf(1.0f - n.z, 3.0f);
+            size_t i = y*OPENCAD_MATCAP_SIZE + x;
+
+            float clay = 0.28f + 0.62f*diffuse + 0.15f*rim;
+            opencad_matcaps[OPENCAD_MATCAP_CLAY][i] = opencad_rgb(clay*0.86f, clay*0.82f, clay*0.78f);
+
+            float plastic = 0.18f + 0.7f*diffuse;
+            opencad_matcaps[OPENCAD_MATCAP_PLASTIC][i] = opencad_rgb(plastic + 0.6f*specular,
+                                                                     plastic + 0.6f*specular,
+                                                                     plastic + 0.6f*specular);
+
+            // Reflect the view direction and look the reflection up in a sky/ground gradient.
+            float ry = 2.0f*n.z*n.y;
+            float sky = ry > 0.0f ? 0.55f + 0.4f*ry : 0.25f + 0.2f*ry;
+            float horizon = expf(-ry*ry*40.0f)*0.35f;
+            float metal = sky + horizon + 0.8f*specular;
+            opencad_matcaps[OPENCAD_MATCAP_METAL][i] = opencad_rgb(metal*0.92f, metal*0.94f, metal);
+        }
+    }
+}
+
+/**
+ * Returns a built-in matcap, generating all of them on first use.
+ * @param matcap The matcap to return.
+ * @return OPENCAD_MATCAP_SIZE*OPENCAD_MATCAP_SIZE texels, row by row, +y up.
+ */
+const uint32_t *opencad_matcap_texture(Opencad_Matcap matcap)
+{
+    pthread_once(&opencad_matcaps_once, opencad_matcaps_generate);
+    if ((size_t) matcap >= COUNT_OPENCAD_MATCAPS) matcap = OPENCAD_MATCAP_CLAY;
+    return opencad_matcaps[matcap];
+}
+
+/**
+ * Multiplies every texel of a matcap by a color, channel by channel.
+ * @param out Receives the tinted texels.
+ * @param matcap The matcap texels.
+ * @param color The tint.
+ */
+static void opencad_matcap_tint(uint32_t *out, const uint32_t *matcap, uint32_t color)
+{
+    uint32_t tr = (color >> (8*0)) & 0xFF;
+    uint32_t tg = (color >> (8*1)) & 0xFF;
+    uint32_t tb = (color >> (8*2)) & 0xFF;
+    for (size_t i = 0; i < OPENCAD_MATCAP_SIZE*OPENCAD_MATCAP_SIZE; ++i) {
+        uint32_t texel = matcap[i];
+        uint32_t r = ((texel >> (8*0)) & 0xFF)*tr/255;
+        uint32_t g = ((texel >> (8*1)) & 0xFF)*tg/255;
+        uint32_t b = ((texel >> (8*2)) & 0xFF)*tb/255;
+        out[i] = (color & 0xFF000000) | (b << (8*2)) | (g << (8*1)) | (r << (8*0));
+    }
+}
+
+/**
+ * Vertex stage for one pass: projects a batch of OPENCAD_LANES loaded vertices and computes
+ * view-space normals and Gouraud intensities.
+ * @param pass The pass.
+ * @param instance The instance the batch belongs to.
+ * @param i The index of the first vertex of the batch in pass->vertices.
+ * @param n The number of valid lanes.
+ * @param uvs The texture coordinates of the batch, if the material is textured.
+ * @param px The x coordinates of the batch.
+ * @param py The y coordinates of the batch.
+ * @param pz The z coordinates of the batch.
+ * @param mx The x components of the model-space normals of the batch.
+ * @param my The y components of the model-space normals of the batch.
+ * @param mz The z components of the model-space normals of the batch.
+ */
+static void opencad_vertex_batch(Opencad_Pass *pass, const Opencad_Instance *instance, size_t i, size_t n,
+                                 const Opencad_Vec2 *uvs, const float *px, const float *py, const float *pz,
+                                 const float *mx, const float *my, const float *mz)
+{
+    const float (*m)[4] = instance->mvp.m;
+    float width = (float) pass->canvas.width;
+    float height = (float) pass->canvas.height;
+
+    // The reciprocals are taken in one loop and selected in the next: a select next to the division
+    // it guards would be turned back into a branch, and the loops would not vectorize.
+    float cx[OPENCAD_LANES], cy[OPENCAD_LANES], cz[OPENCAD_LANES], sw[OPENCAD_LANES], rw[OPENCAD_LANES];
+    for (size_t l = 0; l < OPENCAD_LANES; ++l) {
+        cx[l] = m[0][0]*px[l] + m[0][1]*py[l] + m[0][2]*pz[l] + m[0][3];
+        cy[l] = m[1][0]*px[l] + m[1][1]*py[l] + m[1][2]*pz[l] + m[1][3];
+        cz[l] = m[2][0]*px[l] + m[2][1]*py[l] + m[2][2]*pz[l] + m[2][3];
+        sw[l] = m[3][0]*px[l] + m[3][1]*py[l] + m[3][2]*pz[l] + m[3][3];
+        rw[l] = 1.0f/sw[l];
+    }
+    float sx[OPENCAD_LANES], sy[OPENCAD_LANES], sz[OPENCAD_LANES], iw[OPENCAD_LANES];
+    for (size_t l = 0; l < OPENCAD_LANES; ++l) {
+        iw[l] = sw[l] != 0.0f ? rw[l] : 0.0f;
+        sx[l] = (cx[l]*iw[l]*0.5f + 0.5f)*width;
+        sy[l] = (0.5f - cy[l]*iw[l]*0.5f)*height;
+        sz[l] = cz[l]*iw[l]*0.5f + 0.5f;
+    }
+    for (size_t l = 0; l < n; ++l) {
+        Opencad_Raster_Vertex *v = &pass->vertices[i + l];
+        v->x = sx[l];
+        v->y = sy[l];
+        v->z = sz[l];
+        v->w = sw[l];
+    }
+
+    // Attributes divided by w are affine in screen space, so the rasterizer can interpolate them like
+    // any other varying and divide by the interpolated 1/w, which makes textures perspective-correct.
+    if (pass->material->texture) {
+        for (size_t l = 0; l < n; ++l) {
+            float *varyings = pass->vertices[i + l].varyings;
+            varyings[pass->texture_varying + 0] = uvs[l].x*iw[l];
+            varyings[pass->texture_varying + 1] = uvs[l].y*iw[l];
+            varyings[pass->texture_varying + 2] = iw[l];
+        }
+    }
+
+    // For the section planes only the sign of the distance matters.
+    for (size_t k = 0; k < pass->section_count; ++k) {
+        Opencad_Vec4 plane = instance->section_model[k];
+        float d[OPENCAD_LANES];
+        for (size_t l = 0; l < OPENCAD_LANES; ++l) d[l] = (plane.x*px[l] + plane.y*py[l] + plane.z*pz[l] + plane.w)*iw[l];
+        for (size_t l = 0; l < n; ++l) pass->vertices[i + l].varyings[pass->section_varying + k] = d[l];
+    }
+
+    if (mx == NULL) return;
+
+    const float (*nm)[4] = instance->normal_matrix.m;
+    float nx[OPENCAD_LANES], ny[OPENCAD_LANES], nz[OPENCAD_LANES], length2[OPENCAD_LANES], rl[OPENCAD_LANES];
+    for (size_t l = 0; l < OPENCAD_LANES; ++l) {
+        nx[l] = nm[0][0]*mx[l] + nm[0][1]*my[l] + nm[0][2]*mz[l];
+        ny[l] = nm[1][0]*mx[l] + nm[1][1]*my[l] + nm[1][2]*mz[l];
+        nz[l] = nm[2][0]*mx[l] + nm[2][1]*my[l] + nm[2][2]*mz[l];
+        length2[l] = nx[l]*nx[l] + ny[l]*ny[l] + nz[l]*nz[l];
+        rl[l] = 1.0f/sqrtf(length2[l]);
+    }
+    float shade[OPENCAD_LANES];
+    for (size_t l = 0; l < OPENCAD_LANES; ++l) {
+        float inv = length2[l] > 0.0f ? rl[l] : 0.0f;
+        nx[l] *= inv;
+        ny[l] *= inv;
+        nz[l] *= inv;
+        shade[l] = pass->material->ambient;
+    }
+    for (size_t k = 0; k < pass->material->light_count; ++k) {
+        Opencad_Light light = pass->material->lights[k];
+        Opencad_Vec3 d = opencad_vec3_normalize(light.direction);
+        for (size_t l = 0; l < OPENCAD_LANES; ++l) {
+            float lambert = nx[l]*d.x + ny[l]*d.y + nz[l]*d.z;
+            shade[l] += (lambert > 0.0f ? lambert : 0.0f)*light.intensity;
+        }
+    }
+    for (size_t l = 0; l < n; ++l) {
+        float *varyings = pass->vertices[i + l].varyings;
+        varyings[OPENCAD_VARYING_SHADE] = shade[l];
+        varyings[OPENCAD_VARYING_NORMAL_X] = nx[l];
+        varyings[OPENCAD_VARYING_NORMAL_Y] = ny[l];
+    }
+}
+
+/**
+ * Vertex stage: loads batches of OPENCAD_LANES vertices once and projects them for every pass of the frame.
+ * The range runs over the vertices of all instances; batches stop at instance boundaries.
+ */
+static void opencad_vertex_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    Opencad_Frame *frame = ctx;
+    const Opencad_Vec3 *positions = frame->mesh->vertices;
+    const Opencad_Vec3 *normals = frame->normals;
+    const size_t vertex_count = frame->mesh->vertex_count;
+    (void) thread;
+
+    for (size_t g = begin; g < end;) {
+        size_t k = g/vertex_count, i = g%vertex_count;
+        size_t n = end - g < OPENCAD_LANES ? end - g : OPENCAD_LANES;
+        if (n > vertex_count - i) n = vertex_count - i;
+        float px[OPENCAD_LANES] = {0}, py[OPENCAD_LANES] = {0}, pz[OPENCAD_LANES] = {0};
+        float mx[OPENCAD_LANES] = {0}, my[OPENCAD_LANES] = {0}, mz[OPENCAD_LANES] = {0};
+        for (size_t l = 0; l < n; ++l) {
+            px[l] = positions[i + l].x;
+            py[l] = positions[i + l].y;
+            pz[l] = positions[i + l].z;
+        }
+        if (normals) {
+            for (size_t l = 0; l < n; ++l) {
+                mx[l] = normals[i + l].x;
+                my[l] = normals[i + l].y;
+                mz[l] = normals[i + l].z;
+            }
+        }
+
+        const Opencad_Vec2 *uvs = frame->mesh->uvs ? &frame->mesh->uvs[i] : NULL;
+        for (size_t p = 0; p < frame->pass_count; ++p) {
+            Opencad_Pass *pass = &frame->passes[p];
+            opencad_vertex_batch(pass, &pass->instances[k], g, n, uvs, px, py, pz,
+                                 normals ? mx : NULL, normals ? my : NULL, normals ? mz : NULL);
+        }
+        g += n;
+    }
+}
+
+/**
+ * Appends a triangle id to a bin.
+ * @param bin The bin.
+ * @param id The triangle id.
+ * @return True on success, false if memory ran out.
+ */
+static bool opencad_bin_push(Opencad_Bin *bin, uint32_t id)
+{
+    if (bin->count == bin->capacity) {
+        size_t capacity = bin->capacity ? bin->capacity*2 : 256;
+        uint32_t *items = realloc(bin->items, capacity*sizeof(*items));
+        if (items == NULL) return false;
+        bin->items = items;
+        bin->capacity = capacity;
+    }
+    bin->items[bin->count++] = id;
+    return true;
+}
+
+/**
+ * Records a triangle in the bins of the tiles its screen bounding box touches.
+ * @param pass The pass.
+ * @param bins The bins of the calling thread.
+ * @param v The projected vertices of the triangle.
+ * @param id The bin item: a triangle id, or a clipped piece index with OPENCAD_CLIPPED_BIT set.
+ */
+static void opencad_bin_rect(Opencad_Pass *pass, Opencad_Bin *bins, const Opencad_Raster_Vertex *v[3], uint32_t id)
+{
+    float min_x = fminf(v[0]->x, fminf(v[1]->x, v[2]->x));
+    float max_x = fmaxf(v[0]->x, fmaxf(v[1]->x, v[2]->x));
+    float min_y = fminf(v[0]->y, fminf(v[1]->y, v[2]->y));
+    float max_y = fmaxf(v[0]->y, fmaxf(v[1]->y, v[2]->y));
+    if (max_x < 0.0f || max_y < 0.0f) return;
+    if (min_x >= (float) pass->canvas.width || min_y >= (float) pass->canvas.height) return;
+
+    size_t tx0 = min_x > 0.0f ? (size_t) min_x/OPENCAD_TILE_SIZE : 0;
+    size_t ty0 = min_y > 0.0f ? (size_t) min_y/OPENCAD_TILE_SIZE : 0;
+    size_t tx1 = (size_t) max_x/OPENCAD_TILE_SIZE;
+    size_t ty1 = (size_t) max_y/OPENCAD_TILE_SIZE;
+    if (tx1 >= pass->tiles_x) tx1 = pass->tiles_x - 1;
+    if (ty1 >= pass->tiles_y) ty1 = pass->tiles_y - 1;
+    for (size_t ty = ty0; ty <= ty1; ++ty) {
+        for (size_t tx = tx0; tx <= tx1; ++tx) {
+            if (!opencad_bin_push(&bins[ty*pass->tiles_x + tx], id)) pass->failed = true;
+        }
+    }
+}
+
+/**
+ * Packs a unit normal into the 8:8:8 format of the canvas normal buffer. The top byte is set, so
+ * only pixels nothing was drawn into read as 0.
+ * @param n The normal.
+ * @return The packed normal.
+ */
+uint32_t opencad_pack_normal(Opencad_Vec3 n)
+{
+    uint32_t x = (uint32_t) lrintf((n.x*0.5f + 0.5f)*255.0f) & 0xFF;
+    uint32_t y = (uint32_t) lrintf((n.y*0.5f + 0.5f)*255.0f) & 0xFF;
+    uint32_t z = (uint32_t) lrintf((n.z*0.5f + 0.5f)*255.0f) & 0xFF;
+    return 0xFF000000 | (z << (8*2)) | (y << (8*1)) | (x << (8*0));
+}
+
+/**
+ * Stores the flat-shaded color and the packed view-space normal of a triangle, as far as the pass needs them.
+ * @param pass The pass.
+ * @param t The triangle id.
+ * @param tri The vertex indices of the triangle in the mesh.
+ * @param instance The instance of the triangle.
+ * @param area The signed screen area, positive for back faces.
+ */
+static void opencad_face_attributes(Opencad_Pass *pass, size_t t, const uint32_t *tri, size_t instance, float area)
+{
+    bool flat = pass->material->shading == OPENCAD_SHADING_FLAT;
+    if (!flat && pass->face_normals == NULL) return;
+
+    const Opencad_Mesh *mesh = pass->mesh;
+    Opencad_Vec3 n = opencad_triangle_normal(mesh->vertices[tri[0]], mesh->vertices[tri[1]], mesh->vertices[tri[2]]);
+    n = opencad_vec3_normalize(opencad_mat4_transform_point(pass->instances[instance].normal_matrix, n));
+    if (area > 0.0f) n = opencad_vec3_scale(n, -1.0f);
+    if (flat) pass->face_colors[t] = opencad_shade_color(pass->material->color, opencad_light_intensity(pass->material, n));
+    if (pass->face_normals) pass->face_normals[t] = opencad_pack_normal(n);
+}
+
+typedef struct {
+    Opencad_Vec4 clip;
+    float varyings[OPENCAD_MAX_VARYINGS];
+} Opencad_Clip_Vertex;
+
+#define OPENCAD_CLIP_PLANES 6
+#define OPENCAD_MAX_CLIP_VERTICES (3 + OPENCAD_CLIP_PLANES)
+
+/**
+ * Returns the signed distance of a clip-space point to one of the clipping planes, positive inside.
+ * Planes 0 and 1 are near and far, 2 to 5 are the guard band.
+ * @param pass The pass.
+ * @param c The point.
+ * @param plane The plane.
+ * @return The distance, scaled by w.
+ */
+static float opencad_clip_distance(const Opencad_Pass *pass, Opencad_Vec4 c, int plane)
+{
+    switch (plane) {
+    case 0:  return c.w + c.z;
+    case 1:  return c.w - c.z;
+    case 2:  return pass->guard_x*c.w + c.x;
+    case 3:  return pass->guard_x*c.w - c.x;
+    case 4:  return pass->guard_y*c.w + c.y;
+    default: return pass->guard_y*c.w - c.y;
+    }
+}
+
+/**
+ * Clips a convex polygon in homogeneous clip space (Sutherland-Hodgman). Varyings are interpolated
+ * in clip space, which is perspective-correct.
+ * @param pass The pass.
+ * @param polygon The polygon, room for OPENCAD_MAX_CLIP_VERTICES vertices. Receives the result.
+ * @param count The number of vertices.
+ * @return The number of vertices left, 0 if the polygon was clipped away.
+ */
+static size_t opencad_clip_polygon(const Opencad_Pass *pass, Opencad_Clip_Vertex *polygon, size_t count)
+{
+    Opencad_Clip_Vertex scratch[OPENCAD_MAX_CLIP_VERTICES];
+    for (int plane = 0; plane < OPENCAD_CLIP_PLANES; ++plane) {
+        size_t out = 0;
+        for (size_t i = 0; i < count; ++i) {
+            const Opencad_Clip_Vertex *a = &polygon[i], *b = &polygon[(i + 1)%count];
+            float da = opencad_clip_distance(pass, a->clip, plane);
+            float db = opencad_clip_distance(pass, b->clip, plane);
+            if (da >= 0.0f) scratch[out++] = *a;
+            if ((da >= 0.0f) != (db >= 0.0f)) {
+                float t = da/(da - db);
+                Opencad_Clip_Vertex *v = &scratch[out++];
+                v->clip.x = a->clip.x + (b->clip.x - a->clip.x)*t;
+                v->clip.y = a->clip.y + (b->clip.y - a->clip.y)*t;
+                v->clip.z = a->clip.z + (b->clip.z - a->clip.z)*t;
+                v->clip.w = a->clip.w + (b->clip.w - a->clip.w)*t;
+                for (size_t k = 0; k < pass->varying_count; ++k) {
+                    v->varyings[k] = a->varyings[k] + (b->varyings[k] - a->varyings[k])*t;
+                }
+            }
+        }
+        count = out;
+        if (count < 3) return 0;
+        memcpy(polygon, scratch, count*sizeof(*polygon));
+    }
+    return count;
+}
+
+/**
+ * Slow path of the binning stage for triangles reaching behind the camera or outside the guard band:
+ * clips the triangle in homogeneous space and bins the pieces of its fan.
+ * @param pass The pass.
+ * @param thread The index of the calling worker thread.
+ * @param t The triangle id.
+ * @param tri The vertex indices of the triangle in the mesh.
+ * @param instance The instance of the triangle.
+ */
+static void opencad_bin_clipped(Opencad_Pass *pass, size_t thread, size_t t, const uint32_t *tri, size_t instance)
+{
+    const Opencad_Instance *in = &pass->instances[instance];
+    const Opencad_Raster_Vertex *vertices = &pass->vertices[instance*pass->mesh->vertex_count];
+    Opencad_Clip_Vertex polygon[OPENCAD_MAX_CLIP_VERTICES];
+    unsigned outside_all = 0x3F;
+    for (int k = 0; k < 3; ++k) {
+        Opencad_Vec3 p = pass->mesh->vertices[tri[k]];
+        Opencad_Vec4 c = opencad_mat4_apply(in->mvp, (Opencad_Vec4) {p.x, p.y, p.z, 1.0f});
+        polygon[k].clip = c;
+        memcpy(polygon[k].varyings, vertices[tri[k]].varyings, sizeof(polygon[k].varyings));
+        // Varyings divided by w are clipped undivided and divided again after projection.
+        if (pass->material->texture) {
+            Opencad_Vec2 uv = pass->mesh->uvs[tri[k]];
+            polygon[k].varyings[pass->texture_varying + 0] = uv.x;
+            polygon[k].varyings[pass->texture_varying + 1] = uv.y;
+            polygon[k].varyings[pass->texture_varying + 2] = 1.0f;
+        }
+        for (size_t s = 0; s < pass->section_count; ++s) {
+            Opencad_Vec4 plane = in->section_model[s];
+            polygon[k].varyings[pass->section_varying + s] = plane.x*p.x + plane.y*p.y + plane.z*p.z + plane.w;
+        }
+
+        // Outcodes against the view volume itself: a triangle entirely outside one plane is gone.
+        unsigned outside = (c.w + c.z < 0.0f) | (c.w - c.z < 0.0f) << 1
+                         | (c.w + c.x < 0.0f) << 2 | (c.w - c.x < 0.0f) << 3
+                         | (c.w + c.y < 0.0f) << 4 | (c.w - c.y < 0.0f) << 5;
+        outside_all &= outside;
+    }
+    if (outside_all) return;
+
+    size_t count = opencad_clip_polygon(pass, polygon, 3);
+    if (count == 0) return;
+
+    float width = (float) pass->canvas.width;
+    float height = (float) pass->canvas.height;
+    Opencad_Raster_Vertex projected[OPENCAD_MAX_CLIP_VERTICES];
+    for (size_t i = 0; i < count; ++i) {
+        Opencad_Vec4 c = polygon[i].clip;
+        float inv = 1.0f/c.w;
+        projected[i].x = (c.x*inv*0.5f + 0.5f)*width;
+        projected[i].y = (0.5f - c.y*inv*0.5f)*height;
+        projected[i].z = c.z*inv*0.5f + 0.5f;
+        projected[i].w = c.w;
+        memcpy(projected[i].varyings, polygon[i].varyings, sizeof(projected[i].varyings));
+        for (size_t k = pass->texture_varying; k < pass->varying_count; ++k) projected[i].varyings[k] *= inv;
+    }
+
+    // The clipped polygon is planar and convex, so the whole fan shares one orientation.
+    float area = 0.0f;
+    for (size_t i = 1; i + 1 < count && area == 0.0f; ++i) {
+        const Opencad_Raster_Vertex *a = &projected[0], *b = &projected[i], *c = &projected[i + 1];
+        area = (b->x - a->x)*(c->y - a->y) - (b->y - a->y)*(c->x - a->x);
+    }
+    if (area == 0.0f || (area > 0.0f && !pass->material->double_sided && pass->section_count == 0)) return;
+    opencad_face_attributes(pass, t, tri, instance, area);
+
+    Opencad_Clipped_List *list = &pass->clipped[thread];
+    Opencad_Bin *bins = pass->bins + thread*pass->tiles_x*pass->tiles_y;
+    for (size_t i = 1; i + 1 < count; ++i) {
+        if (list->count == list->capacity) {
+            size_t capacity = list->capacity ? list->capacity*2 : 64;
+            Opencad_Clipped *items = capacity <= OPENCAD_CLIPPED_BIT ? realloc(list->items, capacity*sizeof(*items)) : NULL;
+            if (items == NULL) {
+                pass->failed = true;
+                return;
+            }
+            list->items = items;
+            list->capacity = capacity;
+        }
+        Opencad_Clipped *piece = &list->items[list->count];
+        piece->v[0] = projected[0];
+        piece->v[1] = projected[i];
+        piece->v[2] = projected[i + 1];
+        piece->face = (uint32_t) t;
+        const Opencad_Raster_Vertex *v[3] = {&piece->v[0], &piece->v[1], &piece->v[2]};
+        opencad_bin_rect(pass, bins, v, OPENCAD_CLIPPED_BIT | (uint32_t) list->count);
+        list->count += 1;
+    }
+}
+
+/**
+ * Binning stage for one pass: culls a triangle, computes its flat color and records it in the
+ * bins of the tiles its bounding box touches. Each thread writes only its own bins.
+ * Only triangles with a vertex behind the camera or outside the guard band are clipped; the
+ * rasterizer handles everything else, so the common case costs no clipping at all.
+ * @param pass The pass.
+ * @param thread The index of the calling worker thread.
+ * @param t The triangle id.
+ * @param tri The vertex indices of the triangle in the mesh.
+ * @param instance The instance of the triangle.
+ */
+static void opencad_bin_triangle(Opencad_Pass *pass, size_t thread, size_t t, const uint32_t *tri, size_t instance)
+{
+    const Opencad_Raster_Vertex *vertices = &pass->vertices[instance*pass->mesh->vertex_count];
+    const Opencad_Raster_Vertex *v[3] = {
+        &vertices[tri[0]],
+        &vertices[tri[1]],
+        &vertices[tri[2]],
+    };
+    float width = (float) pass->canvas.width, height = (float) pass->canvas.height;
+    for (int k = 0; k < 3; ++k) {
+        bool inside = v[k]->w > 0.0f
+            && v[k]->x > -OPENCAD_GUARD_BAND && v[k]->x < width + OPENCAD_GUARD_BAND
+            && v[k]->y > -OPENCAD_GUARD_BAND && v[k]->y < height + OPENCAD_GUARD_BAND;
+        if (!inside) {
+            opencad_bin_clipped(pass, thread, t, tri, instance);
+            return;
+        }
+    }
+
+    float area = (v[1]->x - v[0]->x)*(v[2]->y - v[0]->y) - (v[1]->y - v[0]->y)*(v[2]->x - v[0]->x);
+    if (area == 0.0f || (area > 0.0f && !pass->material->double_sided && pass->section_count == 0)) return;
+    opencad_face_attributes(pass, t, tri, instance, area);
+    opencad_bin_rect(pass, pass->bins + thread*pass->tiles_x*pass->tiles_y, v, (uint32_t) t);
+}
+
+/**
+ * Binning stage: loads every triangle once and bins it for every pass of the frame. The range runs
+ * over the triangles of all instances.
+ */
+static void opencad_bin_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    Opencad_Frame *frame = ctx;
+    const size_t triangle_count = frame->mesh->triangle_count;
+    for (size_t t = begin; t < end; ++t) {
+        size_t instance = t/triangle_count;
+        const uint32_t *tri = &frame->mesh->indices[(t%triangle_count)*3];
+        for (size_t p = 0; p < frame->pass_count; ++p) {
+            opencad_bin_triangle(&frame->passes[p], thread, t, tri, instance);
+        }
+    }
+}
+
+/**
+ * Samples one mipmap level of a texture with bilinear filtering.
+ * @param texture The texture.
+ * @param level The mipmap level.
+ * @param u The horizontal texture coordinate.
+ * @param v The vertical texture coordinate.
+ * @return The filtered color.
+ */
+static uint32_t opencad_texture_sample(const Opencad_Texture *texture, size_t level, float u, float v)
+{
+    size_t width = texture->widths[level], height = texture->heights[level];
+    const uint32_t *texels = texture->texels + texture->offsets[level];
+    if (texture->clamp) {
+        u = u < 0.0f ? 0.0f : u > 1.0f ? 1.0f : u;
+        v = v < 0.0f ? 0.0f : v > 1.0f ? 1.0f : v;
+    } else {
+        u -= floorf(u);
+        v -= floorf(v);
+    }
+    float x = u*(float) width - 0.5f;
+    float y = v*(float) height - 0.5f;
+    float fx = floorf(x), fy = floorf(y);
+    float tx = x - fx, ty = y - fy;
+
+    // Neighbors past the edge repeat the opposite edge or the edge itself.
+    long x0 = (long) fx, y0 = (long) fy, x1 = x0 + 1, y1 = y0 + 1;
+    long w = (long) width, h = (long) height;
+    if (texture->clamp) {
+        if (x0 < 0) x0 = 0;
+        if (y0 < 0) y0 = 0;
+        if (x1 > w - 1) x1 = w - 1;
+        if (y1 > h - 1) y1 = h - 1;
+    } else {
+        if (x0 < 0) x0 += w;
+        if (y0 < 0) y0 += h;
+        if (x1 > w - 1) x1 -= w;
+        if (y1 > h - 1) y1 -= h;
+    }
+    uint32_t c00 = texels[y0*w + x0], c10 = texels[y0*w + x1];
+    uint32_t c01 = texels[y1*w + x0], c11 = texels[y1*w + x1];
+
+    uint32_t result = 0;
+    for (int c = 0; c < 4; ++c) {
+        float a = (float) ((c00 >> (8*c)) & 0xFF), b = (float) ((c10 >> (8*c)) & 0xFF);
+        float d = (float) ((c01 >> (8*c)) & 0xFF), e = (float) ((c11 >> (8*c)) & 0xFF);
+        float top = a + (b - a)*tx, bottom = d + (e - d)*tx;
+        result |= (uint32_t) (top + (bottom - top)*ty + 0.5f) << (8*c);
+    }
+    return result;
+}
+
+/**
+ * Multiplies the RGB channels of two 0xAABBGGRR colors.
+ * @param color The color.
+ * @param tint The color to multiply with.
+ * @return The product, with the alpha of color.
+ */
+static uint32_t opencad_modulate_color(uint32_t color, uint32_t tint)
+{
+    uint32_t result = color & 0xFF000000;
+    for (int c = 0; c < 3; ++c) {
+        uint32_t a = (color >> (8*c)) & 0xFF, b = (tint >> (8*c)) & 0xFF;
+        result |= ((a*b + 127)/255) << (8*c);
+    }
+    return result;
+}
+
+/**
+ * Rasterizes one triangle into a rectangle of the canvas.
+ * Coverage uses fixed-point edge functions with the top-left rule. The triangle's bounding box is
+ * walked in 8x8 blocks; blocks outside any edge are rejected at once, the rest are processed one
+ * row of OPENCAD_LANES pixels at a time.
+ * Textures are sampled bilinearly from the mipmap level whose texels best match the pixel footprint,
+ * found from the screen-space derivatives of the perspective-correct texture coordinates.
+ * With section planes, fragments on the cut-away side are discarded, and every fragment in the view
+ * volume flips the stencil bit of each plane it is on the kept side of; back faces of single-sided
+ * materials are walked for that alone.
+ * @param pass The pass being drawn.
+ * @param v The three vertices.
+ * @param face_color The color used by unlit and flat shading.
+ * @param face_normal The packed view-space normal, written to the normal buffer if the canvas has one.
+ * @param x0 The left edge of the rectangle.
+ * @param y0 The top edge of the rectangle.
+ * @param x1 The right edge of the rectangle (exclusive).
+ * @param y1 The bottom edge of the rectangle (exclusive).
+ */
+static void opencad_raster_triangle(const Opencad_Pass *pass, const Opencad_Raster_Vertex *v[3], uint32_t face_color,
+                                    uint32_t face_normal, int x0, int y0, int x1, int y1)
+{
+    int64_t px[3], py[3];
+    for (int k = 0; k < 3; ++k) {
+        px[k] = (int64_t) lrintf(v[k]->x*OPENCAD_SUBPIXEL);
+        py[k] = (int64_t) lrintf(v[k]->y*OPENCAD_SUBPIXEL);
+    }
+    // Screen y points down, so counter-clockwise front faces have negative area. Back faces are
+    // culled, and front faces are flipped so every edge function is positive inside.
+    int64_t area = (px[1] - px[0])*(py[2] - py[0]) - (py[1] - py[0])*(px[2] - px[0]);
+    if (area == 0) return;
+    bool parity_only = area > 0 && !pass->material->double_sided;
+    if (parity_only && pass->section_count == 0) return;
+    if (area < 0) {
+        OPENCAD_SWAP(int64_t, px[1], px[2]);
+        OPENCAD_SWAP(int64_t, py[1], py[2]);
+        const Opencad_Raster_Vertex *t = v[1];
+        v[1] = v[2];
+        v[2] = t;
+        area = -area;
+    }
+
+    int64_t min_x = px[0], max_x = px[0], min_y = py[0], max_y = py[0];
+    for (int k = 1; k < 3; ++k) {
+        if (px[k] < min_x) min_x = px[k];
+        if (px[k] > max_x) max_x = px[k];
+        if (py[k] < min_y) min_y = py[k];
+        if (py[k] > max_y) max_y = py[k];
+    }
+    int bx0 = min_x > 0 ? (int) (min_x/OPENCAD_SUBPIXEL) : 0;
+    int by0 = min_y > 0 ? (int) (min_y/OPENCAD_SUBPIXEL) : 0;
+    int bx1 = max_x > 0 ? (int) (max_x/OPENCAD_SUBPIXEL) + 1 : 0;
+    int by1 = max_y > 0 ? (int) (max_y/OPENCAD_SUBPIXEL) + 1 : 0;
+    if (bx0 < x0) bx0 = x0;
+    if (by0 < y0) by0 = y0;
+    if (bx1 > x1) bx1 = x1;
+    if (by1 > y1) by1 = y1;
+    if (bx0 >= bx1 || by0 >= by1) return;
+    bx0 &= ~(OPENCAD_LANES - 1);
+    by0 &= ~(OPENCAD_LANES - 1);
+
+    // Edge k is opposite to vertex k, so its function is proportional to the barycentric weight of vertex k.
+    int64_t step_x[3], step_y[3], bias[3], edge_origin[3];
+    for (int k = 0; k < 3; ++k) {
+        int i = (k + 1)%3, j = (k + 2)%3;
+        int64_t dx = px[j] - px[i];
+        int64_t dy = py[j] - py[i];
+        bool top_left = dy < 0 || (dy == 0 && dx > 0);
+        bias[k] = top_left ? 0 : -1;
+        step_x[k] = -dy*OPENCAD_SUBPIXEL;
+        step_y[k] = dx*OPENCAD_SUBPIXEL;
+        int64_t ox = (int64_t) bx0*OPENCAD_SUBPIXEL + OPENCAD_SUBPIXEL/2;
+        int64_t oy = (int64_t) by0*OPENCAD_SUBPIXEL + OPENCAD_SUBPIXEL/2;
+        edge_origin[k] = dx*(oy - py[i]) - dy*(ox - px[i]) + bias[k];
+    }
+
+    // Plane equations of depth and varyings in pixel units, relative to the block grid origin.
+    float inv_area = 1.0f/(float) area;
+    float w0 = (float) (edge_origin[0] - bias[0])*inv_area;
+    float w1 = (float) (edge_origin[1] - bias[1])*inv_area;
+    float w2 = (float) (edge_origin[2] - bias[2])*inv_area;
+    float gx[3], gy[3];
+    for (int k = 0; k < 3; ++k) {
+        gx[k] = (float) step_x[k]*inv_area;
+        gy[k] = (float) step_y[k]*inv_area;
+    }
+    size_t count = 1 + pass->varying_count;
+    float plane_o[1 + OPENCAD_MAX_VARYINGS], plane_x[1 + OPENCAD_MAX_VARYINGS], plane_y[1 + OPENCAD_MAX_VARYINGS];
+    for (size_t a = 0; a < count; ++a) {
+        float va = a == 0 ? v[0]->z : v[0]->varyings[a - 1];
+        float vb = a == 0 ? v[1]->z : v[1]->varyings[a - 1];
+        float vc = a == 0 ? v[2]->z : v[2]->varyings[a - 1];
+        plane_o[a] = w0*va + w1*vb + w2*vc;
+        plane_x[a] = gx[0]*va + gx[1]*vb + gx[2]*vc;
+        plane_y[a] = gy[0]*va + gy[1]*vb + gy[2]*vc;
+    }
+
+    Opencad_Canvas canvas = pass->canvas;
+    Opencad_Shading shading = pass->material->shading;
+    float alpha = 1.0f - pass->material->transparency;
+    uint32_t color = pass->material->color;
+    float color_r = (float) ((color >> (8*0)) & 0xFF);
+    float color_g = (float) ((color >> (8*1)) & 0xFF);
+    float color_b = (float) ((color >> (8*2)) & 0xFF);
+
+    for (int by = by0; by < by1; by += OPENCAD_LANES) {
+        for (int bx = bx0; bx < bx1; bx += OPENCAD_LANES) {
+            int64_t ddx = bx - bx0, ddy = by - by0;
+            int64_t e[3];
+            bool rejected = false;
+            for (int k = 0; k < 3; ++k) {
+                e[k] = edge_origin[k] + ddx*step_x[k] + ddy*step_y[k];
+                int64_t best = e[k];
+                if (step_x[k] > 0) best += step_x[k]*(OPENCAD_LANES - 1);
+                if (step_y[k] > 0) best += step_y[k]*(OPENCAD_LANES - 1);
+                if (best < 0) rejected = true;
+            }
+            if (rejected) continue;
+
+            // Within a block an edge function moves by at most 14*OPENCAD_SUBPIXEL times the
+            // guard-banded extent, well inside 2^30, so the lanes step in int32 from the block corner.
+            // Corners far inside an edge are clamped; they stay positive across the block.
+            int32_t block_e[3], lane_step[3], row_step[3];
+            for (int k = 0; k < 3; ++k) {
+                block_e[k] = (int32_t) (e[k] < (1 << 30) ? e[k] : (1 << 30));
+                lane_step[k] = (int32_t) step_x[k];
+                row_step[k] = (int32_t) step_y[k];
+            }
+
+            int row_end = by + OPENCAD_LANES < by1 ? by + OPENCAD_LANES : by1;
+            int lanes = bx1 - bx < OPENCAD_LANES ? bx1 - bx : OPENCAD_LANES;
+            int first_row = by < y0 ? y0 : by;
+            int first_lane = bx < x0 ? x0 - bx : 0;
+            for (int y = first_row; y < row_end; ++y) {
+                int64_t row = y - by;
+                float fy = (float) (y - by0);
+                float fx = (float) (bx - bx0);
+                size_t offset = (size_t) y*canvas.stride + (size_t) bx;
+
+                int32_t row_e[3];
+                for (int k = 0; k < 3; ++k) row_e[k] = block_e[k] + (int32_t) row*row_step[k];
+                // Lane masks as int32 like the edge functions, so the loop needs no narrowing.
+                int32_t covered[OPENCAD_LANES], mask[OPENCAD_LANES];
+                float z[OPENCAD_LANES];
+                for (int l = 0; l < OPENCAD_LANES; ++l) {
+                    int32_t e0 = row_e[0] + l*lane_step[0];
+                    int32_t e1 = row_e[1] + l*lane_step[1];
+                    int32_t e2 = row_e[2] + l*lane_step[2];
+                    covered[l] = (e0 | e1 | e2) >= 0;
+                    mask[l] = covered[l];
+                }
+                for (int l = 0; l < OPENCAD_LANES; ++l) z[l] = plane_o[0] + (fx + (float) l)*plane_x[0] + fy*plane_y[0];
+
+                if (pass->section_count > 0) {
+                    uint8_t flip[OPENCAD_LANES] = {0};
+                    for (size_t k = 0; k < pass->section_count; ++k) {
+                        const size_t a = 1 + pass->section_varying + k;
+                        for (int l = 0; l < OPENCAD_LANES; ++l) {
+                            float d = plane_o[a] + (fx + (float) l)*plane_x[a] + fy*plane_y[a];
+                            if (d >= 0.0f) flip[l] |= (uint8_t) (1u << k);
+                            else mask[l] = 0;
+                        }
+                    }
+                    for (int l = first_lane; l < lanes; ++l) {
+                        if (covered[l] && z[l] >= 0.0f && z[l] <= 1.0f) canvas.stencil[offset + l] ^= flip[l];
+                    }
+                    if (parity_only) continue;
+                }
+
+                uint32_t out[OPENCAD_LANES];
+                if (shading == OPENCAD_SHADING_GOURAUD) {
+                    const int s = 1 + OPENCAD_VARYING_SHADE;
+                    for (int l = 0; l < OPENCAD_LANES; ++l) {
+                        float shade = plane_o[s] + (fx + (float) l)*plane_x[s] + fy*plane_y[s];
+                        float r = color_r*shade, g = color_g*shade, b = color_b*shade;
+                        uint32_t ri = r < 255.0f ? (uint32_t) r : 255;
+                        uint32_t gi = g < 255.0f ? (uint32_t) g : 255;
+                        uint32_t bi = b < 255.0f ? (uint32_t) b : 255;
+                        out[l] = (color & 0xFF000000) | (bi << (8*2)) | (gi << (8*1)) | (ri << (8*0));
+                    }
+                } else if (shading == OPENCAD_SHADING_MATCAP) {
+                    const int sx = 1 + OPENCAD_VARYING_NORMAL_X, sy = 1 + OPENCAD_VARYING_NORMAL_Y;
+                    const float scale = 0.5f*(OPENCAD_MATCAP_SIZE - 1);
+                    for (int l = 0; l < OPENCAD_LANES; ++l) {
+                        float nx = plane_o[sx] + (fx + (float) l)*plane_x[sx] + fy*plane_y[sx];
+                        float ny = plane_o[sy] + (fx + (float) l)*plane_x[sy] + fy*plane_y[sy];
+                        float u = (nx + 1.0f)*scale + 0.5f;
+                        float v = (1.0f - ny)*scale + 0.5f;
+                        int ui = u < 0.0f ? 0 : u > OPENCAD_MATCAP_SIZE - 1 ? OPENCAD_MATCAP_SIZE - 1 : (int) u;
+                        int vi = v < 0.0f ? 0 : v > OPENCAD_MATCAP_SIZE - 1 ? OPENCAD_MATCAP_SIZE - 1 : (int) v;
+                        out[l] = pass->matcap[vi*OPENCAD_MATCAP_SIZE + ui];
+                    }
+                } else {
+                    for (int l = 0; l < OPENCAD_LANES; ++l) out[l] = face_color;
+                }
+
+                const Opencad_Texture *texture = pass->material->texture;
+                if (texture) {
+                    // u = a/q and v = b/q with a, b and q affine in screen space, so their derivatives are exact.
+                    const size_t a = 1 + pass->texture_varying, b = a + 1, q = a + 2;
+                    float scale_u = (float) texture->widths[0], scale_v = (float) texture->heights[0];
+                    for (int l = 0; l < OPENCAD_LANES; ++l) {
+                        float lane_x = fx + (float) l;
+                        float ua = plane_o[a] + lane_x*plane_x[a] + fy*plane_y[a];
+                        float vb = plane_o[b] + lane_x*plane_x[b] + fy*plane_y[b];
+                        float qq = plane_o[q] + lane_x*plane_x[q] + fy*plane_y[q];
+                        float inv = qq != 0.0f ? 1.0f/qq : 0.0f;
+                        float u = ua*inv, v = vb*inv;
+                        float dudx = (plane_x[a] - u*plane_x[q])*inv*scale_u;
+                        float dvdx = (plane_x[b] - v*plane_x[q])*inv*scale_v;
+                        float dudy = (plane_y[a] - u*plane_y[q])*inv*scale_u;
+                        float dvdy = (plane_y[b] - v*plane_y[q])*inv*scale_v;
+                        float footprint = fmaxf(dudx*dudx + dvdx*dvdx, dudy*dudy + dvdy*dvdy);
+                        float lod = 0.5f*log2f(footprint) + 0.5f;
+                        size_t level = !(lod > 0.0f) ? 0 : lod >= (float) (texture->level_count - 1) ? texture->level_count - 1 : (size_t) lod;
+                        if (mask[l]) out[l] = opencad_modulate_color(out[l], opencad_texture_sample(texture, level, u, v));
+                    }
+                }
+
+                if (alpha < 1.0f) {
+                    // Weighted blended OIT (McGuire and Bavoil): nearer fragments weigh more, nothing is sorted.
+                    for (int l = first_lane; l < lanes; ++l) {
+                        if (mask[l] && z[l] >= 0.0f && z[l] < canvas.depth[offset + l]) {
+                            float d = 1.0f - z[l];
+                            float weight = alpha*fmaxf(1e-2f, 3e3f*d*d*d);
+                            float *accum = &canvas.accum[(offset + l)*4];
+                            accum[0] += (float) ((out[l] >> (8*0)) & 0xFF)*weight;
+                            accum[1] += (float) ((out[l] >> (8*1)) & 0xFF)*weight;
+                            accum[2] += (float) ((out[l] >> (8*2)) & 0xFF)*weight;
+                            accum[3] += weight;
+                            canvas.revealage[offset + l] *= 1.0f - alpha;
+                        }
+                    }
+                    continue;
+                }
+                for (int l = first_lane; l < lanes; ++l) {
+                    if (mask[l] && z[l] >= 0.0f && z[l] < canvas.depth[offset + l]) {
+                        canvas.depth[offset + l] = z[l];
+                        canvas.pixels[offset + l] = out[l];
+                        if (canvas.normals) canvas.normals[offset + l] = face_normal;
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Fills the section caps of a rectangle of the canvas and clears its stencil buffer. A pixel whose
+ * stencil bit for a plane is odd saw the plane's point on its ray from inside the mesh; the nearest
+ * such point that the other planes keep and the depth test passes becomes cap.
+ * @param pass The pass being drawn.
+ * @param x0 The left edge of the rectangle.
+ * @param y0 The top edge of the rectangle.
+ * @param x1 The right edge of the rectangle (exclusive).
+ * @param y1 The bottom edge of the rectangle (exclusive).
+ */
+static void opencad_raster_caps(const Opencad_Pass *pass, int x0, int y0, int x1, int y1)
+{
+    Opencad_Canvas canvas = pass->canvas;
+    const Opencad_Section *section = pass->material->section;
+    for (int y = y0; y < y1; ++y) {
+        float ndc_y = 1.0f - ((float) y + 0.5f)/(float) canvas.height*2.0f;
+        for (int x = x0; x < x1; ++x) {
+            size_t index = (size_t) y*canvas.stride + (size_t) x;
+            uint8_t bits = canvas.stencil[index];
+            if (bits == 0) continue;
+            canvas.stencil[index] = 0;
+
+            float ndc_x = ((float) x + 0.5f)/(float) canvas.width*2.0f - 1.0f;
+            float nearest = canvas.depth[index];
+            size_t cap = OPENCAD_MAX_SECTION_PLANES;
+            for (size_t k = 0; k < pass->section_count; ++k) {
+                Opencad_Vec4 plane = pass->section_ndc[k];
+                if (!(bits & (1u << k)) || plane.z == 0.0f) continue;
+                float ndc_z = -(plane.x*ndc_x + plane.y*ndc_y + plane.w)/plane.z;
+                float z = ndc_z*0.5f + 0.5f;
+                if (z < 0.0f || z >= nearest) continue;
+
+                bool kept = true;
+                for (size_t j = 0; j < pass->section_count && kept; ++j) {
+                    Opencad_Vec4 other = pass->section_ndc[j];
+                    if (j != k) kept = other.x*ndc_x + other.y*ndc_y + other.z*ndc_z + other.w >= 0.0f;
+                }
+                if (!kept) continue;
+                nearest = z;
+                cap = k;
+            }
+            if (cap == OPENCAD_MAX_SECTION_PLANES) continue;
+
+            bool hatch = section->hatch_spacing > 0 && (size_t) (x + y)%section->hatch_spacing == 0;
+            canvas.depth[index] = nearest;
+            canvas.pixels[index] = hatch ? section->hatch_color : pass->cap_colors[cap];
+            if (canvas.normals) canvas.normals[index] = pass->cap_normals[cap];
+        }
+    }
+}
+
+/**
+ * Raster stage: draws every binned triangle of one tile. Tiles of all passes are numbered consecutively.
+ */
+static void opencad_raster_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    Opencad_Frame *frame = ctx;
+    size_t threads = opencad_thread_count();
+    (void) thread;
+
+    for (size_t index = begin; index < end; ++index) {
+        size_t p = 0;
+        while (index >= frame->tile_offsets[p + 1]) ++p;
+        const Opencad_Pass *pass = &frame->passes[p];
+        size_t tile = index - frame->tile_offsets[p];
+        size_t tile_count = pass->tiles_x*pass->tiles_y;
+
+        int x0 = (int) ((tile%pass->tiles_x)*OPENCAD_TILE_SIZE);
+        int y0 = (int) ((tile/pass->tiles_x)*OPENCAD_TILE_SIZE);
+        int x1 = x0 + OPENCAD_TILE_SIZE < (int) pass->canvas.width ? x0 + OPENCAD_TILE_SIZE : (int) pass->canvas.width;
+        int y1 = y0 + OPENCAD_TILE_SIZE < (int) pass->canvas.height ? y0 + OPENCAD_TILE_SIZE : (int) pass->canvas.height;
+
+        for (size_t t = 0; t < threads; ++t) {
+            const Opencad_Bin *bin = &pass->bins[t*tile_count + tile];
+            for (size_t i = 0; i < bin->count; ++i) {
+                uint32_t id = bin->items[i];
+                const Opencad_Raster_Vertex *v[3];
+                if (id & OPENCAD_CLIPPED_BIT) {
+                    const Opencad_Clipped *piece = &pass->clipped[t].items[id & ~OPENCAD_CLIPPED_BIT];
+                    for (int k = 0; k < 3; ++k) v[k] = &piece->v[k];
+                    id = piece->face;
+                } else {
+                    size_t instance = id/pass->mesh->triangle_count;
+                    const uint32_t *tri = &pass->mesh->indices[(id%pass->mesh->triangle_count)*3];
+                    const Opencad_Raster_Vertex *vertices = &pass->vertices[instance*pass->mesh->vertex_count];
+                    for (int k = 0; k < 3; ++k) v[k] = &vertices[tri[k]];
+                }
+                uint32_t face_color = pass->material->shading == OPENCAD_SHADING_FLAT
+                    ? pass->face_colors[id]
+                    : pass->material->color;
+                uint32_t face_normal = pass->face_normals ? pass->face_normals[id] : 0;
+                opencad_raster_triangle(pass, v, face_color, face_normal, x0, y0, x1, y1);
+            }
+        }
+        if (pass->section_count > 0) opencad_raster_caps(pass, x0, y0, x1, y1);
+    }
+}
+
+/**
+ * Releases everything a frame allocated.
+ * @param frame The frame.
+ */
+static void opencad_frame_free(Opencad_Frame *frame)
+{
+    size_t threads = opencad_thread_count();
+    for (size_t p = 0; p < frame->pass_count; ++p) {
+        Opencad_Pass *pass = &frame->passes[p];
+        if (pass->bins) {
+            for (size_t i = 0; i < threads*pass->tiles_x*pass->tiles_y; ++i) free(pass->bins[i].items);
+        }
+        free(pass->bins);
+        if (pass->clipped) {
+            for (size_t i = 0; i < threads; ++i) free(pass->clipped[i].items);
+        }
+        free(pass->clipped);
+        free(pass->vertices);
+        free(pass->face_colors);
+        free(pass->face_normals);
+        free(pass->instances);
+    }
+    free(frame->tinted_matcap);
+    free(frame->owned_normals);
+}
+
+/**
+ * Draws copies of a mesh into several canvases, one camera each, in a single pass over the vertex and index data.
+ * @param canvases The canvases to draw into.
+ * @param cameras The camera of every canvas.
+ * @param count The number of canvases, at most OPENCAD_MAX_VIEWS.
+ * @param mesh The mesh to draw.
+ * @param models The model-to-world transform of every copy.
+ * @param instance_count The number of copies.
+ * @param material The material.
+ * @return An error code indicating the result of the operation.
+ */
+static Errno opencad_render_frame(const Opencad_Canvas *canvases, const Opencad_Camera *cameras, size_t count,
+                                  const Opencad_Mesh *mesh, const Opencad_Mat4 *models, size_t instance_count,
+                                  const Opencad_Material *material)
+{
+    int result = 0;
+    size_t threads = opencad_thread_count();
+    Opencad_Pass passes[OPENCAD_MAX_VIEWS] = {0};
+    size_t tile_offsets[OPENCAD_MAX_VIEWS + 1] = {0};
+    Opencad_Frame frame = {
+        .mesh = mesh,
+        .normals = mesh->normals,
+        .material = material,
+        .passes = passes,
+        .tile_offsets = tile_offsets,
+    };
+
+    {
+        if (count > OPENCAD_MAX_VIEWS) return_defer(EINVAL);
+        const Opencad_Section *section = material->section;
+        size_t section_count = section ? section->plane_count : 0;
+        if (section_count > OPENCAD_MAX_SECTION_PLANES) return_defer(EINVAL);
+        if (material->texture && (mesh->uvs == NULL || material->texture->level_count == 0)) return_defer(EINVAL);
+        for (size_t p = 0; p < count && section_count > 0; ++p) {
+            if (canvases[p].stencil == NULL) return_defer(EINVAL);
+        }
+        if (material->transparency > 0.0f) {
+            for (size_t p = 0; p < count; ++p) {
+                if (canvases[p].accum == NULL || canvases[p].revealage == NULL) return_defer(EINVAL);
+            }
+        }
+        if (mesh->triangle_count == 0 || instance_count == 0) return_defer(0);
+        if (mesh->triangle_count >= OPENCAD_CLIPPED_BIT/instance_count) return_defer(EOVERFLOW);
+        size_t vertex_total = mesh->vertex_count*instance_count;
+        size_t triangle_total = mesh->triangle_count*instance_count;
+
+        bool smooth = material->shading == OPENCAD_SHADING_GOURAUD || material->shading == OPENCAD_SHADING_MATCAP;
+        if (!smooth) frame.normals = NULL;
+        if (smooth && frame.normals == NULL) {
+            Opencad_Mesh normals_mesh = *mesh;
+            normals_mesh.normals = NULL;
+            Errno err = opencad_mesh_compute_normals(&normals_mesh);
+            if (err) return_defer(err);
+            frame.owned_normals = normals_mesh.normals;
+            frame.normals = frame.owned_normals;
+        }
+
+        const uint32_t *matcap = NULL;
+        if (material->shading == OPENCAD_SHADING_MATCAP) {
+            matcap = opencad_matcap_texture(material->matcap);
+            if ((material->color | 0xFF000000) != 0xFFFFFFFF) {
+                frame.tinted_matcap = malloc(OPENCAD_MATCAP_SIZE*OPENCAD_MATCAP_SIZE*sizeof(*frame.tinted_matcap));
+                if (frame.tinted_matcap == NULL) return_defer(ENOMEM);
+                opencad_matcap_tint(frame.tinted_matcap, matcap, material->color);
+                matcap = frame.tinted_matcap;
+            }
+        }
+
+        for (size_t p = 0; p < count; ++p) {
+            Opencad_Pass *pass = &passes[p];
+            frame.pass_count = p + 1;
+            pass->canvas = canvases[p];
+            pass->mesh = mesh;
+            pass->normals = frame.normals;
+            pass->material = material;
+            pass->matcap = matcap;
+            pass->tiles_x = (pass->canvas.width + OPENCAD_TILE_SIZE - 1)/OPENCAD_TILE_SIZE;
+            pass->tiles_y = (pass->canvas.height + OPENCAD_TILE_SIZE - 1)/OPENCAD_TILE_SIZE;
+            tile_offsets[p + 1] = tile_offsets[p] + pass->tiles_x*pass->tiles_y;
+            pass->guard_x = 1.0f + 2.0f*OPENCAD_GUARD_BAND/(float) pass->canvas.width;
+            pass->guard_y = 1.0f + 2.0f*OPENCAD_GUARD_BAND/(float) pass->canvas.height;
+
+            pass->instances = malloc(instance_count*sizeof(*pass->instances));
+            if (pass->instances == NULL) return_defer(ENOMEM);
+            pass->instance_count = instance_count;
+            for (size_t k = 0; k < instance_count; ++k) {
+                Opencad_Mat4 model_view = opencad_mat4_mul(cameras[p].view, models[k]);
+                pass->instances[k].mvp = opencad_mat4_mul(cameras[p].projection, model_view);
+                pass->instances[k].normal_matrix = opencad_mat4_normal_matrix(model_view);
+                for (size_t j = 0; j < section_count; ++j) {
+                    pass->instances[k].section_model[j] = opencad_plane_transform(section->planes[j], models[k]);
+                }
+            }
+            pass->varying_count = material->shading == OPENCAD_SHADING_GOURAUD ? 1
+                                : material->shading == OPENCAD_SHADING_MATCAP ? 3
+                                : 0;
+
+            pass->texture_varying = pass->varying_count;
+            if (material->texture) pass->varying_count += 3;
+            pass->section_count = section_count;
+            pass->section_varying = pass->varying_count;
+            pass->varying_count += section_count;
+            Opencad_Mat4 inverse_view_projection = opencad_mat4_inverse(opencad_mat4_mul(cameras[p].projection, cameras[p].view));
+            Opencad_Mat4 inverse_view = opencad_mat4_inverse(cameras[p].view);
+            for (size_t k = 0; k < section_count; ++k) {
+                pass->section_ndc[k] = opencad_plane_transform(section->planes[k], inverse_view_projection);
+
+                // The cap faces the cut-away side.
+                Opencad_Vec4 view_plane = opencad_plane_transform(section->planes[k], inverse_view);
+                Opencad_Vec3 n = opencad_vec3_normalize(opencad_vec3(-view_plane.x, -view_plane.y, -view_plane.z));
+                bool lit = material->shading == OPENCAD_SHADING_FLAT || material->shading == OPENCAD_SHADING_GOURAUD;
+                pass->cap_colors[k] = lit ? opencad_shade_color(section->cap_color, opencad_light_intensity(material, n))
+                                          : section->cap_color;
+                pass->cap_normals[k] = opencad_pack_normal(n);
+            }
+
+            pass->vertices = malloc((vertex_total + 1)*sizeof(*pass->vertices));
+            pass->bins = calloc(threads*pass->tiles_x*pass->tiles_y + 1, sizeof(*pass->bins));
+            pass->clipped = calloc(threads, sizeof(*pass->clipped));
+            if (pass->vertices == NULL || pass->bins == NULL || pass->clipped == NULL) return_defer(ENOMEM);
+            if (material->shading == OPENCAD_SHADING_FLAT) {
+                pass->face_colors = malloc(triangle_total*sizeof(*pass->face_colors));
+                if (pass->face_colors == NULL) return_defer(ENOMEM);
+            }
+            if (pass->canvas.normals && material->transparency <= 0.0f) {
+                pass->face_normals = malloc(triangle_total*sizeof(*pass->face_normals));
+                if (pass->face_normals == NULL) return_defer(ENOMEM);
+            }
+        }
+
+        opencad_parallel_for(vertex_total, 1 << 14, opencad_vertex_task, &frame);
+        opencad_parallel_for(triangle_total, 1 << 14, opencad_bin_task, &frame);
+        for (size_t p = 0; p < count; ++p) {
+            if (passes[p].failed) return_defer(ENOMEM);
+        }
+        opencad_parallel_for(tile_offsets[count], 1, opencad_raster_task, &frame);
+    }
+
+defer:
+    opencad_frame_free(&frame);
+    return result;
+}
+
+/**
+ * Draws a mesh into a canvas with depth testing.
+ * Vertices are projected in SIMD-friendly batches, triangles are binned into screen tiles and
+ * the tiles are rasterized in parallel. Gouraud and matcap shading use mesh->normals when
+ * present and compute temporary normals otherwise.
+ * @param canvas The canvas to draw into.
+ * @param mesh The mesh to draw.
+ * @param model The model-to-world transform.
+ * @param camera The camera.
+ * @param material The material.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_render_mesh(Opencad_Canvas canvas, const Opencad_Mesh *mesh, Opencad_Mat4 model,
+                          const Opencad_Camera *camera, const Opencad_Material *material)
+{
+    return opencad_render_frame(&canvas, camera, 1, mesh, &model, 1, material);
+}
+
+/**
+ * Composites the rows of a canvas' transparency buffers over its pixels and empties them.
+ */
+static void opencad_resolve_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    (void) thread;
+    const Opencad_Canvas *canvas = ctx;
+    for (size_t y = begin; y < end; ++y) {
+        for (size_t x = 0; x < canvas->width; ++x) {
+            size_t i = y*canvas->stride + x;
+            float revealage = canvas->revealage[i];
+            float *accum = &canvas->accum[i*4];
+            if (revealage >= 1.0f) continue;
+
+            float scale = (1.0f - revealage)/fmaxf(accum[3], 1e-5f);
+            uint32_t pixel = canvas->pixels[i];
+            uint32_t result = pixel & 0xFF000000;
+            for (int c = 0; c < 3; ++c) {
+                float below = (float) ((pixel >> (8*c)) & 0xFF);
+                float value = accum[c]*scale + below*revealage;
+                result |= (value < 255.0f ? (uint32_t) value : 255) << (8*c);
+            }
+            canvas->pixels[i] = result;
+            memset(accum, 0, 4*sizeof(*accum));
+            canvas->revealage[i] = 1.0f;
+        }
+    }
+}
+
+/**
+ * Blends everything drawn with transparent materials since the last clear or resolve over the opaque
+ * pixels of a canvas, then empties the transparency buffers. Does nothing without them.
+ * @param canvas The canvas.
+ */
+void opencad_resolve_transparency(Opencad_Canvas canvas)
+{
+    if (canvas.accum == NULL || canvas.revealage == NULL) return;
+    opencad_parallel_for(canvas.height, 16, opencad_resolve_task, &canvas);
+}
+
+/**
+ * Converts a depth buffer value back to the view-space z it was drawn at.
+ * @param projection The projection it was drawn with.
+ * @param depth The depth, in [0, 1].
+ * @return The view-space z, negative in front of the camera.
+ */
+static float opencad_view_z(const Opencad_Mat4 *projection, float depth)
+{
+    const float (*p)[4] = projection->m;
+    float ndc = depth*2.0f - 1.0f;
+    return (p[2][3] - ndc*p[3][3])/(ndc*p[3][2] - p[2][2]);
+}
+
+/**
+ * Settings of the outline post-process, see opencad_draw_outlines.
+ */
+typedef struct {
+    uint32_t color;
+    float depth_threshold;      // Relative depth jump that counts as an edge, e.g. 0.05 for 5%.
+    float normal_threshold;     // Sobel magnitude of the unit normals that counts as an edge, e.g. 2.0 to skip tessellation facets.
+} Opencad_Outline;
+
+#define OPENCAD_OUTLINE_PAD (OPENCAD_TILE_SIZE + 2)
+#define OPENCAD_OUTLINE_STRIDE (OPENCAD_OUTLINE_PAD + OPENCAD_LANES)  // Room for the lanes past the tile's last column.
+
+typedef struct {
+    Opencad_Canvas canvas;
+    const Opencad_Outline *outline;
+    Opencad_Mat4 projection;
+    size_t tiles_x;
+} Opencad_Outline_Pass;
+
+/**
+ * Finds and draws the outlines of one tile. The tile plus a one-pixel border, clamped at the canvas
+ * edges, is first unpacked into local planes, so the filters below run on plain rows of lanes.
+ */
+static void opencad_outline_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    (void) thread;
+    const Opencad_Outline_Pass *pass = ctx;
+    Opencad_Canvas canvas = pass->canvas;
+    bool perspective = pass->projection.m[3][2] != 0.0f;
+
+    static _Thread_local float q[OPENCAD_OUTLINE_STRIDE*OPENCAD_OUTLINE_PAD];
+    static _Thread_local float n[3][OPENCAD_OUTLINE_STRIDE*OPENCAD_OUTLINE_PAD];
+
+    for (size_t tile = begin; tile < end; ++tile) {
+        size_t x0 = (tile%pass->tiles_x)*OPENCAD_TILE_SIZE;
+        size_t y0 = (tile/pass->tiles_x)*OPENCAD_TILE_SIZE;
+        size_t w = x0 + OPENCAD_TILE_SIZE < canvas.width ? OPENCAD_TILE_SIZE : canvas.width - x0;
+        size_t h = y0 + OPENCAD_TILE_SIZE < canvas.height ? OPENCAD_TILE_SIZE : canvas.height - y0;
+
+        // Window depth is affine in view depth d for orthographic cameras and in 1/d for perspective
+        // ones, so q is linear across any plane and its second difference only fires at real steps.
+        for (size_t j = 0; j < h + 2; ++j) {
+            size_t y = y0 + j > 0 ? y0 + j - 1 : 0;
+            if (y >= canvas.height) y = canvas.height - 1;
+            for (size_t i = 0; i < w + 2; ++i) {
+                size_t x = x0 + i > 0 ? x0 + i - 1 : 0;
+                if (x >= canvas.width) x = canvas.width - 1;
+                size_t index = y*canvas.stride + x;
+
+                float view_z = opencad_view_z(&pass->projection, canvas.depth[index]);
+                q[j*OPENCAD_OUTLINE_STRIDE + i] = perspective ? -1.0f/view_z : -view_z;
+
+                uint32_t packed = canvas.normals[index];
+                for (int c = 0; c < 3; ++c) {
+                    float value = (float) ((packed >> (8*c)) & 0xFF)*(2.0f/255.0f) - 1.0f;
+                    n[c][j*OPENCAD_OUTLINE_STRIDE + i] = packed ? value : 0.0f;
+                }
+            }
+            // The lanes past the tile read the rest of the row, which would otherwise hold whatever an
+            // earlier tile of this thread left there.
+            size_t rest = OPENCAD_OUTLINE_STRIDE - (w + 2);
+            memset(&q[j*OPENCAD_OUTLINE_STRIDE + w + 2], 0, rest*sizeof(*q));
+            for (int c = 0; c < 3; ++c) memset(&n[c][j*OPENCAD_OUTLINE_STRIDE + w + 2], 0, rest*sizeof(*n[c]));
+        }
+
+        const Opencad_Outline *outline = pass->outline;
+        float r = (float) ((outline->color >> (8*0)) & 0xFF);
+        float g = (float) ((outline->color >> (8*1)) & 0xFF);
+        float b = (float) ((outline->color >> (8*2)) & 0xFF);
+        for (size_t j = 1; j <= h; ++j) {
+            for (size_t i = 1; i <= w; i += OPENCAD_LANES) {
+                // Lanes past the tile read the zeros after each row and are never stored. The filters run
+                // as separate lane loops with selects for clamps, so each one vectorizes.
+                const size_t c = j*OPENCAD_OUTLINE_STRIDE + i;
+                const size_t up = c - OPENCAD_OUTLINE_STRIDE, down = c + OPENCAD_OUTLINE_STRIDE;
+                float depth_edge[OPENCAD_LANES], sobel[OPENCAD_LANES] = {0}, strength[OPENCAD_LANES];
+                for (size_t l = 0; l < OPENCAD_LANES; ++l) {
+                    float laplacian = q[c + l - 1] + q[c + l + 1] + q[up + l] + q[down + l] - 4.0f*q[c + l];
+                    float scale = fabsf(q[c + l]);
+                    depth_edge[l] = fabsf(laplacian)/(scale > 1e-20f ? scale : 1e-20f)/outline->depth_threshold;
+                }
+                for (int k = 0; k < 3; ++k) {
+                    const float *m = n[k];
+                    for (size_t l = 0; l < OPENCAD_LANES; ++l) {
+                        float gx = (m[up + l + 1] + 2.0f*m[c + l + 1] + m[down + l + 1]) - (m[up + l - 1] + 2.0f*m[c + l - 1] + m[down + l - 1]);
+                        float gy = (m[down + l - 1] + 2.0f*m[down + l] + m[down + l + 1]) - (m[up + l - 1] + 2.0f*m[up + l] + m[up + l + 1]);
+                        sobel[l] += gx*gx + gy*gy;
+                    }
+                }
+                for (size_t l = 0; l < OPENCAD_LANES; ++l) {
+                    float normal_edge = sqrtf(sobel[l])/outline->normal_threshold;
+                    // A soft ramp from the threshold to twice the threshold keeps the lines from aliasing.
+                    float edge = (depth_edge[l] > normal_edge ? depth_edge[l] : normal_edge) - 1.0f;
+                    edge = edge > 0.0f ? edge : 0.0f;
+                    strength[l] = edge < 1.0f ? edge : 1.0f;
+                }
+
+                // A strength of zero blends a pixel into itself, so every lane is blended without a branch.
+                size_t lanes = w + 1 - i < OPENCAD_LANES ? w + 1 - i : OPENCAD_LANES;
+                uint32_t *row = &canvas.pixels[(y0 + j - 1)*canvas.stride + x0 + i - 1];
+                uint32_t pixels[OPENCAD_LANES] = {0};
+                memcpy(pixels, row, lanes*sizeof(*row));
+                for (size_t l = 0; l < OPENCAD_LANES; ++l) {
+                    float s = strength[l];
+                    uint32_t pixel = pixels[l];
+                    float pr = (float) ((pixel >> (8*0)) & 0xFF);
+                    float pg = (float) ((pixel >> (8*1)) & 0xFF);
+                    float pb = (float) ((pixel >> (8*2)) & 0xFF);
+                    uint32_t ri = (uint32_t) (pr + (r - pr)*s);
+                    uint32_t gi = (uint32_t) (pg + (g - pg)*s);
+                    uint32_t bi = (uint32_t) (pb + (b - pb)*s);
+                    pixels[l] = (pixel & 0xFF000000) | (bi << (8*2)) | (gi << (8*1)) | (ri << (8*0));
+                }
+                memcpy(row, pixels, lanes*sizeof(*row));
+            }
+        }
+    }
+}
+
+/**
+ * Draws outlines where the depth or normal buffer of a canvas changes abruptly: a fixed-cost image-space
+ * alternative to geometric silhouettes. The canvas needs a normal buffer, filled by rendering into it.
+ * Depth steps are found with a second difference, which is zero across any plane, so surfaces seen at
+ * grazing angles do not light up; normal creases are found with a Sobel filter. The pass runs over
+ * tiles in parallel.
+ * @param canvas The canvas, after the opaque geometry was drawn.
+ * @param camera The camera the geometry was drawn with.
+ * @param outline The settings.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_draw_outlines(Opencad_Canvas canvas, const Opencad_Camera *camera, const Opencad_Outline *outline)
+{
+    if (canvas.normals == NULL) return EINVAL;
+    if (canvas.width == 0 || canvas.height == 0) return 0;
+    size_t tiles_x = (canvas.width + OPENCAD_TILE_SIZE - 1)/OPENCAD_TILE_SIZE;
+    size_t tiles_y = (canvas.height + OPENCAD_TILE_SIZE - 1)/OPENCAD_TILE_SIZE;
+    Opencad_Outline_Pass pass = {
+        .canvas = canvas,
+        .outline = outline,
+        .projection = camera->projection,
+        .tiles_x = tiles_x,
+    };
+    opencad_parallel_for(tiles_x*tiles_y, 1, opencad_outline_task, &pass);
+    return 0;
+}
+
+/**
+ * Settings of the ambient occlusion post-process, see opencad_apply_occlusion.
+ */
+typedef struct {
+    float radius;       // View-space distance within which geometry occludes, in model units.
+    float strength;     // How dark fully occluded pixels get, from 0 to 1.
+} Opencad_Occlusion;
+
+#define OPENCAD_OCCLUSION_SAMPLES 12
+#define OPENCAD_OCCLUSION_PATTERN 4             // Side of the square of pixels that share one set of sample rotations.
+#define OPENCAD_OCCLUSION_MAX_RADIUS 32.0f      // In half-resolution pixels, so close-ups stay cache-friendly.
+#define OPENCAD_OCCLUSION_BIAS 0.1f             // Cosine below which occluders are ignored, hides tessellation.
+
+typedef struct {
+    Opencad_Canvas canvas;
+    const Opencad_Occlusion *occlusion;
+    Opencad_Mat4 projection;
+    size_t width, height;       // Of the half-resolution buffers.
+    size_t tiles_x;
+    float *depth;               // Nearest depth of each 2x2 block, 1 where nothing was drawn.
+    float *x, *y, *z;           // View-space position of that nearest pixel.
+    float *raw, *blurred;
+    float offsets[OPENCAD_OCCLUSION_PATTERN*OPENCAD_OCCLUSION_PATTERN][OPENCAD_OCCLUSION_SAMPLES][2];
+} Opencad_Occlusion_Pass;
+
+/**
+ * Reduces rows of the canvas to half resolution, keeping the nearest pixel of every 2x2 block and
+ * reconstructing its view-space position.
+ */
+static void opencad_occlusion_downsample_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    (void) thread;
+    const Opencad_Occlusion_Pass *pass = ctx;
+    Opencad_Canvas canvas = pass->canvas;
+    const float (*p)[4] = pass->projection.m;
+    for (size_t j = begin; j < end; ++j) {
+        for (size_t i = 0; i < pass->width; ++i) {
+            size_t sx = 2*i, sy = 2*j;
+            float nearest = 1.0f;
+            for (size_t dy = 0; dy < 2 && 2*j + dy < canvas.height; ++dy) {
+                for (size_t dx = 0; dx < 2 && 2*i + dx < canvas.width; ++dx) {
+                    float d = canvas.depth[(2*j + dy)*canvas.stride + 2*i + dx];
+                    if (d < nearest) {
+                        nearest = d;
+                        sx = 2*i + dx;
+                        sy = 2*j + dy;
+                    }
+                }
+            }
+
+            size_t k = j*pass->width + i;
+            pass->depth[k] = nearest;
+            if (nearest >= 1.0f) continue;
+            float z = opencad_view_z(&pass->projection, nearest);
+            float w = p[3][2]*z + p[3][3];
+            float ndc_x = ((float) sx + 0.5f)/(float) canvas.width*2.0f - 1.0f;
+            float ndc_y = 1.0f - ((float) sy + 0.5f)/(float) canvas.height*2.0f;
+            pass->x[k] = (ndc_x*w - p[0][2]*z - p[0][3])/p[0][0];
+            pass->y[k] = (ndc_y*w - p[1][2]*z - p[1][3])/p[1][1];
+            pass->z[k] = z;
+        }
+    }
+}
+
+/**
+ * Estimates the occlusion of one half-resolution tile. Each row is processed OPENCAD_LANES pixels at a
+ * time: the lanes first set up their point, normal and screen radius, then step through the samples together.
+ */
+static void opencad_occlusion_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    (void) thread;
+    const Opencad_Occlusion_Pass *pass = ctx;
+    const float (*p)[4] = pass->projection.m;
+    const float radius = pass->occlusion->radius;
+    const size_t w = pass->width, h = pass->height;
+    const float *px = pass->x, *py = pass->y, *pz = pass->z, *pd = pass->depth;
+
+    for (size_t tile = begin; tile < end; ++tile) {
+        size_t x0 = (tile%pass->tiles_x)*OPENCAD_TILE_SIZE;
+        size_t y0 = (tile/pass->tiles_x)*OPENCAD_TILE_SIZE;
+        size_t x1 = x0 + OPENCAD_TILE_SIZE < w ? x0 + OPENCAD_TILE_SIZE : w;
+        size_t y1 = y0 + OPENCAD_TILE_SIZE < h ? y0 + OPENCAD_TILE_SIZE : h;
+        for (size_t j = y0; j < y1; ++j) {
+            for (size_t i = x0; i < x1; i += OPENCAD_LANES) {
+                size_t lanes = x1 - i < OPENCAD_LANES ? x1 - i : OPENCAD_LANES;
+                float point_x[OPENCAD_LANES] = {0}, point_y[OPENCAD_LANES] = {0}, point_z[OPENCAD_LANES] = {0};
+                float normal_x[OPENCAD_LANES] = {0}, normal_y[OPENCAD_LANES] = {0}, normal_z[OPENCAD_LANES] = {0};
+                float reach[OPENCAD_LANES] = {0}, lane_x[OPENCAD_LANES], occlusion[OPENCAD_LANES] = {0};
+                int32_t active[OPENCAD_LANES], center[OPENCAD_LANES];
+                size_t pattern[OPENCAD_LANES];
+
+                for (size_t l = 0; l < OPENCAD_LANES; ++l) {
+                    size_t c = j*w + i + (l < lanes ? l : 0);
+                    size_t x = i + l;
+                    active[l] = l < lanes && pd[c] < 1.0f;
+                    center[l] = (int32_t) c;
+                    lane_x[l] = (float) x;
+                    pattern[l] = (x%OPENCAD_OCCLUSION_PATTERN) + (j%OPENCAD_OCCLUSION_PATTERN)*OPENCAD_OCCLUSION_PATTERN;
+                    if (!active[l]) continue;
+                    Opencad_Vec3 point = opencad_vec3(px[c], py[c], pz[c]);
+
+                    // Take each derivative from the neighbor on the same surface, the one closer in depth.
+                    size_t left = x > 0 ? c - 1 : c, right = x + 1 < w ? c + 1 : c;
+                    size_t up = j > 0 ? c - w : c, down = j + 1 < h ? c + w : c;
+                    size_t sx = fabsf(pz[right] - pz[c]) < fabsf(pz[c] - pz[left]) && pd[right] < 1.0f ? right : left;
+                    size_t sy = fabsf(pz[down] - pz[c]) < fabsf(pz[c] - pz[up]) && pd[down] < 1.0f ? down : up;
+                    if (pd[sx] >= 1.0f) sx = c;
+                    if (pd[sy] >= 1.0f) sy = c;
+                    Opencad_Vec3 ddx = opencad_vec3(px[sx] - px[c], py[sx] - py[c], pz[sx] - pz[c]);
+                    Opencad_Vec3 ddy = opencad_vec3(px[sy] - px[c], py[sy] - py[c], pz[sy] - pz[c]);
+                    Opencad_Vec3 n = opencad_vec3_normalize(opencad_vec3_cross(ddx, ddy));
+                    Opencad_Vec3 eye = p[3][2] != 0.0f ? opencad_vec3_scale(point, -1.0f) : opencad_vec3(0, 0, 1);
+                    Opencad_Vec3 normal = opencad_vec3_dot(n, eye) < 0.0f ? opencad_vec3_scale(n, -1.0f) : n;
+                    point_x[l] = point.x;
+                    point_y[l] = point.y;
+                    point_z[l] = point.z;
+                    normal_x[l] = normal.x;
+                    normal_y[l] = normal.y;
+                    normal_z[l] = normal.z;
+
+                    float clip_w = p[3][2]*pz[c] + p[3][3];
+                    float pixels = radius*p[0][0]*0.25f*(float) pass->canvas.width/clip_w;
+                    reach[l] = pixels < OPENCAD_OCCLUSION_MAX_RADIUS ? pixels : OPENCAD_OCCLUSION_MAX_RADIUS;
+                }
+
+                // Each sample gathers its lanes' neighbors in a scalar loop; the rest runs on all lanes at
+                // once, with failed tests selecting a zero contribution instead of skipping the lane.
+                const float limit_x = (float) w, limit_y = (float) h, radius2 = radius*radius;
+                for (size_t k = 0; k < OPENCAD_OCCLUSION_SAMPLES; ++k) {
+                    float offset_x[OPENCAD_LANES], offset_y[OPENCAD_LANES];
+                    for (size_t l = 0; l < OPENCAD_LANES; ++l) {
+                        offset_x[l] = pass->offsets[pattern[l]][k][0];
+                        offset_y[l] = pass->offsets[pattern[l]][k][1];
+                    }
+                    int32_t inside[OPENCAD_LANES], sample[OPENCAD_LANES];
+                    for (size_t l = 0; l < OPENCAD_LANES; ++l) {
+                        float fx = lane_x[l] + offset_x[l]*reach[l];
+                        float fy = (float) j + offset_y[l]*reach[l];
+                        inside[l] = active[l] & (fx >= 0.0f) & (fy >= 0.0f) & (fx < limit_x) & (fy < limit_y);
+                        int32_t s = (int32_t) fy*(int32_t) w + (int32_t) fx;
+                        sample[l] = inside[l] ? s : center[l];
+                    }
+                    float sample_x[OPENCAD_LANES], sample_y[OPENCAD_LANES], sample_z[OPENCAD_LANES], sample_d[OPENCAD_LANES];
+                    for (size_t l = 0; l < OPENCAD_LANES; ++l) {
+                        sample_x[l] = px[sample[l]];
+                        sample_y[l] = py[sample[l]];
+                        sample_z[l] = pz[sample[l]];
+                        sample_d[l] = pd[sample[l]];
+                    }
+                    float contribution[OPENCAD_LANES];
+                    int32_t hit[OPENCAD_LANES];
+                    for (size_t l = 0; l < OPENCAD_LANES; ++l) {
+                        float vx = sample_x[l] - point_x[l], vy = sample_y[l] - point_y[l], vz = sample_z[l] - point_z[l];
+                        float vv = vx*vx + vy*vy + vz*vz;
+                        float falloff = 1.0f - vv/radius2;
+                        float cosine = (vx*normal_x[l] + vy*normal_y[l] + vz*normal_z[l])/sqrtf(vv) - OPENCAD_OCCLUSION_BIAS;
+                        hit[l] = inside[l] & (sample_d[l] < 1.0f) & (falloff > 0.0f) & (vv > 0.0f) & (cosine > 0.0f);
+                        contribution[l] = cosine*falloff;
+                    }
+                    // Selected in a loop of its own, or the select would turn back into a branch.
+                    for (size_t l = 0; l < OPENCAD_LANES; ++l) occlusion[l] += hit[l] ? contribution[l] : 0.0f;
+                }
+
+                for (size_t l = 0; l < lanes; ++l) {
+                    float ao = 1.0f - pass->occlusion->strength*2.0f*occlusion[l]/OPENCAD_OCCLUSION_SAMPLES;
+                    pass->raw[j*w + i + l] = ao < 0.0f ? 0.0f : ao;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Weight of a neighbor in the depth-aware filters, falling off as its depth departs from the center.
+ * @param center The view-space z of the pixel being filtered.
+ * @param neighbor The view-space z of the neighbor.
+ * @param tolerance The depth difference that halves the weight.
+ * @return The weight.
+ */
+static float opencad_bilateral_weight(float center, float neighbor, float tolerance)
+{
+    float t = (neighbor - center)/tolerance;
+    return 1.0f/(1.0f + t*t);
+}
+
+/**
+ * Averages one half-resolution tile over the square the sample rotations repeat in, which cancels
+ * the rotation pattern, skipping neighbors across depth discontinuities.
+ */
+static void opencad_occlusion_blur_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    (void) thread;
+    const Opencad_Occlusion_Pass *pass = ctx;
+    const size_t w = pass->width, h = pass->height;
+    const float tolerance = 0.25f*pass->occlusion->radius;
+    for (size_t tile = begin; tile < end; ++tile) {
+        size_t x0 = (tile%pass->tiles_x)*OPENCAD_TILE_SIZE;
+        size_t y0 = (tile/pass->tiles_x)*OPENCAD_TILE_SIZE;
+        size_t x1 = x0 + OPENCAD_TILE_SIZE < w ? x0 + OPENCAD_TILE_SIZE : w;
+        size_t y1 = y0 + OPENCAD_TILE_SIZE < h ? y0 + OPENCAD_TILE_SIZE : h;
+        for (size_t j = y0; j < y1; ++j) {
+            for (size_t i = x0; i < x1; ++i) {
+                size_t c = j*w + i;
+                if (pass->depth[c] >= 1.0f) {
+                    pass->blurred[c] = 1.0f;
+                    continue;
+                }
+                float sum = 0.0f, total = 0.0f;
+                for (int dy = -1; dy < OPENCAD_OCCLUSION_PATTERN - 1; ++dy) {
+                    if ((dy < 0 && j == 0) || j + dy >= h) continue;
+                    for (int dx = -1; dx < OPENCAD_OCCLUSION_PATTERN - 1; ++dx) {
+                        if ((dx < 0 && i == 0) || i + dx >= w) continue;
+                        size_t s = (j + dy)*w + i + dx;
+                        if (pass->depth[s] >= 1.0f) continue;
+                        float weight = opencad_bilateral_weight(pass->z[c], pass->z[s], tolerance);
+                        sum += pass->raw[s]*weight;
+                        total += weight;
+                    }
+                }
+                pass->blurred[c] = sum/total;
+            }
+        }
+    }
+}
+
+/**
+ * Upsamples the occlusion of one canvas tile and darkens its pixels with it. Each pixel blends its
+ * four nearest half-resolution samples bilinearly, reweighted by how close they are in depth.
+ */
+static void opencad_occlusion_apply_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    (void) thread;
+    const Opencad_Occlusion_Pass *pass = ctx;
+    Opencad_Canvas canvas = pass->canvas;
+    const size_t w = pass->width, h = pass->height;
+    const float tolerance = 0.25f*pass->occlusion->radius;
+    size_t tiles_x = (canvas.width + OPENCAD_TILE_SIZE - 1)/OPENCAD_TILE_SIZE;
+    for (size_t tile = begin; tile < end; ++tile) {
+        size_t x0 = (tile%tiles_x)*OPENCAD_TILE_SIZE;
+        size_t y0 = (tile/tiles_x)*OPENCAD_TILE_SIZE;
+        size_t x1 = x0 + OPENCAD_TILE_SIZE < canvas.width ? x0 + OPENCAD_TILE_SIZE : canvas.width;
+        size_t y1 = y0 + OPENCAD_TILE_SIZE < canvas.height ? y0 + OPENCAD_TILE_SIZE : canvas.height;
+        for (size_t y = y0; y < y1; ++y) {
+            float fy = ((float) y - 0.5f)*0.5f;
+            size_t j0 = fy > 0.0f ? (size_t) fy : 0;
+            size_t j1 = j0 + 1 < h ? j0 + 1 : j0;
+            float ty = fy > 0.0f ? fy - (float) j0 : 0.0f;
+            for (size_t x = x0; x < x1; ++x) {
+                size_t index = y*canvas.stride + x;
+                float d = canvas.depth[index];
+                if (d >= 1.0f) continue;
+                float z = opencad_view_z(&pass->projection, d);
+
+                float fx = ((float) x - 0.5f)*0.5f;
+                size_t i0 = fx > 0.0f ? (size_t) fx : 0;
+                size_t i1 = i0 + 1 < w ? i0 + 1 : i0;
+                float tx = fx > 0.0f ? fx - (float) i0 : 0.0f;
+                const size_t taps[4] = { j0*w + i0, j0*w + i1, j1*w + i0, j1*w + i1 };
+                const float bilinear[4] = { (1 - tx)*(1 - ty), tx*(1 - ty), (1 - tx)*ty, tx*ty };
+
+                float sum = 0.0f, total = 0.0f;
+                for (int k = 0; k < 4; ++k) {
+                    if (pass->depth[taps[k]] >= 1.0f) continue;
+                    float weight = (bilinear[k] + 1e-3f)*opencad_bilateral_weight(z, pass->z[taps[k]], tolerance);
+                    sum += pass->blurred[taps[k]]*weight;
+                    total += weight;
+                }
+                if (total <= 0.0f) continue;
+
+                float ao = sum/total;
+                uint32_t pixel = canvas.pixels[index];
+                uint32_t result = pixel & 0xFF000000;
+                for (int c = 0; c < 3; ++c) {
+                    float value = (float) ((pixel >> (8*c)) & 0xFF)*ao;
+                    result |= (uint32_t) value << (8*c);
+                }
+                canvas.pixels[index] = result;
+            }
+        }
+    }
+}
+
+/**
+ * Darkens creases, recesses and contact areas of the opaque geometry on a canvas, estimating from the
+ * depth buffer alone how much of the hemisphere above each pixel is blocked by nearby surfaces.
+ * The estimate runs at half resolution with a rotated sample pattern per pixel, is blurred over the
+ * pattern and upsampled with depth-aware weights so it does not bleed across silhouettes. All passes
+ * run over tiles in parallel. Apply it before resolving transparency, whose fragments leave no depth.
+ * @param canvas The canvas.
+ * @param camera The camera the geometry was drawn with.
+ * @param occlusion The settings.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_apply_occlusion(Opencad_Canvas canvas, const Opencad_Camera *camera, const Opencad_Occlusion *occlusion)
+{
+    Errno result = 0;
+    float *buffer = NULL;
+    if (occlusion->radius <= 0.0f) return EINVAL;
+    if (canvas.width == 0 || canvas.height == 0) return 0;
+
+    Opencad_Occlusion_Pass pass = {
+        .canvas = canvas,
+        .occlusion = occlusion,
+        .projection = camera->projection,
+        .width = (canvas.width + 1)/2,
+        .height = (canvas.height + 1)/2,
+    };
+    pass.tiles_x = (pass.width + OPENCAD_TILE_SIZE - 1)/OPENCAD_TILE_SIZE;
+    size_t tiles_y = (pass.height + OPENCAD_TILE_SIZE - 1)/OPENCAD_TILE_SIZE;
+
+    size_t plane = pass.width*pass.height;
+    buffer = malloc(6*plane*sizeof(*buffer));
+    if (buffer == NULL) return_defer(ENOMEM);
+    pass.depth = buffer;
+    pass.x = buffer + plane;
+    pass.y = buffer + 2*plane;
+    pass.z = buffer + 3*plane;
+    pass.raw = buffer + 4*plane;
+    pass.blurred = buffer + 5*plane;
+
+    // A spiral of samples out to the full radius, turned differently for each pixel in the pattern square.
+    const size_t rotations = OPENCAD_OCCLUSION_PATTERN*OPENCAD_OCCLUSION_PATTERN;
+    for (size_t r = 0; r < rotations; ++r) {
+        float turn = 2.0f*(float) M_PI*((float) ((r*7)%rotations) + 0.5f)/(float) rotations;
+        for (size_t k = 0; k < OPENCAD_OCCLUSION_SAMPLES; ++k) {
+            float angle = turn + 2.0f*(float) M_PI*7.0f*(float) k/OPENCAD_OCCLUSION_SAMPLES;
+            float distance = ((float) k + 0.5f)/OPENCAD_OCCLUSION_SAMPLES;
+            pass.offsets[r][k][0] = cosf(angle)*distance;
+            pass.offsets[r][k][1] = sinf(angle)*distance;
+        }
+    }
+
+    size_t canvas_tiles = ((canvas.width + OPENCAD_TILE_SIZE - 1)/OPENCAD_TILE_SIZE)
+                        * ((canvas.height + OPENCAD_TILE_SIZE - 1)/OPENCAD_TILE_SIZE);
+    opencad_parallel_for(pass.height, 16, opencad_occlusion_downsample_task, &pass);
+    opencad_parallel_for(pass.tiles_x*tiles_y, 1, opencad_occlusion_task, &pass);
+    opencad_parallel_for(pass.tiles_x*tiles_y, 1, opencad_occlusion_blur_task, &pass);
+    opencad_parallel_for(canvas_tiles, 1, opencad_occlusion_apply_task, &pass);
+
+defer:
+    free(buffer);
+    return result;
+}
+
+/**
+ * Computes the axis-aligned bounding box of a mesh.
+ * @param mesh The mesh.
+ * @param min Receives the minimum corner.
+ * @param max Receives the maximum corner.
+ */
+void opencad_mesh_bounds(const Opencad_Mesh *mesh, Opencad_Vec3 *min, Opencad_Vec3 *max)
+{
+    *min = opencad_vec3(0, 0, 0);
+    *max = opencad_vec3(0, 0, 0);
+    if (mesh->vertex_count == 0) return;
+
+    *min = *max = mesh->vertices[0];
+    for (size_t i = 1; i < mesh->vertex_count; ++i) {
+        Opencad_Vec3 v = mesh->vertices[i];
+        min->x = fminf(min->x, v.x); max->x = fmaxf(max->x, v.x);
+        min->y = fminf(min->y, v.y); max->y = fmaxf(max->y, v.y);
+        min->z = fminf(min->z, v.z); max->z = fmaxf(max->z, v.z);
+    }
+}
+
+/**
+ * Returns an orthographic camera for a standard engineering view of a box, with z up.
+ * The box is fitted by its bounding sphere, so every view of the same box has the same scale.
+ * @param view The view.
+ * @param min The minimum corner of the box.
+ * @param max The maximum corner of the box.
+ * @param aspect The width to height ratio of the viewport.
+ * @return The camera.
+ */
+Opencad_Camera opencad_camera_view(Opencad_View view, Opencad_Vec3 min, Opencad_Vec3 max, float aspect)
+{
+    Opencad_Vec3 center = opencad_vec3_scale(opencad_vec3_add(min, max), 0.5f);
+    float radius = 0.5f*opencad_vec3_length(opencad_vec3_sub(max, min));
+    if (radius <= 0.0f) radius = 1.0f;
+
+    Opencad_Vec3 direction = opencad_vec3(0, -1, 0);
+    Opencad_Vec3 up = opencad_vec3(0, 0, 1);
+    switch (view) {
+    case OPENCAD_VIEW_FRONT: break;
+    case OPENCAD_VIEW_TOP:
+        direction = opencad_vec3(0, 0, 1);
+        up = opencad_vec3(0, 1, 0);
+        break;
+    case OPENCAD_VIEW_RIGHT:
+        direction = opencad_vec3(1, 0, 0);
+        break;
+    case OPENCAD_VIEW_ISOMETRIC:
+    default:
+        direction = opencad_vec3_normalize(opencad_vec3(1, -1, 1));
+        break;
+    }
+
+    Opencad_Vec3 eye = opencad_vec3_add(center, opencad_vec3_scale(direction, 2.0f*radius));
+    float half_w = radius*1.05f, half_h = radius*1.05f;
+    if (aspect >= 1.0f) half_w *= aspect;
+    else half_h /= aspect;
+
+    Opencad_Camera camera = {
+        .view = opencad_mat4_look_at(eye, center, up),
+        .projection = opencad_mat4_ortho(-half_w, half_w, -half_h, half_h, radius*0.5f, radius*3.5f),
+    };
+    return camera;
+}
+
+/**
+ * Draws a mesh from several cameras into a grid of sub-regions of one canvas.
+ * Every vertex is loaded once and projected for all views; the tiles of all views are
+ * rasterized by one parallel loop.
+ * @param canvas The canvas to draw into. It is split into a near-square grid of views, row by row.
+ * @param mesh The mesh to draw.
+ * @param model The model-to-world transform.
+ * @param cameras The camera of every view, see opencad_camera_view.
+ * @param view_count The number of views, at most OPENCAD_MAX_VIEWS.
+ * @param material The material.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_render_mesh_views(Opencad_Canvas canvas, const Opencad_Mesh *mesh, Opencad_Mat4 model,
+                                const Opencad_Camera *cameras, size_t view_count, const Opencad_Material *material)
+{
+    if (view_count == 0) return 0;
+    if (view_count > OPENCAD_MAX_VIEWS) return EINVAL;
+
+    size_t cols = 1;
+    while (cols*cols < view_count) ++cols;
+    size_t rows = (view_count + cols - 1)/cols;
+
+    Opencad_Canvas canvases[OPENCAD_MAX_VIEWS];
+    size_t cell_w = canvas.width/cols;
+    size_t cell_h = canvas.height/rows;
+    for (size_t i = 0; i < view_count; ++i) {
+        canvases[i] = opencad_subcanvas(canvas, (i%cols)*cell_w, (i/cols)*cell_h, cell_w, cell_h);
+    }
+    return opencad_render_frame(canvases, cameras, view_count, mesh, &model, 1, material);
+}
+
+#define OPENCAD_INSTANCE_BATCH_VERTICES (1 << 18)   // Projected vertices held at once while drawing instances.
+
+/**
+ * Draws many copies of one mesh, such as the fasteners of an assembly, without duplicating its data.
+ * Copies whose bounding sphere lies outside the view volume are culled first, OPENCAD_LANES transforms
+ * at a time. The rest are drawn in batches, each batch a single pass through the pipeline: vertices
+ * are projected once per copy, and the triangles of all copies share the tile bins.
+ * @param canvas The canvas to draw into.
+ * @param mesh The mesh to draw.
+ * @param transforms The model-to-world transform of every copy.
+ * @param instance_count The number of copies.
+ * @param camera The camera.
+ * @param material The material.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_render_instances(Opencad_Canvas canvas, const Opencad_Mesh *mesh, const Opencad_Mat4 *transforms,
+                               size_t instance_count, const Opencad_Camera *camera, const Opencad_Material *material)
+{
+    Errno result = 0;
+    Opencad_Mat4 *visible = NULL;
+    if (instance_count == 0 || mesh->vertex_count == 0 || mesh->triangle_count == 0) return 0;
+
+    Opencad_Vec3 min, max;
+    opencad_mesh_bounds(mesh, &min, &max);
+    Opencad_Vec3 center = opencad_vec3_scale(opencad_vec3_add(min, max), 0.5f);
+    float radius2 = 0.0f;
+    for (size_t i = 0; i < mesh->vertex_count; ++i) {
+        Opencad_Vec3 d = opencad_vec3_sub(mesh->vertices[i], center);
+        radius2 = fmaxf(radius2, opencad_vec3_dot(d, d));
+    }
+
+    // The view volume is where -w <= x, y, z <= w; each bound is a plane in world space (Gribb and Hartmann).
+    Opencad_Mat4 vp = opencad_mat4_mul(camera->projection, camera->view);
+    Opencad_Vec4 planes[6];
+    for (int k = 0; k < 6; ++k) {
+        float sign = k%2 == 0 ? 1.0f : -1.0f;
+        const float *row = vp.m[k/2], *w = vp.m[3];
+        float a = w[0] + sign*row[0], b = w[1] + sign*row[1], c = w[2] + sign*row[2], d = w[3] + sign*row[3];
+        float length = sqrtf(a*a + b*b + c*c);
+        float inv = length > 0.0f ? 1.0f/length : 0.0f;
+        planes[k] = (Opencad_Vec4) {a*inv, b*inv, c*inv, d*inv};
+    }
+
+    visible = malloc(instance_count*sizeof(*visible));
+    if (visible == NULL) return_defer(ENOMEM);
+    size_t visible_count = 0;
+    for (size_t i = 0; i < instance_count; i += OPENCAD_LANES) {
+        size_t n = instance_count - i < OPENCAD_LANES ? instance_count - i : OPENCAD_LANES;
+        float cx[OPENCAD_LANES], cy[OPENCAD_LANES], cz[OPENCAD_LANES], r[OPENCAD_LANES];
+        bool inside[OPENCAD_LANES];
+        for (size_t l = 0; l < OPENCAD_LANES; ++l) {
+            const float (*m)[4] = transforms[i + (l < n ? l : 0)].m;
+            cx[l] = m[0][0]*center.x + m[0][1]*center.y + m[0][2]*center.z + m[0][3];
+            cy[l] = m[1][0]*center.x + m[1][1]*center.y + m[1][2]*center.z + m[1][3];
+            cz[l] = m[2][0]*center.x + m[2][1]*center.y + m[2][2]*center.z + m[2][3];
+
+            // The longest transformed axis bounds how far the transform can stretch the sphere.
+            float sx = m[0][0]*m[0][0] + m[1][0]*m[1][0] + m[2][0]*m[2][0];
+            float sy = m[0][1]*m[0][1] + m[1][1]*m[1][1] + m[2][1]*m[2][1];
+            float sz = m[0][2]*m[0][2] + m[1][2]*m[1][2] + m[2][2]*m[2][2];
+            r[l] = sqrtf(radius2*fmaxf(sx, fmaxf(sy, sz)));
+            inside[l] = true;
+        }
+        for (int k = 0; k < 6; ++k) {
+            Opencad_Vec4 plane = planes[k];
+            for (size_t l = 0; l < OPENCAD_LANES; ++l) {
+                float d = plane.x*cx[l] + plane.y*cy[l] + plane.z*cz[l] + plane.w;
+                inside[l] = inside[l] && d >= -r[l];
+            }
+        }
+        for (size_t l = 0; l < n; ++l) {
+            if (inside[l]) visible[visible_count++] = transforms[i + l];
+        }
+    }
+
+    size_t batch = OPENCAD_INSTANCE_BATCH_VERTICES/mesh->vertex_count;
+    size_t max_batch = (OPENCAD_CLIPPED_BIT - 1)/mesh->triangle_count;
+    if (batch > max_batch) batch = max_batch;
+    if (batch == 0) batch = 1;
+    for (size_t i = 0; i < visible_count; i += batch) {
+        size_t n = visible_count - i < batch ? visible_count - i : batch;
+        Errno err = opencad_render_frame(&canvas, camera, 1, mesh, &visible[i], n, material);
+        if (err) return_defer(err);
+    }
+
+defer:
+    free(visible);
+    return result;
+}
+
+/**
+ * A cloud of colored points, such as a laser scan.
+ */
+typedef struct {
+    const Opencad_Vec3 *positions;
+    const uint32_t *colors;     // Optional, one per point; color is used otherwise.
+    size_t count;
+    uint32_t color;
+    size_t splat_size;          // Side of the square drawn for each point, in pixels. 0 draws single pixels.
+} Opencad_Points;
+
+typedef struct {
+    Opencad_Canvas canvas;
+    const Opencad_Points *points;
+    Opencad_Mat4 mvp;
+    uint64_t *buffers;          // One per thread: depth bits above the color, so the nearest point is the minimum.
+} Opencad_Point_Pass;
+
+/**
+ * Projects a range of points in batches of OPENCAD_LANES and splats them into the buffer of the calling thread.
+ */
+static void opencad_point_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    const Opencad_Point_Pass *pass = ctx;
+    const Opencad_Points *points = pass->points;
+    const float (*m)[4] = pass->mvp.m;
+    const size_t width = pass->canvas.width, height = pass->canvas.height;
+    const float fw = (float) width, fh = (float) height;
+    const long size = points->splat_size > 1 ? (long) points->splat_size : 1;
+    const long half = (size - 1)/2;
+    uint64_t *buffer = pass->buffers + thread*width*height;
+
+    for (size_t i = begin; i < end; i += OPENCAD_LANES) {
+        size_t n = end - i < OPENCAD_LANES ? end - i : OPENCAD_LANES;
+        float px[OPENCAD_LANES] = {0}, py[OPENCAD_LANES] = {0}, pz[OPENCAD_LANES] = {0};
+        for (size_t l = 0; l < n; ++l) {
+            px[l] = points->positions[i + l].x;
+            py[l] = points->positions[i + l].y;
+            pz[l] = points->positions[i + l].z;
+        }
+
+        float sx[OPENCAD_LANES], sy[OPENCAD_LANES], sz[OPENCAD_LANES];
+        bool visible[OPENCAD_LANES];
+        for (size_t l = 0; l < OPENCAD_LANES; ++l) {
+            float cx = m[0][0]*px[l] + m[0][1]*py[l] + m[0][2]*pz[l] + m[0][3];
+            float cy = m[1][0]*px[l] + m[1][1]*py[l] + m[1][2]*pz[l] + m[1][3];
+            float cz = m[2][0]*px[l] + m[2][1]*py[l] + m[2][2]*pz[l] + m[2][3];
+            float cw = m[3][0]*px[l] + m[3][1]*py[l] + m[3][2]*pz[l] + m[3][3];
+            float inv = cw > 0.0f ? 1.0f/cw : 0.0f;
+            sx[l] = (cx*inv*0.5f + 0.5f)*fw;
+            sy[l] = (0.5f - cy*inv*0.5f)*fh;
+            sz[l] = cz*inv*0.5f + 0.5f;
+            visible[l] = cw > 0.0f && sz[l] >= 0.0f && sz[l] <= 1.0f
+                      && sx[l] >= 0.0f && sx[l] < fw && sy[l] >= 0.0f && sy[l] < fh;
+        }
+
+        for (size_t l = 0; l < n; ++l) {
+            if (!visible[l]) continue;
+            uint32_t color = points->colors ? points->colors[i + l] : points->color;
+            uint32_t bits;
+            memcpy(&bits, &sz[l], sizeof(bits));
+            uint64_t packed = (uint64_t) bits << 32 | color;
+
+            long x0 = (long) sx[l] - half, y0 = (long) sy[l] - half;
+            long x1 = x0 + size, y1 = y0 + size;
+            if (x0 < 0) x0 = 0;
+            if (y0 < 0) y0 = 0;
+            if (x1 > (long) width) x1 = (long) width;
+            if (y1 > (long) height) y1 = (long) height;
+            for (long y = y0; y < y1; ++y) {
+                uint64_t *row = &buffer[(size_t) y*width];
+                for (long x = x0; x < x1; ++x) {
+                    if (packed < row[x]) row[x] = packed;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Merges rows of the per-thread point buffers into the canvas with a depth test, and empties them.
+ */
+static void opencad_point_merge_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    (void) thread;
+    const Opencad_Point_Pass *pass = ctx;
+    Opencad_Canvas canvas = pass->canvas;
+    const size_t threads = opencad_thread_count();
+    const size_t plane = canvas.width*canvas.height;
+    for (size_t y = begin; y < end; ++y) {
+        for (size_t x = 0; x < canvas.width; ++x) {
+            uint64_t best = UINT64_MAX;
+            for (size_t t = 0; t < threads; ++t) {
+                uint64_t *slot = &pass->buffers[t*plane + y*canvas.width + x];
+                if (*slot < best) best = *slot;
+                *slot = UINT64_MAX;
+            }
+            if (best == UINT64_MAX) continue;
+
+            uint32_t bits = (uint32_t) (best >> 32);
+            float z;
+            memcpy(&z, &bits, sizeof(z));
+            size_t index = y*canvas.stride + x;
+            if (z < canvas.depth[index]) {
+                canvas.depth[index] = z;
+                canvas.pixels[index] = (uint32_t) best;
+            }
+        }
+    }
+}
+
+/**
+ * Draws a point cloud with depth testing. Each thread projects its share of the points in SIMD-friendly
+ * batches into a private buffer that keeps the nearest point of every pixel, packed so a single integer
+ * comparison does the depth test; a final parallel pass merges the buffers into the canvas. No locks or
+ * atomics are involved, and the result does not depend on how the points were split among threads.
+ * @param canvas The canvas to draw into.
+ * @param points The points.
+ * @param model The model-to-world transform.
+ * @param camera The camera.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_render_points(Opencad_Canvas canvas, const Opencad_Points *points, Opencad_Mat4 model,
+                            const Opencad_Camera *camera)
+{
+    if (points->count == 0 || canvas.width == 0 || canvas.height == 0) return 0;
+    size_t threads = opencad_thread_count();
+    size_t plane = canvas.width*canvas.height;
+    Opencad_Point_Pass pass = {
+        .canvas = canvas,
+        .points = points,
+        .mvp = opencad_mat4_mul(camera->projection, opencad_mat4_mul(camera->view, model)),
+        .buffers = malloc(threads*plane*sizeof(*pass.buffers)),
+    };
+    if (pass.buffers == NULL) return ENOMEM;
+    memset(pass.buffers, 0xFF, threads*plane*sizeof(*pass.buffers));
+
+    opencad_parallel_for(points->count, 1 << 16, opencad_point_task, &pass);
+    opencad_parallel_for(canvas.height, 16, opencad_point_merge_task, &pass);
+    free(pass.buffers);
+    return 0;
+}
+
+/**
+ * Sorts 64-bit keys with an LSD radix sort, carrying an optional 32-bit payload along.
+ * @param keys The keys to sort.
+ * @param payload The payload of every key, or NULL.
+ * @param count The number of keys.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_radix_sort_u64(uint64_t *keys, uint32_t *payload, size_t count)
+{
+    uint64_t *key_scratch = malloc((count + 1)*sizeof(*key_scratch));
+    uint32_t *payload_scratch = payload ? malloc((count + 1)*sizeof(*payload_scratch)) : NULL;
+    if (key_scratch == NULL || (payload && payload_scratch == NULL)) {
+        free(key_scratch);
+        free(payload_scratch);
+        return ENOMEM;
+    }
+
+    uint64_t all_bits = 0;
+    for (size_t i = 0; i < count; ++i) all_bits |= keys[i];
+
+    uint64_t *src_keys = keys, *dst_keys = key_scratch;
+    uint32_t *src_payload = payload, *dst_payload = payload_scratch;
+    for (int shift = 0; shift < 64; shift += 16) {
+        if (((all_bits >> shift) & 0xFFFF) == 0) continue;
+
+        static _Thread_local size_t histogram[1 << 16];
+        memset(histogram, 0, sizeof(histogram));
+        for (size_t i = 0; i < count; ++i) histogram[(src_keys[i] >> shift) & 0xFFFF] += 1;
+        size_t offset = 0;
+        for (size_t d = 0; d < (1 << 16); ++d) {
+            size_t n = histogram[d];
+            histogram[d] = offset;
+            offset += n;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            size_t j = histogram[(src_keys[i] >> shift) & 0xFFFF]++;
+            dst_keys[j] = src_keys[i];
+            if (payload) dst_payload[j] = src_payload[i];
+        }
+        OPENCAD_SWAP(uint64_t *, src_keys, dst_keys);
+        OPENCAD_SWAP(uint32_t *, src_payload, dst_payload);
+    }
+
+    if (src_keys != keys) {
+        memcpy(keys, src_keys, count*sizeof(*keys));
+        if (payload) memcpy(payload, src_payload, count*sizeof(*payload));
+    }
+    free(key_scratch);
+    free(payload_scratch);
+    return 0;
+}
+
+/**
+ * Packs an undirected edge into a sortable key, smaller vertex first.
+ * @param a The first vertex.
+ * @param b The second vertex.
+ * @return The key.
+ */
+static uint64_t opencad_edge_key(uint32_t a, uint32_t b)
+{
+    return a < b ? ((uint64_t) a << 32) | b : ((uint64_t) b << 32) | a;
+}
+
+/**
+ * Symmetric 4x4 error quadric of Garland and Heckbert, upper triangle:
+ * aa ab ac ad bb bc bd cc cd dd.
+ */
+typedef struct {
+    double q[10];
+} Opencad_Quadric;
+
+/**
+ * Adds the squared distance to the plane ax + by + cz + d = 0, weighted, to a quadric.
+ * @param q The quadric.
+ * @param a The x component of the plane normal.
+ * @param b The y component of the plane normal.
+ * @param c The z component of the plane normal.
+ * @param d The plane offset.
+ * @param weight The weight.
+ */
+static void opencad_quadric_add_plane(Opencad_Quadric *q, double a, double b, double c, double d, double weight)
+{
+    q->q[0] += weight*a*a; q->q[1] += weight*a*b; q->q[2] += weight*a*c; q->q[3] += weight*a*d;
+    q->q[4] += weight*b*b; q->q[5] += weight*b*c; q->q[6] += weight*b*d;
+    q->q[7] += weight*c*c; q->q[8] += weight*c*d;
+    q->q[9] += weight*d*d;
+}
+
+/**
+ * Evaluates the error of a quadric at a point.
+ * @param q The quadric.
+ * @param v The point.
+ * @return The weighted sum of squared plane distances.
+ */
+static double opencad_quadric_error(const Opencad_Quadric *q, Opencad_Vec3 v)
+{
+    double x = v.x, y = v.y, z = v.z;
+    return q->q[0]*x*x + 2*q->q[1]*x*y + 2*q->q[2]*x*z + 2*q->q[3]*x
+         + q->q[4]*y*y + 2*q->q[5]*y*z + 2*q->q[6]*y
+         + q->q[7]*z*z + 2*q->q[8]*z
+         + q->q[9];
+}
+
+typedef struct {
+    double cost;
+    Opencad_Vec3 target;
+    uint32_t a, b;
+} Opencad_Collapse;
+
+typedef struct {
+    float cost;
+    uint32_t vertex;
+} Opencad_Heap_Entry;
+
+typedef struct {
+    uint32_t *items;
+    uint32_t count;
+    uint32_t capacity;
+} Opencad_Index_List;
+
+/**
+ * State of a quadric-error edge-collapse simplification.
+ */
+typedef struct {
+    Opencad_Vec3 *positions;
+    Opencad_Quadric *quadrics;
+    Opencad_Collapse *best;
+    uint32_t *marks;
+    uint32_t mark;
+    bool *dead_vertices;
+    Opencad_Index_List *vertex_triangles;
+    uint32_t *triangles;
+    bool *dead_triangles;
+    size_t vertex_count;
+    size_t triangle_count;
+    size_t live_triangles;
+    Opencad_Heap_Entry *heap;
+    uint32_t *heap_index;
+    size_t heap_count;
+} Opencad_Simplifier;
+
+/**
+ * Appends an index to a list.
+ * @param list The list.
+ * @param item The index.
+ * @return True on success, false if memory ran out.
+ */
+static bool opencad_index_list_push(Opencad_Index_List *list, uint32_t item)
+{
+    if (list->count == list->capacity) {
+        uint32_t capacity = list->capacity ? list->capacity*2 : 8;
+        uint32_t *items = realloc(list->items, capacity*sizeof(*items));
+        if (items == NULL) return false;
+        list->items = items;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = item;
+    return true;
+}
+
+#define OPENCAD_HEAP_ARITY 4
+
+/**
+ * Stores a heap entry at a position and records where its vertex went.
+ * @param s The simplifier.
+ * @param i The heap position.
+ * @param entry The entry.
+ */
+static void opencad_heap_place(Opencad_Simplifier *s, size_t i, Opencad_Heap_Entry entry)
+{
+    s->heap[i] = entry;
+    s->heap_index[entry.vertex] = (uint32_t) i;
+}
+
+/**
+ * Restores the heap order around an entry whose cost changed.
+ * @param s The simplifier.
+ * @param i The heap position of the entry.
+ */
+static void opencad_heap_sift(Opencad_Simplifier *s, size_t i)
+{
+    Opencad_Heap_Entry entry = s->heap[i];
+    while (i > 0) {
+        size_t parent = (i - 1)/OPENCAD_HEAP_ARITY;
+        if (s->heap[parent].cost <= entry.cost) break;
+        opencad_heap_place(s, i, s->heap[parent]);
+        i = parent;
+    }
+    for (;;) {
+        size_t first = OPENCAD_HEAP_ARITY*i + 1;
+        if (first >= s->heap_count) break;
+        size_t end = first + OPENCAD_HEAP_ARITY < s->heap_count ? first + OPENCAD_HEAP_ARITY : s->heap_count;
+        size_t child = first;
+        for (size_t c = first + 1; c < end; ++c) {
+            if (s->heap[c].cost < s->heap[child].cost) child = c;
+        }
+        if (entry.cost <= s->heap[child].cost) break;
+        opencad_heap_place(s, i, s->heap[child]);
+        i = child;
+    }
+    opencad_heap_place(s, i, entry);
+}
+
+/**
+ * Takes a vertex out of the heap, if it is in there.
+ * @param s The simplifier.
+ * @param v The vertex.
+ */
+static void opencad_heap_remove(Opencad_Simplifier *s, uint32_t v)
+{
+    uint32_t i = s->heap_index[v];
+    if (i == UINT32_MAX) return;
+    s->heap_index[v] = UINT32_MAX;
+    Opencad_Heap_Entry last = s->heap[--s->heap_count];
+    if (i < s->heap_count) {
+        opencad_heap_place(s, i, last);
+        opencad_heap_sift(s, i);
+    }
+}
+
+/**
+ * Moves a vertex in the heap to match the cost of its best collapse, inserting or removing it as needed.
+ * @param s The simplifier.
+ * @param v The vertex.
+ */
+static void opencad_heap_update(Opencad_Simplifier *s, uint32_t v)
+{
+    double cost = s->best[v].cost;
+    if (!isfinite(cost)) {
+        opencad_heap_remove(s, v);
+        return;
+    }
+    size_t i = s->heap_index[v];
+    if (i == UINT32_MAX) i = s->heap_count++;
+    s->heap[i] = (Opencad_Heap_Entry) {(float) cost, v};
+    opencad_heap_sift(s, i);
+}
+
+/**
+ * Computes the optimal position and cost of collapsing an edge. Falls back to the best of the
+ * endpoints and the midpoint when the quadric is singular or the optimum runs away from the edge.
+ * @param s The simplifier.
+ * @param a The first vertex.
+ * @param b The second vertex.
+ * @return The collapse.
+ */
+static Opencad_Collapse opencad_collapse_plan(const Opencad_Simplifier *s, uint32_t a, uint32_t b)
+{
+    Opencad_Quadric q;
+    for (int i = 0; i < 10; ++i) q.q[i] = s->quadrics[a].q[i] + s->quadrics[b].q[i];
+
+    Opencad_Vec3 pa = s->positions[a], pb = s->positions[b];
+    Opencad_Vec3 mid = opencad_vec3_scale(opencad_vec3_add(pa, pb), 0.5f);
+    Opencad_Collapse collapse = {
+        .a = a,
+        .b = b,
+    };
+
+    // Solve the 3x3 system A x = -b with Cramer's rule.
+    double a00 = q.q[0], a01 = q.q[1], a02 = q.q[2];
+    double a11 = q.q[4], a12 = q.q[5], a22 = q.q[7];
+    double b0 = -q.q[3], b1 = -q.q[6], b2 = -q.q[8];
+    double c00 = a11*a22 - a12*a12, c01 = a02*a12 - a01*a22, c02 = a01*a12 - a02*a11;
+    double det = a00*c00 + a01*c01 + a02*c02;
+    double scale = fabs(a00) + fabs(a11) + fabs(a22);
+    if (fabs(det) > 1e-9*scale*scale*scale && scale > 0.0) {
+        double c11 = a00*a22 - a02*a02, c12 = a01*a02 - a00*a12, c22 = a00*a11 - a01*a01;
+        Opencad_Vec3 x = {
+            (float) ((c00*b0 + c01*b1 + c02*b2)/det),
+            (float) ((c01*b0 + c11*b1 + c12*b2)/det),
+            (float) ((c02*b0 + c12*b1 + c22*b2)/det),
+        };
+        float reach = opencad_vec3_length(opencad_vec3_sub(pa, pb));
+        if (opencad_vec3_length(opencad_vec3_sub(x, mid)) <= reach) {
+            collapse.target = x;
+            collapse.cost = opencad_quadric_error(&q, x);
+            return collapse;
+        }
+    }
+
+    Opencad_Vec3 candidates[3] = {pa, pb, mid};
+    collapse.cost = INFINITY;
+    for (int i = 0; i < 3; ++i) {
+        double cost = opencad_quadric_error(&q, candidates[i]);
+        if (cost < collapse.cost) {
+            collapse.cost = cost;
+            collapse.target = candidates[i];
+        }
+    }
+    return collapse;
+}
+
+/**
+ * Finds the cheapest collapse over every edge around a vertex and files it in the heap.
+ * @param s The simplifier.
+ * @param v The vertex.
+ */
+static void opencad_vertex_plan(Opencad_Simplifier *s, uint32_t v)
+{
+    Opencad_Collapse best = {.cost = INFINITY, .a = v, .b = v};
+    const Opencad_Index_List *list = &s->vertex_triangles[v];
+    for (uint32_t i = 0; i < list->count; ++i) {
+        uint32_t t = list->items[i];
+        if (s->dead_triangles[t]) continue;
+        const uint32_t *tri = &s->triangles[(size_t) t*3];
+        for (int k = 0; k < 3; ++k) {
+            if (tri[k] == v) continue;
+            Opencad_Collapse collapse = opencad_collapse_plan(s, v, tri[k]);
+            if (collapse.cost < best.cost) best = collapse;
+        }
+    }
+    s->best[v] = best;
+    opencad_heap_update(s, v);
+}
+
+/**
+ * Releases a simplifier.
+ * @param s The simplifier.
+ */
+static void opencad_simplifier_free(Opencad_Simplifier *s)
+{
+    if (s->vertex_triangles) {
+        for (size_t i = 0; i < s->vertex_count; ++i) free(s->vertex_triangles[i].items);
+    }
+    free(s->vertex_triangles);
+    free(s->positions);
+    free(s->quadrics);
+    free(s->best);
+    free(s->marks);
+    free(s->dead_vertices);
+    free(s->triangles);
+    free(s->dead_triangles);
+    free(s->heap);
+    free(s->heap_index);
+    memset(s, 0, sizeof(*s));
+}
+
+/**
+ * Prepares a simplifier: face and boundary quadrics, vertex-triangle adjacency and the initial edge heap.
+ * @param s The simplifier.
+ * @param mesh The mesh to simplify.
+ * @return An error code indicating the result of the operation.
+ */
+static Errno opencad_simplifier_init(Opencad_Simplifier *s, const Opencad_Mesh *mesh)
+{
+    int result = 0;
+    size_t n = mesh->vertex_count, m = mesh->triangle_count;
+    uint64_t *edges = NULL;
+    uint32_t *edge_faces = NULL;
+
+    {
+        memset(s, 0, sizeof(*s));
+        s->vertex_count = n;
+        s->triangle_count = m;
+        s->live_triangles = m;
+        s->positions = malloc((n + 1)*sizeof(*s->positions));
+        s->quadrics = calloc(n + 1, sizeof(*s->quadrics));
+        s->best = malloc((n + 1)*sizeof(*s->best));
+        s->marks = calloc(n + 1, sizeof(*s->marks));
+        s->heap = malloc((n + 1)*sizeof(*s->heap));
+        s->heap_index = malloc((n + 1)*sizeof(*s->heap_index));
+        s->dead_vertices = calloc(n + 1, sizeof(*s->dead_vertices));
+        s->vertex_triangles = calloc(n + 1, sizeof(*s->vertex_triangles));
+        s->triangles = malloc((m*3 + 1)*sizeof(*s->triangles));
+        s->dead_triangles = calloc(m + 1, sizeof(*s->dead_triangles));
+        edges = malloc((m*3 + 1)*sizeof(*edges));
+        edge_faces = malloc((m*3 + 1)*sizeof(*edge_faces));
+        if (!s->positions || !s->quadrics || !s->best || !s->marks || !s->heap || !s->heap_index || !s->dead_vertices || !s->vertex_triangles ||
+            !s->triangles || !s->dead_triangles || !edges || !edge_faces) {
+            return_defer(ENOMEM);
+        }
+        memcpy(s->positions, mesh->vertices, n*sizeof(*s->positions));
+        memcpy(s->triangles, mesh->indices, m*3*sizeof(*s->triangles));
+        memset(s->heap_index, 0xFF, n*sizeof(*s->heap_index));
+        for (size_t v = 0; v < n; ++v) s->best[v] = (Opencad_Collapse) {.cost = INFINITY, .a = (uint32_t) v, .b = (uint32_t) v};
+
+        for (size_t t = 0; t < m; ++t) {
+            const uint32_t *tri = &s->triangles[t*3];
+            Opencad_Vec3 a = s->positions[tri[0]];
+            Opencad_Vec3 cross = opencad_vec3_cross(opencad_vec3_sub(s->positions[tri[1]], a),
+                                                    opencad_vec3_sub(s->positions[tri[2]], a));
+            double area = 0.5*opencad_vec3_length(cross);
+            Opencad_Vec3 normal = opencad_vec3_normalize(cross);
+            double d = -opencad_vec3_dot(normal, a);
+            for (int k = 0; k < 3; ++k) {
+                opencad_quadric_add_plane(&s->quadrics[tri[k]], normal.x, normal.y, normal.z, d, area);
+                if (!opencad_index_list_push(&s->vertex_triangles[tri[k]], (uint32_t) t)) return_defer(ENOMEM);
+                edges[t*3 + k] = opencad_edge_key(tri[k], tri[(k + 1)%3]);
+                edge_faces[t*3 + k] = (uint32_t) t;
+            }
+        }
+
+        Errno err = opencad_radix_sort_u64(edges, edge_faces, m*3);
+        if (err) return_defer(err);
+
+        for (size_t i = 0; i < m*3;) {
+            size_t j = i + 1;
+            while (j < m*3 && edges[j] == edges[i]) ++j;
+            uint32_t a = (uint32_t) (edges[i] >> 32), b = (uint32_t) edges[i];
+
+            // Boundary edges get a heavy plane perpendicular to their face, so borders keep their shape.
+            if (j - i == 1) {
+                const uint32_t *tri = &s->triangles[(size_t) edge_faces[i]*3];
+                Opencad_Vec3 pa = s->positions[a], pb = s->positions[b];
+                Opencad_Vec3 face = opencad_triangle_normal(s->positions[tri[0]], s->positions[tri[1]], s->positions[tri[2]]);
+                Opencad_Vec3 edge = opencad_vec3_sub(pb, pa);
+                Opencad_Vec3 normal = opencad_vec3_normalize(opencad_vec3_cross(edge, face));
+                double d = -opencad_vec3_dot(normal, pa);
+                double weight = 1000.0*opencad_vec3_dot(edge, edge);
+                opencad_quadric_add_plane(&s->quadrics[a], normal.x, normal.y, normal.z, d, weight);
+                opencad_quadric_add_plane(&s->quadrics[b], normal.x, normal.y, normal.z, d, weight);
+            }
+            i = j;
+        }
+
+        for (size_t i = 0; i < m*3;) {
+            size_t j = i + 1;
+            while (j < m*3 && edges[j] == edges[i]) ++j;
+            uint32_t a = (uint32_t) (edges[i] >> 32), b = (uint32_t) edges[i];
+            if (a != b) {
+                Opencad_Collapse collapse = opencad_collapse_plan(s, a, b);
+                if (collapse.cost < s->best[a].cost) s->best[a] = collapse;
+                if (collapse.cost < s->best[b].cost) s->best[b] = collapse;
+            }
+            i = j;
+        }
+        for (size_t v = 0; v < n; ++v) opencad_heap_update(s, (uint32_t) v);
+    }
+
+defer:
+    free(edges);
+    free(edge_faces);
+    if (result != 0) opencad_simplifier_free(s);
+    return result;
+}
+
+/**
+ * Checks that moving the vertices of a collapse to its target flips no surrounding triangle.
+ * @param s The simplifier.
+ * @param v The vertex whose triangles to check.
+ * @param collapse The collapse.
+ * @return True if the collapse keeps every triangle of v facing the same way.
+ */
+static bool opencad_collapse_keeps_orientation(const Opencad_Simplifier *s, uint32_t v, const Opencad_Collapse *collapse)
+{
+    const Opencad_Index_List *list = &s->vertex_triangles[v];
+    for (uint32_t i = 0; i < list->count; ++i) {
+        uint32_t t = list->items[i];
+        if (s->dead_triangles[t]) continue;
+        const uint32_t *tri = &s->triangles[(size_t) t*3];
+        bool has_a = tri[0] == collapse->a || tri[1] == collapse->a || tri[2] == collapse->a;
+        bool has_b = tri[0] == collapse->b || tri[1] == collapse->b || tri[2] == collapse->b;
+        if (has_a && has_b) continue;
+
+        Opencad_Vec3 before[3], after[3];
+        for (int k = 0; k < 3; ++k) {
+            before[k] = s->positions[tri[k]];
+            after[k] = tri[k] == v ? collapse->target : before[k];
+        }
+        Opencad_Vec3 n0 = opencad_vec3_cross(opencad_vec3_sub(before[1], before[0]), opencad_vec3_sub(before[2], before[0]));
+        Opencad_Vec3 n1 = opencad_vec3_cross(opencad_vec3_sub(after[1], after[0]), opencad_vec3_sub(after[2], after[0]));
+        float d = opencad_vec3_dot(n0, n1);
+        if (d <= 0.1f*opencad_vec3_length(n0)*opencad_vec3_length(n1)) return false;
+    }
+    return true;
+}
+
+/**
+ * Collapses the cheapest edges until at most target triangles are left or nothing can be collapsed.
+ * @param s The simplifier.
+ * @param target The number of triangles to reach.
+ * @return An error code indicating the result of the operation.
+ */
+static Errno opencad_simplifier_run(Opencad_Simplifier *s, size_t target)
+{
+    while (s->live_triangles > target && s->heap_count > 0) {
+        uint32_t v = s->heap[0].vertex;
+        Opencad_Collapse collapse = s->best[v];
+        uint32_t a = collapse.a, b = collapse.b;
+        if (s->dead_vertices[a] || s->dead_vertices[b]) {
+            opencad_vertex_plan(s, v);
+            continue;
+        }
+        if (!opencad_collapse_keeps_orientation(s, a, &collapse) ||
+            !opencad_collapse_keeps_orientation(s, b, &collapse)) {
+            // Park the vertex until a collapse next to it changes its neighbourhood.
+            s->best[v].cost = INFINITY;
+            opencad_heap_remove(s, v);
+            continue;
+        }
+
+        // Merge b into a: retarget b's triangles, kill the ones that degenerate.
+        Opencad_Index_List *la = &s->vertex_triangles[a];
+        Opencad_Index_List *lb = &s->vertex_triangles[b];
+        for (uint32_t i = 0; i < lb->count; ++i) {
+            uint32_t t = lb->items[i];
+            if (s->dead_triangles[t]) continue;
+            uint32_t *tri = &s->triangles[(size_t) t*3];
+            if (tri[0] == a || tri[1] == a || tri[2] == a) {
+                s->dead_triangles[t] = true;
+                s->live_triangles -= 1;
+                continue;
+            }
+            for (int k = 0; k < 3; ++k) {
+                if (tri[k] == b) tri[k] = a;
+            }
+            if (!opencad_index_list_push(la, t)) return ENOMEM;
+        }
+        free(lb->items);
+        memset(lb, 0, sizeof(*lb));
+        s->dead_vertices[b] = true;
+        s->best[b].cost = INFINITY;
+        opencad_heap_remove(s, b);
+
+        s->positions[a] = collapse.target;
+        for (int i = 0; i < 10; ++i) s->quadrics[a].q[i] += s->quadrics[b].q[i];
+
+        // Drop dead triangles from a's list and re-plan a. Only the edges touching a changed cost, so a
+        // neighbour needs a full re-plan only if its best collapse went through a or b.
+        uint32_t live = 0;
+        for (uint32_t i = 0; i < la->count; ++i) {
+            uint32_t t = la->items[i];
+            if (!s->dead_triangles[t]) la->items[live++] = t;
+        }
+        la->count = live;
+        opencad_vertex_plan(s, a);
+        s->mark += 1;
+        s->marks[a] = s->mark;
+        for (uint32_t i = 0; i < la->count; ++i) {
+            const uint32_t *tri = &s->triangles[(size_t) la->items[i]*3];
+            for (int k = 0; k < 3; ++k) {
+                uint32_t w = tri[k];
+                if (s->marks[w] == s->mark) continue;
+                s->marks[w] = s->mark;
+                const Opencad_Collapse *best = &s->best[w];
+                if (best->a == a || best->b == a || best->a == b || best->b == b) {
+                    opencad_vertex_plan(s, w);
+                    continue;
+                }
+                Opencad_Collapse collapse = opencad_collapse_plan(s, w, a);
+                if (collapse.cost < best->cost) {
+                    s->best[w] = collapse;
+                    opencad_heap_update(s, w);
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * Copies the live part of a simplifier into a compact mesh.
+ * @param s The simplifier.
+ * @param out Receives the mesh. Must be freed with opencad_mesh_free.
+ * @return An error code indicating the result of the operation.
+ */
+static Errno opencad_simplifier_extract(const Opencad_Simplifier *s, Opencad_Mesh *out)
+{
+    memset(out, 0, sizeof(*out));
+    uint32_t *remap = malloc((s->vertex_count + 1)*sizeof(*remap));
+    out->vertices = malloc((s->vertex_count + 1)*sizeof(*out->vertices));
+    out->indices = malloc((s->live_triangles*3 + 1)*sizeof(*out->indices));
+    if (remap == NULL || out->vertices == NULL || out->indices == NULL) {
+        free(remap);
+        opencad_mesh_free(out);
+        return ENOMEM;
+    }
+    memset(remap, 0xFF, s->vertex_count*sizeof(*remap));
+
+    for (size_t t = 0; t < s->triangle_count; ++t) {
+        if (s->dead_triangles[t]) continue;
+        for (int k = 0; k < 3; ++k) {
+            uint32_t v = s->triangles[t*3 + k];
+            if (remap[v] == UINT32_MAX) {
+                remap[v] = (uint32_t) out->vertex_count;
+                out->vertices[out->vertex_count++] = s->positions[v];
+            }
+            out->indices[out->triangle_count*3 + k] = remap[v];
+        }
+        out->triangle_count += 1;
+    }
+    free(remap);
+
+    // Sized for every simplifier vertex, most of which a coarse level no longer uses.
+    Opencad_Vec3 *vertices = realloc(out->vertices, (out->vertex_count + 1)*sizeof(*out->vertices));
+    if (vertices != NULL) out->vertices = vertices;
+    return 0;
+}
+
+/**
+ * Simplifies a mesh with quadric-error edge collapses (Garland and Heckbert).
+ * Boundaries are preserved, and collapses that would flip a triangle are rejected.
+ * @param mesh The mesh to simplify.
+ * @param target_triangles The number of triangles to aim for.
+ * @param out Receives the simplified mesh. Must be freed with opencad_mesh_free.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_mesh_simplify(const Opencad_Mesh *mesh, size_t target_triangles, Opencad_Mesh *out)
+{
+    Opencad_Simplifier s;
+    memset(out, 0, sizeof(*out));
+    Errno err = opencad_simplifier_init(&s, mesh);
+    if (err) return err;
+    err = opencad_simplifier_run(&s, target_triangles);
+    if (!err) err = opencad_simplifier_extract(&s, out);
+    opencad_simplifier_free(&s);
+    return err;
+}
+
+#define OPENCAD_MAX_LODS 8
+#define OPENCAD_LOD_MIN_TRIANGLES 64
+
+/**
+ * A chain of levels of detail. Level 0 is the source mesh, every further level has about a
+ * quarter of the triangles of the previous one.
+ */
+typedef struct {
+    const Opencad_Mesh *source;
+    Opencad_Mesh levels[OPENCAD_MAX_LODS];
+    size_t count;
+    Opencad_Vec3 center;
+    float radius;
+} Opencad_Lod;
+
+/**
+ * Builds a chain of levels of detail from one simplification run, snapshotting it at every level.
+ * @param lod Receives the chain. Must be freed with opencad_lod_free.
+ * @param mesh The full-resolution mesh. Must outlive the chain.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_lod_build(Opencad_Lod *lod, const Opencad_Mesh *mesh)
+{
+    int result = 0;
+    Opencad_Simplifier s = {0};
+
+    {
+        memset(lod, 0, sizeof(*lod));
+        lod->source = mesh;
+        lod->count = 1;
+
+        Opencad_Vec3 min, max;
+        opencad_mesh_bounds(mesh, &min, &max);
+        lod->center = opencad_vec3_scale(opencad_vec3_add(min, max), 0.5f);
+        lod->radius = 0.5f*opencad_vec3_length(opencad_vec3_sub(max, min));
+
+        Errno err = opencad_simplifier_init(&s, mesh);
+        if (err) return_defer(err);
+
+        size_t target = mesh->triangle_count/4;
+        while (lod->count < OPENCAD_MAX_LODS && target >= OPENCAD_LOD_MIN_TRIANGLES) {
+            err = opencad_simplifier_run(&s, target);
+            if (err) return_defer(err);
+
+            Opencad_Mesh *level = &lod->levels[lod->count];
+            err = opencad_simplifier_extract(&s, level);
+            if (err) return_defer(err);
+            lod->count += 1;
+            if (mesh->normals) {
+                err = opencad_mesh_compute_normals(level);
+                if (err) return_defer(err);
+            }
+            if (s.live_triangles > target) break;
+            target /= 4;
+        }
+    }
+
+defer:
+    opencad_simplifier_free(&s);
+    if (result != 0) {
+        for (size_t i = 1; i < lod->count; ++i) opencad_mesh_free(&lod->levels[i]);
+        lod->count = 0;
+    }
+    return result;
+}
+
+/**
+ * Releases the levels owned by a chain of levels of detail.
+ * @param lod The chain.
+ */
+void opencad_lod_free(Opencad_Lod *lod)
+{
+    for (size_t i = 1; i < lod->count; ++i) opencad_mesh_free(&lod->levels[i]);
+    memset(lod, 0, sizeof(*lod));
+}
+
+/**
+ * Returns one level of a chain of levels of detail.
+ * @param lod The chain.
+ * @param level The level, 0 being the source mesh.
+ * @return The mesh of the level.
+ */
+const Opencad_Mesh *opencad_lod_level(const Opencad_Lod *lod, size_t level)
+{
+    return level == 0 ? lod->source : &lod->levels[level];
+}
+
+/**
+ * Picks the coarsest level that still has about one triangle per pixel of the projected bounding sphere.
+ * @param lod The chain.
+ * @param canvas The canvas the mesh will be drawn into.
+ * @param model The model-to-world transform.
+ * @param camera The camera.
+ * @return The level to draw.
+ */
+size_t opencad_lod_select(const Opencad_Lod *lod, Opencad_Canvas canvas, Opencad_Mat4 model, const Opencad_Camera *camera)
+{
+    Opencad_Mat4 model_view = opencad_mat4_mul(camera->view, model);
+    Opencad_Vec3 center = opencad_mat4_transform_point(model_view, lod->center);
+    float scale = 0.0f;
+    for (int j = 0; j < 3; ++j) {
+        float column = opencad_vec3_length(opencad_vec3(model_view.m[0][j], model_view.m[1][j], model_view.m[2][j]));
+        if (column > scale) scale = column;
+    }
+    float radius = lod->radius*scale;
+
+    const float (*p)[4] = camera->projection.m;
+    float pixels_per_unit = p[1][1]*0.5f*(float) canvas.height;
+    if (p[3][2] != 0.0f) {
+        if (-center.z <= radius) return 0;
+        pixels_per_unit /= -center.z;
+    }
+    float projected = radius*pixels_per_unit;
+    float budget = (float) M_PI*projected*projected;
+
+    size_t level = 0;
+    while (level + 1 < lod->count && (float) opencad_lod_level(lod, level + 1)->triangle_count >= budget) {
+        level += 1;
+    }
+    return level;
+}
+
+/**
+ * Draws the level of detail that matches the projected size of the mesh.
+ * @param canvas The canvas to draw into.
+ * @param lod The chain of levels of detail.
+ * @param model The model-to-world transform.
+ * @param camera The camera.
+ * @param material The material.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_render_lod(Opencad_Canvas canvas, const Opencad_Lod *lod, Opencad_Mat4 model,
+                         const Opencad_Camera *camera, const Opencad_Material *material)
+{
+    size_t level = opencad_lod_select(lod, canvas, model, camera);
+    return opencad_render_mesh(canvas, opencad_lod_level(lod, level), model, camera, material);
+}
+
+#define OPENCAD_EDGE_BLOCK (1 << 14)
+#define OPENCAD_EDGE_DEPTH_BIAS 1e-4f
+#define OPENCAD_EDGE_MAX_DEPTH_BIAS 1e-2f
+
+/**
+ * The drawable edges of a mesh, see opencad_edges_build.
+ * Edges are pairs of vertex indices. The first feature_count are creases, boundaries and
+ * non-manifold edges, which are always drawn. The rest are smooth edges between two faces;
+ * they are silhouettes whenever exactly one of the two faces looks at the camera.
+ */
+typedef struct {
+    uint32_t *vertices;         // Two per edge.
+    uint32_t *faces;            // Two per edge, UINT32_MAX for the missing face of a boundary edge.
+    size_t count;
+    size_t feature_count;
+    float *planes;              // Face planes as four arrays of face_count floats: nx, ny, nz, d.
+    size_t face_count;
+    uint8_t *facing;            // Per-view scratch: 1 for faces that look at the camera.
+    uint32_t *silhouettes;      // Edges found by the last opencad_edges_find_silhouettes.
+    size_t silhouette_count;
+    size_t *chunk_counts;
+} Opencad_Edges;
+
+typedef struct {
+    const Opencad_Mesh *mesh;
+    Opencad_Edges *edges;
+    Opencad_Vec4 eye;
+} Opencad_Edge_Pass;
+
+/**
+ * Releases the memory owned by an edge set.
+ * @param edges The edges to free.
+ */
+void opencad_edges_free(Opencad_Edges *edges)
+{
+    free(edges->vertices);
+    free(edges->faces);
+    free(edges->planes);
+    free(edges->facing);
+    free(edges->silhouettes);
+    free(edges->chunk_counts);
+    memset(edges, 0, sizeof(*edges));
+}
+
+/**
+ * Computes the unit plane of every face in a range.
+ */
+static void opencad_edge_planes_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    (void) thread;
+    Opencad_Edge_Pass *pass = ctx;
+    const Opencad_Mesh *mesh = pass->mesh;
+    size_t m = pass->edges->face_count;
+    float *planes = pass->edges->planes;
+    for (size_t t = begin; t < end; ++t) {
+        const uint32_t *tri = &mesh->indices[t*3];
+        Opencad_Vec3 a = mesh->vertices[tri[0]];
+        Opencad_Vec3 n = opencad_triangle_normal(a, mesh->vertices[tri[1]], mesh->vertices[tri[2]]);
+        planes[t] = n.x;
+        planes[m + t] = n.y;
+        planes[m*2 + t] = n.z;
+        planes[m*3 + t] = opencad_vec3_dot(n, a);
+    }
+}
+
+/**
+ * Finds the crease, boundary and silhouette-candidate edges of a mesh. This is done once per mesh;
+ * opencad_edges_find_silhouettes then only has to classify faces for each view.
+ * @param edges Receives the edges. Must be freed with opencad_edges_free.
+ * @param mesh The mesh.
+ * @param crease_angle Edges whose faces meet at more than this angle, in radians, are creases.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_edges_build(Opencad_Edges *edges, const Opencad_Mesh *mesh, float crease_angle)
+{
+    int result = 0;
+    size_t m = mesh->triangle_count;
+    uint64_t *keys = NULL;
+    uint32_t *key_faces = NULL;
+
+    {
+        memset(edges, 0, sizeof(*edges));
+        edges->face_count = m;
+        edges->planes = malloc((m*4 + 1)*sizeof(*edges->planes));
+        edges->facing = malloc(m + 1);
+        keys = malloc((m*3 + 1)*sizeof(*keys));
+        key_faces = malloc((m*3 + 1)*sizeof(*key_faces));
+        if (!edges->planes || !edges->facing || !keys || !key_faces) return_defer(ENOMEM);
+
+        Opencad_Edge_Pass pass = {.mesh = mesh, .edges = edges};
+        opencad_parallel_for(m, OPENCAD_EDGE_BLOCK, opencad_edge_planes_task, &pass);
+
+        for (size_t t = 0; t < m; ++t) {
+            for (int k = 0; k < 3; ++k) {
+                keys[t*3 + k] = opencad_edge_key(mesh->indices[t*3 + k], mesh->indices[t*3 + (k + 1)%3]);
+                key_faces[t*3 + k] = (uint32_t) t;
+            }
+        }
+        Errno err = opencad_radix_sort_u64(keys, key_faces, m*3);
+        if (err) return_defer(err);
+
+        // Two passes over the runs of equal keys: count the features and smooth edges, then fill them in.
+        float cos_crease = cosf(crease_angle);
+        const float *nx = edges->planes, *ny = nx + m, *nz = ny + m;
+        for (int fill = 0; fill < 2; ++fill) {
+            size_t features = 0, smooth = 0;
+            for (size_t i = 0; i < m*3;) {
+                size_t j = i + 1;
+                while (j < m*3 && keys[j] == keys[i]) ++j;
+                uint32_t a = (uint32_t) (keys[i] >> 32), b = (uint32_t) keys[i];
+                if (a != b) {
+                    bool feature = true;
+                    if (j - i == 2) {
+                        uint32_t f0 = key_faces[i], f1 = key_faces[i + 1];
+                        float d = nx[f0]*nx[f1] + ny[f0]*ny[f1] + nz[f0]*nz[f1];
+                        feature = d < cos_crease;
+                    }
+                    if (feature) {
+                        if (fill) {
+                            edges->vertices[features*2 + 0] = a;
+                            edges->vertices[features*2 + 1] = b;
+                            edges->faces[features*2 + 0] = key_faces[i];
+                            edges->faces[features*2 + 1] = j - i > 1 ? key_faces[i + 1] : UINT32_MAX;
+                        }
+                        features += 1;
+                    } else {
+                        if (fill) {
+                            size_t e = edges->feature_count + smooth;
+                            edges->vertices[e*2 + 0] = a;
+                            edges->vertices[e*2 + 1] = b;
+                            edges->faces[e*2 + 0] = key_faces[i];
+                            edges->faces[e*2 + 1] = key_faces[i + 1];
+                        }
+                        smooth += 1;
+                    }
+                }
+                i = j;
+            }
+            if (!fill) {
+                edges->feature_count = features;
+                edges->count = features + smooth;
+                size_t chunks = (smooth + OPENCAD_EDGE_BLOCK - 1)/OPENCAD_EDGE_BLOCK;
+                edges->vertices = malloc((edges->count*2 + 1)*sizeof(*edges->vertices));
+                edges->faces = malloc((edges->count*2 + 1)*sizeof(*edges->faces));
+                edges->silhouettes = malloc((smooth + 1)*sizeof(*edges->silhouettes));
+                edges->chunk_counts = malloc((chunks + 1)*sizeof(*edges->chunk_counts));
+                if (!edges->vertices || !edges->faces || !edges->silhouettes || !edges->chunk_counts) {
+                    return_defer(ENOMEM);
+                }
+            }
+        }
+    }
+
+defer:
+    free(keys);
+    free(key_faces);
+    if (result != 0) opencad_edges_free(edges);
+    return result;
+}
+
+/**
+ * Marks the faces in a range that look at the eye, OPENCAD_LANES faces at a time.
+ */
+static void opencad_edge_facing_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    (void) thread;
+    Opencad_Edge_Pass *pass = ctx;
+    size_t m = pass->edges->face_count;
+    const float *nx = pass->edges->planes, *ny = nx + m, *nz = ny + m, *nd = nz + m;
+    Opencad_Vec4 e = pass->eye;
+    uint8_t *facing = pass->edges->facing;
+
+    size_t i = begin;
+    for (; i + OPENCAD_LANES <= end; i += OPENCAD_LANES) {
+        uint8_t lanes[OPENCAD_LANES];
+        for (size_t l = 0; l < OPENCAD_LANES; ++l) {
+            float side = nx[i + l]*e.x + ny[i + l]*e.y + nz[i + l]*e.z - nd[i + l]*e.w;
+            lanes[l] = side > 0.0f;
+        }
+        memcpy(&facing[i], lanes, OPENCAD_LANES);
+    }
+    for (; i < end; ++i) {
+        facing[i] = nx[i]*e.x + ny[i]*e.y + nz[i]*e.z - nd[i]*e.w > 0.0f;
+    }
+}
+
+/**
+ * Collects the smooth edges of a chunk whose faces disagree about facing the eye. Each chunk writes
+ * into its own slice of the silhouette array, compacted afterwards.
+ */
+static void opencad_edge_silhouette_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    (void) thread;
+    Opencad_Edge_Pass *pass = ctx;
+    Opencad_Edges *edges = pass->edges;
+    const uint8_t *facing = edges->facing;
+    const uint32_t *faces = &edges->faces[edges->feature_count*2];
+    uint32_t *out = &edges->silhouettes[begin];
+    size_t count = 0;
+    for (size_t i = begin; i < end; ++i) {
+        out[count] = (uint32_t) (edges->feature_count + i);
+        count += facing[faces[i*2]] != facing[faces[i*2 + 1]];
+    }
+    edges->chunk_counts[begin/OPENCAD_EDGE_BLOCK] = count;
+}
+
+/**
+ * Finds the silhouette edges for one view and stores their indices in edges->silhouettes.
+ * @param edges The edges of the mesh, see opencad_edges_build.
+ * @param model The model-to-world transform.
+ * @param camera The camera.
+ */
+void opencad_edges_find_silhouettes(Opencad_Edges *edges, Opencad_Mat4 model, const Opencad_Camera *camera)
+{
+    // The eye in model space: a point for perspective cameras, a direction towards the viewer for orthographic ones.
+    Opencad_Mat4 inverse = opencad_mat4_inverse(opencad_mat4_mul(camera->view, model));
+    bool perspective = camera->projection.m[3][2] != 0.0f;
+    Opencad_Edge_Pass pass = {
+        .edges = edges,
+        .eye = opencad_mat4_apply(inverse, perspective ? (Opencad_Vec4) {0, 0, 0, 1} : (Opencad_Vec4) {0, 0, 1, 0}),
+    };
+    opencad_parallel_for(edges->face_count, OPENCAD_EDGE_BLOCK, opencad_edge_facing_task, &pass);
+
+    size_t smooth = edges->count - edges->feature_count;
+    opencad_parallel_for(smooth, OPENCAD_EDGE_BLOCK, opencad_edge_silhouette_task, &pass);
+    edges->silhouette_count = 0;
+    for (size_t c = 0; c*OPENCAD_EDGE_BLOCK < smooth; ++c) {
+        memmove(&edges->silhouettes[edges->silhouette_count], &edges->silhouettes[c*OPENCAD_EDGE_BLOCK],
+                edges->chunk_counts[c]*sizeof(*edges->silhouettes));
+        edges->silhouette_count += edges->chunk_counts[c];
+    }
+}
+
+/**
+ * Draws a depth-tested line between two points in window coordinates, clipped to the canvas.
+ * Depth is interpolated linearly in screen space, which is exact for projected segments. Like
+ * glPolygonOffset, the line is pulled towards the viewer by a constant bias plus its own depth
+ * slope per pixel, so edges lying on a surface are not hidden by it.
+ * @param canvas The canvas to draw into.
+ * @param a The start point: x and y in pixels, z the depth in [0, 1].
+ * @param b The end point: x and y in pixels, z the depth in [0, 1].
+ * @param color The color of the line.
+ * @param bias The constant depth offset towards the viewer.
+ */
+void opencad_draw_line_3d(Opencad_Canvas canvas, Opencad_Vec3 a, Opencad_Vec3 b, uint32_t color, float bias)
+{
+    // Liang-Barsky against the canvas rectangle keeps far-away endpoints from costing anything.
+    float dx = b.x - a.x, dy = b.y - a.y, dz = b.z - a.z;
+    float p[4] = {-dx, dx, -dy, dy};
+    float q[4] = {a.x, (float) canvas.width - a.x, a.y, (float) canvas.height - a.y};
+    float t0 = 0.0f, t1 = 1.0f;
+    for (int k = 0; k < 4; ++k) {
+        if (p[k] == 0.0f) {
+            if (q[k] < 0.0f) return;
+            continue;
+        }
+        float r = q[k]/p[k];
+        if (p[k] < 0.0f) {
+            if (r > t1) return;
+            if (r > t0) t0 = r;
+        } else {
+            if (r < t0) return;
+            if (r < t1) t1 = r;
+        }
+    }
+
+    float ax = a.x + t0*dx, ay = a.y + t0*dy, az = a.z + t0*dz;
+    float bx = a.x + t1*dx, by = a.y + t1*dy, bz = a.z + t1*dz;
+    float length = fmaxf(fabsf(bx - ax), fabsf(by - ay));
+    size_t steps = (size_t) ceilf(length);
+    float step = steps > 0 ? 1.0f/(float) steps : 0.0f;
+    float offset = bias + fabsf(bz - az)*step;
+    for (size_t i = 0; i <= steps; ++i) {
+        float t = (float) i*step;
+        int x = (int) (ax + (bx - ax)*t);
+        int y = (int) (ay + (by - ay)*t);
+        float z = az + (bz - az)*t;
+        if (x >= (int) canvas.width) x = (int) canvas.width - 1;
+        if (y >= (int) canvas.height) y = (int) canvas.height - 1;
+        if (x < 0 || y < 0 || z < 0.0f || z > 1.0f) continue;
+        size_t index = (size_t) y*canvas.stride + (size_t) x;
+        if (z - offset < canvas.depth[index]) {
+            canvas.pixels[index] = color;
+            if (z < canvas.depth[index]) canvas.depth[index] = z;
+        }
+    }
+}
+
+/**
+ * Maps a clip-space point to window coordinates.
+ * @param canvas The canvas.
+ * @param c The point, with w > 0.
+ * @return The pixel coordinates and the depth.
+ */
+static Opencad_Vec3 opencad_clip_to_window(Opencad_Canvas canvas, Opencad_Vec4 c)
+{
+    float inv = 1.0f/c.w;
+    return opencad_vec3((c.x*inv*0.5f + 0.5f)*(float) canvas.width,
+                        (0.5f - c.y*inv*0.5f)*(float) canvas.height,
+                        c.z*inv*0.5f + 0.5f);
+}
+
+/**
+ * Draws a depth-tested 3D segment. The segment is clipped against the near and far planes in
+ * homogeneous clip space, so it may cross behind the camera; opencad_draw_line_3d takes care of
+ * the canvas edges.
+ * @param canvas The canvas to draw into.
+ * @param mvp The model-view-projection matrix.
+ * @param a The start point.
+ * @param b The end point.
+ * @param color The color of the line.
+ * @param bias The constant depth offset towards the viewer, see opencad_draw_line_3d.
+ */
+void opencad_draw_segment_3d(Opencad_Canvas canvas, Opencad_Mat4 mvp, Opencad_Vec3 a, Opencad_Vec3 b,
+                             uint32_t color, float bias)
+{
+    Opencad_Vec4 ca = opencad_mat4_apply(mvp, (Opencad_Vec4) {a.x, a.y, a.z, 1.0f});
+    Opencad_Vec4 cb = opencad_mat4_apply(mvp, (Opencad_Vec4) {b.x, b.y, b.z, 1.0f});
+    float t0 = 0.0f, t1 = 1.0f;
+    float da[2] = {ca.w + ca.z, ca.w - ca.z};
+    float db[2] = {cb.w + cb.z, cb.w - cb.z};
+    for (int k = 0; k < 2; ++k) {
+        if (da[k] < 0.0f && db[k] < 0.0f) return;
+        if (da[k] < 0.0f) t0 = fmaxf(t0, da[k]/(da[k] - db[k]));
+        if (db[k] < 0.0f) t1 = fminf(t1, da[k]/(da[k] - db[k]));
+    }
+    if (t0 > t1) return;
+
+    Opencad_Vec4 d = {cb.x - ca.x, cb.y - ca.y, cb.z - ca.z, cb.w - ca.w};
+    Opencad_Vec4 p0 = {ca.x + d.x*t0, ca.y + d.y*t0, ca.z + d.z*t0, ca.w + d.w*t0};
+    Opencad_Vec4 p1 = {ca.x + d.x*t1, ca.y + d.y*t1, ca.z + d.z*t1, ca.w + d.w*t1};
+    if (p0.w <= 0.0f || p1.w <= 0.0f) return;
+    opencad_draw_line_3d(canvas, opencad_clip_to_window(canvas, p0), opencad_clip_to_window(canvas, p1), color, bias);
+}
+
+/**
+ * Projects a vertex to window coordinates.
+ * @param canvas The canvas.
+ * @param mvp The model-view-projection matrix.
+ * @param v The vertex.
+ * @param out Receives the pixel coordinates and the depth.
+ * @return False if the vertex is behind the camera.
+ */
+static bool opencad_edge_project(Opencad_Canvas canvas, Opencad_Mat4 mvp, Opencad_Vec3 v, Opencad_Vec3 *out)
+{
+    Opencad_Vec4 c = opencad_mat4_apply(mvp, (Opencad_Vec4) {v.x, v.y, v.z, 1.0f});
+    if (c.w <= 0.0f) return false;
+    *out = opencad_clip_to_window(canvas, c);
+    return true;
+}
+
+/**
+ * Returns the larger of the x and y depth slopes of a projected face, the slope term of glPolygonOffset.
+ * @param canvas The canvas.
+ * @param mvp The model-view-projection matrix.
+ * @param mesh The mesh.
+ * @param face The face, or UINT32_MAX for none.
+ * @return The depth change per pixel, 0 if the face is missing or behind the camera.
+ */
+static float opencad_face_depth_slope(Opencad_Canvas canvas, Opencad_Mat4 mvp, const Opencad_Mesh *mesh, uint32_t face)
+{
+    if (face == UINT32_MAX) return 0.0f;
+    Opencad_Vec3 p[3];
+    for (int k = 0; k < 3; ++k) {
+        if (!opencad_edge_project(canvas, mvp, mesh->vertices[mesh->indices[(size_t) face*3 + k]], &p[k])) return 0.0f;
+    }
+    float x1 = p[1].x - p[0].x, y1 = p[1].y - p[0].y, z1 = p[1].z - p[0].z;
+    float x2 = p[2].x - p[0].x, y2 = p[2].y - p[0].y, z2 = p[2].z - p[0].z;
+    float area = x1*y2 - x2*y1;
+    if (area == 0.0f) return INFINITY;
+    float dzdx = (z1*y2 - z2*y1)/area;
+    float dzdy = (x1*z2 - x2*z1)/area;
+    return fmaxf(fabsf(dzdx), fabsf(dzdy));
+}
+
+/**
+ * Draws the feature and silhouette edges of a mesh, depth-tested against what the canvas already holds.
+ * Render the shaded mesh first for a shaded-with-edges view, or draw into a cleared canvas for a plain
+ * line drawing.
+ * @param canvas The canvas to draw into.
+ * @param mesh The mesh.
+ * @param edges The edges of the mesh, see opencad_edges_build. Its silhouettes are updated for this view.
+ * @param model The model-to-world transform.
+ * @param camera The camera.
+ * @param color The color of the lines.
+ */
+void opencad_draw_edges(Opencad_Canvas canvas, const Opencad_Mesh *mesh, Opencad_Edges *edges,
+                        Opencad_Mat4 model, const Opencad_Camera *camera, uint32_t color)
+{
+    opencad_edges_find_silhouettes(edges, model, camera);
+    Opencad_Mat4 mvp = opencad_mat4_mul(camera->projection, opencad_mat4_mul(camera->view, model));
+    size_t total = edges->feature_count + edges->silhouette_count;
+    for (size_t i = 0; i < total; ++i) {
+        size_t e = i < edges->feature_count ? i : edges->silhouettes[i - edges->feature_count];
+        // Lines are sampled up to a pixel away from where the surface was, so offset them by the steeper face.
+        float slope = fmaxf(opencad_face_depth_slope(canvas, mvp, mesh, edges->faces[e*2 + 0]),
+                            opencad_face_depth_slope(canvas, mvp, mesh, edges->faces[e*2 + 1]));
+        float bias = fminf(OPENCAD_EDGE_DEPTH_BIAS + slope, OPENCAD_EDGE_MAX_DEPTH_BIAS);
+        opencad_draw_segment_3d(canvas, mvp, mesh->vertices[edges->vertices[e*2 + 0]],
+                                mesh->vertices[edges->vertices[e*2 + 1]], color, bias);
+    }
+}
+
+typedef enum {
+    OPENCAD_SOLID_BOX = 0,
+    OPENCAD_SOLID_CYLINDER,
+    OPENCAD_SOLID_SPHERE,
+    OPENCAD_SOLID_CONE,
+    OPENCAD_SOLID_TORUS,
+    COUNT_OPENCAD_SOLIDS,
+} Opencad_Solid_Kind;
+
+/**
+ * A parametric solid in its own coordinates: boxes, spheres and tori are centered on the origin,
+ * cylinders and cones stand on the xy plane, and everything round turns around the z axis.
+ * Fields a kind does not use are ignored.
+ */
+typedef struct {
+    Opencad_Solid_Kind kind;
+    Opencad_Vec3 size;      // Box: the edge lengths.
+    float radius;           // Cylinder, sphere, cone: the (base) radius. Torus: from the center to the tube.
+    float radius2;          // Cone: the top radius, 0 for a point. Torus: the tube radius.
+    float height;           // Cylinder, cone.
+} Opencad_Solid;
+
+#define OPENCAD_SOLID_MIN_SEGMENTS 3
+#define OPENCAD_SOLID_MAX_SEGMENTS 512
+#define OPENCAD_SOLID_PIXEL_TOLERANCE 0.5f  // Screen distance between a tessellated surface and the true one.
+
+/**
+ * Returns how many chords approximate a full circle to within a tolerance.
+ * @param radius The radius of the circle.
+ * @param tolerance The largest distance between a chord and the arc.
+ * @return The number of chords.
+ */
+static size_t opencad_circle_segments(float radius, float tolerance)
+{
+    if (!(tolerance > 0.0f) || tolerance >= radius) return OPENCAD_SOLID_MIN_SEGMENTS;
+    float segments = ceilf((float) M_PI/acosf(1.0f - tolerance/radius));
+    if (!(segments < OPENCAD_SOLID_MAX_SEGMENTS)) return OPENCAD_SOLID_MAX_SEGMENTS;
+    return segments < OPENCAD_SOLID_MIN_SEGMENTS ? OPENCAD_SOLID_MIN_SEGMENTS : (size_t) segments;
+}
+
+/**
+ * A profile of a surface of revolution: polylines in the (r, z) half plane, ordered so the solid lies on
+ * their left. Separate strips do not share vertices, which keeps shading creases sharp between them.
+ */
+typedef struct {
+    float r[OPENCAD_SOLID_MAX_SEGMENTS + 1];
+    float z[OPENCAD_SOLID_MAX_SEGMENTS + 1];
+    size_t strip_ends[3];   // One past the last point of each strip.
+    size_t strip_count;
+    bool closed;            // The only strip loops back to its first point.
+} Opencad_Profile;
+
+/**
+ * Sweeps a profile around the z axis. Profile points on the axis become a single pole vertex.
+ * @param profile The profile.
+ * @param segments The number of steps around the axis.
+ * @param mesh Receives the mesh.
+ * @return An error code indicating the result of the operation.
+ */
+static Errno opencad_revolve_profile(const Opencad_Profile *profile, size_t segments, Opencad_Mesh *mesh)
+{
+    size_t point_count = profile->strip_ends[profile->strip_count - 1];
+    size_t first[OPENCAD_SOLID_MAX_SEGMENTS + 1];
+    size_t vertex_count = 0;
+    for (size_t i = 0; i < point_count; ++i) {
+        first[i] = vertex_count;
+        vertex_count += profile->r[i] == 0.0f ? 1 : segments;
+    }
+    size_t triangle_count = 2*segments*point_count;
+
+    memset(mesh, 0, sizeof(*mesh));
+    mesh->vertices = malloc(vertex_count*sizeof(*mesh->vertices));
+    mesh->indices = malloc(triangle_count*3*sizeof(*mesh->indices));
+    if (mesh->vertices == NULL || mesh->indices == NULL) {
+        opencad_mesh_free(mesh);
+        return ENOMEM;
+    }
+    mesh->vertex_count = vertex_count;
+
+    for (size_t j = 0; j < segments; ++j) {
+        float angle = 2.0f*(float) M_PI*(float) j/(float) segments;
+        float c = cosf(angle), s = sinf(angle);
+        for (size_t i = 0; i < point_count; ++i) {
+            if (profile->r[i] == 0.0f && j > 0) continue;
+            mesh->vertices[first[i] + j] = opencad_vec3(profile->r[i]*c, profile->r[i]*s, profile->z[i]);
+        }
+    }
+
+    // Quad (a_j, a_j+1, b_j+1, b_j) faces outwards when b follows a with the solid on the left.
+    uint32_t *out = mesh->indices;
+    size_t begin = 0;
+    for (size_t strip = 0; strip < profile->strip_count; ++strip) {
+        size_t end = profile->strip_ends[strip];
+        size_t edges = profile->closed ? end - begin : end - begin - 1;
+        for (size_t e = 0; e < edges; ++e) {
+            size_t a = begin + e, b = begin + (e + 1)%(end - begin);
+            bool a_pole = profile->r[a] == 0.0f, b_pole = profile->r[b] == 0.0f;
+            if (a_pole && b_pole) continue;
+            for (size_t j = 0; j < segments; ++j) {
+                size_t k = (j + 1)%segments;
+                uint32_t aj = (uint32_t) (first[a] + (a_pole ? 0 : j)), ak = (uint32_t) (first[a] + (a_pole ? 0 : k));
+                uint32_t bj = (uint32_t) (first[b] + (b_pole ? 0 : j)), bk = (uint32_t) (first[b] + (b_pole ? 0 : k));
+                if (!a_pole) {
+                    *out++ = aj; *out++ = ak; *out++ = bk;
+                }
+                if (!b_pole) {
+                    *out++ = aj; *out++ = bk; *out++ = bj;
+                }
+            }
+        }
+        begin = end;
+    }
+    mesh->triangle_count = (size_t) (out - mesh->indices)/3;
+    Errno err = opencad_mesh_compute_normals(mesh);
+    if (err) opencad_mesh_free(mesh);
+    return err;
+}
+
+/**
+ * Tessellates a solid so that no point of the mesh is farther than a tolerance from the true surface.
+ * Curved surfaces share vertices, so their vertex normals shade them smoothly; flat faces and the edges
+ * around them stay sharp.
+ * @param solid The solid.
+ * @param tolerance The largest allowed deviation, in the solid's units.
+ * @param mesh Receives the mesh. Must be freed with opencad_mesh_free.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_solid_tessellate(const Opencad_Solid *solid, float tolerance, Opencad_Mesh *mesh)
+{
+    memset(mesh, 0, sizeof(*mesh));
+    Opencad_Profile profile = {0};
+
+    switch (solid->kind) {
+    case OPENCAD_SOLID_BOX: {
+        if (!(solid->size.x > 0.0f && solid->size.y > 0.0f && solid->size.z > 0.0f)) return EINVAL;
+        Opencad_Vec3 h = opencad_vec3_scale(solid->size, 0.5f);
+        // Each face: its normal axis, then two in-plane axes whose cross product points outwards.
+        // Even faces look along +axis, odd faces along -axis.
+        static const int faces[6][3] = {{0, 1, 2}, {0, 2, 1}, {1, 2, 0}, {1, 0, 2}, {2, 0, 1}, {2, 1, 0}};
+        mesh->vertices = malloc(24*sizeof(*mesh->vertices));
+        mesh->indices = malloc(36*sizeof(*mesh->indices));
+        if (mesh->vertices == NULL || mesh->indices == NULL) {
+            opencad_mesh_free(mesh);
+            return ENOMEM;
+        }
+        const float half[3] = {h.x, h.y, h.z};
+        for (int f = 0; f < 6; ++f) {
+            int n = faces[f][0], u = faces[f][1], v = faces[f][2];
+            float sign = f%2 == 0 ? 1.0f : -1.0f;
+            static const float corners[4][2] = {{-1, -1}, {1, -1}, {1, 1}, {-1, 1}};
+            for (int k = 0; k < 4; ++k) {
+                float p[3];
+                p[n] = sign*half[n];
+                p[u] = corners[k][0]*half[u];
+                p[v] = corners[k][1]*half[v];
+                mesh->vertices[f*4 + k] = opencad_vec3(p[0], p[1], p[2]);
+            }
+            uint32_t base = (uint32_t) f*4;
+            uint32_t *out = &mesh->indices[f*6];
+            out[0] = base; out[1] = base + 1; out[2] = base + 2;
+            out[3] = base; out[4] = base + 2; out[5] = base + 3;
+        }
+        mesh->vertex_count = 24;
+        mesh->triangle_count = 12;
+        Errno err = opencad_mesh_compute_normals(mesh);
+        if (err) opencad_mesh_free(mesh);
+        return err;
+    }
+
+    case OPENCAD_SOLID_CYLINDER:
+    case OPENCAD_SOLID_CONE: {
+        float bottom = solid->radius;
+        float top = solid->kind == OPENCAD_SOLID_CONE ? solid->radius2 : solid->radius;
+        if (!(bottom > 0.0f && top >= 0.0f && solid->height > 0.0f)) return EINVAL;
+        const float r[] = {0.0f, bottom, bottom, top, top, 0.0f};
+        const float z[] = {0.0f, 0.0f, 0.0f, solid->height, solid->height, solid->height};
+        memcpy(profile.r, r, sizeof(r));
+        memcpy(profile.z, z, sizeof(z));
+        profile.strip_ends[0] = 2;
+        profile.strip_ends[1] = 4;
+        profile.strip_ends[2] = 6;
+        profile.strip_count = top > 0.0f ? 3 : 2;
+        return opencad_revolve_profile(&profile, opencad_circle_segments(fmaxf(bottom, top), tolerance), mesh);
+    }
+
+    case OPENCAD_SOLID_SPHERE: {
+        if (!(solid->radius > 0.0f)) return EINVAL;
+        size_t segments = opencad_circle_segments(solid->radius, tolerance);
+        size_t rows = (segments + 1)/2;
+        for (size_t i = 0; i <= rows; ++i) {
+            float angle = (float) M_PI*((float) i/(float) rows - 0.5f);
+            profile.r[i] = i == 0 || i == rows ? 0.0f : solid->radius*cosf(angle);
+            profile.z[i] = solid->radius*sinf(angle);
+        }
+        profile.strip_ends[0] = rows + 1;
+        profile.strip_count = 1;
+        return opencad_revolve_profile(&profile, segments, mesh);
+    }
+
+    case OPENCAD_SOLID_TORUS: {
+        if (!(solid->radius2 > 0.0f && solid->radius > solid->radius2)) return EINVAL;
+        size_t sides = opencad_circle_segments(solid->radius2, tolerance);
+        for (size_t i = 0; i < sides; ++i) {
+            float angle = 2.0f*(float) M_PI*(float) i/(float) sides - (float) M_PI;
+            profile.r[i] = solid->radius + solid->radius2*cosf(angle);
+            profile.z[i] = solid->radius2*sinf(angle);
+        }
+        profile.strip_ends[0] = sides;
+        profile.strip_count = 1;
+        profile.closed = true;
+        return opencad_revolve_profile(&profile, opencad_circle_segments(solid->radius + solid->radius2, tolerance), mesh);
+    }
+
+    default:
+        return EINVAL;
+    }
+}
+
+/**
+ * Returns the center and radius of a sphere around a solid.
+ * @param solid The solid.
+ * @param center Receives the center.
+ * @return The radius.
+ */
+static float opencad_solid_bounds(const Opencad_Solid *solid, Opencad_Vec3 *center)
+{
+    *center = opencad_vec3(0, 0, 0);
+    switch (solid->kind) {
+    case OPENCAD_SOLID_BOX:
+        return 0.5f*opencad_vec3_length(solid->size);
+    case OPENCAD_SOLID_CYLINDER:
+    case OPENCAD_SOLID_CONE: {
+        float r = solid->kind == OPENCAD_SOLID_CONE ? fmaxf(solid->radius, solid->radius2) : solid->radius;
+        *center = opencad_vec3(0, 0, 0.5f*solid->height);
+        return sqrtf(r*r + 0.25f*solid->height*solid->height);
+    }
+    case OPENCAD_SOLID_SPHERE:
+        return solid->radius;
+    case OPENCAD_SOLID_TORUS:
+        return solid->radius + solid->radius2;
+    default:
+        return 0.0f;
+    }
+}
+
+/**
+ * Converts a deviation on screen into a tessellation tolerance for a solid, measured where the solid
+ * comes closest to a perspective camera.
+ * @param solid The solid.
+ * @param canvas The canvas it will be drawn into.
+ * @param model The model-to-world transform.
+ * @param camera The camera.
+ * @param pixels The allowed deviation on screen, see OPENCAD_SOLID_PIXEL_TOLERANCE.
+ * @return The tolerance in the solid's units.
+ */
+float opencad_solid_tolerance(const Opencad_Solid *solid, Opencad_Canvas canvas, Opencad_Mat4 model,
+                              const Opencad_Camera *camera, float pixels)
+{
+    Opencad_Vec3 center;
+    float radius = opencad_solid_bounds(solid, &center);
+    Opencad_Mat4 model_view = opencad_mat4_mul(camera->view, model);
+    center = opencad_mat4_transform_point(model_view, center);
+    float scale = 0.0f;
+    for (int j = 0; j < 3; ++j) {
+        float column = opencad_vec3_length(opencad_vec3(model_view.m[0][j], model_view.m[1][j], model_view.m[2][j]));
+        if (column > scale) scale = column;
+    }
+
+    const float (*p)[4] = camera->projection.m;
+    float pixels_per_unit = p[1][1]*0.5f*(float) canvas.height;
+    if (p[3][2] != 0.0f) {
+        // A camera inside the bounds gets the finest tessellation the segment limit allows.
+        float distance = -center.z - radius*scale;
+        if (distance <= 0.0f) return 0.0f;
+        pixels_per_unit /= distance;
+    }
+    return pixels/(pixels_per_unit*scale);
+}
+
+typedef struct {
+    Opencad_Solid solid;    // With the fields its kind does not use zeroed.
+    float tolerance;
+    uint32_t hash;
+    Opencad_Mesh mesh;
+} Opencad_Solid_Entry;
+
+/**
+ * Tessellated solids by parameters and tolerance. Meshes live as long as the cache, so pointers to them
+ * stay valid across later lookups. Not thread-safe.
+ */
+typedef struct {
+    Opencad_Solid_Entry **slots;
+    size_t capacity;        // A power of two, or 0.
+    size_t count;
+} Opencad_Solid_Cache;
+
+/**
+ * Releases every mesh held by a cache.
+ * @param cache The cache.
+ */
+void opencad_solid_cache_free(Opencad_Solid_Cache *cache)
+{
+    for (size_t i = 0; i < cache->capacity; ++i) {
+        if (cache->slots[i] == NULL) continue;
+        opencad_mesh_free(&cache->slots[i]->mesh);
+        free(cache->slots[i]);
+    }
+    free(cache->slots);
+    memset(cache, 0, sizeof(*cache));
+}
+
+/**
+ * Returns the tessellation of a solid at a tolerance, from the cache or freshly made and added to it.
+ * Tolerances are rounded down to a power of two first, so a camera moving or zooming a little keeps
+ * hitting the same entry, and the mesh is never coarser than asked for.
+ * @param cache The cache.
+ * @param solid The solid.
+ * @param tolerance The largest allowed deviation, in the solid's units.
+ * @param mesh Receives the mesh, owned by the cache.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_solid_cache_get(Opencad_Solid_Cache *cache, const Opencad_Solid *solid, float tolerance,
+                              const Opencad_Mesh **mesh)
+{
+    Opencad_Solid key = {.kind = solid->kind};
+    switch (solid->kind) {
+    case OPENCAD_SOLID_BOX:      key.size = solid->size; break;
+    case OPENCAD_SOLID_CYLINDER: key.radius = solid->radius; key.height = solid->height; break;
+    case OPENCAD_SOLID_SPHERE:   key.radius = solid->radius; break;
+    case OPENCAD_SOLID_CONE:     key.radius = solid->radius; key.radius2 = solid->radius2; key.height = solid->height; break;
+    case OPENCAD_SOLID_TORUS:    key.radius = solid->radius; key.radius2 = solid->radius2; break;
+    default: return EINVAL;
+    }
+    if (solid->kind == OPENCAD_SOLID_BOX) tolerance = 0.0f;
+    else if (tolerance > 0.0f && isfinite(tolerance)) tolerance = exp2f(floorf(log2f(tolerance)));
+    else tolerance = 0.0f;
+
+    // Hash the fields one by one: the struct may have padding.
+    const float fields[] = {key.size.x, key.size.y, key.size.z, key.radius, key.radius2, key.height, tolerance};
+    uint32_t hash = opencad_mix32((uint32_t) key.kind + 0x9e3779b9u);
+    for (size_t i = 0; i < sizeof(fields)/sizeof(fields[0]); ++i) {
+        uint32_t bits;
+        memcpy(&bits, &fields[i], sizeof(bits));
+        hash = opencad_mix32(hash ^ bits);
+    }
+
+    for (size_t i = hash; cache->capacity > 0; ++i) {
+        Opencad_Solid_Entry *entry = cache->slots[i & (cache->capacity - 1)];
+        if (entry == NULL) break;
+        const Opencad_Solid *s = &entry->solid;
+        if (entry->hash == hash && s->kind == key.kind && s->size.x == key.size.x && s->size.y == key.size.y
+            && s->size.z == key.size.z && s->radius == key.radius && s->radius2 == key.radius2
+            && s->height == key.height && entry->tolerance == tolerance) {
+            *mesh = &entry->mesh;
+            return 0;
+        }
+    }
+
+    if ((cache->count + 1)*4 > cache->capacity*3) {
+        size_t capacity = cache->capacity ? cache->capacity*2 : 64;
+        Opencad_Solid_Entry **slots = calloc(capacity, sizeof(*slots));
+        if (slots == NULL) return ENOMEM;
+        for (size_t i = 0; i < cache->capacity; ++i) {
+            Opencad_Solid_Entry *entry = cache->slots[i];
+            if (entry == NULL) continue;
+            size_t j = entry->hash;
+            while (slots[j & (capacity - 1)]) ++j;
+            slots[j & (capacity - 1)] = entry;
+        }
+        free(cache->slots);
+        cache->slots = slots;
+        cache->capacity = capacity;
+    }
+
+    Opencad_Solid_Entry *entry = malloc(sizeof(*entry));
+    if (entry == NULL) return ENOMEM;
+    entry->solid = key;
+    entry->tolerance = tolerance;
+    entry->hash = hash;
+    Errno err = opencad_solid_tessellate(&key, tolerance, &entry->mesh);
+    if (err) {
+        free(entry);
+        return err;
+    }
+    size_t j = hash;
+    while (cache->slots[j & (cache->capacity - 1)]) ++j;
+    cache->slots[j & (cache->capacity - 1)] = entry;
+    cache->count += 1;
+    *mesh = &entry->mesh;
+    return 0;
+}
+
+/**
+ * Draws a solid tessellated to OPENCAD_SOLID_PIXEL_TOLERANCE on screen, reusing the cached mesh for
+ * that tolerance if there is one.
+ * @param canvas The canvas to draw into.
+ * @param cache The tessellation cache.
+ * @param solid The solid.
+ * @param model The model-to-world transform.
+ * @param camera The camera.
+ * @param material The material.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_render_solid(Opencad_Canvas canvas, Opencad_Solid_Cache *cache, const Opencad_Solid *solid,
+                           Opencad_Mat4 model, const Opencad_Camera *camera, const Opencad_Material *material)
+{
+    const Opencad_Mesh *mesh = NULL;
+    float tolerance = opencad_solid_tolerance(solid, canvas, model, camera, OPENCAD_SOLID_PIXEL_TOLERANCE);
+    Errno err = opencad_solid_cache_get(cache, solid, tolerance, &mesh);
+    if (err) return err;
+    return opencad_render_mesh(canvas, mesh, model, camera, material);
+}
+
+// Shewchuk's bounds on the error of the double precision determinants below, relative to their
+// permanents, with epsilon = 2^-53.
+#define OPENCAD_EPSILON 0x1p-53
+#define OPENCAD_ORIENT2D_BOUND ((3.0 + 16.0*OPENCAD_EPSILON)*OPENCAD_EPSILON)
+#define OPENCAD_ORIENT3D_BOUND ((7.0 + 56.0*OPENCAD_EPSILON)*OPENCAD_EPSILON)
+#define OPENCAD_INCIRCLE_BOUND ((10.0 + 96.0*OPENCAD_EPSILON)*OPENCAD_EPSILON)
+
+/**
+ * Computes a + b exactly as the rounded sum plus its roundoff.
+ */
+static void opencad_two_sum(double a, double b, double *sum, double *roundoff)
+{
+    double s = a + b, bv = s - a, av = s - bv;
+    *sum = s;
+    *roundoff = (a - av) + (b - bv);
+}
+
+/**
+ * Returns the roundoff of a - b, zero when the difference is exact.
+ */
+static double opencad_difference_roundoff(double a, double b)
+{
+    double difference, roundoff;
+    opencad_two_sum(a, -b, &difference, &roundoff);
+    return roundoff;
+}
+
+/**
+ * Computes a*b exactly as the rounded product plus its roundoff. The fused multiply-add keeps this
+ * exact even where the compiler contracts multiplications and additions on its own.
+ */
+static void opencad_two_product(double a, double b, double *product, double *roundoff)
+{
+    double p = a*b;
+    *product = p;
+    *roundoff = fma(a, b, -p);
+}
+
+/**
+ * Adds two expansions: sums of nonoverlapping doubles ordered by increasing magnitude, which represent
+ * a number exactly. Zero components are dropped, except for a single zero when the sum is zero.
+ * @param e The first expansion.
+ * @param e_count The number of components of e.
+ * @param f The second expansion.
+ * @param f_count The number of components of f.
+ * @param h Receives the sum, up to e_count + f_count components.
+ * @return The number of components of h.
+ */
+static size_t opencad_expansion_sum(const double *e, size_t e_count, const double *f, size_t f_count, double *h)
+{
+    size_t i = 0, j = 0, count = 0;
+    double q = 0.0;
+    for (size_t k = 0; k < e_count + f_count; ++k) {
+        double g = j == f_count || (i < e_count && fabs(e[i]) < fabs(f[j])) ? e[i++] : f[j++];
+        if (k == 0) {
+            q = g;
+            continue;
+        }
+        double roundoff;
+        opencad_two_sum(q, g, &q, &roundoff);
+        if (roundoff != 0.0) h[count++] = roundoff;
+    }
+    if (q != 0.0 || count == 0) h[count++] = q;
+    return count;
+}
+
+/**
+ * Multiplies an expansion by a double, see opencad_expansion_sum.
+ * @param e The expansion.
+ * @param e_count The number of components of e.
+ * @param b The factor.
+ * @param h Receives the product, up to 2*e_count components.
+ * @return The number of components of h.
+ */
+static size_t opencad_expansion_scale(const double *e, size_t e_count, double b, double *h)
+{
+    size_t count = 0;
+    double q, roundoff;
+    opencad_two_product(e[0], b, &q, &roundoff);
+    if (roundoff != 0.0) h[count++] = roundoff;
+    for (size_t i = 1; i < e_count; ++i) {
+        double high, low, sum;
+        opencad_two_product(e[i], b, &high, &low);
+        opencad_two_sum(q, low, &sum, &roundoff);
+        if (roundoff != 0.0) h[count++] = roundoff;
+        opencad_two_sum(high, sum, &q, &roundoff);
+        if (roundoff != 0.0) h[count++] = roundoff;
+    }
+    if (q != 0.0 || count == 0) h[count++] = q;
+    return count;
+}
+
+/**
+ * Computes a.x*b.y - b.x*a.y exactly, in up to four components.
+ */
+static size_t opencad_expansion_cross(const double *a, const double *b, double *h)
+{
+    double p[2], q[2];
+    opencad_two_product(a[0], b[1], &p[1], &p[0]);
+    opencad_two_product(-b[0], a[1], &q[1], &q[0]);
+    return opencad_expansion_sum(p, 2, q, 2, h);
+}
+
+/**
+ * Computes the exact orientations of the triangles bcd, acd, abd and abc of four points in the plane:
+ * the minors that expanding the exact 3D orientation and in-circle determinants along their third
+ * column leaves.
+ * @param points The four points, only their x and y are used.
+ * @param minors Receives the orientations as expansions of up to 12 components.
+ * @param counts Receives the number of components of each.
+ */
+static void opencad_expansion_minors(const double *points[4], double minors[4][12], size_t counts[4])
+{
+    // cross[i][j] is the cross product of points i and j; the triangle ijk is ij + jk + ki.
+    double cross[4][4][4];
+    size_t cross_counts[4][4];
+    for (int i = 0; i < 4; ++i) {
+        for (int j = i + 1; j < 4; ++j) {
+            cross_counts[i][j] = cross_counts[j][i] = opencad_expansion_cross(points[i], points[j], cross[i][j]);
+            for (size_t k = 0; k < cross_counts[i][j]; ++k) cross[j][i][k] = -cross[i][j][k];
+        }
+    }
+    static const int triangles[4][3] = {{1, 2, 3}, {0, 2, 3}, {0, 1, 3}, {0, 1, 2}};
+    for (int t = 0; t < 4; ++t) {
+        int i = triangles[t][0], j = triangles[t][1], k = triangles[t][2];
+        double sum[8];
+        size_t count = opencad_expansion_sum(cross[i][j], cross_counts[i][j], cross[j][k], cross_counts[j][k], sum);
+        counts[t] = opencad_expansion_sum(sum, count, cross[k][i], cross_counts[k][i], minors[t]);
+    }
+}
+
+/**
+ * Returns the orientation of c against the directed line through a and b: positive when abc turns
+ * counter-clockwise. The sign is exact: when the double precision determinant is too close to zero for
+ * its error bound, it is recomputed in exact arithmetic.
+ * @param a The first point of the line.
+ * @param b The second point of the line.
+ * @param c The point to test.
+ * @return Twice the signed area of abc, approximately.
+ */
+static double opencad_orient2d_double(Opencad_Vec2d a, Opencad_Vec2d b, Opencad_Vec2d c)
+{
+    double left = (b.x - a.x)*(c.y - a.y), right = (b.y - a.y)*(c.x - a.x);
+    double det = left - right, bound = OPENCAD_ORIENT2D_BOUND*(fabs(left) + fabs(right));
+    if (det > bound || -det > bound || bound == 0.0) return det;
+
+    // Differences of floats widened to double are exact unless their exponents lie far apart, which
+    // leaves only the products to expand.
+    const double u[2] = {b.x - a.x, b.y - a.y}, v[2] = {c.x - a.x, c.y - a.y};
+    if (opencad_difference_roundoff(b.x, a.x) == 0.0 && opencad_difference_roundoff(b.y, a.y) == 0.0 &&
+        opencad_difference_roundoff(c.x, a.x) == 0.0 && opencad_difference_roundoff(c.y, a.y) == 0.0) {
+        double exact[4];
+        size_t count = opencad_expansion_cross(u, v, exact);
+        return exact[count - 1];
+    }
+
+    const double p[3][2] = {{a.x, a.y}, {b.x, b.y}, {c.x, c.y}};
+    double ab[4], bc[4], ca[4], sum[8], exact[12];
+    size_t ab_count = opencad_expansion_cross(p[0], p[1], ab);
+    size_t bc_count = opencad_expansion_cross(p[1], p[2], bc);
+    size_t ca_count = opencad_expansion_cross(p[2], p[0], ca);
+    size_t count = opencad_expansion_sum(ab, ab_count, bc, bc_count, sum);
+    count = opencad_expansion_sum(sum, count, ca, ca_count, exact);
+    return exact[count - 1];
+}
+
+/**
+ * Returns the orientation of c against the directed line through a and b, see opencad_orient2d_double.
+ * @param a The first point of the line.
+ * @param b The second point of the line.
+ * @param c The point to test.
+ * @return Twice the signed area of abc, approximately.
+ */
+double opencad_orient2d(Opencad_Vec2 a, Opencad_Vec2 b, Opencad_Vec2 c)
+{
+    return opencad_orient2d_double((Opencad_Vec2d) {a.x, a.y}, (Opencad_Vec2d) {b.x, b.y}, (Opencad_Vec2d) {c.x, c.y});
+}
+
+/**
+ * Returns the orientation of d against the plane through a, b and c: the determinant of
+ * (b - a, c - a, d - a), positive when d lies on the side the counter-clockwise triangle abc faces.
+ * The sign is exact, see opencad_orient2d.
+ * @param a The first point of the plane.
+ * @param b The second point of the plane.
+ * @param c The third point of the plane.
+ * @param d The point to test.
+ * @return The determinant, approximately.
+ */
+double opencad_orient3d(const double *a, const double *b, const double *c, const double *d)
+{
+    double bx = b[0] - a[0], by = b[1] - a[1], bz = b[2] - a[2];
+    double cx = c[0] - a[0], cy = c[1] - a[1], cz = c[2] - a[2];
+    double dx = d[0] - a[0], dy = d[1] - a[1], dz = d[2] - a[2];
+    double bycz = by*cz, bzcy = bz*cy, bzcx = bz*cx, bxcz = bx*cz, bxcy = bx*cy, bycx = by*cx;
+    double det = (bycz - bzcy)*dx + (bzcx - bxcz)*dy + (bxcy - bycx)*dz;
+    double permanent = (fabs(bycz) + fabs(bzcy))*fabs(dx) + (fabs(bzcx) + fabs(bxcz))*fabs(dy) +
+                       (fabs(bxcy) + fabs(bycx))*fabs(dz);
+    double bound = OPENCAD_ORIENT3D_BOUND*permanent;
+    if (det > bound || -det > bound || bound == 0.0) return det;
+
+    const double *points[4] = {a, b, c, d};
+    bool exact_differences = true;
+    for (int i = 1; i < 4; ++i) {
+        for (int k = 0; k < 3; ++k) exact_differences &= opencad_difference_roundoff(points[i][k], a[k]) == 0.0;
+    }
+    if (exact_differences) {
+        // Along the column of d - a, each minor a cross product of the differences.
+        const double minor_rows[3][2][2] = {{{by, bz}, {cy, cz}}, {{bz, bx}, {cz, cx}}, {{bx, by}, {cx, cy}}};
+        const double factors[3] = {dx, dy, dz};
+        double minor[4], terms[3][8], sum[16], exact[24];
+        size_t term_counts[3];
+        for (int k = 0; k < 3; ++k) {
+            size_t count = opencad_expansion_cross(minor_rows[k][0], minor_rows[k][1], minor);
+            term_counts[k] = opencad_expansion_scale(minor, count, factors[k], terms[k]);
+        }
+        size_t count = opencad_expansion_sum(terms[0], term_counts[0], terms[1], term_counts[1], sum);
+        count = opencad_expansion_sum(sum, count, terms[2], term_counts[2], exact);
+        return exact[count - 1];
+    }
+
+    // Along the z column of the 4x4 determinant with rows (x, y, z, 1), which is minus this one.
+    double minors[4][12], terms[4][24], sums[2][48], exact[96];
+    size_t counts[4], term_counts[4];
+    opencad_expansion_minors(points, minors, counts);
+    for (int i = 0; i < 4; ++i) {
+        term_counts[i] = opencad_expansion_scale(minors[i], counts[i], i%2 ? points[i][2] : -points[i][2], terms[i]);
+    }
+    size_t first = opencad_expansion_sum(terms[0], term_counts[0], terms[1], term_counts[1], sums[0]);
+    size_t second = opencad_expansion_sum(terms[2], term_counts[2], terms[3], term_counts[3], sums[1]);
+    size_t count = opencad_expansion_sum(sums[0], first, sums[1], second, exact);
+    return exact[count - 1];
+}
+
+/**
+ * Returns where d lies against the circle through a, b and c: positive inside when abc is
+ * counter-clockwise, negative outside and zero on it, with the sign flipped for a clockwise abc.
+ * The sign is exact, see opencad_orient2d.
+ * @param a The first point of the circle.
+ * @param b The second point of the circle.
+ * @param c The third point of the circle.
+ * @param d The point to test.
+ * @return The determinant of the points lifted onto the paraboloid z = x^2 + y^2, approximately.
+ */
+double opencad_incircle(Opencad_Vec2 a, Opencad_Vec2 b, Opencad_Vec2 c, Opencad_Vec2 d)
+{
+    double adx = (double) a.x - d.x, ady = (double) a.y - d.y;
+    double bdx = (double) b.x - d.x, bdy = (double) b.y - d.y;
+    double cdx = (double) c.x - d.x, cdy = (double) c.y - d.y;
+    double bdxcdy = bdx*cdy, cdxbdy = cdx*bdy, cdxady = cdx*ady, adxcdy = adx*cdy, adxbdy = adx*bdy, bdxady = bdx*ady;
+    double alift = adx*adx + ady*ady, blift = bdx*bdx + bdy*bdy, clift = cdx*cdx + cdy*cdy;
+    double det = alift*(bdxcdy - cdxbdy) + blift*(cdxady - adxcdy) + clift*(adxbdy - bdxady);
+    double permanent = (fabs(bdxcdy) + fabs(cdxbdy))*alift + (fabs(cdxady) + fabs(adxcdy))*blift +
+                       (fabs(adxbdy) + fabs(bdxady))*clift;
+    double bound = OPENCAD_INCIRCLE_BOUND*permanent;
+    if (det > bound || -det > bound || bound == 0.0) return det;
+
+    if (opencad_difference_roundoff(a.x, d.x) == 0.0 && opencad_difference_roundoff(a.y, d.y) == 0.0 &&
+        opencad_difference_roundoff(b.x, d.x) == 0.0 && opencad_difference_roundoff(b.y, d.y) == 0.0 &&
+        opencad_difference_roundoff(c.x, d.x) == 0.0 && opencad_difference_roundoff(c.y, d.y) == 0.0) {
+        // Along the lift column of the differences, each minor a cross product.
+        const double rows[3][2] = {{adx, ady}, {bdx, bdy}, {cdx, cdy}};
+        double minor[4], scaled[2][8], lifted[2][16], terms[3][32], sum[64], exact[96];
+        size_t term_counts[3];
+        for (int i = 0; i < 3; ++i) {
+            size_t count = opencad_expansion_cross(rows[(i + 1)%3], rows[(i + 2)%3], minor), lifted_counts[2];
+            for (int k = 0; k < 2; ++k) {
+                size_t scaled_count = opencad_expansion_scale(minor, count, rows[i][k], scaled[k]);
+                lifted_counts[k] = opencad_expansion_scale(scaled[k], scaled_count, rows[i][k], lifted[k]);
+            }
+            term_counts[i] = opencad_expansion_sum(lifted[0], lifted_counts[0], lifted[1], lifted_counts[1], terms[i]);
+        }
+        size_t count = opencad_expansion_sum(terms[0], term_counts[0], terms[1], term_counts[1], sum);
+        count = opencad_expansion_sum(sum, count, terms[2], term_counts[2], exact);
+        return exact[count - 1];
+    }
+
+    // Along the lift column of the 4x4 determinant with rows (x, y, x^2 + y^2, 1).
+    const double p[4][2] = {{a.x, a.y}, {b.x, b.y}, {c.x, c.y}, {d.x, d.y}};
+    const double *points[4] = {p[0], p[1], p[2], p[3]};
+    double minors[4][12], scaled[2][24], lifted[2][48], terms[4][96], sums[2][192], exact[384];
+    size_t counts[4], term_counts[4];
+    opencad_expansion_minors(points, minors, counts);
+    for (int i = 0; i < 4; ++i) {
+        size_t lifted_counts[2];
+        for (int k = 0; k < 2; ++k) {
+            size_t count = opencad_expansion_scale(minors[i], counts[i], p[i][k], scaled[k]);
+            lifted_counts[k] = opencad_expansion_scale(scaled[k], count, i%2 ? -p[i][k] : p[i][k], lifted[k]);
+        }
+        term_counts[i] = opencad_expansion_sum(lifted[0], lifted_counts[0], lifted[1], lifted_counts[1], terms[i]);
+    }
+    size_t first = opencad_expansion_sum(terms[0], term_counts[0], terms[1], term_counts[1], sums[0]);
+    size_t second = opencad_expansion_sum(terms[2], term_counts[2], terms[3], term_counts[3], sums[1]);
+    size_t count = opencad_expansion_sum(sums[0], first, sums[1], second, exact);
+    return exact[count - 1];
+}
+
+// The directions of the symbolic step in opencad_orient3d_sign, in order of decreasing size. Generic
+// and independent, so no face or edge of a typical model is parallel to the first and together they
+// span every direction.
+static const double opencad_perturbation[3][3] = {
+    {0.5772156649015329, 0.3183098861837907, 0.7548776662466927},
+    {0.4142135623730950, 0.6931471805599453, 0.2360679774997897},
+    {0.7320508075688772, 0.1415926535897932, 0.5615528128088303},
+};
+
+/**
+ * Returns the sign of opencad_orient3d after the points flagged in moved take the infinitesimal step
+ * e*p[0] + e^2*p[1] + e^3*p[2] along opencad_perturbation. Booleans move every point of their second
+ * operand this way, which breaks ties between coplanar faces, collinear edges and vertices lying on
+ * faces consistently (simulation of simplicity). All moved points take the same step, so the
+ * determinant changes by the dot product of that step with g, its gradient with respect to the step,
+ * and the sign is that of the first nonzero of the determinant and the dot products of g with the
+ * three directions, all computed exactly. This leaves 0 only where g is zero, where no translation of
+ * the moved points can change the determinant: a zero-area triangle, or the line through two points
+ * parallel to the line through the other two.
+ * @param a The first point of the plane.
+ * @param b The second point of the plane.
+ * @param c The third point of the plane.
+ * @param d The point to test.
+ * @param moved Bit 0 to 3 flag a to d as moved.
+ * @return 1, -1, or 0 for input no step breaks the tie of.
+ */
+static int opencad_orient3d_sign(const double *a, const double *b, const double *c, const double *d, unsigned moved)
+{
+    double det = opencad_orient3d(a, b, c, d);
+    if (det != 0.0 || moved == 0 || moved == 0xF) return (det > 0.0) - (det < 0.0);
+
+    // The gradient with respect to point i is the normal of the triangle of the other three, with the
+    // sign alternating as along the z column in opencad_orient3d. Component k of a normal is the
+    // orientation of the triangle projected along axis k, which opencad_expansion_minors gives exactly.
+    const double *points[4] = {a, b, c, d};
+    double gradient[3][48];
+    size_t gradient_counts[3];
+    for (int k = 0; k < 3; ++k) {
+        double projected[4][2];
+        const double *rows[4];
+        for (int i = 0; i < 4; ++i) {
+            projected[i][0] = points[i][(k + 1)%3];
+            projected[i][1] = points[i][(k + 2)%3];
+            rows[i] = projected[i];
+        }
+        double minors[4][12], sum[48];
+        size_t counts[4];
+        opencad_expansion_minors(rows, minors, counts);
+        gradient[k][0] = 0.0;
+        gradient_counts[k] = 1;
+        for (int i = 0; i < 4; ++i) {
+            if (!(moved & (1u << i))) continue;
+            if (i%2 == 0) {
+                for (size_t j = 0; j < counts[i]; ++j) minors[i][j] = -minors[i][j];
+            }
+            size_t count = opencad_expansion_sum(gradient[k], gradient_counts[k], minors[i], counts[i], sum);
+            memcpy(gradient[k], sum, count*sizeof(*sum));
+            gradient_counts[k] = count;
+        }
+    }
+
+    for (int j = 0; j < 3; ++j) {
+        double terms[3][96], sum[192], slope[288];
+        size_t term_counts[3];
+        for (int k = 0; k < 3; ++k) {
+            term_counts[k] = opencad_expansion_scale(gradient[k], gradient_counts[k], opencad_perturbation[j][k], terms[k]);
+        }
+        size_t count = opencad_expansion_sum(terms[0], term_counts[0], terms[1], term_counts[1], sum);
+        count = opencad_expansion_sum(sum, count, terms[2], term_counts[2], slope);
+        if (slope[count - 1] != 0.0) return (slope[count - 1] > 0.0) - (slope[count - 1] < 0.0);
+    }
+    return 0;
+}
+
+typedef struct {
+    uint32_t point;
+    uint32_t prev;
+    uint32_t next;
+    uint32_t z;         // The Morton code of the point within the polygon's bounding box.
+    uint32_t prev_z;    // The neighbours in the list of remaining nodes sorted by z, or UINT32_MAX.
+    uint32_t next_z;
+} Opencad_Ear_Node;
+
+typedef struct {
+    double min_x, min_y;
+    double scale;       // Maps the bounding box onto 0..32767 along its longer side.
+} Opencad_Ear_Grid;
+
+/**
+ * Computes the Morton code of p on the grid by interleaving the bits of its two 15-bit cell coordinates.
+ */
+static uint32_t opencad_ear_z(Opencad_Ear_Grid grid, Opencad_Vec2d p)
+{
+    uint32_t c[2] = {(uint32_t) ((p.x - grid.min_x)*grid.scale), (uint32_t) ((p.y - grid.min_y)*grid.scale)};
+    for (int k = 0; k < 2; ++k) {
+        c[k] = (c[k] | (c[k] << 8)) & 0x00FF00FF;
+        c[k] = (c[k] | (c[k] << 4)) & 0x0F0F0F0F;
+        c[k] = (c[k] | (c[k] << 2)) & 0x33333333;
+        c[k] = (c[k] | (c[k] << 1)) & 0x55555555;
+    }
+    return c[0] | (c[1] << 1);
+}
+
+/**
+ * Tells whether the segment ab crosses the segment cd at a point inside both.
+ */
+static bool opencad_segments_cross(Opencad_Vec2d a, Opencad_Vec2d b, Opencad_Vec2d c, Opencad_Vec2d d)
+{
+    double abc = opencad_orient2d_double(a, b, c), abd = opencad_orient2d_double(a, b, d);
+    double cda = opencad_orient2d_double(c, d, a), cdb = opencad_orient2d_double(c, d, b);
+    return ((abc > 0.0 && abd < 0.0) || (abc < 0.0 && abd > 0.0)) &&
+           ((cda > 0.0 && cdb < 0.0) || (cda < 0.0 && cdb > 0.0));
+}
+
+/**
+ * Tells whether the diagonal from node n towards p starts into the polygon's interior.
+ */
+static bool opencad_ear_locally_inside(const Opencad_Vec2d *points, const Opencad_Ear_Node *nodes, uint32_t n,
+                                       Opencad_Vec2d p)
+{
+    Opencad_Vec2d a = points[nodes[nodes[n].prev].point], b = points[nodes[n].point];
+    Opencad_Vec2d c = points[nodes[nodes[n].next].point];
+    if (opencad_orient2d_double(a, b, c) >= 0.0) {
+        return opencad_orient2d_double(a, b, p) > 0.0 && opencad_orient2d_double(b, c, p) > 0.0;
+    }
+    return opencad_orient2d_double(a, b, p) > 0.0 || opencad_orient2d_double(b, c, p) > 0.0;
+}
+
+/**
+ * Tells whether the point of node m blocks cutting off the triangle abc, whose bounding box runs from
+ * low to high: it is a reflex vertex inside or on the triangle, other than one of its corners.
+ */
+static bool opencad_ear_blocks(const Opencad_Vec2d *points, const Opencad_Ear_Node *nodes, uint32_t m,
+                               Opencad_Vec2d a, Opencad_Vec2d b, Opencad_Vec2d c, Opencad_Vec2d low, Opencad_Vec2d high)
+{
+    Opencad_Vec2d p = points[nodes[m].point];
+    if (p.x < low.x || p.x > high.x || p.y < low.y || p.y > high.y) return false;
+    if ((p.x == a.x && p.y == a.y) || (p.x == b.x && p.y == b.y) || (p.x == c.x && p.y == c.y)) return false;
+    if (opencad_orient2d_double(a, b, p) < 0.0 || opencad_orient2d_double(b, c, p) < 0.0) return false;
+    if (opencad_orient2d_double(c, a, p) < 0.0) return false;
+    return opencad_orient2d_double(points[nodes[nodes[m].prev].point], p, points[nodes[nodes[m].next].point]) <= 0.0;
+}
+
+/**
+ * Tells whether the corner at node n can be cut off: it is convex and no reflex vertex lies in it.
+ * Only the nodes whose Morton codes fall within the range of the corner's bounding box can lie in
+ * it, so the search walks the z-order list outwards from n until it leaves that range.
+ */
+static bool opencad_ear_is_ear(const Opencad_Vec2d *points, const Opencad_Ear_Node *nodes, Opencad_Ear_Grid grid,
+                               uint32_t n)
+{
+    uint32_t prev = nodes[n].prev, next = nodes[n].next;
+    Opencad_Vec2d a = points[nodes[prev].point], b = points[nodes[n].point], c = points[nodes[next].point];
+    if (opencad_orient2d_double(a, b, c) <= 0.0) return false;
+    Opencad_Vec2d low = {fmin(a.x, fmin(b.x, c.x)), fmin(a.y, fmin(b.y, c.y))};
+    Opencad_Vec2d high = {fmax(a.x, fmax(b.x, c.x)), fmax(a.y, fmax(b.y, c.y))};
+    uint32_t min_z = opencad_ear_z(grid, low), max_z = opencad_ear_z(grid, high);
+    for (uint32_t m = nodes[n].prev_z; m != UINT32_MAX && nodes[m].z >= min_z; m = nodes[m].prev_z) {
+        if (opencad_ear_blocks(points, nodes, m, a, b, c, low, high)) return false;
+    }
+    for (uint32_t m = nodes[n].next_z; m != UINT32_MAX && nodes[m].z <= max_z; m = nodes[m].next_z) {
+        if (opencad_ear_blocks(points, nodes, m, a, b, c, low, high)) return false;
+    }
+    return true;
+}
+
+/**
+ * Triangulates a polygon with holes given in double precision, see opencad_triangulate_polygon.
+ */
+static Errno opencad_triangulate_polygon_double(const Opencad_Vec2d *points, const size_t *loop_ends, size_t loop_count,
+                                                uint32_t *indices, size_t *triangle_count)
+{
+    int result = 0;
+    *triangle_count = 0;
+    size_t point_count = loop_ends[loop_count - 1];
+    Opencad_Ear_Node *nodes = malloc((point_count + 2*loop_count)*sizeof(*nodes));
+    uint32_t *holes = malloc(loop_count*sizeof(*holes));   // The rightmost node of each hole.
+    uint64_t *keys = NULL;
+    uint32_t *order = NULL;
+    if (nodes == NULL || holes == NULL) return_defer(ENOMEM);
+    if (point_count > UINT32_MAX/2) return_defer(EOVERFLOW);
+
+    // Link every loop into a ring: the boundary counter-clockwise, holes clockwise.
+    size_t node_count = 0;
+    uint32_t start = UINT32_MAX;
+    size_t hole_count = 0;
+    for (size_t loop = 0; loop < loop_count; ++loop) {
+        size_t begin = loop == 0 ? 0 : loop_ends[loop - 1], end = loop_ends[loop];
+        if (end - begin < 3) continue;
+        double area = 0.0;
+        for (size_t i = begin; i < end; ++i) {
+            Opencad_Vec2d p = points[i], q = points[i + 1 < end ? i + 1 : begin];
+            area += p.x*q.y - q.x*p.y;
+        }
+        bool reverse = loop == 0 ? area < 0.0 : area > 0.0;
+        uint32_t first = (uint32_t) node_count, rightmost = first;
+        for (size_t i = 0; i < end - begin; ++i) {
+            uint32_t n = (uint32_t) node_count++;
+            nodes[n].point = (uint32_t) (reverse ? end - 1 - i : begin + i);
+            nodes[n].prev = i == 0 ? first + (uint32_t) (end - begin) - 1 : n - 1;
+            nodes[n].next = i + 1 == end - begin ? first : n + 1;
+            Opencad_Vec2d p = points[nodes[n].point], r = points[nodes[rightmost].point];
+            if (p.x > r.x || (p.x == r.x && p.y < r.y)) rightmost = n;
+        }
+        if (loop == 0) start = first;
+        else holes[hole_count++] = rightmost;
+    }
+    if (start == UINT32_MAX) return_defer(0);
+
+    // Bridge the holes from right to left, so a bridge never has to cross a hole not yet merged.
+    for (size_t i = 1; i < hole_count; ++i) {
+        for (size_t j = i; j > 0 && points[nodes[holes[j]].point].x > points[nodes[holes[j - 1]].point].x; --j) {
+            OPENCAD_SWAP(uint32_t, holes[j], holes[j - 1]);
+        }
+    }
+    for (size_t h = 0; h < hole_count; ++h) {
+        uint32_t m = holes[h];
+        Opencad_Vec2d p = points[nodes[m].point];
+        uint32_t best = UINT32_MAX, nearest = UINT32_MAX;
+        double best_distance = INFINITY, nearest_distance = INFINITY;
+        uint32_t v = start;
+        do {
+            Opencad_Vec2d q = points[nodes[v].point];
+            double distance = (q.x - p.x)*(q.x - p.x) + (q.y - p.y)*(q.y - p.y);
+            if (distance < nearest_distance) {
+                nearest_distance = distance;
+                nearest = v;
+            }
+            if (distance < best_distance && opencad_ear_locally_inside(points, nodes, v, p)) {
+                bool visible = true;
+                // Check the merged boundary and every hole still waiting; the bridge may touch
+                // neither except at its own ends.
+                for (size_t k = h; k <= hole_count && visible; ++k) {
+                    uint32_t ring = k == hole_count ? start : holes[k];
+                    uint32_t e = ring;
+                    do {
+                        Opencad_Vec2d a = points[nodes[e].point], b = points[nodes[nodes[e].next].point];
+                        if (opencad_segments_cross(p, q, a, b)) {
+                            visible = false;
+                            break;
+                        }
+                        e = nodes[e].next;
+                    } while (e != ring);
+                }
+                if (visible) {
+                    best_distance = distance;
+                    best = v;
+                }
+            }
+            v = nodes[v].next;
+        } while (v != start);
+        if (best == UINT32_MAX) best = nearest;
+
+        // Splice: ... best, m, (hole), m', best', best.next ...
+        uint32_t m2 = (uint32_t) node_count++, b2 = (uint32_t) node_count++;
+        uint32_t best_next = nodes[best].next, m_prev = nodes[m].prev;
+        nodes[m2].point = nodes[m].point;
+        nodes[b2].point = nodes[best].point;
+        nodes[best].next = m;
+        nodes[m].prev = best;
+        nodes[m_prev].next = m2;
+        nodes[m2].prev = m_prev;
+        nodes[m2].next = b2;
+        nodes[b2].prev = m2;
+        nodes[b2].next = best_next;
+        nodes[best_next].prev = b2;
+    }
+
+    size_t remaining = 0;
+    uint32_t n = start;
+    Opencad_Vec2d low = points[nodes[start].point], high = low;
+    do {
+        Opencad_Vec2d p = points[nodes[n].point];
+        low = (Opencad_Vec2d) {fmin(low.x, p.x), fmin(low.y, p.y)};
+        high = (Opencad_Vec2d) {fmax(high.x, p.x), fmax(high.y, p.y)};
+        remaining += 1;
+        n = nodes[n].next;
+    } while (n != start);
+
+    // Sort the ring by Morton code, so an ear only has to be tested against the nodes near it.
+    double extent = fmax(high.x - low.x, high.y - low.y);
+    Opencad_Ear_Grid grid = {low.x, low.y, extent > 0.0 ? 32767.0/extent : 0.0};
+    keys = malloc(remaining*sizeof(*keys));
+    order = malloc(remaining*sizeof(*order));
+    if (keys == NULL || order == NULL) return_defer(ENOMEM);
+    for (size_t i = 0; i < remaining; ++i) {
+        nodes[n].z = opencad_ear_z(grid, points[nodes[n].point]);
+        keys[i] = nodes[n].z;
+        order[i] = n;
+        n = nodes[n].next;
+    }
+    Errno err = opencad_radix_sort_u64(keys, order, remaining);
+    if (err != 0) return_defer(err);
+    for (size_t i = 0; i < remaining; ++i) {
+        nodes[order[i]].prev_z = i == 0 ? UINT32_MAX : order[i - 1];
+        nodes[order[i]].next_z = i + 1 == remaining ? UINT32_MAX : order[i + 1];
+    }
+
+    size_t count = 0, stalled = 0;
+    while (remaining > 3) {
+        uint32_t prev = nodes[n].prev, next = nodes[n].next;
+        bool ear = opencad_ear_is_ear(points, nodes, grid, n);
+        if (!ear && ++stalled < remaining) {
+            n = next;
+            continue;
+        }
+        if (!ear) {
+            // A full lap without an ear: the input is not quite simple. Drop a flat corner if there is
+            // one, otherwise cut the current corner anyway so the loop always finishes.
+            uint32_t flat = n;
+            do {
+                Opencad_Vec2d a = points[nodes[nodes[flat].prev].point], c = points[nodes[nodes[flat].next].point];
+                if (opencad_orient2d_double(a, points[nodes[flat].point], c) == 0.0) break;
+                flat = nodes[flat].next;
+            } while (flat != n);
+            if (opencad_orient2d_double(points[nodes[nodes[flat].prev].point], points[nodes[flat].point],
+                                        points[nodes[nodes[flat].next].point]) == 0.0) {
+                n = flat;
+                prev = nodes[n].prev;
+                next = nodes[n].next;
+                ear = true;
+            }
+        }
+        Opencad_Vec2d a = points[nodes[prev].point], b = points[nodes[n].point], c = points[nodes[next].point];
+        if (!ear || opencad_orient2d_double(a, b, c) != 0.0) {
+            indices[count*3 + 0] = nodes[prev].point;
+            indices[count*3 + 1] = nodes[n].point;
+            indices[count*3 + 2] = nodes[next].point;
+            count += 1;
+        }
+        nodes[prev].next = next;
+        nodes[next].prev = prev;
+        if (nodes[n].prev_z != UINT32_MAX) nodes[nodes[n].prev_z].next_z = nodes[n].next_z;
+        if (nodes[n].next_z != UINT32_MAX) nodes[nodes[n].next_z].prev_z = nodes[n].prev_z;
+        remaining -= 1;
+        stalled = 0;
+        // Skip a node before trying again, so the cuts spread around the ring rather than fanning out
+        // from prev into long slivers whose bounding boxes hold many nodes.
+        n = nodes[next].next;
+    }
+    uint32_t prev = nodes[n].prev, next = nodes[n].next;
+    if (opencad_orient2d_double(points[nodes[prev].point], points[nodes[n].point], points[nodes[next].point]) > 0.0) {
+        indices[count*3 + 0] = nodes[prev].point;
+        indices[count*3 + 1] = nodes[n].point;
+        indices[count*3 + 2] = nodes[next].point;
+        count += 1;
+    }
+    *triangle_count = count;
+
+defer:
+    free(nodes);
+    free(holes);
+    free(keys);
+    free(order);
+    return result;
+}
+
+/**
+ * Triangulates a polygon with holes by ear clipping. Every hole is first joined to the boundary by a
+ * bridge from its rightmost vertex to the nearest boundary vertex it can see, which turns the polygon
+ * into a single loop touching itself along the bridges. Loops may come in either orientation.
+ * @param points The vertices of the loops: the outer boundary, then each hole, one after another.
+ * @param loop_ends One past the last vertex of each loop.
+ * @param loop_count The number of loops, at least 1.
+ * @param indices Receives three indices into points per triangle, counter-clockwise. Needs room for
+ *        point_count + 2*(loop_count - 1) - 2 triangles.
+ * @param triangle_count Receives the number of triangles.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_triangulate_polygon(const Opencad_Vec2 *points, const size_t *loop_ends, size_t loop_count,
+                                  uint32_t *indices, size_t *triangle_count)
+{
+    *triangle_count = 0;
+    size_t point_count = loop_ends[loop_count - 1];
+    Opencad_Vec2d *wide = malloc((point_count + 1)*sizeof(*wide));
+    if (wide == NULL) return ENOMEM;
+    for (size_t i = 0; i < point_count; ++i) wide[i] = (Opencad_Vec2d) {points[i].x, points[i].y};
+    Errno err = opencad_triangulate_polygon_double(wide, loop_ends, loop_count, indices, triangle_count);
+    free(wide);
+    return err;
+}
+
+typedef enum {
+    OPENCAD_PATH_LINE,      // A straight line to end.
+    OPENCAD_PATH_ARC,       // A circular arc around control[0] to end, counter-clockwise unless clockwise is set.
+                            // An arc that ends where it starts is a full circle.
+    OPENCAD_PATH_SPLINE,    // A cubic Bezier curve through the control points control[0] and control[1] to end.
+    COUNT_OPENCAD_PATH_SEGMENTS
+} Opencad_Path_Segment_Kind;
+
+typedef struct {
+    Opencad_Path_Segment_Kind kind;
+    Opencad_Vec2 end;
+    Opencad_Vec2 control[2];
+    bool clockwise;
+} Opencad_Path_Segment;
+
+/**
+ * A planar region bounded by closed loops of lines, arcs and splines: the outer boundary, then each hole.
+ * Every segment starts where the one before it ends, and the first segment of a loop where the last one
+ * ends. Loops may run either way.
+ */
+typedef struct {
+    const Opencad_Path_Segment *segments;
+    const size_t *loop_ends;    // One past the last segment of each loop.
+    size_t loop_count;
+} Opencad_Path;
+
+#define OPENCAD_PATH_SMOOTH_COSINE 0.9998f  // Segments meeting at a smaller angle than about a degree join smoothly.
+
+/**
+ * A path flattened into polygon loops, the outer one counter-clockwise and the holes clockwise.
+ */
+typedef struct {
+    Opencad_Vec2 *points;
+    bool *creases;          // Per point: whether the segments meeting there do not join smoothly.
+    size_t *loop_ends;      // One past the last point of each loop.
+    size_t loop_count;
+} Opencad_Flat_Path;
+
+static void opencad_flat_path_free(Opencad_Flat_Path *flat)
+{
+    free(flat->points);
+    free(flat->creases);
+    free(flat->loop_ends);
+    memset(flat, 0, sizeof(*flat));
+}
+
+/**
+ * Returns the sweep of an arc segment starting at start, in radians, signed by its direction.
+ */
+static float opencad_path_arc_sweep(Opencad_Vec2 start, const Opencad_Path_Segment *segment)
+{
+    Opencad_Vec2 c = segment->control[0];
+    float a0 = atan2f(start.y - c.y, start.x - c.x), a1 = atan2f(segment->end.y - c.y, segment->end.x - c.x);
+    float sweep = a1 - a0;
+    if (segment->clockwise) {
+        if (sweep >= 0.0f) sweep -= 2.0f*(float) M_PI;
+    } else {
+        if (sweep <= 0.0f) sweep += 2.0f*(float) M_PI;
+    }
+    return sweep;
+}
+
+/**
+ * Returns how many chords approximate a segment to within a tolerance: one per line, enough for the
+ * sagitta of arcs, and for splines Wang's bound, from the largest second difference of the control points.
+ */
+static size_t opencad_path_segment_steps(Opencad_Vec2 start, const Opencad_Path_Segment *segment, float tolerance)
+{
+    switch (segment->kind) {
+    case OPENCAD_PATH_ARC: {
+        Opencad_Vec2 c = segment->control[0];
+        float radius = fmaxf(hypotf(start.x - c.x, start.y - c.y), hypotf(segment->end.x - c.x, segment->end.y - c.y));
+        float sweep = fabsf(opencad_path_arc_sweep(start, segment));
+        float steps = ceilf((float) opencad_circle_segments(radius, tolerance)*sweep/(2.0f*(float) M_PI));
+        return steps > 1.0f ? (size_t) steps : 1;
+    }
+    case OPENCAD_PATH_SPLINE: {
+        const Opencad_Vec2 p[4] = {start, segment->control[0], segment->control[1], segment->end};
+        float m = 0.0f;
+        for (int i = 0; i < 2; ++i) {
+            m = fmaxf(m, hypotf(p[i].x - 2.0f*p[i + 1].x + p[i + 2].x, p[i].y - 2.0f*p[i + 1].y + p[i + 2].y));
+        }
+        float steps = ceilf(sqrtf(0.75f*m/tolerance));
+        if (!(steps < OPENCAD_SOLID_MAX_SEGMENTS)) return OPENCAD_SOLID_MAX_SEGMENTS;
+        return steps > 1.0f ? (size_t) steps : 1;
+    }
+    default:
+        return 1;
+    }
+}
+
+/**
+ * Evaluates a segment starting at start at a parameter in [0, 1]. Arcs whose ends lie at different
+ * distances from the center blend the radius between them.
+ */
+static Opencad_Vec2 opencad_path_segment_point(Opencad_Vec2 start, const Opencad_Path_Segment *segment, float t)
+{
+    Opencad_Vec2 e = segment->end;
+    switch (segment->kind) {
+    case OPENCAD_PATH_ARC: {
+        Opencad_Vec2 c = segment->control[0];
+        float r0 = hypotf(start.x - c.x, start.y - c.y), r1 = hypotf(e.x - c.x, e.y - c.y);
+        float angle = atan2f(start.y - c.y, start.x - c.x) + opencad_path_arc_sweep(start, segment)*t;
+        float r = r0 + (r1 - r0)*t;
+        return (Opencad_Vec2) { c.x + r*cosf(angle), c.y + r*sinf(angle) };
+    }
+    case OPENCAD_PATH_SPLINE: {
+        Opencad_Vec2 a = segment->control[0], b = segment->control[1];
+        float s = 1.0f - t, w0 = s*s*s, w1 = 3.0f*s*s*t, w2 = 3.0f*s*t*t, w3 = t*t*t;
+        return (Opencad_Vec2) { w0*start.x + w1*a.x + w2*b.x + w3*e.x, w0*start.y + w1*a.y + w2*b.y + w3*e.y };
+    }
+    default:
+        return (Opencad_Vec2) { start.x + (e.x - start.x)*t, start.y + (e.y - start.y)*t };
+    }
+}
+
+/**
+ * Returns the direction of a segment starting at start, at its start or at its end.
+ */
+static Opencad_Vec2 opencad_path_segment_tangent(Opencad_Vec2 start, const Opencad_Path_Segment *segment, bool at_end)
+{
+    Opencad_Vec2 p = at_end ? segment->end : start, e = segment->end;
+    switch (segment->kind) {
+    case OPENCAD_PATH_ARC: {
+        Opencad_Vec2 c = segment->control[0];
+        float sign = segment->clockwise ? -1.0f : 1.0f;
+        return (Opencad_Vec2) { -sign*(p.y - c.y), sign*(p.x - c.x) };
+    }
+    case OPENCAD_PATH_SPLINE: {
+        // A control point on its end point leaves the direction to the other one.
+        Opencad_Vec2 a = segment->control[0], b = segment->control[1];
+        if (at_end) {
+            Opencad_Vec2 q = e.x != b.x || e.y != b.y ? b : a.x != e.x || a.y != e.y ? a : start;
+            return (Opencad_Vec2) { e.x - q.x, e.y - q.y };
+        }
+        Opencad_Vec2 q = a.x != start.x || a.y != start.y ? a : b.x != start.x || b.y != start.y ? b : e;
+        return (Opencad_Vec2) { q.x - start.x, q.y - start.y };
+    }
+    default:
+        return (Opencad_Vec2) { e.x - start.x, e.y - start.y };
+    }
+}
+
+/**
+ * Flattens a path into loops of points no farther than a tolerance from it, each segment contributing
+ * the points after its start, so every loop closes on itself.
+ * @return An error code indicating the result of the operation.
+ */
+static Errno opencad_path_flatten(const Opencad_Path *path, float tolerance, Opencad_Flat_Path *flat)
+{
+    memset(flat, 0, sizeof(*flat));
+    if (path->loop_count == 0 || !(tolerance > 0.0f)) return EINVAL;
+    size_t count = 0;
+    for (size_t loop = 0; loop < path->loop_count; ++loop) {
+        size_t begin = loop == 0 ? 0 : path->loop_ends[loop - 1], end = path->loop_ends[loop];
+        if (end <= begin) return EINVAL;
+        for (size_t s = begin; s < end; ++s) {
+            if (path->segments[s].kind >= COUNT_OPENCAD_PATH_SEGMENTS) return EINVAL;
+            count += opencad_path_segment_steps(path->segments[s == begin ? end - 1 : s - 1].end, &path->segments[s], tolerance);
+        }
+    }
+    if (count >= UINT32_MAX/8) return EOVERFLOW;
+
+    flat->points = malloc(count*sizeof(*flat->points));
+    flat->creases = malloc(count*sizeof(*flat->creases));
+    flat->loop_ends = malloc(path->loop_count*sizeof(*flat->loop_ends));
+    if (!flat->points || !flat->creases || !flat->loop_ends) {
+        opencad_flat_path_free(flat);
+        return ENOMEM;
+    }
+    flat->loop_count = path->loop_count;
+
+    size_t n = 0;
+    for (size_t loop = 0; loop < path->loop_count; ++loop) {
+        size_t begin = loop == 0 ? 0 : path->loop_ends[loop - 1], end = path->loop_ends[loop], first = n;
+        for (size_t s = begin; s < end; ++s) {
+            const Opencad_Path_Segment *segment = &path->segments[s], *next = &path->segments[s + 1 < end ? s + 1 : begin];
+            Opencad_Vec2 start = path->segments[s == begin ? end - 1 : s - 1].end;
+            size_t steps = opencad_path_segment_steps(start, segment, tolerance);
+            for (size_t i = 1; i < steps; ++i) {
+                flat->points[n] = opencad_path_segment_point(start, segment, (float) i/(float) steps);
+                flat->creases[n++] = false;
+            }
+            Opencad_Vec2 u = opencad_path_segment_tangent(start, segment, true);
+            Opencad_Vec2 v = opencad_path_segment_tangent(segment->end, next, false);
+            float lengths = hypotf(u.x, u.y)*hypotf(v.x, v.y);
+            flat->points[n] = segment->end;
+            flat->creases[n++] = !(u.x*v.x + u.y*v.y > OPENCAD_PATH_SMOOTH_COSINE*lengths);
+        }
+
+        // The boundary counter-clockwise and the holes clockwise, so the solid is always on the left.
+        double area = 0.0;
+        for (size_t i = first; i < n; ++i) {
+            Opencad_Vec2 p = flat->points[i], q = flat->points[i + 1 < n ? i + 1 : first];
+            area += (double) p.x*q.y - (double) q.x*p.y;
+        }
+        if (loop == 0 ? area < 0.0 : area > 0.0) {
+            // Reversing keeps the loop's closing point last: it ends the last segment of the reversed loop too.
+            for (size_t i = first, j = n - 2; i + 1 < n && i < j; ++i, --j) {
+                OPENCAD_SWAP(Opencad_Vec2, flat->points[i], flat->points[j]);
+                OPENCAD_SWAP(bool, flat->creases[i], flat->creases[j]);
+            }
+        }
+        flat->loop_ends[loop] = n;
+    }
+    return 0;
+}
+
+/**
+ * The vertices of the walls swept from a flattened path: one per point, or two where the path has a
+ * crease, so the faces on either side of a sharp corner do not share normals.
+ */
+typedef struct {
+    Opencad_Vec2 *points;
+    uint32_t *incoming;     // Per path point: the wall vertex of the edge ending there.
+    uint32_t *outgoing;     // Per path point: the wall vertex of the edge starting there.
+    size_t count;
+} Opencad_Path_Walls;
+
+static void opencad_path_walls_free(Opencad_Path_Walls *walls)
+{
+    free(walls->points);
+    free(walls->incoming);
+    free(walls->outgoing);
+    memset(walls, 0, sizeof(*walls));
+}
+
+static Errno opencad_path_walls(const Opencad_Flat_Path *flat, Opencad_Path_Walls *walls)
+{
+    memset(walls, 0, sizeof(*walls));
+    size_t point_count = flat->loop_ends[flat->loop_count - 1];
+    walls->points = malloc(2*point_count*sizeof(*walls->points));
+    walls->incoming = malloc(point_count*sizeof(*walls->incoming));
+    walls->outgoing = malloc(point_count*sizeof(*walls->outgoing));
+    if (!walls->points || !walls->incoming || !walls->outgoing) {
+        opencad_path_walls_free(walls);
+        return ENOMEM;
+    }
+    for (size_t i = 0; i < point_count; ++i) {
+        walls->incoming[i] = (uint32_t) walls->count;
+        walls->points[walls->count++] = flat->points[i];
+        if (flat->creases[i]) walls->points[walls->count++] = flat->points[i];
+        walls->outgoing[i] = (uint32_t) walls->count - 1;
+    }
+    return 0;
+}
+
+/**
+ * Returns the point after a point of a flattened path, wrapping around its loop.
+ */
+static size_t opencad_flat_path_next(const Opencad_Flat_Path *flat, size_t loop, size_t i)
+{
+    size_t begin = loop == 0 ? 0 : flat->loop_ends[loop - 1];
+    return i + 1 < flat->loop_ends[loop] ? i + 1 : begin;
+}
+
+/**
+ * Triangulates the region of a flattened path for a cap.
+ * @param indices Receives the triangles, counter-clockwise. Must be freed.
+ * @return An error code indicating the result of the operation.
+ */
+static Errno opencad_flat_path_triangulate(const Opencad_Flat_Path *flat, uint32_t **indices, size_t *triangle_count)
+{
+    size_t point_count = flat->loop_ends[flat->loop_count - 1];
+    *indices = malloc((point_count + 2*flat->loop_count)*3*sizeof(**indices));
+    if (*indices == NULL) return ENOMEM;
+    Errno err = opencad_triangulate_polygon(flat->points, flat->loop_ends, flat->loop_count, *indices, triangle_count);
+    if (err) {
+        free(*indices);
+        *indices = NULL;
+    }
+    return err;
+}
+
+/**
+ * Extrudes a path along the z axis into a closed solid standing on the xy plane. Curves are flattened to
+ * within a chord height tolerance, the walls are swept in one pass over the flattened points, and the
+ * caps are triangulated by ear clipping. The walls are smooth along arcs and splines and sharp where
+ * segments meet at an angle.
+ * @param path The profile.
+ * @param height The height of the solid.
+ * @param tolerance The largest distance between a curve and its chords.
+ * @param mesh Receives the mesh. Must be freed with opencad_mesh_free.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_path_extrude(const Opencad_Path *path, float height, float tolerance, Opencad_Mesh *mesh)
+{
+    int result = 0;
+    memset(mesh, 0, sizeof(*mesh));
+    Opencad_Flat_Path flat = {0};
+    Opencad_Path_Walls walls = {0};
+    uint32_t *cap = NULL;
+    {
+        if (!(height > 0.0f)) return_defer(EINVAL);
+        Errno err = opencad_path_flatten(path, tolerance, &flat);
+        if (err) return_defer(err);
+        err = opencad_path_walls(&flat, &walls);
+        if (err) return_defer(err);
+        size_t cap_count;
+        err = opencad_flat_path_triangulate(&flat, &cap, &cap_count);
+        if (err) return_defer(err);
+
+        // Bottom then top rings of wall vertices, then bottom then top cap vertices.
+        const size_t point_count = flat.loop_ends[flat.loop_count - 1], w = walls.count;
+        mesh->vertex_count = 2*w + 2*point_count;
+        mesh->triangle_count = 2*point_count + 2*cap_count;
+        mesh->vertices = malloc(mesh->vertex_count*sizeof(*mesh->vertices));
+        mesh->indices = malloc(mesh->triangle_count*3*sizeof(*mesh->indices));
+        if (!mesh->vertices || !mesh->indices) return_defer(ENOMEM);
+        Opencad_Vec3 *v = mesh->vertices;
+        for (size_t k = 0; k < w; ++k) {
+            v[k] = opencad_vec3(walls.points[k].x, walls.points[k].y, 0.0f);
+            v[w + k] = opencad_vec3(walls.points[k].x, walls.points[k].y, height);
+        }
+        for (size_t i = 0; i < point_count; ++i) {
+            v[2*w + i] = opencad_vec3(flat.points[i].x, flat.points[i].y, 0.0f);
+            v[2*w + point_count + i] = opencad_vec3(flat.points[i].x, flat.points[i].y, height);
+        }
+
+        // Quad (p, q, q', p') faces outwards with the solid on the left of pq.
+        uint32_t *out = mesh->indices;
+        for (size_t loop = 0; loop < flat.loop_count; ++loop) {
+            for (size_t i = loop == 0 ? 0 : flat.loop_ends[loop - 1]; i < flat.loop_ends[loop]; ++i) {
+                uint32_t p = walls.outgoing[i], q = walls.incoming[opencad_flat_path_next(&flat, loop, i)];
+                *out++ = p; *out++ = q; *out++ = (uint32_t) w + q;
+                *out++ = p; *out++ = (uint32_t) w + q; *out++ = (uint32_t) w + p;
+            }
+        }
+        for (size_t t = 0; t < cap_count; ++t) {
+            const uint32_t *c = &cap[t*3];
+            *out++ = (uint32_t) (2*w) + c[0]; *out++ = (uint32_t) (2*w) + c[2]; *out++ = (uint32_t) (2*w) + c[1];
+            for (int k = 0; k < 3; ++k) *out++ = (uint32_t) (2*w + point_count) + c[k];
+        }
+        err = opencad_mesh_compute_normals(mesh);
+        if (err) return_defer(err);
+    }
+
+defer:
+    opencad_flat_path_free(&flat);
+    opencad_path_walls_free(&walls);
+    free(cap);
+    if (result != 0) opencad_mesh_free(mesh);
+    return result;
+}
+
+/**
+ * Revolves a path in the xz plane (its x is the distance from the axis, its y the height) around the z
+ * axis. Curves are flattened to within a chord height tolerance and the steps around the axis follow the
+ * same tolerance at the largest radius. Points on the axis become single pole vertices; a partial
+ * revolution is closed by two caps, triangulated by ear clipping.
+ * @param path The profile. Must not cross the axis: x >= 0 everywhere.
+ * @param angle The angle to sweep, counter-clockwise around z, in radians; 2*pi or more for a full turn.
+ * @param tolerance The largest distance between a curve and its chords.
+ * @param mesh Receives the mesh. Must be freed with opencad_mesh_free.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_path_revolve(const Opencad_Path *path, float angle, float tolerance, Opencad_Mesh *mesh)
+{
+    int result = 0;
+    memset(mesh, 0, sizeof(*mesh));
+    Opencad_Flat_Path flat = {0};
+    Opencad_Path_Walls walls = {0};
+    uint32_t *cap = NULL, *first = NULL;
+    {
+        if (!(angle > 0.0f)) return_defer(EINVAL);
+        Errno err = opencad_path_flatten(path, tolerance, &flat);
+        if (err) return_defer(err);
+        const size_t point_count = flat.loop_ends[flat.loop_count - 1];
+        float radius = 0.0f;
+        for (size_t i = 0; i < point_count; ++i) {
+            if (!(flat.points[i].x >= 0.0f)) return_defer(EINVAL);
+            radius = fmaxf(radius, flat.points[i].x);
+        }
+        if (radius == 0.0f) return_defer(EINVAL);
+        err = opencad_path_walls(&flat, &walls);
+        if (err) return_defer(err);
+
+        const bool full = angle >= 2.0f*(float) M_PI;
+        if (full) angle = 2.0f*(float) M_PI;
+        float steps_f = ceilf((float) opencad_circle_segments(radius, tolerance)*angle/(2.0f*(float) M_PI));
+        const size_t steps = steps_f > 1.0f ? (size_t) steps_f : 1, rings = full ? steps : steps + 1;
+        size_t cap_count = 0;
+        if (!full) {
+            err = opencad_flat_path_triangulate(&flat, &cap, &cap_count);
+            if (err) return_defer(err);
+        }
+
+        // Wall vertex k at step j is first[k] + j, or first[k] alone on the axis; the caps follow.
+        first = malloc((walls.count + 1)*sizeof(*first));
+        if (first == NULL) return_defer(ENOMEM);
+        size_t vertex_count = 0;
+        for (size_t k = 0; k < walls.count; ++k) {
+            first[k] = (uint32_t) vertex_count;
+            vertex_count += walls.points[k].x == 0.0f ? 1 : rings;
+        }
+        const size_t caps = vertex_count;
+        if (!full) vertex_count += 2*point_count;
+        if (vertex_count >= UINT32_MAX) return_defer(EOVERFLOW);
+        mesh->vertex_count = vertex_count;
+        mesh->vertices = malloc(vertex_count*sizeof(*mesh->vertices));
+        mesh->indices = malloc((2*steps*point_count + 2*cap_count)*3*sizeof(*mesh->indices));
+        if (!mesh->vertices || !mesh->indices) return_defer(ENOMEM);
+
+        for (size_t j = 0; j < rings; ++j) {
+            float a = angle*(float) j/(float) steps, c = cosf(a), s = sinf(a);
+            for (size_t k = 0; k < walls.count; ++k) {
+                Opencad_Vec2 p = walls.points[k];
+                if (p.x == 0.0f && j > 0) continue;
+                mesh->vertices[first[k] + j] = opencad_vec3(p.x*c, p.x*s, p.y);
+            }
+        }
+        if (!full) {
+            float c = cosf(angle), s = sinf(angle);
+            for (size_t i = 0; i < point_count; ++i) {
+                Opencad_Vec2 p = flat.points[i];
+                mesh->vertices[caps + i] = opencad_vec3(p.x, 0.0f, p.y);
+                mesh->vertices[caps + point_count + i] = opencad_vec3(p.x*c, p.x*s, p.y);
+            }
+        }
+
+        // Quad (a_j, a_j+1, b_j+1, b_j) faces outwards when b follows a with the solid on the left.
+        uint32_t *out = mesh->indices;
+        for (size_t loop = 0; loop < flat.loop_count; ++loop) {
+            for (size_t i = loop == 0 ? 0 : flat.loop_ends[loop - 1]; i < flat.loop_ends[loop]; ++i) {
+                uint32_t a = walls.outgoing[i], b = walls.incoming[opencad_flat_path_next(&flat, loop, i)];
+                bool a_pole = walls.points[a].x == 0.0f, b_pole = walls.points[b].x == 0.0f;
+                if (a_pole && b_pole) continue;
+                for (size_t j = 0; j < steps; ++j) {
+                    size_t k = (j + 1)%rings;
+                    uint32_t aj = first[a] + (uint32_t) (a_pole ? 0 : j), ak = first[a] + (uint32_t) (a_pole ? 0 : k);
+                    uint32_t bj = first[b] + (uint32_t) (b_pole ? 0 : j), bk = first[b] + (uint32_t) (b_pole ? 0 : k);
+                    if (!a_pole) {
+                        *out++ = aj; *out++ = ak; *out++ = bk;
+                    }
+                    if (!b_pole) {
+                        *out++ = aj; *out++ = bk; *out++ = bj;
+                    }
+                }
+            }
+        }
+        // The start cap looks along -y, which the counter-clockwise triangles of the profile already do.
+        for (size_t t = 0; t < cap_count; ++t) {
+            const uint32_t *c = &cap[t*3];
+            for (int k = 0; k < 3; ++k) *out++ = (uint32_t) caps + c[k];
+            *out++ = (uint32_t) (caps + point_count) + c[0]; *out++ = (uint32_t) (caps + point_count) + c[2];
+            *out++ = (uint32_t) (caps + point_count) + c[1];
+        }
+        mesh->triangle_count = (size_t) (out - mesh->indices)/3;
+        err = opencad_mesh_compute_normals(mesh);
+        if (err) return_defer(err);
+    }
+
+defer:
+    opencad_flat_path_free(&flat);
+    opencad_path_walls_free(&walls);
+    free(cap);
+    free(first);
+    if (result != 0) opencad_mesh_free(mesh);
+    return result;
+}
+
+#define OPENCAD_BVH_LEAF_SIZE 4
+#define OPENCAD_BVH_MAX_DEPTH 64
+
+typedef struct {
+    float min[3];
+    float max[3];
+    uint32_t first;     // Leaf: the first entry in triangles. Inner node: the right child; the left one follows the node.
+    uint32_t count;     // Leaf: the number of triangles. Inner node: 0.
+} Opencad_Bvh_Node;
+
+/**
+ * A bounding volume hierarchy over the triangles of a mesh.
+ */
+typedef struct {
+    Opencad_Bvh_Node *nodes;
+    size_t node_count;
+    uint32_t *triangles;
+    size_t triangle_count;
+} Opencad_Bvh;
+
+typedef struct {
+    Opencad_Bvh *bvh;
+    const uint64_t *codes;  // Morton codes of the triangle centers, sorted along with bvh->triangles.
+    float (*bounds)[6];     // Per triangle: min, max.
+} Opencad_Bvh_Builder;
+
+/**
+ * Spreads the low 10 bits of a value out to every third bit.
+ */
+static uint32_t opencad_morton_spread(uint32_t v)
+{
+    v &= 0x3FF;
+    v = (v | (v << 16)) & 0x030000FF;
+    v = (v | (v << 8)) & 0x0300F00F;
+    v = (v | (v << 4)) & 0x030C30C3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+/**
+ * Builds the subtree over triangles[begin, end) into node, splitting where the highest bit of the
+ * range's Morton codes changes, which is the middle of the longest side of a cell of the Morton grid.
+ */
+static void opencad_bvh_split(Opencad_Bvh_Builder *builder, uint32_t node, size_t begin, size_t end, size_t depth)
+{
+    Opencad_Bvh *bvh = builder->bvh;
+    Opencad_Bvh_Node *n = &bvh->nodes[node];
+    if (end - begin <= OPENCAD_BVH_LEAF_SIZE || depth + 1 >= OPENCAD_BVH_MAX_DEPTH) {
+        for (int k = 0; k < 3; ++k) {
+            n->min[k] = INFINITY;
+            n->max[k] = -INFINITY;
+        }
+        for (size_t i = begin; i < end; ++i) {
+            const float *b = builder->bounds[bvh->triangles[i]];
+            for (int k = 0; k < 3; ++k) {
+                if (b[k] < n->min[k]) n->min[k] = b[k];
+                if (b[3 + k] > n->max[k]) n->max[k] = b[3 + k];
+            }
+        }
+        n->first = (uint32_t) begin;
+        n->count = (uint32_t) (end - begin);
+        return;
+    }
+
+    const uint64_t *codes = builder->codes;
+    size_t split = begin + (end - begin)/2;
+    if (codes[begin] != codes[end - 1]) {
+        int bit = 63 - __builtin_clzll(codes[begin] ^ codes[end - 1]);
+        size_t lo = begin, hi = end - 1;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo)/2;
+            if ((codes[mid] >> bit) & 1) hi = mid;
+            else lo = mid + 1;
+        }
+        split = lo;
+    }
+
+    uint32_t left = (uint32_t) bvh->node_count++;
+    opencad_bvh_split(builder, left, begin, split, depth + 1);
+    uint32_t right = (uint32_t) bvh->node_count++;
+    opencad_bvh_split(builder, right, split, end, depth + 1);
+    n = &bvh->nodes[node];
+    const Opencad_Bvh_Node *l = &bvh->nodes[left], *r = &bvh->nodes[right];
+    for (int k = 0; k < 3; ++k) {
+        n->min[k] = l->min[k] < r->min[k] ? l->min[k] : r->min[k];
+        n->max[k] = l->max[k] > r->max[k] ? l->max[k] : r->max[k];
+    }
+    n->first = right;
+    n->count = 0;
+}
+
+/**
+ * Releases the memory held by a bounding volume hierarchy.
+ * @param bvh The hierarchy.
+ */
+void opencad_bvh_free(Opencad_Bvh *bvh)
+{
+    free(bvh->nodes);
+    free(bvh->triangles);
+    memset(bvh, 0, sizeof(*bvh));
+}
+
+/**
+ * Builds a bounding volume hierarchy over the triangles of a mesh. Triangles are sorted along a
+ * Morton curve through their centers, and the tree follows the bits of the curve.
+ * @param bvh Receives the hierarchy. Must be freed with opencad_bvh_free.
+ * @param mesh The mesh. The hierarchy refers to its triangles by index.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_bvh_build(Opencad_Bvh *bvh, const Opencad_Mesh *mesh)
+{
+    int result = 0;
+    memset(bvh, 0, sizeof(*bvh));
+    uint64_t *codes = NULL;
+    Opencad_Bvh_Builder builder = { .bvh = bvh };
+    {
+        if (mesh->triangle_count >= UINT32_MAX/2) return_defer(EOVERFLOW);
+        bvh->nodes = malloc((2*mesh->triangle_count + 1)*sizeof(*bvh->nodes));
+        bvh->triangles = malloc((mesh->triangle_count + 1)*sizeof(*bvh->triangles));
+        builder.bounds = malloc((mesh->triangle_count + 1)*sizeof(*builder.bounds));
+        codes = malloc((mesh->triangle_count + 1)*sizeof(*codes));
+        if (!bvh->nodes || !bvh->triangles || !builder.bounds || !codes) return_defer(ENOMEM);
+
+        Opencad_Vec3 min, max;
+        opencad_mesh_bounds(mesh, &min, &max);
+        const float lo[3] = {min.x, min.y, min.z}, hi[3] = {max.x, max.y, max.z};
+        for (size_t t = 0; t < mesh->triangle_count; ++t) {
+            const uint32_t *tri = &mesh->indices[t*3];
+            const float *p[3];
+            for (int j = 0; j < 3; ++j) p[j] = &mesh->vertices[tri[j]].x;
+            uint32_t cell[3];
+            for (int k = 0; k < 3; ++k) {
+                float a = p[0][k] < p[1][k] ? p[0][k] : p[1][k], b = p[0][k] > p[1][k] ? p[0][k] : p[1][k];
+                builder.bounds[t][k] = a < p[2][k] ? a : p[2][k];
+                builder.bounds[t][3 + k] = b > p[2][k] ? b : p[2][k];
+                float center = 0.5f*(builder.bounds[t][k] + builder.bounds[t][3 + k]);
+                float s = hi[k] > lo[k] ? (center - lo[k])/(hi[k] - lo[k]) : 0.0f;
+                cell[k] = (uint32_t) (s*1023.0f + 0.5f);
+            }
+            codes[t] = opencad_morton_spread(cell[0]) | opencad_morton_spread(cell[1]) << 1 | opencad_morton_spread(cell[2]) << 2;
+            bvh->triangles[t] = (uint32_t) t;
+        }
+        Errno err = opencad_radix_sort_u64(codes, bvh->triangles, mesh->triangle_count);
+        if (err) return_defer(err);
+
+        builder.codes = codes;
+        bvh->triangle_count = mesh->triangle_count;
+        bvh->node_count = 1;
+        opencad_bvh_split(&builder, 0, 0, mesh->triangle_count, 0);
+    }
+
+defer:
+    free(builder.bounds);
+    free(codes);
+    if (result != 0) opencad_bvh_free(bvh);
+    return result;
+}
+
+typedef enum {
+    OPENCAD_BOOLEAN_UNION = 0,
+    OPENCAD_BOOLEAN_DIFFERENCE,
+    OPENCAD_BOOLEAN_INTERSECTION,
+    COUNT_OPENCAD_BOOLEANS,
+} Opencad_Boolean;
+
+/**
+ * A piece of the curve where two triangles, one of each operand, cross.
+ */
+typedef struct {
+    double points[2][3];    // Kept in double, so the split sees where the curve really runs.
+    uint32_t triangles[2];  // The triangle of each operand.
+    int8_t edges[2][2];     // [end][operand]: the edge of that triangle the end lies on, or -1 inside it.
+} Opencad_Csg_Segment;
+
+/**
+ * A point of the crossing curve on an edge of an operand's mesh. Every triangle around the edge has
+ * to split there, crossed by the curve or not, or the result would have T-junctions.
+ */
+typedef struct {
+    uint32_t mesh;
+    uint64_t edge;          // The smaller vertex index in the upper half.
+    double point[3];
+} Opencad_Csg_Edge_Point;
+
+typedef struct {
+    uint32_t thread;
+    uint32_t count;         // Triangles.
+    size_t offset;          // Into the corners of the thread.
+} Opencad_Csg_Output;
+
+typedef struct {
+    const Opencad_Mesh *meshes[2];
+    Opencad_Bvh bvhs[2];
+    Opencad_Boolean op;
+    double centers[2][3];   // Of the bounding boxes.
+    double reach[2];        // Half the diagonal of the bounding boxes.
+    Opencad_Csg_Segment *thread_segments[OPENCAD_MAX_THREADS];
+    size_t thread_segment_counts[OPENCAD_MAX_THREADS];
+    size_t thread_segment_capacities[OPENCAD_MAX_THREADS];
+    Opencad_Csg_Segment *segments;
+    uint32_t *segment_offsets[2];   // Per triangle of each operand, into segment_ids.
+    uint32_t *segment_ids[2];
+    Opencad_Csg_Edge_Point *thread_edge_points[OPENCAD_MAX_THREADS];
+    size_t thread_edge_point_counts[OPENCAD_MAX_THREADS];
+    size_t thread_edge_point_capacities[OPENCAD_MAX_THREADS];
+    Opencad_Csg_Edge_Point *edge_points;    // Sorted by operand and edge.
+    size_t edge_point_count;
+    int8_t *twins[2];               // Per triangle: 1 (-1) where the other operand has the same triangle facing
+                                    // the same (opposite) way, else 0.
+    uint32_t *components[2];        // Per triangle not crossed by the curve: a triangle standing for its region.
+    bool *inside[2];                // Per component: whether it lies inside the other operand.
+    uint32_t *roots;                // The components of both operands, the second's offset by the first's triangle count.
+    Opencad_Vec3 *thread_corners[OPENCAD_MAX_THREADS];
+    size_t thread_corner_counts[OPENCAD_MAX_THREADS];
+    size_t thread_corner_capacities[OPENCAD_MAX_THREADS];
+    Opencad_Csg_Output *outputs;    // Per triangle, the first operand's and then the second's.
+    atomic_bool failed;             // Set by any thread that runs out of memory.
+} Opencad_Csg;
+
+/**
+ * Loads a vertex of an operand as doubles.
+ */
+static void opencad_csg_point(const Opencad_Mesh *mesh, uint32_t vertex, double *p)
+{
+    p[0] = mesh->vertices[vertex].x;
+    p[1] = mesh->vertices[vertex].y;
+    p[2] = mesh->vertices[vertex].z;
+}
+
+/**
+ * Tells whether two points are the same.
+ */
+static bool opencad_csg_same_point(const double *a, const double *b)
+{
+    return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+}
+
+/**
+ * Finds where triangle ta of the first operand crosses triangle tb of the second. Every end of the
+ * segment is an edge of one triangle piercing the other, and its position depends only on that edge
+ * and that triangle, so the triangles around an edge all compute bit-identical points.
+ * @return Whether the triangles cross.
+ */
+static bool opencad_csg_intersect(const Opencad_Csg *csg, uint32_t ta, uint32_t tb, Opencad_Csg_Segment *segment)
+{
+    double p[2][3][3];
+    uint32_t ids[2][3];
+    uint32_t t[2] = {ta, tb};
+    for (int m = 0; m < 2; ++m) {
+        for (int k = 0; k < 3; ++k) {
+            ids[m][k] = csg->meshes[m]->indices[t[m]*3 + k];
+            opencad_csg_point(csg->meshes[m], ids[m][k], p[m][k]);
+        }
+    }
+
+    // The second operand is the one that moves, see opencad_orient3d_sign. An edge reaching past both
+    // sides of a plane is never parallel to an edge lying in it, so a 0 below comes only from a
+    // zero-area triangle, which crosses nothing.
+    int side[2][3];
+    for (int k = 0; k < 3; ++k) {
+        side[0][k] = opencad_orient3d_sign(p[1][0], p[1][1], p[1][2], p[0][k], 0x7);
+        side[1][k] = opencad_orient3d_sign(p[0][0], p[0][1], p[0][2], p[1][k], 0x8);
+    }
+    for (int m = 0; m < 2; ++m) {
+        if (side[m][0] == 0 || side[m][1] == 0 || side[m][2] == 0) return false;
+        if (side[m][0] == side[m][1] && side[m][1] == side[m][2]) return false;
+    }
+
+    size_t count = 0;
+    for (int m = 0; m < 2; ++m) {
+        int o = 1 - m;
+        unsigned moved = m == 0 ? 0xC : 0x3;
+        for (int k = 0; k < 3; ++k) {
+            int i = k, j = (k + 1)%3;
+            if (side[m][i] == side[m][j]) continue;
+            int lo = ids[m][i] < ids[m][j] ? i : j, hi = lo == i ? j : i;
+            int s0 = opencad_orient3d_sign(p[m][lo], p[m][hi], p[o][0], p[o][1], moved);
+            int s1 = opencad_orient3d_sign(p[m][lo], p[m][hi], p[o][1], p[o][2], moved);
+            int s2 = opencad_orient3d_sign(p[m][lo], p[m][hi], p[o][2], p[o][0], moved);
+            if (s0 == 0 || s0 != s1 || s1 != s2) continue;
+            if (count == 2) return false;
+
+            double dl = opencad_orient3d(p[o][0], p[o][1], p[o][2], p[m][lo]);
+            double dh = opencad_orient3d(p[o][0], p[o][1], p[o][2], p[m][hi]);
+            double s = dl == dh ? 0.0 : dl/(dl - dh);
+            if (s < 0.0) s = 0.0;
+            if (s > 1.0) s = 1.0;
+            for (int j = 0; j < 3; ++j) segment->points[count][j] = p[m][lo][j] + s*(p[m][hi][j] - p[m][lo][j]);
+            segment->edges[count][m] = (int8_t) k;
+            segment->edges[count][o] = -1;
+            count += 1;
+        }
+    }
+    if (count != 2) return false;
+    if (opencad_csg_same_point(segment->points[0], segment->points[1])) return false;
+    segment->triangles[0] = ta;
+    segment->triangles[1] = tb;
+    return true;
+}
+
+/**
+ * Intersection phase: every triangle of the first operand against the triangles of the second whose
+ * boxes overlap its own, found through the second operand's hierarchy.
+ */
+static void opencad_csg_intersect_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    Opencad_Csg *csg = ctx;
+    const Opencad_Mesh *a = csg->meshes[0], *b = csg->meshes[1];
+    const Opencad_Bvh *bvh = &csg->bvhs[1];
+    for (size_t t = begin; t < end; ++t) {
+        float lo[3], hi[3];
+        const float *p[3];
+        if (csg->twins[0][t] != 0) continue;
+        for (int j = 0; j < 3; ++j) p[j] = &a->vertices[a->indices[t*3 + j]].x;
+        for (int k = 0; k < 3; ++k) {
+            lo[k] = fminf(p[0][k], fminf(p[1][k], p[2][k]));
+            hi[k] = fmaxf(p[0][k], fmaxf(p[1][k], p[2][k]));
+        }
+
+        uint32_t stack[OPENCAD_BVH_MAX_DEPTH];
+        size_t top = 0;
+        uint32_t node = 0;
+        for (;;) {
+            const Opencad_Bvh_Node *n = &bvh->nodes[node];
+            bool overlaps = n->min[0] <= hi[0] && n->max[0] >= lo[0] && n->min[1] <= hi[1] && n->max[1] >= lo[1] &&
+                            n->min[2] <= hi[2] && n->max[2] >= lo[2];
+            if (overlaps && n->count == 0) {
+                stack[top++] = n->first;
+                node += 1;
+                continue;
+            }
+            if (overlaps) {
+                for (uint32_t i = n->first; i < n->first + n->count; ++i) {
+                    uint32_t s = bvh->triangles[i];
+                    if (csg->twins[1][s] != 0) continue;
+                    const float *q[3];
+                    for (int j = 0; j < 3; ++j) q[j] = &b->vertices[b->indices[s*3 + j]].x;
+                    bool apart = false;
+                    for (int k = 0; k < 3 && !apart; ++k) {
+                        apart = fmaxf(q[0][k], fmaxf(q[1][k], q[2][k])) < lo[k] ||
+                                fminf(q[0][k], fminf(q[1][k], q[2][k])) > hi[k];
+                    }
+                    Opencad_Csg_Segment segment;
+                    if (apart || !opencad_csg_intersect(csg, (uint32_t) t, s, &segment)) continue;
+
+                    size_t count = csg->thread_segment_counts[thread];
+                    if (count == csg->thread_segment_capacities[thread]) {
+                        size_t capacity = count ? count*2 : 256;
+                        Opencad_Csg_Segment *grown = realloc(csg->thread_segments[thread], capacity*sizeof(*grown));
+                        if (grown == NULL) {
+                            csg->failed = true;
+                            return;
+                        }
+                        csg->thread_segments[thread] = grown;
+                        csg->thread_segment_capacities[thread] = capacity;
+                    }
+                    csg->thread_segments[thread][count] = segment;
+                    csg->thread_segment_counts[thread] = count + 1;
+                }
+            }
+            if (top == 0) break;
+            node = stack[--top];
+        }
+    }
+}
+
+/**
+ * Tells whether a point on the surface of one operand lies inside the other, by the parity of the
+ * crossings of a ray leaving it in a fixed generic direction. Crossings are decided with the same
+ * perturbed predicates as the intersection phase, so points on coplanar faces get a consistent answer.
+ * @param m The operand the point lies on.
+ */
+static bool opencad_csg_inside(const Opencad_Csg *csg, size_t m, const double *point)
+{
+    static const double direction[3] = {0.4328, 0.7953, 0.4244};
+    size_t o = 1 - m;
+    const Opencad_Mesh *mesh = csg->meshes[o];
+    const Opencad_Bvh *bvh = &csg->bvhs[o];
+    unsigned moved_plane = m == 0 ? 0x7 : 0x8, moved_edge = m == 0 ? 0xC : 0x3;
+
+    const double *p = point;
+    double q[3], inverse[3];
+    double distance = 0.0;
+    for (int k = 0; k < 3; ++k) distance += (p[k] - csg->centers[o][k])*(p[k] - csg->centers[o][k]);
+    double length = 2.0*(sqrt(distance) + csg->reach[o]) + 1.0;
+    for (int k = 0; k < 3; ++k) {
+        q[k] = p[k] + direction[k]*length;
+        inverse[k] = 1.0/(q[k] - p[k]);
+    }
+
+    size_t crossings = 0;
+    uint32_t stack[OPENCAD_BVH_MAX_DEPTH];
+    size_t top = 0;
+    uint32_t node = 0;
+    for (;;) {
+        const Opencad_Bvh_Node *n = &bvh->nodes[node];
+        double enter = 0.0, leave = 1.0;
+        for (int k = 0; k < 3; ++k) {
+            double t0 = (n->min[k] - p[k])*inverse[k], t1 = (n->max[k] - p[k])*inverse[k];
+            enter = fmax(enter, fmin(t0, t1));
+            leave = fmin(leave, fmax(t0, t1));
+        }
+        bool hit = enter <= leave;
+        if (hit && n->count == 0) {
+            stack[top++] = n->first;
+            node += 1;
+            continue;
+        }
+        if (hit) {
+            for (uint32_t i = n->first; i < n->first + n->count; ++i) {
+                double t[3][3];
+                for (int j = 0; j < 3; ++j) opencad_csg_point(mesh, mesh->indices[bvh->triangles[i]*3 + j], t[j]);
+                // As in opencad_csg_intersect, a 0 comes only from a zero-area triangle.
+                int sp = opencad_orient3d_sign(t[0], t[1], t[2], p, moved_plane);
+                int sq = opencad_orient3d_sign(t[0], t[1], t[2], q, moved_plane);
+                if (sp == 0 || sq == 0 || sp == sq) continue;
+                int s0 = opencad_orient3d_sign(p, q, t[0], t[1], moved_edge);
+                int s1 = opencad_orient3d_sign(p, q, t[1], t[2], moved_edge);
+                int s2 = opencad_orient3d_sign(p, q, t[2], t[0], moved_edge);
+                if (s0 != 0 && s0 == s1 && s1 == s2) crossings += 1;
+            }
+        }
+        if (top == 0) break;
+        node = stack[--top];
+    }
+    return crossings%2 == 1;
+}
+
+/**
+ * Tells whether the parts of operand m on one side of the other operand belong to the result.
+ */
+static bool opencad_csg_keep(const Opencad_Csg *csg, size_t m, bool inside)
+{
+    switch (csg->op) {
+    case OPENCAD_BOOLEAN_UNION:        return !inside;
+    case OPENCAD_BOOLEAN_INTERSECTION: return inside;
+    case OPENCAD_BOOLEAN_DIFFERENCE:   return m == 0 ? !inside : inside;
+    default:                           return false;
+    }
+}
+
+/**
+ * Tells whether a triangle of operand m that has a twin in the other operand belongs to the result.
+ * Of twins facing the same way, where the solids lie on the same side, the first operand's stays in a
+ * union and an intersection; twins facing opposite ways separate two solids touching there, which
+ * leaves the first operand's in a difference only.
+ * @param twin 1 for twins facing the same way, -1 for opposite ones.
+ */
+static bool opencad_csg_keep_twin(const Opencad_Csg *csg, size_t m, int twin)
+{
+    if (m == 1) return false;
+    return csg->op == OPENCAD_BOOLEAN_DIFFERENCE ? twin < 0 : twin > 0;
+}
+
+/**
+ * Appends a result triangle to the corners of a thread, turned inside out for the second operand of
+ * a difference. Triangles with two corners rounding to the same float are dropped: welding turns them
+ * into a pair of opposite edges, which leaves the rest of the mesh closed.
+ */
+static bool opencad_csg_emit(Opencad_Csg *csg, size_t thread, size_t m,
+                             const double *pa, const double *pb, const double *pc)
+{
+    Opencad_Vec3 a = {(float) pa[0], (float) pa[1], (float) pa[2]};
+    Opencad_Vec3 b = {(float) pb[0], (float) pb[1], (float) pb[2]};
+    Opencad_Vec3 c = {(float) pc[0], (float) pc[1], (float) pc[2]};
+    if ((a.x == b.x && a.y == b.y && a.z == b.z) || (b.x == c.x && b.y == c.y && b.z == c.z) ||
+        (c.x == a.x && c.y == a.y && c.z == a.z)) {
+        return true;
+    }
+    size_t count = csg->thread_corner_counts[thread];
+    if (count + 3 > csg->thread_corner_capacities[thread]) {
+        size_t capacity = count ? count*2 : 3*1024;
+        Opencad_Vec3 *grown = realloc(csg->thread_corners[thread], capacity*sizeof(*grown));
+        if (grown == NULL) return false;
+        csg->thread_corners[thread] = grown;
+        csg->thread_corner_capacities[thread] = capacity;
+    }
+    if (m == 1 && csg->op == OPENCAD_BOOLEAN_DIFFERENCE) OPENCAD_SWAP(Opencad_Vec3, b, c);
+    Opencad_Vec3 *out = &csg->thread_corners[thread][count];
+    out[0] = a;
+    out[1] = b;
+    out[2] = c;
+    csg->thread_corner_counts[thread] = count + 3;
+    return true;
+}
+
+typedef struct {
+    double position[3];
+    uint32_t id;
+} Opencad_Csg_Vertex;
+
+typedef struct {
+    int edge;
+    double t;
+    uint32_t id;
+} Opencad_Csg_Stop;
+
+typedef struct {
+    uint32_t from;
+    uint32_t to;
+    Opencad_Vec2d origin;   // The projected ends, which order the edges around their origin.
+    Opencad_Vec2d target;
+    uint32_t next;
+    uint32_t cycle;
+} Opencad_Csg_Half_Edge;
+
+typedef struct {
+    size_t begin;           // Into the cycle vertex list.
+    size_t count;
+    double area;
+    size_t owner;           // For holes: the face they cut into.
+} Opencad_Csg_Cycle;
+
+static int opencad_csg_compare_vertices(const void *a, const void *b)
+{
+    const Opencad_Csg_Vertex *u = a, *v = b;
+    for (int k = 0; k < 3; ++k) {
+        if (u->position[k] != v->position[k]) return u->position[k] < v->position[k] ? -1 : 1;
+    }
+    return (u->id > v->id) - (u->id < v->id);
+}
+
+static int opencad_csg_compare_stops(const void *a, const void *b)
+{
+    const Opencad_Csg_Stop *u = a, *v = b;
+    if (u->edge != v->edge) return u->edge < v->edge ? -1 : 1;
+    return (u->t > v->t) - (u->t < v->t);
+}
+
+static int opencad_csg_compare_keys(const void *a, const void *b)
+{
+    uint64_t u = *(const uint64_t *) a, v = *(const uint64_t *) b;
+    return (u > v) - (u < v);
+}
+
+/**
+ * Tells whether a half edge points into the lower half plane: down, or straight left.
+ */
+static bool opencad_csg_points_down(const Opencad_Csg_Half_Edge *h)
+{
+    return h->target.y < h->origin.y || (h->target.y == h->origin.y && h->target.x < h->origin.x);
+}
+
+/**
+ * Orders half edges by origin, then counter-clockwise by direction, exactly.
+ */
+static int opencad_csg_compare_half_edges(const void *a, const void *b)
+{
+    const Opencad_Csg_Half_Edge *u = a, *v = b;
+    if (u->from != v->from) return u->from < v->from ? -1 : 1;
+    bool u_down = opencad_csg_points_down(u), v_down = opencad_csg_points_down(v);
+    if (u_down != v_down) return u_down ? 1 : -1;
+    double turn = opencad_orient2d_double(u->origin, u->target, v->target);
+    return (turn < 0.0) - (turn > 0.0);
+}
+
+/**
+ * Tells whether a point lies inside a closed polyline, by crossing number.
+ */
+static bool opencad_csg_cycle_contains(const Opencad_Vec2d *flat, const uint32_t *loop, size_t count, Opencad_Vec2d p)
+{
+    bool inside = false;
+    for (size_t i = 0, j = count - 1; i < count; j = i++) {
+        Opencad_Vec2d a = flat[loop[i]], b = flat[loop[j]];
+        if ((a.y > p.y) == (b.y > p.y)) continue;
+        // The ray to the right crosses the edge when p lies left of it, taken upwards.
+        double side = opencad_orient2d_double(a, b, p);
+        if (a.y < b.y ? side > 0.0 : side < 0.0) inside = !inside;
+    }
+    return inside;
+}
+
+/**
+ * Returns the key of the edge between two vertices, the same in both directions.
+ */
+static uint64_t opencad_csg_edge_key(uint32_t a, uint32_t b)
+{
+    return a < b ? (uint64_t) a << 32 | b : (uint64_t) b << 32 | a;
+}
+
+static int opencad_csg_compare_edge_points(const void *a, const void *b)
+{
+    const Opencad_Csg_Edge_Point *u = a, *v = b;
+    if (u->mesh != v->mesh) return u->mesh < v->mesh ? -1 : 1;
+    return (u->edge > v->edge) - (u->edge < v->edge);
+}
+
+/**
+ * Finds the curve points lying on an edge of an operand's mesh.
+ * @return The first of them; count receives how many there are.
+ */
+static const Opencad_Csg_Edge_Point *opencad_csg_find_edge_points(const Opencad_Csg *csg, size_t m, uint64_t edge, size_t *count)
+{
+    size_t lo = 0, hi = csg->edge_point_count;
+    Opencad_Csg_Edge_Point key = { .mesh = (uint32_t) m, .edge = edge };
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo)/2;
+        if (opencad_csg_compare_edge_points(&csg->edge_points[mid], &key) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    size_t end = lo;
+    while (end < csg->edge_point_count && opencad_csg_compare_edge_points(&csg->edge_points[end], &key) == 0) end += 1;
+    *count = end - lo;
+    return &csg->edge_points[lo];
+}
+
+/**
+ * Projects points onto the plane a triangle faces most, keeping the triangle counter-clockwise.
+ * @param points The triangle's corners, then the points to project along with them.
+ * @param count The number of points, corners included.
+ * @param flat Receives the projected points.
+ */
+static void opencad_csg_flatten(const double (*points)[3], size_t count, Opencad_Vec2d *flat)
+{
+    double u[3], v[3];
+    for (int k = 0; k < 3; ++k) {
+        u[k] = points[1][k] - points[0][k];
+        v[k] = points[2][k] - points[0][k];
+    }
+    const double n[3] = {u[1]*v[2] - u[2]*v[1], u[2]*v[0] - u[0]*v[2], u[0]*v[1] - u[1]*v[0]};
+    int axis = fabs(n[0]) > fabs(n[1]) ? (fabs(n[0]) > fabs(n[2]) ? 0 : 2) : (fabs(n[1]) > fabs(n[2]) ? 1 : 2);
+    int ax = (axis + 1)%3, ay = (axis + 2)%3;
+    if (n[axis] < 0.0) OPENCAD_SWAP(int, ax, ay);
+    for (size_t i = 0; i < count; ++i) flat[i] = (Opencad_Vec2d) { points[i][ax], points[i][ay] };
+}
+
+/**
+ * Returns the side of a projected triangle a point lies exactly on, strictly between its corners.
+ * @return The side, or -1.
+ */
+static int opencad_csg_side(const Opencad_Vec2d *corners, Opencad_Vec2d p)
+{
+    for (int k = 0; k < 3; ++k) {
+        Opencad_Vec2d a = corners[k], b = corners[(k + 1)%3];
+        double along = (p.x - a.x)*(b.x - a.x) + (p.y - a.y)*(b.y - a.y);
+        double length = (b.x - a.x)*(b.x - a.x) + (b.y - a.y)*(b.y - a.y);
+        if (opencad_orient2d_double(a, b, p) == 0.0 && along > 0.0 && along < length) return k;
+    }
+    return -1;
+}
+
+/**
+ * Locating phase: records every segment end lying on an edge of the triangle it belongs to. Besides
+ * the ends computed on an edge, that includes ends that land on one exactly, as they do where a
+ * vertex of one operand touches an edge of the other.
+ */
+static void opencad_csg_locate_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    Opencad_Csg *csg = ctx;
+    size_t first_count = csg->meshes[0]->triangle_count;
+    for (size_t i = begin; i < end; ++i) {
+        size_t m = i < first_count ? 0 : 1;
+        uint32_t t = (uint32_t) (i - (m ? first_count : 0));
+        const Opencad_Mesh *mesh = csg->meshes[m];
+        const uint32_t *tri = &mesh->indices[t*3];
+        double corners[4][3];
+        for (int j = 0; j < 3; ++j) opencad_csg_point(mesh, tri[j], corners[j]);
+        Opencad_Vec2d flat[4];
+        for (uint32_t j = csg->segment_offsets[m][t]; j < csg->segment_offsets[m][t + 1]; ++j) {
+            const Opencad_Csg_Segment *segment = &csg->segments[csg->segment_ids[m][j]];
+            for (int e = 0; e < 2; ++e) {
+                int edge = segment->edges[e][m];
+                if (edge < 0) {
+                    memcpy(corners[3], segment->points[e], sizeof(corners[3]));
+                    opencad_csg_flatten((const double (*)[3]) corners, 4, flat);
+                    edge = opencad_csg_side(flat, flat[3]);
+                    if (edge < 0) continue;
+                }
+
+                size_t count = csg->thread_edge_point_counts[thread];
+                if (count == csg->thread_edge_point_capacities[thread]) {
+                    size_t capacity = count ? count*2 : 256;
+                    Opencad_Csg_Edge_Point *grown = realloc(csg->thread_edge_points[thread], capacity*sizeof(*grown));
+                    if (grown == NULL) {
+                        csg->failed = true;
+                        return;
+                    }
+                    csg->thread_edge_points[thread] = grown;
+                    csg->thread_edge_point_capacities[thread] = capacity;
+                }
+                Opencad_Csg_Edge_Point *point = &csg->thread_edge_points[thread][count];
+                point->mesh = (uint32_t) m;
+                point->edge = opencad_csg_edge_key(tri[edge], tri[(edge + 1)%3]);
+                memcpy(point->point, segment->points[e], sizeof(point->point));
+                csg->thread_edge_point_counts[thread] = count + 1;
+            }
+        }
+    }
+}
+
+/**
+ * Splits a triangle crossed by the other operand along the crossing curve and keeps the faces the
+ * operation wants. The triangle's edges and the segments form a planar graph; its faces are traced,
+ * holes are matched with the faces around them, and every face is ear clipped and classified once.
+ */
+static Errno opencad_csg_split(Opencad_Csg *csg, size_t thread, size_t m, uint32_t t)
+{
+    int result = 0;
+    const Opencad_Mesh *mesh = csg->meshes[m];
+    uint32_t first = csg->segment_offsets[m][t], last = csg->segment_offsets[m][t + 1];
+    size_t segment_count = last - first;
+    const Opencad_Csg_Edge_Point *edge_points[3];
+    size_t edge_point_counts[3];
+    for (int k = 0; k < 3; ++k) {
+        uint64_t edge = opencad_csg_edge_key(mesh->indices[t*3 + k], mesh->indices[t*3 + (k + 1)%3]);
+        edge_points[k] = opencad_csg_find_edge_points(csg, m, edge, &edge_point_counts[k]);
+    }
+    size_t point_count = 3 + 2*segment_count + edge_point_counts[0] + edge_point_counts[1] + edge_point_counts[2];
+    size_t edge_capacity = point_count + segment_count;
+
+    double (*points)[3] = malloc(point_count*sizeof(*points));
+    int8_t *point_edges = malloc(point_count*sizeof(*point_edges));
+    uint32_t *reps = malloc(point_count*sizeof(*reps));
+    Opencad_Vec2d *flat = malloc(point_count*sizeof(*flat));
+    Opencad_Csg_Vertex *sorted = malloc(point_count*sizeof(*sorted));
+    Opencad_Csg_Stop *stops = malloc(point_count*sizeof(*stops));
+    uint64_t *keys = malloc(edge_capacity*sizeof(*keys));
+    Opencad_Csg_Half_Edge *half_edges = malloc(2*edge_capacity*sizeof(*half_edges));
+    uint32_t *rings = malloc((point_count + 1)*sizeof(*rings));
+    uint32_t *loops = malloc(2*edge_capacity*sizeof(*loops));
+    Opencad_Csg_Cycle *cycles = malloc(2*edge_capacity*sizeof(*cycles));
+    Opencad_Vec2d *polygon = malloc(2*edge_capacity*sizeof(*polygon));
+    uint32_t *polygon_ids = malloc(2*edge_capacity*sizeof(*polygon_ids));
+    size_t *loop_ends = malloc(2*edge_capacity*sizeof(*loop_ends));
+    uint32_t *triangles = malloc(3*(2*edge_capacity + 4*edge_capacity)*sizeof(*triangles));
+    if (!points || !point_edges || !reps || !flat || !sorted || !stops || !keys || !half_edges || !rings ||
+        !loops || !cycles || !polygon || !polygon_ids || !loop_ends || !triangles) {
+        return_defer(ENOMEM);
+    }
+
+    // Points: the corners, both ends of every segment, then the curve points on the sides, this
+    // triangle's own or found by its neighbours. Duplicates map to the first copy.
+    for (int k = 0; k < 3; ++k) {
+        opencad_csg_point(mesh, mesh->indices[t*3 + k], points[k]);
+        point_edges[k] = -1;
+    }
+    for (size_t i = 0; i < segment_count; ++i) {
+        const Opencad_Csg_Segment *segment = &csg->segments[csg->segment_ids[m][first + i]];
+        for (int e = 0; e < 2; ++e) {
+            memcpy(points[3 + 2*i + e], segment->points[e], sizeof(points[0]));
+            point_edges[3 + 2*i + e] = -1;
+        }
+    }
+    size_t point = 3 + 2*segment_count;
+    for (int k = 0; k < 3; ++k) {
+        for (size_t i = 0; i < edge_point_counts[k]; ++i) {
+            memcpy(points[point], edge_points[k][i].point, sizeof(points[0]));
+            point_edges[point++] = (int8_t) k;
+        }
+    }
+    for (size_t i = 0; i < point_count; ++i) {
+        memcpy(sorted[i].position, points[i], sizeof(points[i]));
+        sorted[i].id = (uint32_t) i;
+    }
+    qsort(sorted, point_count, sizeof(*sorted), opencad_csg_compare_vertices);
+    for (size_t i = 0; i < point_count; ++i) {
+        bool same = i > 0 && opencad_csg_same_point(sorted[i].position, sorted[i - 1].position);
+        reps[sorted[i].id] = same ? reps[sorted[i - 1].id] : sorted[i].id;
+    }
+    for (size_t i = 3; i < point_count; ++i) {
+        if (point_edges[i] > point_edges[reps[i]]) point_edges[reps[i]] = point_edges[i];
+    }
+
+    opencad_csg_flatten((const double (*)[3]) points, point_count, flat);
+
+    // Edges: the triangle's sides cut at every point lying on them, then the segments.
+    size_t stop_count = 0;
+    for (uint32_t i = 3; i < point_count; ++i) {
+        int edge = point_edges[i];
+        if (reps[i] != i || edge < 0) continue;
+        const double *a = points[edge], *b = points[(edge + 1)%3];
+        double s = 0.0;
+        for (int k = 0; k < 3; ++k) s += (points[i][k] - a[k])*(b[k] - a[k]);
+        stops[stop_count++] = (Opencad_Csg_Stop) { edge, s, i };
+    }
+    qsort(stops, stop_count, sizeof(*stops), opencad_csg_compare_stops);
+    size_t key_count = 0;
+    size_t s = 0;
+    for (int edge = 0; edge < 3; ++edge) {
+        uint32_t from = (uint32_t) edge;
+        for (; s < stop_count && stops[s].edge == edge; ++s) {
+            uint32_t to = stops[s].id;
+            keys[key_count++] = from < to ? (uint64_t) from << 32 | to : (uint64_t) to << 32 | from;
+            from = to;
+        }
+        uint32_t to = (uint32_t) (edge + 1)%3;
+        keys[key_count++] = from < to ? (uint64_t) from << 32 | to : (uint64_t) to << 32 | from;
+    }
+    for (size_t i = 0; i < segment_count; ++i) {
+        uint32_t a = reps[3 + 2*i], b = reps[3 + 2*i + 1];
+        if (a == b) continue;
+        keys[key_count++] = a < b ? (uint64_t) a << 32 | b : (uint64_t) b << 32 | a;
+    }
+    qsort(keys, key_count, sizeof(*keys), opencad_csg_compare_keys);
+
+    size_t half_edge_count = 0;
+    for (size_t i = 0; i < key_count; ++i) {
+        if (i > 0 && keys[i] == keys[i - 1]) continue;
+        uint32_t a = (uint32_t) (keys[i] >> 32), b = (uint32_t) keys[i];
+        if (a == b) continue;
+        half_edges[half_edge_count++] = (Opencad_Csg_Half_Edge) { a, b, flat[a], flat[b], 0, UINT32_MAX };
+        half_edges[half_edge_count++] = (Opencad_Csg_Half_Edge) { b, a, flat[b], flat[a], 0, UINT32_MAX };
+    }
+    qsort(half_edges, half_edge_count, sizeof(*half_edges), opencad_csg_compare_half_edges);
+    memset(rings, 0, (point_count + 1)*sizeof(*rings));
+    for (size_t h = 0; h < half_edge_count; ++h) rings[half_edges[h].from + 1] += 1;
+    for (size_t i = 0; i < point_count; ++i) rings[i + 1] += rings[i];
+
+    // Walking a face: after arriving at v from u, leave along the edge just clockwise of v->u.
+    for (size_t h = 0; h < half_edge_count; ++h) {
+        uint32_t u = half_edges[h].from, v = half_edges[h].to;
+        uint32_t begin = rings[v], end = rings[v + 1], twin = begin;
+        while (twin < end && half_edges[twin].to != u) twin += 1;
+        half_edges[h].next = twin == begin ? end - 1 : twin - 1;
+    }
+
+    size_t cycle_count = 0, loop_count = 0;
+    size_t outer = SIZE_MAX;
+    for (size_t h = 0; h < half_edge_count; ++h) {
+        if (half_edges[h].cycle != UINT32_MAX) continue;
+        Opencad_Csg_Cycle *cycle = &cycles[cycle_count];
+        *cycle = (Opencad_Csg_Cycle) { .begin = loop_count, .owner = SIZE_MAX };
+        Opencad_Vec2d o = flat[half_edges[h].from];
+        for (size_t e = h; half_edges[e].cycle == UINT32_MAX; e = half_edges[e].next) {
+            half_edges[e].cycle = (uint32_t) cycle_count;
+            loops[loop_count++] = half_edges[e].from;
+            Opencad_Vec2d a = flat[half_edges[e].from], b = flat[half_edges[e].to];
+            cycle->area += 0.5*((a.x - o.x)*(b.y - o.y) - (b.x - o.x)*(a.y - o.y));
+        }
+        cycle->count = loop_count - cycle->begin;
+        if (cycle->area < 0.0 && (outer == SIZE_MAX || cycle->area < cycles[outer].area)) outer = cycle_count;
+        cycle_count += 1;
+    }
+
+    // Every other clockwise cycle is the rim of an island: a hole in the smallest face around it.
+    for (size_t c = 0; c < cycle_count; ++c) {
+        if (c == outer || !(cycles[c].area < 0.0)) continue;
+        uint32_t v = loops[cycles[c].begin];
+        double best = INFINITY;
+        for (size_t f = 0; f < cycle_count; ++f) {
+            if (!(cycles[f].area > 0.0) || cycles[f].area >= best) continue;
+            bool shares = false;
+            for (size_t i = 0; i < cycles[f].count && !shares; ++i) shares = loops[cycles[f].begin + i] == v;
+            if (shares || !opencad_csg_cycle_contains(flat, &loops[cycles[f].begin], cycles[f].count, flat[v])) continue;
+            best = cycles[f].area;
+            cycles[c].owner = f;
+        }
+    }
+
+    for (size_t f = 0; f < cycle_count; ++f) {
+        if (!(cycles[f].area > 0.0)) continue;
+        size_t polygon_count = 0, ring_count = 0;
+        for (size_t k = 0; k <= cycle_count; ++k) {
+            // The face's own loop first, then its holes.
+            size_t c = k == 0 ? f : k - 1;
+            if (k > 0 && cycles[c].owner != f) continue;
+            for (size_t i = 0; i < cycles[c].count; ++i) {
+                uint32_t id = loops[cycles[c].begin + i];
+                polygon[polygon_count] = flat[id];
+                polygon_ids[polygon_count++] = id;
+            }
+            loop_ends[ring_count++] = polygon_count;
+        }
+        size_t triangle_count = 0;
+        Errno err = opencad_triangulate_polygon_double(polygon, loop_ends, ring_count, triangles, &triangle_count);
+        if (err) return_defer(err);
+        if (triangle_count == 0) continue;
+
+        // Classify the face by the center of its largest triangle, the one least likely to touch the other operand.
+        size_t largest = 0;
+        double largest_area = -1.0;
+        for (size_t i = 0; i < triangle_count; ++i) {
+            const uint32_t *tri = &triangles[i*3];
+            double area = opencad_orient2d_double(polygon[tri[0]], polygon[tri[1]], polygon[tri[2]]);
+            if (area > largest_area) {
+                largest_area = area;
+                largest = i;
+            }
+        }
+        double center[3];
+        for (int k = 0; k < 3; ++k) {
+            center[k] = 0.0;
+            for (int j = 0; j < 3; ++j) center[k] += points[polygon_ids[triangles[largest*3 + j]]][k]/3.0;
+        }
+        bool keep = csg->twins[m][t] ? opencad_csg_keep_twin(csg, m, csg->twins[m][t]) :
+                                       opencad_csg_keep(csg, m, opencad_csg_inside(csg, m, center));
+        if (!keep) continue;
+        for (size_t i = 0; i < triangle_count; ++i) {
+            const uint32_t *tri = &triangles[i*3];
+            if (!opencad_csg_emit(csg, thread, m, points[polygon_ids[tri[0]]], points[polygon_ids[tri[1]]],
+                                  points[polygon_ids[tri[2]]])) {
+                return_defer(ENOMEM);
+            }
+        }
+    }
+
+defer:
+    free(points);
+    free(point_edges);
+    free(reps);
+    free(flat);
+    free(sorted);
+    free(stops);
+    free(keys);
+    free(half_edges);
+    free(rings);
+    free(loops);
+    free(cycles);
+    free(polygon);
+    free(polygon_ids);
+    free(loop_ends);
+    free(triangles);
+    return result;
+}
+
+/**
+ * Classification phase: splits the triangles crossed by the other operand and keeps or drops every
+ * resulting face, and every untouched triangle, by which side of the other operand it lies on.
+ */
+static void opencad_csg_classify_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    Opencad_Csg *csg = ctx;
+    size_t first_count = csg->meshes[0]->triangle_count;
+    for (size_t i = begin; i < end; ++i) {
+        size_t m = i < first_count ? 0 : 1;
+        uint32_t t = (uint32_t) (i - (m ? first_count : 0));
+        const Opencad_Mesh *mesh = csg->meshes[m];
+        size_t before = csg->thread_corner_counts[thread];
+        bool touched = csg->segment_offsets[m][t] != csg->segment_offsets[m][t + 1];
+        for (int k = 0; k < 3 && !touched; ++k) {
+            size_t count;
+            opencad_csg_find_edge_points(csg, m, opencad_csg_edge_key(mesh->indices[t*3 + k], mesh->indices[t*3 + (k + 1)%3]), &count);
+            touched = count > 0;
+        }
+        if (touched) {
+            if (opencad_csg_split(csg, thread, m, t) != 0) {
+                csg->failed = true;
+                return;
+            }
+        } else {
+            double corners[3][3];
+            for (int j = 0; j < 3; ++j) opencad_csg_point(mesh, mesh->indices[t*3 + j], corners[j]);
+            bool keep = csg->twins[m][t] ? opencad_csg_keep_twin(csg, m, csg->twins[m][t]) :
+                                           opencad_csg_keep(csg, m, csg->inside[m][csg->components[m][t]]);
+            if (keep && !opencad_csg_emit(csg, thread, m, corners[0], corners[1], corners[2])) {
+                csg->failed = true;
+                return;
+            }
+        }
+        csg->outputs[i] = (Opencad_Csg_Output) {
+            .thread = (uint32_t) thread,
+            .count = (uint32_t) ((csg->thread_corner_counts[thread] - before)/3),
+            .offset = before,
+        };
+    }
+}
+
+/**
+ * Classifies one triangle of every region of the operands the curve does not cross.
+ */
+static void opencad_csg_component_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    (void) thread;
+    Opencad_Csg *csg = ctx;
+    size_t first_count = csg->meshes[0]->triangle_count;
+    for (size_t i = begin; i < end; ++i) {
+        size_t m = csg->roots[i] < first_count ? 0 : 1;
+        uint32_t t = (uint32_t) (csg->roots[i] - (m ? first_count : 0));
+        const Opencad_Mesh *mesh = csg->meshes[m];
+        double corners[3][3], center[3];
+        for (int j = 0; j < 3; ++j) opencad_csg_point(mesh, mesh->indices[t*3 + j], corners[j]);
+        for (int k = 0; k < 3; ++k) center[k] = (corners[0][k] + corners[1][k] + corners[2][k])/3.0;
+        csg->inside[m][t] = opencad_csg_inside(csg, m, center);
+    }
+}
+
+/**
+ * Finds the triangle standing for a component, halving the path on the way.
+ */
+static uint32_t opencad_csg_find(uint32_t *components, uint32_t t)
+{
+    while (components[t] != t) {
+        components[t] = components[components[t]];
+        t = components[t];
+    }
+    return t;
+}
+
+/**
+ * Builds the hierarchy of one operand.
+ */
+static void opencad_csg_bvh_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    (void) thread;
+    Opencad_Csg *csg = ctx;
+    for (size_t m = begin; m < end; ++m) {
+        if (opencad_bvh_build(&csg->bvhs[m], csg->meshes[m]) != 0) csg->failed = true;
+    }
+}
+
+typedef struct {
+    Opencad_Vec3 corners[3];    // The smallest corner first, then the other two, the smaller first.
+    uint32_t triangle;
+    int8_t turn;                // 1 when that is the order of the triangle's own corners, else -1.
+} Opencad_Csg_Face_Key;
+
+static int opencad_csg_compare_positions(Opencad_Vec3 u, Opencad_Vec3 v)
+{
+    if (u.x != v.x) return u.x < v.x ? -1 : 1;
+    if (u.y != v.y) return u.y < v.y ? -1 : 1;
+    return (u.z > v.z) - (u.z < v.z);
+}
+
+static int opencad_csg_compare_face_keys(const void *a, const void *b)
+{
+    const Opencad_Csg_Face_Key *u = a, *v = b;
+    for (int j = 0; j < 3; ++j) {
+        int order = opencad_csg_compare_positions(u->corners[j], v->corners[j]);
+        if (order != 0) return order;
+    }
+    return 0;
+}
+
+/**
+ * Finds the triangles the operands have in common, facing either way, and records them in twins.
+ * @return An error code indicating the result of the operation.
+ */
+static Errno opencad_csg_find_twins(Opencad_Csg *csg)
+{
+    Opencad_Csg_Face_Key *keys[2] = {0};
+    for (size_t m = 0; m < 2; ++m) {
+        const Opencad_Mesh *mesh = csg->meshes[m];
+        keys[m] = malloc((mesh->triangle_count + 1)*sizeof(*keys[m]));
+        if (keys[m] == NULL) {
+            free(keys[0]);
+            return ENOMEM;
+        }
+        for (size_t t = 0; t < mesh->triangle_count; ++t) {
+            Opencad_Vec3 c[3];
+            for (int j = 0; j < 3; ++j) c[j] = mesh->vertices[mesh->indices[t*3 + j]];
+            int first = 0;
+            for (int j = 1; j < 3; ++j) {
+                if (opencad_csg_compare_positions(c[j], c[first]) < 0) first = j;
+            }
+            Opencad_Vec3 b = c[(first + 1)%3], d = c[(first + 2)%3];
+            bool ordered = opencad_csg_compare_positions(b, d) < 0;
+            keys[m][t] = (Opencad_Csg_Face_Key) {
+                .corners = {c[first], ordered ? b : d, ordered ? d : b},
+                .triangle = (uint32_t) t,
+                .turn = ordered ? 1 : -1,
+            };
+        }
+        qsort(keys[m], mesh->triangle_count, sizeof(*keys[m]), opencad_csg_compare_face_keys);
+    }
+    for (size_t i = 0, j = 0; i < csg->meshes[0]->triangle_count && j < csg->meshes[1]->triangle_count;) {
+        int order = opencad_csg_compare_face_keys(&keys[0][i], &keys[1][j]);
+        if (order == 0) {
+            int8_t twin = keys[0][i].turn == keys[1][j].turn ? 1 : -1;
+            csg->twins[0][keys[0][i].triangle] = twin;
+            csg->twins[1][keys[1][j].triangle] = twin;
+        }
+        if (order <= 0) i += 1;
+        if (order >= 0) j += 1;
+    }
+    free(keys[0]);
+    free(keys[1]);
+    return 0;
+}
+
+/**
+ * Combines two closed, outward-facing meshes into the boundary of their union, difference (a minus b)
+ * or intersection. Candidate triangle pairs come from a bounding volume hierarchy instead of testing
+ * all pairs; both the intersection and the classification phase run in parallel. Triangles both
+ * operands have in common are kept or dropped as a whole, so a solid minus itself is empty and two
+ * solids touching along a face merge without a wall between them; this needs the shared faces to be
+ * split into the same triangles on both sides. Other exact ties between the operands (coplanar
+ * overlaps, touching edges) are broken as if b were shifted by an infinitesimal step, see
+ * opencad_orient3d_sign. Crossing points are kept in double until the result is emitted, and the
+ * result is closed: every edge is shared by exactly two triangles, running opposite ways.
+ * @param a The first operand.
+ * @param b The second operand.
+ * @param op The operation.
+ * @param out Receives the result. Must be freed with opencad_mesh_free.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_mesh_boolean(const Opencad_Mesh *a, const Opencad_Mesh *b, Opencad_Boolean op, Opencad_Mesh *out)
+{
+    int result = 0;
+    size_t threads = opencad_thread_count();
+    Opencad_Vec3 *corners = NULL;
+    Opencad_Mesh welded[2] = {0};
+    Opencad_Csg csg = { .meshes = {&welded[0], &welded[1]}, .op = op };
+
+    {
+        memset(out, 0, sizeof(*out));
+        if (op < 0 || op >= COUNT_OPENCAD_BOOLEANS) return_defer(EINVAL);
+        if (a->triangle_count + b->triangle_count >= UINT32_MAX) return_defer(EOVERFLOW);
+
+        // Edges are matched up by vertex index, so vertices split for flat shading have to be merged.
+        const Opencad_Mesh *operands[2] = {a, b};
+        for (size_t m = 0; m < 2; ++m) {
+            const Opencad_Mesh *mesh = operands[m];
+            corners = malloc((mesh->triangle_count*3 + 1)*sizeof(*corners));
+            if (corners == NULL) return_defer(ENOMEM);
+            for (size_t i = 0; i < mesh->triangle_count*3; ++i) corners[i] = mesh->vertices[mesh->indices[i]];
+            Errno err = opencad_mesh_from_soup(corners, mesh->triangle_count, &welded[m]);
+            free(corners);
+            corners = NULL;
+            if (err) return_defer(err);
+        }
+
+        for (size_t m = 0; m < 2; ++m) {
+            Opencad_Vec3 min, max;
+            opencad_mesh_bounds(csg.meshes[m], &min, &max);
+            csg.centers[m][0] = 0.5*((double) min.x + max.x);
+            csg.centers[m][1] = 0.5*((double) min.y + max.y);
+            csg.centers[m][2] = 0.5*((double) min.z + max.z);
+            csg.reach[m] = 0.5*opencad_vec3_length(opencad_vec3_sub(max, min));
+        }
+
+        // Triangles the operands share exactly, as where a solid meets itself or two solids touch along
+        // a face, lie on the other operand's boundary rather than to one side of it; they get no crossing
+        // curve and opencad_csg_keep_twin decides them instead.
+        for (size_t m = 0; m < 2; ++m) {
+            csg.twins[m] = calloc(csg.meshes[m]->triangle_count + 1, sizeof(*csg.twins[m]));
+            if (csg.twins[m] == NULL) return_defer(ENOMEM);
+        }
+        Errno err = opencad_csg_find_twins(&csg);
+        if (err) return_defer(err);
+
+        opencad_parallel_for(2, 1, opencad_csg_bvh_task, &csg);
+        if (csg.failed) return_defer(ENOMEM);
+        opencad_parallel_for(welded[0].triangle_count, 64, opencad_csg_intersect_task, &csg);
+        if (csg.failed) return_defer(ENOMEM);
+
+        // Gather the segments and index them by the triangle of each operand.
+        size_t segment_count = 0;
+        for (size_t i = 0; i < threads; ++i) segment_count += csg.thread_segment_counts[i];
+        if (segment_count >= UINT32_MAX) return_defer(EOVERFLOW);
+        csg.segments = malloc((segment_count + 1)*sizeof(*csg.segments));
+        if (csg.segments == NULL) return_defer(ENOMEM);
+        segment_count = 0;
+        for (size_t i = 0; i < threads; ++i) {
+            if (csg.thread_segment_counts[i] == 0) continue;
+            memcpy(&csg.segments[segment_count], csg.thread_segments[i], csg.thread_segment_counts[i]*sizeof(*csg.segments));
+            segment_count += csg.thread_segment_counts[i];
+        }
+        for (size_t m = 0; m < 2; ++m) {
+            size_t triangle_count = csg.meshes[m]->triangle_count;
+            csg.segment_offsets[m] = calloc(triangle_count + 2, sizeof(*csg.segment_offsets[m]));
+            csg.segment_ids[m] = malloc((segment_count + 1)*sizeof(*csg.segment_ids[m]));
+            if (!csg.segment_offsets[m] || !csg.segment_ids[m]) return_defer(ENOMEM);
+            uint32_t *offsets = csg.segment_offsets[m];
+            for (size_t i = 0; i < segment_count; ++i) offsets[csg.segments[i].triangles[m] + 2] += 1;
+            for (size_t t = 0; t < triangle_count; ++t) offsets[t + 2] += offsets[t + 1];
+            for (size_t i = 0; i < segment_count; ++i) csg.segment_ids[m][offsets[csg.segments[i].triangles[m] + 1]++] = (uint32_t) i;
+        }
+
+        size_t total = a->triangle_count + b->triangle_count;
+        opencad_parallel_for(total, 256, opencad_csg_locate_task, &csg);
+        if (csg.failed) return_defer(ENOMEM);
+        for (size_t i = 0; i < threads; ++i) csg.edge_point_count += csg.thread_edge_point_counts[i];
+        csg.edge_points = malloc((csg.edge_point_count + 1)*sizeof(*csg.edge_points));
+        if (csg.edge_points == NULL) return_defer(ENOMEM);
+        for (size_t i = 0, count = 0; i < threads; ++i) {
+            if (csg.thread_edge_point_counts[i] == 0) continue;
+            memcpy(&csg.edge_points[count], csg.thread_edge_points[i], csg.thread_edge_point_counts[i]*sizeof(*csg.edge_points));
+            count += csg.thread_edge_point_counts[i];
+        }
+        qsort(csg.edge_points, csg.edge_point_count, sizeof(*csg.edge_points), opencad_csg_compare_edge_points);
+
+        // Triangles the curve does not cross lie on the same side as their neighbours, so only one
+        // triangle per region needs a ray. Regions are joined through vertices no crossed triangle
+        // and no curve point on an edge touches.
+        csg.roots = malloc((total + 1)*sizeof(*csg.roots));
+        if (csg.roots == NULL) return_defer(ENOMEM);
+        size_t root_count = 0;
+        for (size_t m = 0; m < 2; ++m) {
+            const Opencad_Mesh *mesh = csg.meshes[m];
+            const uint32_t *offsets = csg.segment_offsets[m];
+            uint32_t *components = csg.components[m] = malloc((mesh->triangle_count + 1)*sizeof(*components));
+            csg.inside[m] = calloc(mesh->triangle_count + 1, sizeof(*csg.inside[m]));
+            uint32_t *owners = malloc((mesh->vertex_count + 1)*sizeof(*owners));
+            if (!components || !csg.inside[m] || !owners) {
+                free(owners);
+                return_defer(ENOMEM);
+            }
+            const uint32_t none = UINT32_MAX, blocked = UINT32_MAX - 1;
+            for (size_t v = 0; v < mesh->vertex_count; ++v) owners[v] = none;
+            for (size_t t = 0; t < mesh->triangle_count; ++t) {
+                components[t] = (uint32_t) t;
+                if (offsets[t] == offsets[t + 1] && csg.twins[m][t] == 0) continue;
+                for (int k = 0; k < 3; ++k) owners[mesh->indices[t*3 + k]] = blocked;
+            }
+            for (size_t i = 0; i < csg.edge_point_count; ++i) {
+                if (csg.edge_points[i].mesh != m) continue;
+                owners[csg.edge_points[i].edge >> 32] = blocked;
+                owners[(uint32_t) csg.edge_points[i].edge] = blocked;
+            }
+            for (size_t t = 0; t < mesh->triangle_count; ++t) {
+                if (offsets[t] != offsets[t + 1] || csg.twins[m][t] != 0) continue;
+                for (int k = 0; k < 3; ++k) {
+                    uint32_t *owner = &owners[mesh->indices[t*3 + k]];
+                    if (*owner == blocked) continue;
+                    if (*owner == none) {
+                        *owner = (uint32_t) t;
+                        continue;
+                    }
+                    uint32_t u = opencad_csg_find(components, *owner), v = opencad_csg_find(components, (uint32_t) t);
+                    components[u > v ? u : v] = u > v ? v : u;
+                }
+            }
+            free(owners);
+            for (size_t t = 0; t < mesh->triangle_count; ++t) {
+                components[t] = opencad_csg_find(components, (uint32_t) t);
+                if (components[t] == t && offsets[t] == offsets[t + 1] && csg.twins[m][t] == 0) {
+                    csg.roots[root_count++] = (uint32_t) (t + (m ? csg.meshes[0]->triangle_count : 0));
+                }
+            }
+        }
+        opencad_parallel_for(root_count, 16, opencad_csg_component_task, &csg);
+
+        csg.outputs = malloc((total + 1)*sizeof(*csg.outputs));
+        if (csg.outputs == NULL) return_defer(ENOMEM);
+        opencad_parallel_for(total, 64, opencad_csg_classify_task, &csg);
+        if (csg.failed) return_defer(ENOMEM);
+
+        // Concatenate in triangle order, so the result does not depend on the scheduling.
+        size_t triangle_count = 0;
+        for (size_t i = 0; i < total; ++i) triangle_count += csg.outputs[i].count;
+        corners = malloc((triangle_count*3 + 1)*sizeof(*corners));
+        if (corners == NULL) return_defer(ENOMEM);
+        size_t count = 0;
+        for (size_t i = 0; i < total; ++i) {
+            const Opencad_Csg_Output *output = &csg.outputs[i];
+            if (output->count == 0) continue;
+            memcpy(&corners[count], &csg.thread_corners[output->thread][output->offset], output->count*3*sizeof(*corners));
+            count += output->count*3;
+        }
+        result = opencad_mesh_from_soup(corners, triangle_count, out);
+    }
+
+defer:
+    for (size_t m = 0; m < 2; ++m) {
+        opencad_mesh_free(&welded[m]);
+        opencad_bvh_free(&csg.bvhs[m]);
+        free(csg.segment_offsets[m]);
+        free(csg.segment_ids[m]);
+        free(csg.twins[m]);
+        free(csg.components[m]);
+        free(csg.inside[m]);
+    }
+    for (size_t i = 0; i < OPENCAD_MAX_THREADS; ++i) {
+        free(csg.thread_segments[i]);
+        free(csg.thread_edge_points[i]);
+        free(csg.thread_corners[i]);
+    }
+    free(csg.segments);
+    free(csg.edge_points);
+    free(csg.outputs);
+    free(csg.roots);
+    free(corners);
+    if (result != 0) opencad_mesh_free(out);
+    return result;
+}
+
+/**
+ * Kinds of signed distance field nodes. Primitives are centered on the origin.
+ */
+typedef enum {
+    OPENCAD_SDF_SPHERE,     // params[0]: radius.
+    OPENCAD_SDF_BOX,        // params[0..2]: half extents.
+    OPENCAD_SDF_CYLINDER,   // Along z. params[0]: radius, params[1]: half height.
+    OPENCAD_SDF_TORUS,      // Around z. params[0]: major radius, params[1]: minor radius.
+    OPENCAD_SDF_BOOLEAN,    // Combines a and b. params[0]: blend radius.
+    OPENCAD_SDF_TRANSFORM,  // Moves a by model.
+    OPENCAD_SDF_OFFSET,     // Grows a by params[0], rounding its edges.
+    COUNT_OPENCAD_SDFS
+} Opencad_Sdf_Kind;
+
+#define OPENCAD_SDF_NONE UINT32_MAX
+
+typedef struct {
+    Opencad_Sdf_Kind kind;
+    Opencad_Boolean op;
+    uint32_t a, b;
+    float params[4];
+    float scale;            // Transforms: a lower bound on how much model stretches distances.
+    Opencad_Mat4 model;     // Transforms.
+    Opencad_Mat4 inverse;   // Transforms.
+} Opencad_Sdf_Node;
+
+/**
+ * A signed distance field model: a tree of primitives, smooth booleans, transforms and offsets, stored as
+ * an array of nodes that refer to their operands by index. Nodes are added by the opencad_sdf_* builders,
+ * each returning the index of the new node; any node can serve as the root of a model. A builder that runs
+ * out of memory returns OPENCAD_SDF_NONE and marks the whole field failed, and builders given
+ * OPENCAD_SDF_NONE return it too, so a model can be built without checking every step.
+ */
+typedef struct {
+    Opencad_Sdf_Node *nodes;
+    size_t count;
+    size_t capacity;
+    bool failed;
+} Opencad_Sdf;
+
+/**
+ * Releases the nodes of a signed distance field and resets it to the empty field.
+ * @param sdf The field.
+ */
+void opencad_sdf_free(Opencad_Sdf *sdf)
+{
+    free(sdf->nodes);
+    memset(sdf, 0, sizeof(*sdf));
+}
+
+/**
+ * Appends a node to a field.
+ * @return The index of the node, or OPENCAD_SDF_NONE if out of memory.
+ */
+static uint32_t opencad_sdf_push(Opencad_Sdf *sdf, Opencad_Sdf_Node node)
+{
+    if (sdf->failed) return OPENCAD_SDF_NONE;
+    if (sdf->count == sdf->capacity) {
+        size_t capacity = sdf->capacity ? sdf->capacity*2 : 64;
+        Opencad_Sdf_Node *nodes = capacity < OPENCAD_SDF_NONE ? realloc(sdf->nodes, capacity*sizeof(*nodes)) : NULL;
+        if (nodes == NULL) {
+            sdf->failed = true;
+            return OPENCAD_SDF_NONE;
+        }
+        sdf->nodes = nodes;
+        sdf->capacity = capacity;
+    }
+    sdf->nodes[sdf->count] = node;
+    return (uint32_t) sdf->count++;
+}
+
+/**
+ * Adds a sphere.
+ * @param sdf The field.
+ * @param radius The radius.
+ * @return The node, or OPENCAD_SDF_NONE if out of memory.
+ */
+uint32_t opencad_sdf_sphere(Opencad_Sdf *sdf, float radius)
+{
+    return opencad_sdf_push(sdf, (Opencad_Sdf_Node) { .kind = OPENCAD_SDF_SPHERE, .params = {radius} });
+}
+
+/**
+ * Adds a box.
+ * @param sdf The field.
+ * @param size The edge lengths.
+ * @return The node, or OPENCAD_SDF_NONE if out of memory.
+ */
+uint32_t opencad_sdf_box(Opencad_Sdf *sdf, Opencad_Vec3 size)
+{
+    return opencad_sdf_push(sdf, (Opencad_Sdf_Node) {
+        .kind = OPENCAD_SDF_BOX,
+        .params = {0.5f*size.x, 0.5f*size.y, 0.5f*size.z},
+    });
+}
+
+/**
+ * Adds a cylinder along the z axis.
+ * @param sdf The field.
+ * @param radius The radius.
+ * @param height The height.
+ * @return The node, or OPENCAD_SDF_NONE if out of memory.
+ */
+uint32_t opencad_sdf_cylinder(Opencad_Sdf *sdf, float radius, float height)
+{
+    return opencad_sdf_push(sdf, (Opencad_Sdf_Node) { .kind = OPENCAD_SDF_CYLINDER, .params = {radius, 0.5f*height} });
+}
+
+/**
+ * Adds a torus around the z axis.
+ * @param sdf The field.
+ * @param radius The distance from the axis to the center of the tube.
+ * @param tube The radius of the tube.
+ * @return The node, or OPENCAD_SDF_NONE if out of memory.
+ */
+uint32_t opencad_sdf_torus(Opencad_Sdf *sdf, float radius, float tube)
+{
+    return opencad_sdf_push(sdf, (Opencad_Sdf_Node) { .kind = OPENCAD_SDF_TORUS, .params = {radius, tube} });
+}
+
+/**
+ * Combines two nodes. A positive blend radius replaces the sharp crease where the surfaces meet by a
+ * fillet (or, for union, a blend) about that wide, using the quadratic polynomial smooth minimum.
+ * @param sdf The field.
+ * @param op The operation.
+ * @param a The first operand.
+ * @param b The second operand, subtracted from the first by OPENCAD_BOOLEAN_DIFFERENCE.
+ * @param blend The blend radius, 0 for a sharp result.
+ * @return The node, or OPENCAD_SDF_NONE if out of memory or an operand is OPENCAD_SDF_NONE.
+ */
+uint32_t opencad_sdf_boolean(Opencad_Sdf *sdf, Opencad_Boolean op, uint32_t a, uint32_t b, float blend)
+{
+    if (a == OPENCAD_SDF_NONE || b == OPENCAD_SDF_NONE) return OPENCAD_SDF_NONE;
+    return opencad_sdf_push(sdf, (Opencad_Sdf_Node) {
+        .kind = OPENCAD_SDF_BOOLEAN,
+        .op = op,
+        .a = a,
+        .b = b,
+        .params = {blend > 0.0f ? blend : 0.0f},
+    });
+}
+
+/**
+ * Moves a node by an affine transform. Non-uniform scales keep the surface exact but make the field
+ * only a bound on the distance, which costs some tracing speed.
+ * @param sdf The field.
+ * @param a The node to move.
+ * @param model The transform, mapping the node's coordinates to the result's.
+ * @return The node, or OPENCAD_SDF_NONE if out of memory or a is OPENCAD_SDF_NONE.
+ */
+uint32_t opencad_sdf_transform(Opencad_Sdf *sdf, uint32_t a, Opencad_Mat4 model)
+{
+    if (a == OPENCAD_SDF_NONE) return OPENCAD_SDF_NONE;
+    Opencad_Sdf_Node node = {
+        .kind = OPENCAD_SDF_TRANSFORM,
+        .a = a,
+        .model = model,
+        .inverse = opencad_mat4_inverse(model),
+    };
+    // A distance d in the node's coordinates is at least d/|inverse| after the transform. The largest
+    // absolute row sum of inverse^T*inverse bounds |inverse|^2, and equals it for rotations and scales
+    // along the axes.
+    const float (*m)[4] = node.inverse.m;
+    float norm = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+        float sum = 0.0f;
+        for (int j = 0; j < 3; ++j) {
+            float dot = m[0][i]*m[0][j] + m[1][i]*m[1][j] + m[2][i]*m[2][j];
+            sum += dot < 0.0f ? -dot : dot;
+        }
+        if (sum > norm) norm = sum;
+    }
+    node.scale = norm > 0.0f ? 1.0f/sqrtf(norm) : 0.0f;
+    return opencad_sdf_push(sdf, node);
+}
+
+/**
+ * Grows a node by a distance, which rounds its convex edges with that radius; shrink the node first to keep its size.
+ * @param sdf The field.
+ * @param a The node to grow.
+ * @param distance The distance, negative to shrink.
+ * @return The node, or OPENCAD_SDF_NONE if out of memory or a is OPENCAD_SDF_NONE.
+ */
+uint32_t opencad_sdf_offset(Opencad_Sdf *sdf, uint32_t a, float distance)
+{
+    if (a == OPENCAD_SDF_NONE) return OPENCAD_SDF_NONE;
+    return opencad_sdf_push(sdf, (Opencad_Sdf_Node) { .kind = OPENCAD_SDF_OFFSET, .a = a, .params = {distance} });
+}
+
+#define OPENCAD_SDF_LANES 16
+#define OPENCAD_SDF_MAX_REGISTERS 128
+
+/**
+ * Instructions of compiled distance field programs. Registers hold OPENCAD_SDF_LANES floats each;
+ * points are three consecutive registers.
+ */
+typedef enum {
+    OPENCAD_SDF_OP_TRANSFORM,       // out..out+2 = the 3x4 matrix in params times the point at a.
+    OPENCAD_SDF_OP_SPHERE,          // out = the primitive at the point at a, with the node's params.
+    OPENCAD_SDF_OP_BOX,
+    OPENCAD_SDF_OP_CYLINDER,
+    OPENCAD_SDF_OP_TORUS,
+    OPENCAD_SDF_OP_AFFINE,          // out = a*params[0] + params[1].
+    OPENCAD_SDF_OP_MIN,             // out = min(a, b).
+    OPENCAD_SDF_OP_MAX,             // out = max(a, b).
+    OPENCAD_SDF_OP_MAX_NEG,         // out = max(a, -b).
+    OPENCAD_SDF_OP_SMOOTH_MIN,      // As above, blended over params[0].
+    OPENCAD_SDF_OP_SMOOTH_MAX,
+    OPENCAD_SDF_OP_SMOOTH_MAX_NEG,
+    COUNT_OPENCAD_SDF_OPS
+} Opencad_Sdf_Op;
+
+typedef struct {
+    Opencad_Sdf_Op op;
+    uint16_t out, a, b;
+    float params[12];
+} Opencad_Sdf_Instruction;
+
+/**
+ * A distance field model compiled into straight-line code over a register file, see opencad_sdf_compile.
+ * Registers 0 to 2 hold the coordinates of the points evaluated.
+ */
+typedef struct {
+    Opencad_Sdf_Instruction *code;
+    size_t count;
+    size_t capacity;
+    size_t register_count;
+    uint16_t result;
+} Opencad_Sdf_Program;
+
+/**
+ * Releases the code of a program and resets it to the empty program.
+ * @param program The program.
+ */
+void opencad_sdf_program_free(Opencad_Sdf_Program *program)
+{
+    free(program->code);
+    memset(program, 0, sizeof(*program));
+}
+
+/**
+ * Appends an instruction to a program.
+ * @return Whether there was memory for it.
+ */
+static bool opencad_sdf_emit(Opencad_Sdf_Program *program, Opencad_Sdf_Instruction instruction)
+{
+    if (program->count == program->capacity) {
+        size_t capacity = program->capacity ? program->capacity*2 : 64;
+        Opencad_Sdf_Instruction *code = realloc(program->code, capacity*sizeof(*code));
+        if (code == NULL) return false;
+        program->code = code;
+        program->capacity = capacity;
+    }
+    program->code[program->count++] = instruction;
+    return true;
+}
+
+/**
+ * Follows a chain of transforms down to the node they move, composing them.
+ * @param sdf The field.
+ * @param node The first node of the chain.
+ * @param inverse Receives the composed map from the chain's coordinates to the node's.
+ * @param scale Receives the composed distance scale.
+ * @return The node below the chain.
+ */
+static uint32_t opencad_sdf_fold_transforms(const Opencad_Sdf *sdf, uint32_t node, Opencad_Mat4 *inverse, float *scale)
+{
+    *inverse = opencad_mat4_identity();
+    *scale = 1.0f;
+    while (sdf->nodes[node].kind == OPENCAD_SDF_TRANSFORM) {
+        *inverse = opencad_mat4_mul(sdf->nodes[node].inverse, *inverse);
+        *scale *= sdf->nodes[node].scale;
+        node = sdf->nodes[node].a;
+    }
+    return node;
+}
+
+/**
+ * Counts the registers a node needs above the ones in use when it starts, evaluating the needier
+ * operand of every boolean first (Sethi-Ullman numbering). Counts are memoized in needs, 0 meaning unknown.
+ * @return The count, or SIZE_MAX if the node refers to itself or a later node.
+ */
+static size_t opencad_sdf_register_need(const Opencad_Sdf *sdf, uint32_t node, size_t *needs)
+{
+    const Opencad_Sdf_Node *n = &sdf->nodes[node];
+    if (needs[node] != 0) return needs[node];
+    size_t need = 1;
+    switch (n->kind) {
+    case OPENCAD_SDF_BOOLEAN: {
+        if (n->a >= node || n->b >= node) {
+            need = SIZE_MAX;
+            break;
+        }
+        size_t a = opencad_sdf_register_need(sdf, n->a, needs), b = opencad_sdf_register_need(sdf, n->b, needs);
+        need = a == SIZE_MAX || b == SIZE_MAX ? SIZE_MAX : a == b ? a + 1 : a > b ? a : b;
+        break;
+    }
+    case OPENCAD_SDF_TRANSFORM: {
+        Opencad_Mat4 inverse;
+        float scale;
+        uint32_t at = node;
+        while (sdf->nodes[at].kind == OPENCAD_SDF_TRANSFORM && sdf->nodes[at].a < at) at = sdf->nodes[at].a;
+        if (sdf->nodes[at].kind == OPENCAD_SDF_TRANSFORM) {
+            need = SIZE_MAX;
+            break;
+        }
+        size_t a = opencad_sdf_register_need(sdf, opencad_sdf_fold_transforms(sdf, node, &inverse, &scale), needs);
+        need = a == SIZE_MAX ? a : 3 + a;
+        break;
+    }
+    case OPENCAD_SDF_OFFSET:
+        need = n->a < node ? opencad_sdf_register_need(sdf, n->a, needs) : SIZE_MAX;
+        break;
+    default:
+        break;
+    }
+    needs[node] = need;
+    return need;
+}
+
+/**
+ * Emits the code of a node. Registers are used as a stack: the node's result ends up in the lowest free
+ * register, top, and everything above it is free again afterwards.
+ * @return Whether there was memory for the code.
+ */
+static bool opencad_sdf_compile_node(const Opencad_Sdf *sdf, uint32_t node, uint16_t point, uint16_t top,
+                                     size_t *needs, Opencad_Sdf_Program *program)
+{
+    const Opencad_Sdf_Node *n = &sdf->nodes[node];
+    Opencad_Sdf_Instruction ins = { .out = top, .a = point };
+    switch (n->kind) {
+    case OPENCAD_SDF_SPHERE:
+    case OPENCAD_SDF_BOX:
+    case OPENCAD_SDF_CYLINDER:
+    case OPENCAD_SDF_TORUS:
+        ins.op = OPENCAD_SDF_OP_SPHERE + (n->kind - OPENCAD_SDF_SPHERE);
+        memcpy(ins.params, n->params, sizeof(n->params));
+        return opencad_sdf_emit(program, ins);
+    case OPENCAD_SDF_BOOLEAN: {
+        static const Opencad_Sdf_Op ops[COUNT_OPENCAD_BOOLEANS][2] = {
+            [OPENCAD_BOOLEAN_UNION] = {OPENCAD_SDF_OP_MIN, OPENCAD_SDF_OP_SMOOTH_MIN},
+            [OPENCAD_BOOLEAN_DIFFERENCE] = {OPENCAD_SDF_OP_MAX_NEG, OPENCAD_SDF_OP_SMOOTH_MAX_NEG},
+            [OPENCAD_BOOLEAN_INTERSECTION] = {OPENCAD_SDF_OP_MAX, OPENCAD_SDF_OP_SMOOTH_MAX},
+        };
+        bool b_first = opencad_sdf_register_need(sdf, n->b, needs) > opencad_sdf_register_need(sdf, n->a, needs);
+        uint32_t first = b_first ? n->b : n->a, second = b_first ? n->a : n->b;
+        if (!opencad_sdf_compile_node(sdf, first, point, top, needs, program)) return false;
+        if (!opencad_sdf_compile_node(sdf, second, point, top + 1, needs, program)) return false;
+        ins.op = ops[n->op][n->params[0] > 0.0f];
+        ins.a = b_first ? top + 1 : top;
+        ins.b = b_first ? top : top + 1;
+        ins.params[0] = n->params[0];
+        return opencad_sdf_emit(program, ins);
+    }
+    case OPENCAD_SDF_TRANSFORM: {
+        Opencad_Mat4 inverse;
+        float scale;
+        uint32_t child = opencad_sdf_fold_transforms(sdf, node, &inverse, &scale);
+        ins.op = OPENCAD_SDF_OP_TRANSFORM;
+        memcpy(ins.params, inverse.m, 12*sizeof(float));
+        if (!opencad_sdf_emit(program, ins)) return false;
+        if (!opencad_sdf_compile_node(sdf, child, top, top + 3, needs, program)) return false;
+        return opencad_sdf_emit(program, (Opencad_Sdf_Instruction) {
+            .op = OPENCAD_SDF_OP_AFFINE, .out = top, .a = top + 3, .params = {scale, 0.0f},
+        });
+    }
+    case OPENCAD_SDF_OFFSET:
+        if (!opencad_sdf_compile_node(sdf, n->a, point, top, needs, program)) return false;
+        return opencad_sdf_emit(program, (Opencad_Sdf_Instruction) {
+            .op = OPENCAD_SDF_OP_AFFINE, .out = top, .a = top, .params = {1.0f, -n->params[0]},
+        });
+    default:
+        return false;
+    }
+}
+
+/**
+ * Compiles a distance field model into a flat register program, so evaluating it costs one dispatch per
+ * instruction for a whole batch of points instead of a walk over the tree per point. Chains of
+ * transforms are folded into one, and the needier operand of every boolean goes first, which keeps
+ * the register file small even for long chains of booleans.
+ * @param sdf The field.
+ * @param root The node to compile.
+ * @param program Receives the program. Must be freed with opencad_sdf_program_free.
+ * @return An error code indicating the result of the operation: E2BIG if the model needs more than
+ * OPENCAD_SDF_MAX_REGISTERS registers.
+ */
+Errno opencad_sdf_compile(const Opencad_Sdf *sdf, uint32_t root, Opencad_Sdf_Program *program)
+{
+    int result = 0;
+    memset(program, 0, sizeof(*program));
+    size_t *needs = NULL;
+    {
+        if (sdf->failed) return_defer(ENOMEM);
+        if (root >= sdf->count) return_defer(EINVAL);
+        needs = calloc(root + 1, sizeof(*needs));
+        if (needs == NULL) return_defer(ENOMEM);
+        size_t need = opencad_sdf_register_need(sdf, root, needs);
+        if (need == SIZE_MAX) return_defer(EINVAL);
+        if (3 + need > OPENCAD_SDF_MAX_REGISTERS) return_defer(E2BIG);
+        if (!opencad_sdf_compile_node(sdf, root, 0, 3, needs, program)) return_defer(ENOMEM);
+        program->register_count = 3 + need;
+        program->result = 3;
+    }
+
+defer:
+    free(needs);
+    if (result != 0) opencad_sdf_program_free(program);
+    return result;
+}
+
+/**
+ * Runs a program on OPENCAD_SDF_LANES points. Every instruction is a few plain loops over the lanes into
+ * locals, which the compiler turns into SIMD code, so the dispatch is paid once per batch.
+ * @param program The program.
+ * @param x The x-coordinates of the points.
+ * @param y The y-coordinates of the points.
+ * @param z The z-coordinates of the points.
+ * @param out Receives the distances.
+ */
+void opencad_sdf_program_eval(const Opencad_Sdf_Program *program, const float *x, const float *y,
+                              const float *z, float *out)
+{
+    float r[OPENCAD_SDF_MAX_REGISTERS][OPENCAD_SDF_LANES];
+    memcpy(r[0], x, sizeof(r[0]));
+    memcpy(r[1], y, sizeof(r[1]));
+    memcpy(r[2], z, sizeof(r[2]));
+    for (size_t i = 0; i < program->count; ++i) {
+        const Opencad_Sdf_Instruction *ins = &program->code[i];
+        const float *p = ins->params;
+        const float *a = r[ins->a], *b = r[ins->b];
+        float v[3][OPENCAD_SDF_LANES], w[OPENCAD_SDF_LANES];
+        switch (ins->op) {
+        case OPENCAD_SDF_OP_TRANSFORM: {
+            const float *ay = r[ins->a + 1], *az = r[ins->a + 2];
+            for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) {
+                v[0][l] = p[0]*a[l] + p[1]*ay[l] + p[2]*az[l] + p[3];
+                v[1][l] = p[4]*a[l] + p[5]*ay[l] + p[6]*az[l] + p[7];
+                v[2][l] = p[8]*a[l] + p[9]*ay[l] + p[10]*az[l] + p[11];
+            }
+            memcpy(r[ins->out], v, sizeof(v));
+            continue;
+        }
+        case OPENCAD_SDF_OP_SPHERE: {
+            const float *ay = r[ins->a + 1], *az = r[ins->a + 2];
+            for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) {
+                v[0][l] = sqrtf(a[l]*a[l] + ay[l]*ay[l] + az[l]*az[l]) - p[0];
+            }
+            break;
+        }
+        case OPENCAD_SDF_OP_BOX: {
+            // The outside part is clamped in one loop and squared in the next: clamps feeding arithmetic
+            // in the same loop keep GCC from vectorizing it.
+            const float *ay = r[ins->a + 1], *az = r[ins->a + 2];
+            float q[3][OPENCAD_SDF_LANES];
+            for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) {
+                float qx = fabsf(a[l]) - p[0], qy = fabsf(ay[l]) - p[1], qz = fabsf(az[l]) - p[2];
+                float inner = qx > qy ? qx : qy;
+                inner = inner > qz ? inner : qz;
+                v[1][l] = inner < 0.0f ? inner : 0.0f;
+                q[0][l] = qx > 0.0f ? qx : 0.0f;
+                q[1][l] = qy > 0.0f ? qy : 0.0f;
+                q[2][l] = qz > 0.0f ? qz : 0.0f;
+            }
+            for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) {
+                v[0][l] = sqrtf(q[0][l]*q[0][l] + q[1][l]*q[1][l] + q[2][l]*q[2][l]) + v[1][l];
+            }
+            break;
+        }
+        case OPENCAD_SDF_OP_CYLINDER: {
+            const float *ay = r[ins->a + 1], *az = r[ins->a + 2];
+            float q[2][OPENCAD_SDF_LANES];
+            for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) {
+                float qr = sqrtf(a[l]*a[l] + ay[l]*ay[l]) - p[0], qz = fabsf(az[l]) - p[1];
+                float inner = qr > qz ? qr : qz;
+                v[1][l] = inner < 0.0f ? inner : 0.0f;
+                q[0][l] = qr > 0.0f ? qr : 0.0f;
+                q[1][l] = qz > 0.0f ? qz : 0.0f;
+            }
+            for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) {
+                v[0][l] = sqrtf(q[0][l]*q[0][l] + q[1][l]*q[1][l]) + v[1][l];
+            }
+            break;
+        }
+        case OPENCAD_SDF_OP_TORUS: {
+            const float *ay = r[ins->a + 1], *az = r[ins->a + 2];
+            for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) {
+                float qr = sqrtf(a[l]*a[l] + ay[l]*ay[l]) - p[0];
+                v[0][l] = sqrtf(qr*qr + az[l]*az[l]) - p[1];
+            }
+            break;
+        }
+        case OPENCAD_SDF_OP_AFFINE:
+            for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) v[0][l] = a[l]*p[0] + p[1];
+            break;
+        case OPENCAD_SDF_OP_MIN:
+            for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) v[0][l] = a[l] < b[l] ? a[l] : b[l];
+            break;
+        case OPENCAD_SDF_OP_MAX:
+            for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) v[0][l] = a[l] > b[l] ? a[l] : b[l];
+            break;
+        case OPENCAD_SDF_OP_MAX_NEG:
+            for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) v[0][l] = a[l] > -b[l] ? a[l] : -b[l];
+            break;
+        case OPENCAD_SDF_OP_SMOOTH_MIN:
+        case OPENCAD_SDF_OP_SMOOTH_MAX:
+        case OPENCAD_SDF_OP_SMOOTH_MAX_NEG: {
+            // Maxima are -min(-a, -b) and -min(-a, b), with the polynomial smooth minimum
+            // min(u, v) - h*h*k/4 where h = max(k - |u - v|, 0)/k.
+            float sa = ins->op == OPENCAD_SDF_OP_SMOOTH_MIN ? 1.0f : -1.0f;
+            float sb = ins->op == OPENCAD_SDF_OP_SMOOTH_MAX ? -1.0f : 1.0f;
+            float k = p[0], inv = 1.0f/k;
+            for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) {
+                float u = sa*a[l], t = sb*b[l];
+                float h = k - fabsf(u - t);
+                w[l] = h > 0.0f ? h*inv : 0.0f;
+                v[1][l] = u < t ? u : t;
+            }
+            for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) v[0][l] = sa*(v[1][l] - w[l]*w[l]*k*0.25f);
+            break;
+        }
+        default:
+            continue;
+        }
+        memcpy(r[ins->out], v[0], sizeof(v[0]));
+    }
+    memcpy(out, r[program->result], sizeof(r[0]));
+}
+
+/**
+ * Evaluates the field of a node at one point by walking the tree. This is the plain definition the compiled
+ * programs must agree with, and is fine for a few queries; anything that samples many points should
+ * compile the model, see opencad_sdf_compile.
+ * @param sdf The field.
+ * @param node The node.
+ * @param p The point.
+ * @return The distance, or INFINITY for an invalid node.
+ */
+float opencad_sdf_eval(const Opencad_Sdf *sdf, uint32_t node, Opencad_Vec3 p)
+{
+    if (node >= sdf->count) return INFINITY;
+    const Opencad_Sdf_Node *n = &sdf->nodes[node];
+    const float *k = n->params;
+    switch (n->kind) {
+    case OPENCAD_SDF_SPHERE:
+        return sqrtf(p.x*p.x + p.y*p.y + p.z*p.z) - k[0];
+    case OPENCAD_SDF_BOX: {
+        float qx = fabsf(p.x) - k[0], qy = fabsf(p.y) - k[1], qz = fabsf(p.z) - k[2];
+        float inner = fmaxf(qx, fmaxf(qy, qz));
+        qx = fmaxf(qx, 0.0f);
+        qy = fmaxf(qy, 0.0f);
+        qz = fmaxf(qz, 0.0f);
+        return sqrtf(qx*qx + qy*qy + qz*qz) + fminf(inner, 0.0f);
+    }
+    case OPENCAD_SDF_CYLINDER: {
+        float qr = sqrtf(p.x*p.x + p.y*p.y) - k[0], qz = fabsf(p.z) - k[1];
+        float inner = fmaxf(qr, qz);
+        qr = fmaxf(qr, 0.0f);
+        qz = fmaxf(qz, 0.0f);
+        return sqrtf(qr*qr + qz*qz) + fminf(inner, 0.0f);
+    }
+    case OPENCAD_SDF_TORUS: {
+        float qr = sqrtf(p.x*p.x + p.y*p.y) - k[0];
+        return sqrtf(qr*qr + p.z*p.z) - k[1];
+    }
+    case OPENCAD_SDF_BOOLEAN: {
+        if (n->a >= node || n->b >= node) return INFINITY;
+        // Intersection is -min(-a, -b) and difference -min(-a, b), with the polynomial smooth minimum
+        // min(u, v) - h*h*k/4 where h = max(k - |u - v|, 0)/k.
+        float sa = n->op == OPENCAD_BOOLEAN_UNION ? 1.0f : -1.0f;
+        float sb = n->op == OPENCAD_BOOLEAN_INTERSECTION ? -1.0f : 1.0f;
+        float u = sa*opencad_sdf_eval(sdf, n->a, p), v = sb*opencad_sdf_eval(sdf, n->b, p);
+        float h = k[0] > 0.0f ? fmaxf(k[0] - fabsf(u - v), 0.0f)/k[0] : 0.0f;
+        return sa*(fminf(u, v) - h*h*k[0]*0.25f);
+    }
+    case OPENCAD_SDF_TRANSFORM:
+        if (n->a >= node) return INFINITY;
+        return opencad_sdf_eval(sdf, n->a, opencad_mat4_transform_point(n->inverse, p))*n->scale;
+    case OPENCAD_SDF_OFFSET:
+        if (n->a >= node) return INFINITY;
+        return opencad_sdf_eval(sdf, n->a, p) - k[0];
+    default:
+        return INFINITY;
+    }
+}
+
+/**
+ * Bounds |x| for x in [lo, hi].
+ */
+static void opencad_abs_interval(float lo, float hi, float *abs_lo, float *abs_hi)
+{
+    if (lo >= 0.0f) {
+        *abs_lo = lo;
+        *abs_hi = hi;
+    } else if (hi <= 0.0f) {
+        *abs_lo = -hi;
+        *abs_hi = -lo;
+    } else {
+        *abs_lo = 0.0f;
+        *abs_hi = -lo > hi ? -lo : hi;
+    }
+}
+
+/**
+ * The distance from a box corner offset q: the length of its positive part plus its largest negative
+ * component. It grows with every component of q, so bounds on q give bounds on it.
+ */
+static float opencad_sdf_corner_distance(const float *q, int n)
+{
+    float outside = 0.0f, inner = -INFINITY;
+    for (int k = 0; k < n; ++k) {
+        if (q[k] > 0.0f) outside += q[k]*q[k];
+        if (q[k] > inner) inner = q[k];
+    }
+    return sqrtf(outside) + (inner < 0.0f ? inner : 0.0f);
+}
+
+/**
+ * The polynomial smooth minimum of the programs, see opencad_sdf_program_eval.
+ */
+static float opencad_smooth_min(float u, float v, float k)
+{
+    float h = k - fabsf(u - v);
+    h = h > 0.0f ? h/k : 0.0f;
+    return (u < v ? u : v) - h*h*k*0.25f;
+}
+
+/**
+ * Bounds the field of a program over a box with interval arithmetic and specializes the program to the
+ * box: a minimum or maximum whose operands' ranges keep one of them from ever winning inside the box
+ * becomes a copy of the other, and the code only the loser needed is dropped. Nested boxes can be
+ * specialized from each other's programs, so an octree walk keeps shrinking the program as it descends.
+ * @param program The program.
+ * @param min The minimum corner of the box.
+ * @param max The maximum corner of the box.
+ * @param out Receives the specialized program. Memory it holds from an earlier call is reused, and it
+ * must be freed with opencad_sdf_program_free. May not be program.
+ * @param lo Receives a lower bound of the field over the box: the box is outside the model if it is positive.
+ * @param hi Receives an upper bound of the field over the box: the box is inside the model if it is negative.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_sdf_program_specialize(const Opencad_Sdf_Program *program, Opencad_Vec3 min, Opencad_Vec3 max,
+                                     Opencad_Sdf_Program *out, float *lo, float *hi)
+{
+    if (out->capacity < program->count) {
+        Opencad_Sdf_Instruction *code = realloc(out->code, program->count*sizeof(*code));
+        if (code == NULL) return ENOMEM;
+        out->code = code;
+        out->capacity = program->count;
+    }
+    out->register_count = program->register_count;
+    out->result = program->result;
+
+    float rl[OPENCAD_SDF_MAX_REGISTERS], rh[OPENCAD_SDF_MAX_REGISTERS];
+    rl[0] = min.x, rl[1] = min.y, rl[2] = min.z;
+    rh[0] = max.x, rh[1] = max.y, rh[2] = max.z;
+    for (size_t i = 0; i < program->count; ++i) {
+        Opencad_Sdf_Instruction ins = program->code[i];
+        const float *p = ins.params;
+        float al[3], ah[3];
+        switch (ins.op) {
+        case OPENCAD_SDF_OP_TRANSFORM:
+            for (int r = 0; r < 3; ++r) {
+                float center = p[r*4 + 3], radius = 0.0f;
+                for (int k = 0; k < 3; ++k) {
+                    center += p[r*4 + k]*0.5f*(rl[ins.a + k] + rh[ins.a + k]);
+                    radius += fabsf(p[r*4 + k])*0.5f*(rh[ins.a + k] - rl[ins.a + k]);
+                }
+                al[r] = center - radius;
+                ah[r] = center + radius;
+            }
+            for (int r = 0; r < 3; ++r) {
+                rl[ins.out + r] = al[r];
+                rh[ins.out + r] = ah[r];
+            }
+            break;
+        case OPENCAD_SDF_OP_SPHERE:
+            for (int k = 0; k < 3; ++k) opencad_abs_interval(rl[ins.a + k], rh[ins.a + k], &al[k], &ah[k]);
+            rl[ins.out] = sqrtf(al[0]*al[0] + al[1]*al[1] + al[2]*al[2]) - p[0];
+            rh[ins.out] = sqrtf(ah[0]*ah[0] + ah[1]*ah[1] + ah[2]*ah[2]) - p[0];
+            break;
+        case OPENCAD_SDF_OP_BOX:
+            for (int k = 0; k < 3; ++k) {
+                opencad_abs_interval(rl[ins.a + k], rh[ins.a + k], &al[k], &ah[k]);
+                al[k] -= p[k];
+                ah[k] -= p[k];
+            }
+            rl[ins.out] = opencad_sdf_corner_distance(al, 3);
+            rh[ins.out] = opencad_sdf_corner_distance(ah, 3);
+            break;
+        case OPENCAD_SDF_OP_CYLINDER:
+        case OPENCAD_SDF_OP_TORUS:
+            for (int k = 0; k < 3; ++k) opencad_abs_interval(rl[ins.a + k], rh[ins.a + k], &al[k], &ah[k]);
+            al[0] = sqrtf(al[0]*al[0] + al[1]*al[1]) - p[0];
+            ah[0] = sqrtf(ah[0]*ah[0] + ah[1]*ah[1]) - p[0];
+            if (ins.op == OPENCAD_SDF_OP_CYLINDER) {
+                al[1] = al[2] - p[1];
+                ah[1] = ah[2] - p[1];
+                rl[ins.out] = opencad_sdf_corner_distance(al, 2);
+                rh[ins.out] = opencad_sdf_corner_distance(ah, 2);
+            } else {
+                opencad_abs_interval(al[0], ah[0], &al[0], &ah[0]);
+                rl[ins.out] = sqrtf(al[0]*al[0] + al[2]*al[2]) - p[1];
+                rh[ins.out] = sqrtf(ah[0]*ah[0] + ah[2]*ah[2]) - p[1];
+            }
+            break;
+        case OPENCAD_SDF_OP_AFFINE:
+            al[0] = rl[ins.a]*p[0] + p[1];
+            ah[0] = rh[ins.a]*p[0] + p[1];
+            rl[ins.out] = al[0] < ah[0] ? al[0] : ah[0];
+            rh[ins.out] = al[0] < ah[0] ? ah[0] : al[0];
+            break;
+        default: {
+            // All the booleans are sa*min(u, v), smooth or not, with u = sa*a and v = sb*b.
+            bool smooth = ins.op >= OPENCAD_SDF_OP_SMOOTH_MIN;
+            Opencad_Sdf_Op plain = smooth ? ins.op - (OPENCAD_SDF_OP_SMOOTH_MIN - OPENCAD_SDF_OP_MIN) : ins.op;
+            float sa = plain == OPENCAD_SDF_OP_MIN ? 1.0f : -1.0f;
+            float sb = plain == OPENCAD_SDF_OP_MAX ? -1.0f : 1.0f;
+            float k = smooth ? p[0] : 0.0f;
+            float ul = sa > 0.0f ? rl[ins.a] : -rh[ins.a], uh = sa > 0.0f ? rh[ins.a] : -rl[ins.a];
+            float vl = sb > 0.0f ? rl[ins.b] : -rh[ins.b], vh = sb > 0.0f ? rh[ins.b] : -rl[ins.b];
+            // The smooth minimum grows with both operands, so the ends of the ranges bound it.
+            float ml = smooth ? opencad_smooth_min(ul, vl, k) : (ul < vl ? ul : vl);
+            float mh = smooth ? opencad_smooth_min(uh, vh, k) : (uh < vh ? uh : vh);
+            rl[ins.out] = sa > 0.0f ? ml : -mh;
+            rh[ins.out] = sa > 0.0f ? mh : -ml;
+            if (uh + k <= vl) {
+                ins = (Opencad_Sdf_Instruction) { .op = OPENCAD_SDF_OP_AFFINE, .out = ins.out, .a = ins.a, .params = {1.0f, 0.0f} };
+                // A copy of a register into itself does nothing.
+                if (ins.out == ins.a) ins.op = COUNT_OPENCAD_SDF_OPS;
+            } else if (vh + k <= ul) {
+                ins = (Opencad_Sdf_Instruction) { .op = OPENCAD_SDF_OP_AFFINE, .out = ins.out, .a = ins.b, .params = {sa*sb, 0.0f} };
+            }
+            break;
+        }
+        }
+        out->code[i] = ins;
+    }
+    *lo = rl[program->result];
+    *hi = rh[program->result];
+
+    // Walk back from the result, dropping instructions whose outputs nobody reads.
+    bool live[OPENCAD_SDF_MAX_REGISTERS] = {0};
+    live[program->result] = true;
+    for (size_t i = program->count; i-- > 0;) {
+        Opencad_Sdf_Instruction *ins = &out->code[i];
+        if (ins->op == COUNT_OPENCAD_SDF_OPS) continue;
+        int outputs = ins->op == OPENCAD_SDF_OP_TRANSFORM ? 3 : 1;
+        bool needed = false;
+        for (int k = 0; k < outputs; ++k) {
+            needed |= live[ins->out + k];
+            live[ins->out + k] = false;
+        }
+        if (!needed) {
+            ins->op = COUNT_OPENCAD_SDF_OPS;
+            continue;
+        }
+        if (ins->op <= OPENCAD_SDF_OP_TORUS) {
+            for (int k = 0; k < 3; ++k) live[ins->a + k] = true;
+        } else {
+            live[ins->a] = true;
+            if (ins->op != OPENCAD_SDF_OP_AFFINE) live[ins->b] = true;
+        }
+    }
+    out->count = 0;
+    for (size_t i = 0; i < program->count; ++i) {
+        if (out->code[i].op != COUNT_OPENCAD_SDF_OPS) out->code[out->count++] = out->code[i];
+    }
+    return 0;
+}
+
+/**
+ * Computes a box enclosing the surface of a node. The box is empty (min > max) when the node provably
+ * has no inside.
+ * @param sdf The field.
+ * @param node The node.
+ * @param min Receives the minimum corner.
+ * @param max Receives the maximum corner.
+ */
+void opencad_sdf_bounds(const Opencad_Sdf *sdf, uint32_t node, Opencad_Vec3 *min, Opencad_Vec3 *max)
+{
+    const Opencad_Sdf_Node *n = &sdf->nodes[node];
+    const float *p = n->params;
+    switch (n->kind) {
+    case OPENCAD_SDF_SPHERE:
+        *max = opencad_vec3(p[0], p[0], p[0]);
+        break;
+    case OPENCAD_SDF_BOX:
+        *max = opencad_vec3(p[0], p[1], p[2]);
+        break;
+    case OPENCAD_SDF_CYLINDER:
+        *max = opencad_vec3(p[0], p[0], p[1]);
+        break;
+    case OPENCAD_SDF_TORUS:
+        *max = opencad_vec3(p[0] + p[1], p[0] + p[1], p[1]);
+        break;
+    case OPENCAD_SDF_BOOLEAN: {
+        Opencad_Vec3 bmin, bmax;
+        opencad_sdf_bounds(sdf, n->a, min, max);
+        if (n->op == OPENCAD_BOOLEAN_DIFFERENCE) return;
+        opencad_sdf_bounds(sdf, n->b, &bmin, &bmax);
+        if (n->op == OPENCAD_BOOLEAN_INTERSECTION) {
+            // Smoothing only ever removes material from an intersection.
+            *min = opencad_vec3(fmaxf(min->x, bmin.x), fmaxf(min->y, bmin.y), fmaxf(min->z, bmin.z));
+            *max = opencad_vec3(fminf(max->x, bmax.x), fminf(max->y, bmax.y), fminf(max->z, bmax.z));
+            return;
+        }
+        // The smooth minimum lies at most k/4 below the plain one, and the field is 1-Lipschitz.
+        float grow = 0.25f*p[0];
+        *min = opencad_vec3(fminf(min->x, bmin.x) - grow, fminf(min->y, bmin.y) - grow, fminf(min->z, bmin.z) - grow);
+        *max = opencad_vec3(fmaxf(max->x, bmax.x) + grow, fmaxf(max->y, bmax.y) + grow, fmaxf(max->z, bmax.z) + grow);
+        return;
+    }
+    case OPENCAD_SDF_TRANSFORM: {
+        Opencad_Vec3 amin, amax;
+        opencad_sdf_bounds(sdf, n->a, &amin, &amax);
+        *min = opencad_vec3(INFINITY, INFINITY, INFINITY);
+        *max = opencad_vec3(-INFINITY, -INFINITY, -INFINITY);
+        if (amin.x > amax.x || amin.y > amax.y || amin.z > amax.z) return;
+        for (int c = 0; c < 8; ++c) {
+            Opencad_Vec3 corner = opencad_vec3(c & 1 ? amax.x : amin.x, c & 2 ? amax.y : amin.y, c & 4 ? amax.z : amin.z);
+            Opencad_Vec3 q = opencad_mat4_transform_point(n->model, corner);
+            *min = opencad_vec3(fminf(min->x, q.x), fminf(min->y, q.y), fminf(min->z, q.z));
+            *max = opencad_vec3(fmaxf(max->x, q.x), fmaxf(max->y, q.y), fmaxf(max->z, q.z));
+        }
+        return;
+    }
+    case OPENCAD_SDF_OFFSET:
+        opencad_sdf_bounds(sdf, n->a, min, max);
+        *min = opencad_vec3(min->x - p[0], min->y - p[0], min->z - p[0]);
+        *max = opencad_vec3(max->x + p[0], max->y + p[0], max->z + p[0]);
+        return;
+    default:
+        *max = opencad_vec3(-1.0f, -1.0f, -1.0f);
+        break;
+    }
+    *min = opencad_vec3_scale(*max, -1.0f);
+}
+
+#define OPENCAD_SDF_MAX_STEPS 256
+#define OPENCAD_SDF_REGION 16
+
+typedef struct {
+    Opencad_Canvas canvas;
+    const Opencad_Sdf_Program *program;
+    const Opencad_Material *material;
+    Opencad_Mat4 view;
+    Opencad_Mat4 view_projection;
+    Opencad_Mat4 inverse;           // Of view_projection.
+    float bounds[2][3];             // Of the root.
+    float depth[2];                 // The range of normalized device z the bounds cover.
+    size_t rect[4];                 // The pixels the bounds may cover: x0, y0, x1, y1.
+    size_t tiles_x;
+    float footprint[2];             // The size of a pixel at distance t along a ray is footprint[0] + footprint[1]*t.
+    Opencad_Sdf_Program regions[OPENCAD_MAX_THREADS];  // The program specialized to the region a thread traces.
+    atomic_bool failed;             // Set by any thread that runs out of memory.
+} Opencad_Sdf_Pass;
+
+/**
+ * Unprojects a pixel center onto the near and far planes.
+ */
+static void opencad_sdf_pixel_ray(const Opencad_Sdf_Pass *pass, float x, float y, Opencad_Vec3 *near, Opencad_Vec3 *far)
+{
+    float nx = 2.0f*x/(float) pass->canvas.width - 1.0f, ny = 1.0f - 2.0f*y/(float) pass->canvas.height;
+    Opencad_Vec4 a = opencad_mat4_apply(pass->inverse, (Opencad_Vec4) {nx, ny, -1.0f, 1.0f});
+    Opencad_Vec4 b = opencad_mat4_apply(pass->inverse, (Opencad_Vec4) {nx, ny, 1.0f, 1.0f});
+    *near = opencad_vec3_scale(opencad_vec3(a.x, a.y, a.z), 1.0f/a.w);
+    *far = opencad_vec3_scale(opencad_vec3(b.x, b.y, b.z), 1.0f/b.w);
+}
+
+/**
+ * Traces OPENCAD_SDF_LANES rays at once through the field. All lanes step together and evaluate the field
+ * together; a lane that hit or left the bounds just stops moving until the last one is done.
+ * @param pass The pass.
+ * @param program The program of the field.
+ * @param ox The ray origins, on the near plane.
+ * @param dx The unit ray directions.
+ * @param t0 The distance each ray enters the bounds at, replaced by the distance of the hit.
+ * @param t1 The distance each ray leaves the bounds at.
+ * @param active Which lanes march; cleared as they finish.
+ * @param hit Receives whether each lane hit.
+ */
+static void opencad_sdf_march(const Opencad_Sdf_Pass *pass, const Opencad_Sdf_Program *program, const float (*ox)[OPENCAD_SDF_LANES],
+                              const float (*dx)[OPENCAD_SDF_LANES], float *t0, const float *t1, bool *active, bool *hit)
+{
+    float px[3][OPENCAD_SDF_LANES], d[OPENCAD_SDF_LANES];
+    for (size_t step = 0; step < OPENCAD_SDF_MAX_STEPS; ++step) {
+        bool any = false;
+        for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) any |= active[l];
+        if (!any) break;
+
+        for (int k = 0; k < 3; ++k) {
+            for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) px[k][l] = ox[k][l] + dx[k][l]*t0[l];
+        }
+        opencad_sdf_program_eval(program, px[0], px[1], px[2], d);
+        for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) {
+            if (!active[l]) continue;
+            float epsilon = 0.5f*(pass->footprint[0] + pass->footprint[1]*t0[l]);
+            if (d[l] < epsilon) {
+                hit[l] = true;
+                active[l] = false;
+            } else {
+                t0[l] += d[l];
+                if (t0[l] > t1[l]) active[l] = false;
+            }
+        }
+    }
+}
+
+/**
+ * Sphere traces a region of at most OPENCAD_SDF_REGION^2 pixels in rows of OPENCAD_SDF_LANES, then shades
+ * the hits with normals from four more packet evaluations and depth tests them against the canvas.
+ * @param pass The pass.
+ * @param program The program of the field, specialized to the region.
+ * @param box The part of the bounds the region's rays cross.
+ * @param rect The pixels of the region: x0, y0, x1, y1.
+ */
+static void opencad_sdf_trace_region(const Opencad_Sdf_Pass *pass, const Opencad_Sdf_Program *program,
+                                     const float (*box)[3], const size_t *rect)
+{
+    const Opencad_Canvas canvas = pass->canvas;
+    const Opencad_Material *material = pass->material;
+    const float (*vp)[4] = pass->view_projection.m;
+    const float (*v)[4] = pass->view.m;
+    for (size_t y = rect[1]; y < rect[3]; ++y) {
+        for (size_t x = rect[0]; x < rect[2]; x += OPENCAD_SDF_LANES) {
+            float o[3][OPENCAD_SDF_LANES], d[3][OPENCAD_SDF_LANES], t0[OPENCAD_SDF_LANES], t1[OPENCAD_SDF_LANES];
+            bool active[OPENCAD_SDF_LANES], hit[OPENCAD_SDF_LANES] = {0};
+            for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) {
+                Opencad_Vec3 near, far;
+                opencad_sdf_pixel_ray(pass, (float) (x + l) + 0.5f, (float) y + 0.5f, &near, &far);
+                Opencad_Vec3 dir = opencad_vec3_sub(far, near);
+                float length = opencad_vec3_length(dir);
+                dir = opencad_vec3_scale(dir, 1.0f/length);
+                o[0][l] = near.x, o[1][l] = near.y, o[2][l] = near.z;
+                d[0][l] = dir.x, d[1][l] = dir.y, d[2][l] = dir.z;
+
+                // Clip the ray to the box and to the depth range.
+                float enter = 0.0f, leave = length;
+                for (int k = 0; k < 3; ++k) {
+                    float inv = 1.0f/d[k][l];
+                    float a = (box[0][k] - o[k][l])*inv, b = (box[1][k] - o[k][l])*inv;
+                    if (a > b) OPENCAD_SWAP(float, a, b);
+                    if (a > enter) enter = a;
+                    if (b < leave) leave = b;
+                }
+                t0[l] = enter;
+                t1[l] = leave;
+                active[l] = x + l < rect[2] && enter <= leave;
+            }
+            opencad_sdf_march(pass, program, (const float (*)[OPENCAD_SDF_LANES]) o, (const float (*)[OPENCAD_SDF_LANES]) d, t0, t1, active, hit);
+
+            bool any = false;
+            for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) any |= hit[l];
+            if (!any) continue;
+
+            // Tetrahedral central differences: the field at four corners of a tetrahedron around the hit.
+            float p[3][OPENCAD_SDF_LANES], n[3][OPENCAD_SDF_LANES] = {0}, q[3][OPENCAD_SDF_LANES], f[OPENCAD_SDF_LANES];
+            static const float corners[4][3] = {{1, -1, -1}, {-1, -1, 1}, {-1, 1, -1}, {1, 1, 1}};
+            for (int k = 0; k < 3; ++k) {
+                for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) p[k][l] = o[k][l] + d[k][l]*t0[l];
+            }
+            for (int c = 0; c < 4; ++c) {
+                for (int k = 0; k < 3; ++k) {
+                    for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) {
+                        float h = 0.25f*(pass->footprint[0] + pass->footprint[1]*t0[l]);
+                        q[k][l] = p[k][l] + corners[c][k]*h;
+                    }
+                }
+                opencad_sdf_program_eval(program, q[0], q[1], q[2], f);
+                for (int k = 0; k < 3; ++k) {
+                    for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) n[k][l] += corners[c][k]*f[l];
+                }
+            }
+
+            for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) {
+                if (!hit[l]) continue;
+                float cz = vp[2][0]*p[0][l] + vp[2][1]*p[1][l] + vp[2][2]*p[2][l] + vp[2][3];
+                float cw = vp[3][0]*p[0][l] + vp[3][1]*p[1][l] + vp[3][2]*p[2][l] + vp[3][3];
+                float z = cz/cw*0.5f + 0.5f;
+                size_t index = y*canvas.stride + x + l;
+                if (!(z >= 0.0f && z < canvas.depth[index])) continue;
+
+                Opencad_Vec3 normal = opencad_vec3_normalize(opencad_vec3(
+                    v[0][0]*n[0][l] + v[0][1]*n[1][l] + v[0][2]*n[2][l],
+                    v[1][0]*n[0][l] + v[1][1]*n[1][l] + v[1][2]*n[2][l],
+                    v[2][0]*n[0][l] + v[2][1]*n[1][l] + v[2][2]*n[2][l]));
+                canvas.depth[index] = z;
+                canvas.pixels[index] = material->shading == OPENCAD_SHADING_UNLIT ? material->color
+                                     : opencad_shade_color(material->color, opencad_light_intensity(material, normal));
+                if (canvas.normals) canvas.normals[index] = opencad_pack_normal(normal);
+            }
+        }
+    }
+}
+
+/**
+ * Traces one tile of the canvas region by region. The part of the bounds a region's rays can reach is
+ * boxed in from the corners of its frustum; the region is skipped if the field is provably positive over
+ * that box and otherwise traced with the program specialized to it.
+ */
+static void opencad_sdf_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    Opencad_Sdf_Pass *pass = ctx;
+    const Opencad_Canvas canvas = pass->canvas;
+    for (size_t tile = begin; tile < end; ++tile) {
+        size_t x0 = (tile % pass->tiles_x)*OPENCAD_TILE_SIZE, y0 = (tile / pass->tiles_x)*OPENCAD_TILE_SIZE;
+        size_t x1 = x0 + OPENCAD_TILE_SIZE < canvas.width ? x0 + OPENCAD_TILE_SIZE : canvas.width;
+        size_t y1 = y0 + OPENCAD_TILE_SIZE < canvas.height ? y0 + OPENCAD_TILE_SIZE : canvas.height;
+        if (x0 < pass->rect[0]) x0 = pass->rect[0];
+        if (y0 < pass->rect[1]) y0 = pass->rect[1];
+        if (x1 > pass->rect[2]) x1 = pass->rect[2];
+        if (y1 > pass->rect[3]) y1 = pass->rect[3];
+
+        for (size_t ry = y0; ry < y1; ry += OPENCAD_SDF_REGION) {
+            for (size_t rx = x0; rx < x1; rx += OPENCAD_SDF_REGION) {
+                size_t rect[4] = {
+                    rx, ry, rx + OPENCAD_SDF_REGION < x1 ? rx + OPENCAD_SDF_REGION : x1,
+                    ry + OPENCAD_SDF_REGION < y1 ? ry + OPENCAD_SDF_REGION : y1,
+                };
+                float box[2][3] = {{INFINITY, INFINITY, INFINITY}, {-INFINITY, -INFINITY, -INFINITY}};
+                for (int c = 0; c < 8; ++c) {
+                    float nx = 2.0f*(float) rect[c & 1 ? 2 : 0]/(float) canvas.width - 1.0f;
+                    float ny = 1.0f - 2.0f*(float) rect[c & 2 ? 3 : 1]/(float) canvas.height;
+                    Opencad_Vec4 q = opencad_mat4_apply(pass->inverse, (Opencad_Vec4) {nx, ny, pass->depth[c >> 2], 1.0f});
+                    const float point[3] = {q.x/q.w, q.y/q.w, q.z/q.w};
+                    for (int k = 0; k < 3; ++k) {
+                        if (point[k] < box[0][k]) box[0][k] = point[k];
+                        if (point[k] > box[1][k]) box[1][k] = point[k];
+                    }
+                }
+                bool empty = false;
+                for (int k = 0; k < 3; ++k) {
+                    if (pass->bounds[0][k] > box[0][k]) box[0][k] = pass->bounds[0][k];
+                    if (pass->bounds[1][k] < box[1][k]) box[1][k] = pass->bounds[1][k];
+                    empty |= box[0][k] > box[1][k];
+                }
+                if (empty) continue;
+
+                // The normals sample the field up to a pixel outside the box, so specialize with that much slack.
+                Opencad_Vec3 near, far;
+                opencad_sdf_pixel_ray(pass, 0.5f*(float) (rect[0] + rect[2]), 0.5f*(float) (rect[1] + rect[3]), &near, &far);
+                float reach = 0.0f;
+                for (int c = 0; c < 8; ++c) {
+                    Opencad_Vec3 corner = opencad_vec3(box[c & 1][0], box[(c >> 1) & 1][1], box[c >> 2][2]);
+                    float distance = opencad_vec3_length(opencad_vec3_sub(corner, near));
+                    if (distance > reach) reach = distance;
+                }
+                float slack = pass->footprint[0] + pass->footprint[1]*reach;
+                float lo, hi;
+                Errno err = opencad_sdf_program_specialize(pass->program,
+                    opencad_vec3(box[0][0] - slack, box[0][1] - slack, box[0][2] - slack),
+                    opencad_vec3(box[1][0] + slack, box[1][1] + slack, box[1][2] + slack), &pass->regions[thread], &lo, &hi);
+                if (err) {
+                    pass->failed = true;
+                    return;
+                }
+                if (lo > 0.0f) continue;
+                opencad_sdf_trace_region(pass, &pass->regions[thread], (const float (*)[3]) box, rect);
+            }
+        }
+    }
+}
+
+/**
+ * Draws a signed distance field model into a canvas by sphere tracing, with depth testing, so it mixes
+ * with meshes drawn before or after. The canvas is traced in parallel tiles, each in packets of
+ * OPENCAD_SDF_LANES rays; tiles outside the screen rectangle of the model's bounds are skipped and every ray
+ * only marches through the part of the bounds it crosses. Hits are shaded with the material's color and
+ * lights; any shading other than unlit is lit per pixel, and sections, textures and transparency are
+ * ignored. The view transform of the camera must not scale.
+ * @param canvas The canvas to draw into.
+ * @param sdf The field.
+ * @param root The node to draw.
+ * @param camera The camera.
+ * @param material The material.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_render_sdf(Opencad_Canvas canvas, const Opencad_Sdf *sdf, uint32_t root,
+                         const Opencad_Camera *camera, const Opencad_Material *material)
+{
+    if (sdf->failed) return ENOMEM;
+    if (root >= sdf->count) return EINVAL;
+    if (canvas.width == 0 || canvas.height == 0) return 0;
+
+    Opencad_Vec3 min, max;
+    opencad_sdf_bounds(sdf, root, &min, &max);
+    if (min.x > max.x || min.y > max.y || min.z > max.z) return 0;
+
+    Opencad_Sdf_Pass pass = {
+        .canvas = canvas,
+        .material = material,
+        .view = camera->view,
+        .view_projection = opencad_mat4_mul(camera->projection, camera->view),
+        .bounds = {{min.x, min.y, min.z}, {max.x, max.y, max.z}},
+        .rect = {0, 0, canvas.width, canvas.height},
+        .tiles_x = (canvas.width + OPENCAD_TILE_SIZE - 1)/OPENCAD_TILE_SIZE,
+    };
+    pass.inverse = opencad_mat4_inverse(pass.view_projection);
+
+    // The screen rectangle and depth range of the bounds, unless a corner is behind the eye.
+    float rect[4] = {INFINITY, INFINITY, -INFINITY, -INFINITY};
+    bool behind = false;
+    pass.depth[0] = 1.0f;
+    pass.depth[1] = -1.0f;
+    for (int c = 0; c < 8 && !behind; ++c) {
+        Opencad_Vec4 q = opencad_mat4_apply(pass.view_projection, (Opencad_Vec4) {
+            c & 1 ? max.x : min.x, c & 2 ? max.y : min.y, c & 4 ? max.z : min.z, 1.0f,
+        });
+        if (q.w <= 0.0f) behind = true;
+        pass.depth[0] = fminf(pass.depth[0], q.z/q.w);
+        pass.depth[1] = fmaxf(pass.depth[1], q.z/q.w);
+        float sx = (q.x/q.w*0.5f + 0.5f)*(float) canvas.width, sy = (0.5f - q.y/q.w*0.5f)*(float) canvas.height;
+        rect[0] = fminf(rect[0], sx);
+        rect[1] = fminf(rect[1], sy);
+        rect[2] = fmaxf(rect[2], sx);
+        rect[3] = fmaxf(rect[3], sy);
+    }
+    if (behind || pass.depth[0] < -1.0f) pass.depth[0] = -1.0f;
+    if (behind || pass.depth[1] > 1.0f) pass.depth[1] = 1.0f;
+    if (pass.depth[0] > pass.depth[1]) return 0;
+    if (!behind) {
+        if (rect[2] < 0.0f || rect[3] < 0.0f || rect[0] >= (float) canvas.width || rect[1] >= (float) canvas.height) return 0;
+        pass.rect[0] = rect[0] > 0.0f ? (size_t) rect[0] : 0;
+        pass.rect[1] = rect[1] > 0.0f ? (size_t) rect[1] : 0;
+        pass.rect[2] = rect[2] + 1.0f < (float) canvas.width ? (size_t) rect[2] + 1 : canvas.width;
+        pass.rect[3] = rect[3] + 1.0f < (float) canvas.height ? (size_t) rect[3] + 1 : canvas.height;
+    }
+
+    // How far apart neighboring rays are on the near and far planes, interpolated in between.
+    float cx = 0.5f*(float) canvas.width, cy = 0.5f*(float) canvas.height;
+    Opencad_Vec3 near0, far0, near1, far1;
+    opencad_sdf_pixel_ray(&pass, cx, cy, &near0, &far0);
+    opencad_sdf_pixel_ray(&pass, cx + 1.0f, cy, &near1, &far1);
+    float length = opencad_vec3_length(opencad_vec3_sub(far0, near0));
+    pass.footprint[0] = opencad_vec3_length(opencad_vec3_sub(near1, near0));
+    pass.footprint[1] = (opencad_vec3_length(opencad_vec3_sub(far1, far0)) - pass.footprint[0])/length;
+
+    Opencad_Sdf_Program program;
+    Errno err = opencad_sdf_compile(sdf, root, &program);
+    if (err) return err;
+    pass.program = &program;
+    size_t tiles_y = (canvas.height + OPENCAD_TILE_SIZE - 1)/OPENCAD_TILE_SIZE;
+    opencad_parallel_for(pass.tiles_x*tiles_y, 1, opencad_sdf_task, &pass);
+    opencad_sdf_program_free(&program);
+    for (size_t i = 0; i < OPENCAD_MAX_THREADS; ++i) opencad_sdf_program_free(&pass.regions[i]);
+    return pass.failed ? ENOMEM : 0;
+}
+
+#define OPENCAD_SDF_BLOCK 16
+#define OPENCAD_SDF_BLOCK_SAMPLES ((OPENCAD_SDF_BLOCK + 1)*(OPENCAD_SDF_BLOCK + 1)*(OPENCAD_SDF_BLOCK + 1))
+#define OPENCAD_SDF_QEF_BIAS 0.05f
+#define OPENCAD_SDF_OCTREE_DEPTH 3      // Levels of the octree over the blocks; the top level spans 2^(depth - 1) blocks.
+
+typedef struct {
+    float *samples;             // The field at the corners of the cells of the current block.
+    int32_t *edges;             // Per sample and axis: the crossing on the edge starting there, or -1.
+    float (*crossings)[6];      // Point and unit normal.
+    uint64_t *keys;             // The cell of every vertex.
+    Opencad_Vec3 *vertices;
+    size_t vertex_count;
+    size_t vertex_capacity;
+    uint64_t (*quads)[4];       // Four cells around a crossed edge, counter-clockwise seen from outside.
+    size_t quad_count;
+    size_t quad_capacity;
+    Opencad_Sdf_Program levels[OPENCAD_SDF_OCTREE_DEPTH];  // The program specialized to each node on the current path.
+} Opencad_Sdf_Mesher_Thread;
+
+typedef struct {
+    size_t thread;
+    size_t offset;
+    size_t count;
+} Opencad_Sdf_Block_Output;
+
+typedef struct {
+    Opencad_Sdf_Program program;
+    float origin[3];
+    float cell;
+    size_t cells[3];                // Per axis, a multiple of OPENCAD_SDF_BLOCK.
+    size_t blocks[3];
+    size_t tops[3];                 // Top level octree nodes per axis.
+    Opencad_Sdf_Block_Output *outputs;  // Per block; empty for the blocks the octree discarded.
+    Opencad_Sdf_Mesher_Thread threads[OPENCAD_MAX_THREADS];
+    uint64_t *keys;                 // Sorted cells of all vertices.
+    uint64_t (*quads)[4];           // All quads, in block order.
+    uint32_t *indices;              // Two triangles per quad, or UINT32_MAX where a quad lost a vertex.
+    atomic_bool failed;             // Set by any thread that runs out of memory.
+} Opencad_Sdf_Mesher;
+
+/**
+ * Solves the quadratic error function of a cell: the point closest, in the least squares sense, to the
+ * tangent planes at the crossings, pulled slightly towards their mean so flat and edge-like cells stay
+ * well conditioned, and clamped to the cell.
+ */
+static Opencad_Vec3 opencad_sdf_qef(const float (*crossings)[6], const int32_t *ids, size_t count,
+                                    const float *lo, float cell)
+{
+    float c[3] = {0};
+    for (size_t i = 0; i < count; ++i) {
+        for (int k = 0; k < 3; ++k) c[k] += crossings[ids[i]][k];
+    }
+    for (int k = 0; k < 3; ++k) c[k] /= (float) count;
+
+    float a[3][3] = {{OPENCAD_SDF_QEF_BIAS, 0, 0}, {0, OPENCAD_SDF_QEF_BIAS, 0}, {0, 0, OPENCAD_SDF_QEF_BIAS}}, b[3] = {0};
+    for (size_t i = 0; i < count; ++i) {
+        const float *p = crossings[ids[i]], *n = &crossings[ids[i]][3];
+        float offset = n[0]*(p[0] - c[0]) + n[1]*(p[1] - c[1]) + n[2]*(p[2] - c[2]);
+        for (int r = 0; r < 3; ++r) {
+            for (int k = 0; k < 3; ++k) a[r][k] += n[r]*n[k];
+            b[r] += n[r]*offset;
+        }
+    }
+
+    // Cramer's rule; the bias keeps the determinant away from zero.
+    float det = a[0][0]*(a[1][1]*a[2][2] - a[1][2]*a[2][1]) - a[0][1]*(a[1][0]*a[2][2] - a[1][2]*a[2][0])
+              + a[0][2]*(a[1][0]*a[2][1] - a[1][1]*a[2][0]);
+    float x[3];
+    for (int k = 0; k < 3; ++k) {
+        float m[3][3];
+        memcpy(m, a, sizeof(m));
+        for (int r = 0; r < 3; ++r) m[r][k] = b[r];
+        float dk = m[0][0]*(m[1][1]*m[2][2] - m[1][2]*m[2][1]) - m[0][1]*(m[1][0]*m[2][2] - m[1][2]*m[2][0])
+                 + m[0][2]*(m[1][0]*m[2][1] - m[1][1]*m[2][0]);
+        x[k] = c[k] + dk/det;
+        if (x[k] < lo[k]) x[k] = lo[k];
+        if (x[k] > lo[k] + cell) x[k] = lo[k] + cell;
+    }
+    return opencad_vec3(x[0], x[1], x[2]);
+}
+
+/**
+ * Contours a block with a program specialized to it. The field is sampled at the corners of its cells in
+ * packets of OPENCAD_SDF_LANES, crossed edges get a point and a normal, every cell with crossings gets one
+ * vertex at the minimum of its quadratic error function, and every crossed edge whose first sample lies
+ * in the block gets a quad joining the four cells around it. Vertices and quads refer to cells by their
+ * global index, so neighboring blocks need no coordination to agree on shared vertices.
+ */
+static void opencad_sdf_contour_block(Opencad_Sdf_Mesher *mesher, size_t thread, size_t block,
+                                      const Opencad_Sdf_Program *program)
+{
+    Opencad_Sdf_Mesher_Thread *t = &mesher->threads[thread];
+    const size_t S = OPENCAD_SDF_BLOCK + 1;
+    if (t->samples == NULL) {
+        t->samples = malloc(OPENCAD_SDF_BLOCK_SAMPLES*sizeof(*t->samples));
+        t->edges = malloc(3*OPENCAD_SDF_BLOCK_SAMPLES*sizeof(*t->edges));
+        t->crossings = malloc(3*OPENCAD_SDF_BLOCK_SAMPLES*sizeof(*t->crossings));
+        if (!t->samples || !t->edges || !t->crossings) {
+            mesher->failed = true;
+            return;
+        }
+    }
+    const float cell = mesher->cell;
+    const size_t *cells = mesher->cells;
+
+    size_t base[3] = {
+        block % mesher->blocks[0]*OPENCAD_SDF_BLOCK,
+        block / mesher->blocks[0] % mesher->blocks[1]*OPENCAD_SDF_BLOCK,
+        block / mesher->blocks[0] / mesher->blocks[1]*OPENCAD_SDF_BLOCK,
+    };
+    float lo[3];
+    for (int k = 0; k < 3; ++k) lo[k] = mesher->origin[k] + (float) base[k]*cell;
+
+    for (size_t i = 0; i < OPENCAD_SDF_BLOCK_SAMPLES; i += OPENCAD_SDF_LANES) {
+        float x[OPENCAD_SDF_LANES], y[OPENCAD_SDF_LANES], z[OPENCAD_SDF_LANES], d[OPENCAD_SDF_LANES];
+        for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) {
+            size_t s = i + l < OPENCAD_SDF_BLOCK_SAMPLES ? i + l : OPENCAD_SDF_BLOCK_SAMPLES - 1;
+            x[l] = mesher->origin[0] + (float) (base[0] + s % S)*cell;
+            y[l] = mesher->origin[1] + (float) (base[1] + s/S % S)*cell;
+            z[l] = mesher->origin[2] + (float) (base[2] + s/(S*S))*cell;
+        }
+        opencad_sdf_program_eval(program, x, y, z, d);
+        for (size_t l = 0; l < OPENCAD_SDF_LANES && i + l < OPENCAD_SDF_BLOCK_SAMPLES; ++l) t->samples[i + l] = d[l];
+    }
+
+    // Crossing points, by linear interpolation along the edges between samples of opposite sign.
+    const size_t step[3] = {1, S, S*S};
+    size_t crossing_count = 0;
+    for (size_t s = 0; s < OPENCAD_SDF_BLOCK_SAMPLES; ++s) {
+        size_t at[3] = {s % S, s/S % S, s/(S*S)};
+        for (int k = 0; k < 3; ++k) {
+            t->edges[s*3 + k] = -1;
+            if (at[k] == OPENCAD_SDF_BLOCK) continue;
+            float d0 = t->samples[s], d1 = t->samples[s + step[k]];
+            if ((d0 < 0.0f) == (d1 < 0.0f)) continue;
+            float *c = t->crossings[crossing_count];
+            for (int j = 0; j < 3; ++j) c[j] = lo[j] + (float) at[j]*cell;
+            c[k] += d0/(d0 - d1)*cell;
+            t->edges[s*3 + k] = (int32_t) crossing_count++;
+        }
+    }
+    if (crossing_count == 0) {
+        mesher->outputs[block] = (Opencad_Sdf_Block_Output) { .thread = thread };
+        return;
+    }
+
+    // Normals from tetrahedral differences, a packet of crossings at a time.
+    static const float corners[4][3] = {{1, -1, -1}, {-1, -1, 1}, {-1, 1, -1}, {1, 1, 1}};
+    const float h = 0.05f*cell;
+    for (size_t i = 0; i < crossing_count; i += OPENCAD_SDF_LANES) {
+        float n[3][OPENCAD_SDF_LANES] = {0}, q[3][OPENCAD_SDF_LANES], f[OPENCAD_SDF_LANES];
+        for (int c = 0; c < 4; ++c) {
+            for (int k = 0; k < 3; ++k) {
+                for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) {
+                    size_t id = i + l < crossing_count ? i + l : crossing_count - 1;
+                    q[k][l] = t->crossings[id][k] + corners[c][k]*h;
+                }
+            }
+            opencad_sdf_program_eval(program, q[0], q[1], q[2], f);
+            for (int k = 0; k < 3; ++k) {
+                for (size_t l = 0; l < OPENCAD_SDF_LANES; ++l) n[k][l] += corners[c][k]*f[l];
+            }
+        }
+        for (size_t l = 0; l < OPENCAD_SDF_LANES && i + l < crossing_count; ++l) {
+            float length = sqrtf(n[0][l]*n[0][l] + n[1][l]*n[1][l] + n[2][l]*n[2][l]);
+            float inv = length > 0.0f ? 1.0f/length : 0.0f;
+            for (int k = 0; k < 3; ++k) t->crossings[i + l][3 + k] = n[k][l]*inv;
+        }
+    }
+
+    // One vertex per cell with crossings on any of its twelve edges.
+    for (size_t k = 0; k < OPENCAD_SDF_BLOCK; ++k) {
+        for (size_t j = 0; j < OPENCAD_SDF_BLOCK; ++j) {
+            for (size_t i = 0; i < OPENCAD_SDF_BLOCK; ++i) {
+                size_t s = (k*S + j)*S + i;
+                int32_t ids[12];
+                size_t count = 0;
+                for (int e = 0; e < 4; ++e) {
+                    // Edges along x start at the cell's corners (0, e&1, e>>1) in y and z, and so on.
+                    int32_t edge[3] = {
+                        t->edges[(s + (e & 1)*step[1] + (e >> 1)*step[2])*3 + 0],
+                        t->edges[(s + (e & 1)*step[2] + (e >> 1)*step[0])*3 + 1],
+                        t->edges[(s + (e & 1)*step[0] + (e >> 1)*step[1])*3 + 2],
+                    };
+                    for (int axis = 0; axis < 3; ++axis) {
+                        if (edge[axis] >= 0) ids[count++] = edge[axis];
+                    }
+                }
+                if (count == 0) continue;
+                if (t->vertex_count == t->vertex_capacity) {
+                    size_t capacity = t->vertex_capacity ? t->vertex_capacity*2 : 1024;
+                    Opencad_Vec3 *vertices = realloc(t->vertices, capacity*sizeof(*vertices));
+                    if (vertices) t->vertices = vertices;
+                    uint64_t *keys = realloc(t->keys, capacity*sizeof(*keys));
+                    if (keys) t->keys = keys;
+                    if (!vertices || !keys) {
+                        mesher->failed = true;
+                        return;
+                    }
+                    t->vertex_capacity = capacity;
+                }
+                float corner[3] = {lo[0] + (float) i*cell, lo[1] + (float) j*cell, lo[2] + (float) k*cell};
+                t->vertices[t->vertex_count] = opencad_sdf_qef((const float (*)[6]) t->crossings, ids, count, corner, cell);
+                t->keys[t->vertex_count++] = ((uint64_t) (base[2] + k)*cells[1] + base[1] + j)*cells[0] + base[0] + i;
+            }
+        }
+    }
+
+    // One quad per crossed edge starting in the block, joining the cells around it.
+    size_t first = t->quad_count;
+    for (size_t k = 0; k < OPENCAD_SDF_BLOCK; ++k) {
+        for (size_t j = 0; j < OPENCAD_SDF_BLOCK; ++j) {
+            for (size_t i = 0; i < OPENCAD_SDF_BLOCK; ++i) {
+                size_t s = (k*S + j)*S + i;
+                size_t g[3] = {base[0] + i, base[1] + j, base[2] + k};
+                for (int axis = 0; axis < 3; ++axis) {
+                    if (t->edges[s*3 + axis] < 0) continue;
+                    int u = (axis + 1)%3, v = (axis + 2)%3;
+                    if (g[u] == 0 || g[v] == 0) continue;
+                    if (t->quad_count == t->quad_capacity) {
+                        size_t capacity = t->quad_capacity ? t->quad_capacity*2 : 1024;
+                        uint64_t (*quads)[4] = realloc(t->quads, capacity*sizeof(*quads));
+                        if (quads == NULL) {
+                            mesher->failed = true;
+                            return;
+                        }
+                        t->quads = quads;
+                        t->quad_capacity = capacity;
+                    }
+                    // Around the edge counter-clockwise seen from +axis: (-u, -v), (0, -v), (0, 0), (-u, 0).
+                    uint64_t *quad = t->quads[t->quad_count++];
+                    for (int c = 0; c < 4; ++c) {
+                        size_t at[3] = {g[0], g[1], g[2]};
+                        if (c == 0 || c == 3) --at[u];
+                        if (c == 0 || c == 1) --at[v];
+                        quad[c] = ((uint64_t) at[2]*cells[1] + at[1])*cells[0] + at[0];
+                    }
+                    if (t->samples[s] >= 0.0f) {
+                        OPENCAD_SWAP(uint64_t, quad[1], quad[3]);
+                    }
+                }
+            }
+        }
+    }
+    mesher->outputs[block] = (Opencad_Sdf_Block_Output) { .thread = thread, .offset = first, .count = t->quad_count - first };
+}
+
+/**
+ * Walks a node of the octree over the blocks: specializes the parent's program to the node's cells, with
+ * slack for the normals' samples, and discards the node if the field's bounds there do not straddle zero,
+ * since then no edge in it can be crossed. Blocks that survive are contoured with the program specialized
+ * to them, which only keeps the parts of the model that can reach them.
+ * @param at The first block of the node per axis.
+ * @param size The blocks per axis of the node.
+ */
+static void opencad_sdf_octree(Opencad_Sdf_Mesher *mesher, size_t thread, const Opencad_Sdf_Program *parent,
+                               size_t level, const size_t *at, size_t size)
+{
+    Opencad_Sdf_Mesher_Thread *t = &mesher->threads[thread];
+    const float slack = 0.1f*mesher->cell, extent = (float) (size*OPENCAD_SDF_BLOCK)*mesher->cell;
+    float min[3], max[3];
+    for (int k = 0; k < 3; ++k) {
+        min[k] = mesher->origin[k] + (float) (at[k]*OPENCAD_SDF_BLOCK)*mesher->cell - slack;
+        max[k] = min[k] + extent + 2.0f*slack;
+    }
+    float lo, hi;
+    Errno err = opencad_sdf_program_specialize(parent, opencad_vec3(min[0], min[1], min[2]),
+                                               opencad_vec3(max[0], max[1], max[2]), &t->levels[level], &lo, &hi);
+    if (err) {
+        mesher->failed = true;
+        return;
+    }
+    if (lo > 0.0f || hi < 0.0f) return;
+    if (size == 1) {
+        opencad_sdf_contour_block(mesher, thread, (at[2]*mesher->blocks[1] + at[1])*mesher->blocks[0] + at[0], &t->levels[level]);
+        return;
+    }
+    size_t half = size/2;
+    for (int c = 0; c < 8 && !mesher->failed; ++c) {
+        size_t child[3] = {at[0] + (c & 1)*half, at[1] + ((c >> 1) & 1)*half, at[2] + (c >> 2)*half};
+        if (child[0] >= mesher->blocks[0] || child[1] >= mesher->blocks[1] || child[2] >= mesher->blocks[2]) continue;
+        opencad_sdf_octree(mesher, thread, &t->levels[level], level + 1, child, half);
+    }
+}
+
+/**
+ * Walks a range of top level octree nodes.
+ */
+static void opencad_sdf_octree_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    Opencad_Sdf_Mesher *mesher = ctx;
+    const size_t size = (size_t) 1 << (OPENCAD_SDF_OCTREE_DEPTH - 1);
+    for (size_t i = begin; i < end && !mesher->failed; ++i) {
+        size_t at[3] = {
+            i % mesher->tops[0]*size,
+            i / mesher->tops[0] % mesher->tops[1]*size,
+            i / mesher->tops[0] / mesher->tops[1]*size,
+        };
+        opencad_sdf_octree(mesher, thread, &mesher->program, 0, at, size);
+    }
+}
+
+/**
+ * Finds the vertex of a cell among the sorted vertex keys.
+ * @return The vertex index, or UINT32_MAX if the cell has no vertex.
+ */
+static uint32_t opencad_sdf_find_vertex(const uint64_t *keys, size_t count, uint64_t key)
+{
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo)/2;
+        if (keys[mid] < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < count && keys[lo] == key ? (uint32_t) lo : UINT32_MAX;
+}
+
+typedef struct {
+    Opencad_Sdf_Mesher *mesher;
+    const Opencad_Vec3 *vertices;
+    size_t vertex_count;
+} Opencad_Sdf_Index_Pass;
+
+/**
+ * Resolves the cells of a range of quads to vertices and splits every quad along its shorter diagonal.
+ */
+static void opencad_sdf_index_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    (void) thread;
+    const Opencad_Sdf_Index_Pass *pass = ctx;
+    Opencad_Sdf_Mesher *mesher = pass->mesher;
+    for (size_t q = begin; q < end; ++q) {
+        uint32_t v[4];
+        bool complete = true;
+        for (int c = 0; c < 4; ++c) {
+            v[c] = opencad_sdf_find_vertex(mesher->keys, pass->vertex_count, mesher->quads[q][c]);
+            complete &= v[c] != UINT32_MAX;
+        }
+        uint32_t *out = &mesher->indices[q*6];
+        if (!complete) {
+            out[0] = UINT32_MAX;
+            continue;
+        }
+        float d02 = opencad_vec3_length(opencad_vec3_sub(pass->vertices[v[0]], pass->vertices[v[2]]));
+        float d13 = opencad_vec3_length(opencad_vec3_sub(pass->vertices[v[1]], pass->vertices[v[3]]));
+        static const int splits[2][6] = {{0, 1, 2, 0, 2, 3}, {1, 2, 3, 1, 3, 0}};
+        const int *split = splits[d13 < d02];
+        for (int c = 0; c < 6; ++c) out[c] = v[split[c]];
+    }
+}
+
+/**
+ * Converts a signed distance field model into a closed triangle mesh by dual contouring, which keeps the
+ * sharp edges and corners of CAD-like shapes. The bounds of the model are covered by a grid of cubic cells
+ * grouped into blocks of OPENCAD_SDF_BLOCK^3 cells, and an octree over the blocks is walked in parallel:
+ * interval arithmetic discards the nodes the surface provably misses without sampling them, and
+ * specializes the field to the rest, so each block is sampled with only the parts of the model near it.
+ * Each vertex belongs to exactly one cell
+ * and each quad to exactly one edge, so shared vertices are stitched afterwards by sorting them by cell,
+ * with no locks, and the result does not depend on the number of threads.
+ * @param sdf The field.
+ * @param root The node to mesh.
+ * @param cell_size The edge length of the cells, about the size of the smallest feature kept.
+ * @param mesh Receives the mesh. Must be freed with opencad_mesh_free.
+ * @return An error code indicating the result of the operation.
+ */
+Errno opencad_sdf_mesh(const Opencad_Sdf *sdf, uint32_t root, float cell_size, Opencad_Mesh *mesh)
+{
+    int result = 0;
+    memset(mesh, 0, sizeof(*mesh));
+    Opencad_Sdf_Mesher mesher = { .cell = cell_size };
+    uint32_t *order = NULL;
+    size_t quad_count = 0;
+    {
+        if (sdf->failed) return_defer(ENOMEM);
+        if (root >= sdf->count || !(cell_size > 0.0f)) return_defer(EINVAL);
+        Opencad_Vec3 min, max;
+        opencad_sdf_bounds(sdf, root, &min, &max);
+        if (min.x > max.x || min.y > max.y || min.z > max.z) return_defer(0);
+        Errno err = opencad_sdf_compile(sdf, root, &mesher.program);
+        if (err) return_defer(err);
+
+        // A cell of padding on every side keeps the surface off the edge of the grid.
+        const float lo[3] = {min.x, min.y, min.z}, hi[3] = {max.x, max.y, max.z};
+        const size_t top = (size_t) 1 << (OPENCAD_SDF_OCTREE_DEPTH - 1);
+        size_t block_count = 1, top_count = 1;
+        for (int k = 0; k < 3; ++k) {
+            float extent = (hi[k] - lo[k])/cell_size + 2.0f;
+            if (!(extent < (float) (1 << 20))) return_defer(EOVERFLOW);
+            mesher.blocks[k] = ((size_t) ceilf(extent) + OPENCAD_SDF_BLOCK - 1)/OPENCAD_SDF_BLOCK;
+            mesher.cells[k] = mesher.blocks[k]*OPENCAD_SDF_BLOCK;
+            mesher.origin[k] = 0.5f*(lo[k] + hi[k]) - 0.5f*(float) mesher.cells[k]*cell_size;
+            mesher.tops[k] = (mesher.blocks[k] + top - 1)/top;
+            block_count *= mesher.blocks[k];
+            top_count *= mesher.tops[k];
+        }
+        if (block_count > UINT32_MAX) return_defer(EOVERFLOW);
+
+        mesher.outputs = calloc(block_count, sizeof(*mesher.outputs));
+        if (mesher.outputs == NULL) return_defer(ENOMEM);
+        opencad_parallel_for(top_count, 1, opencad_sdf_octree_task, &mesher);
+        if (mesher.failed) return_defer(ENOMEM);
+
+        size_t vertex_count = 0;
+        for (size_t i = 0; i < OPENCAD_MAX_THREADS; ++i) vertex_count += mesher.threads[i].vertex_count;
+        for (size_t b = 0; b < block_count; ++b) quad_count += mesher.outputs[b].count;
+        if (vertex_count >= UINT32_MAX || quad_count == 0) return_defer(vertex_count >= UINT32_MAX ? EOVERFLOW : 0);
+
+        // Stitch: sort the vertices by cell so a quad finds its corners by binary search.
+        mesher.keys = malloc(vertex_count*sizeof(*mesher.keys));
+        order = malloc(vertex_count*sizeof(*order));
+        mesh->vertices = malloc(vertex_count*sizeof(*mesh->vertices));
+        mesher.quads = malloc(quad_count*sizeof(*mesher.quads));
+        mesher.indices = malloc(quad_count*6*sizeof(*mesher.indices));
+        if (!mesher.keys || !order || !mesh->vertices || !mesher.quads || !mesher.indices) return_defer(ENOMEM);
+        size_t count = 0;
+        for (size_t i = 0; i < OPENCAD_MAX_THREADS; ++i) {
+            const Opencad_Sdf_Mesher_Thread *t = &mesher.threads[i];
+            if (t->vertex_count == 0) continue;
+            memcpy(&mesher.keys[count], t->keys, t->vertex_count*sizeof(*t->keys));
+            memcpy(&mesh->vertices[count], t->vertices, t->vertex_count*sizeof(*t->vertices));
+            for (size_t v = 0; v < t->vertex_count; ++v) order[count + v] = (uint32_t) (count + v);
+            count += t->vertex_count;
+        }
+        err = opencad_radix_sort_u64(mesher.keys, order, vertex_count);
+        if (err) return_defer(err);
+        Opencad_Vec3 *sorted = malloc(vertex_count*sizeof(*sorted));
+        if (sorted == NULL) return_defer(ENOMEM);
+        for (size_t v = 0; v < vertex_count; ++v) sorted[v] = mesh->vertices[order[v]];
+        free(mesh->vertices);
+        mesh->vertices = sorted;
+        mesh->vertex_count = vertex_count;
+
+        count = 0;
+        for (size_t b = 0; b < block_count; ++b) {
+            const Opencad_Sdf_Block_Output *output = &mesher.outputs[b];
+            if (output->count == 0) continue;
+            memcpy(&mesher.quads[count], &mesher.threads[output->thread].quads[output->offset], output->count*sizeof(*mesher.quads));
+            count += output->count;
+        }
+        Opencad_Sdf_Index_Pass pass = { .mesher = &mesher, .vertices = mesh->vertices, .vertex_count = vertex_count };
+        opencad_parallel_for(quad_count, 4096, opencad_sdf_index_task, &pass);
+
+        size_t triangle_count = 0;
+        for (size_t q = 0; q < quad_count; ++q) {
+            if (mesher.indices[q*6] == UINT32_MAX) continue;
+            memmove(&mesher.indices[triangle_count*3], &mesher.indices[q*6], 6*sizeof(*mesher.indices));
+            triangle_count += 2;
+        }
+        mesh->indices = mesher.indices;
+        mesh->triangle_count = triangle_count;
+        mesher.indices = NULL;
+    }
+
+defer:
+    for (size_t i = 0; i < OPENCAD_MAX_THREADS; ++i) {
+        Opencad_Sdf_Mesher_Thread *t = &mesher.threads[i];
+        free(t->samples);
+        free(t->edges);
+        free(t->crossings);
+        free(t->keys);
+        free(t->vertices);
+        free(t->quads);
+        for (size_t l = 0; l < OPENCAD_SDF_OCTREE_DEPTH; ++l) opencad_sdf_program_free(&t->levels[l]);
+    }
+    opencad_sdf_program_free(&mesher.program);
+    free(mesher.outputs);
+    free(mesher.keys);
+    free(mesher.quads);
+    free(mesher.indices);
+    free(order);
+    if (result != 0) opencad_mesh_free(mesh);
+    return result;
+}
+
+/**
+ * Kinds of sketch entities. Circles and arcs are both called rounds.
+ */
+typedef enum {
+    OPENCAD_SKETCH_POINT,   // Two variables: x and y.
+    OPENCAD_SKETCH_LINE,    // Through the points a and b.
+    OPENCAD_SKETCH_CIRCLE,  // Around the point a. One variable: the radius.
+    OPENCAD_SKETCH_ARC,     // Around the point a, counter-clockwise from the point b to the point c. One variable: the radius.
+    COUNT_OPENCAD_SKETCH_KINDS
+} Opencad_Sketch_Kind;
+
+/**
+ * Kinds of sketch constraints, with the entities they relate.
+ */
+typedef enum {
+    OPENCAD_SKETCH_COINCIDENT,      // Points a and b coincide.
+    OPENCAD_SKETCH_HORIZONTAL,      // Line a is horizontal.
+    OPENCAD_SKETCH_VERTICAL,        // Line a is vertical.
+    OPENCAD_SKETCH_PARALLEL,        // Lines a and b are parallel.
+    OPENCAD_SKETCH_PERPENDICULAR,   // Lines a and b are perpendicular.
+    OPENCAD_SKETCH_TANGENT,         // Line or round a touches round b, on whichever side it is closer to.
+    OPENCAD_SKETCH_DISTANCE,        // Point a lies value away from point or line b.
+    OPENCAD_SKETCH_RADIUS,          // Round a has radius value.
+    OPENCAD_SKETCH_EQUAL,           // Lines a and b have the same length, or rounds a and b the same radius.
+    OPENCAD_SKETCH_ON,              // Point a lies on line or round b.
+    COUNT_OPENCAD_SKETCH_CONSTRAINTS
+} Opencad_Sketch_Constraint_Kind;
+
+#define OPENCAD_SKETCH_NONE UINT32_MAX
+#define OPENCAD_SKETCH_MAX_ROWS 2           // Equations per constraint.
+#define OPENCAD_SKETCH_MAX_TERMS 8          // Variables per constraint.
+#define OPENCAD_SKETCH_MAX_ITERATIONS 100
+#define OPENCAD_SKETCH_TOLERANCE 1e-9       // The largest residual of a satisfied constraint, in sketch units.
+
+typedef struct {
+    Opencad_Sketch_Kind kind;
+    uint32_t a, b, c;       // Points.
+    uint32_t variable;      // The first variable the entity owns, or OPENCAD_SKETCH_NONE.
+} Opencad_Sketch_Entity;
+
+typedef struct {
+    Opencad_Sketch_Constraint_Kind kind;
+    uint32_t a, b;          // Entities.
+    double value;
+} Opencad_Sketch_Constraint;
+
+/**
+ * A 2D sketch: points, lines, circles and arcs tied together by geometric constraints, which
+ * opencad_sketch_solve enforces by moving the entities as little as it can. Entities and constraints are
+ * added by the opencad_sketch_* builders, each returning the index of the new item. A builder that runs out
+ * of memory returns OPENCAD_SKETCH_NONE and marks the whole sketch failed; builders given OPENCAD_SKETCH_NONE
+ * or entities of the wrong kind return it too, so a sketch can be built without checking every step.
+ * The variables are kept in double precision so solved sketches meet their dimensions exactly.
+ */
+typedef struct {
+    Opencad_Sketch_Entity *entities;
+    size_t entity_count;
+    size_t entity_capacity;
+    Opencad_Sketch_Constraint *constraints;
+    size_t constraint_count;
+    size_t constraint_capacity;
+    double *values;         // The variables.
+    bool *fixed;            // Per variable: whether the solver may not move it.
+    size_t variable_count;
+    size_t variable_capacity;
+    bool failed;
+} Opencad_Sketch;
+
+/**
+ * Releases the memory of a sketch and resets it to the empty sketch.
+ * @param sketch The sketch.
+ */
+void opencad_sketch_free(Opencad_Sketch *sketch)
+{
+    free(sketch->entities);
+    free(sketch->constraints);
+    free(sketch->values);
+    free(sketch->fixed);
+    memset(sketch, 0, sizeof(*sketch));
+}
+
+/**
+ * Appends an entity to a sketch along with the variables it owns.
+ * @return The index of the entity, or OPENCAD_SKETCH_NONE if out of memory.
+ */
+static uint32_t opencad_sketch_push(Opencad_Sketch *sketch, Opencad_Sketch_Entity entity, const double *values, size_t count)
+{
+    if (sketch->failed) return OPENCAD_SKETCH_NONE;
+    if (sketch->entity_count == sketch->entity_capacity) {
+        size_t capacity = sketch->entity_capacity ? sketch->entity_capacity*2 : 64;
+        Opencad_Sketch_Entity *entities = capacity < OPENCAD_SKETCH_NONE ? realloc(sketch->entities, capacity*sizeof(*entities)) : NULL;
+        if (entities == NULL) {
+            sketch->failed = true;
+            return OPENCAD_SKETCH_NONE;
+        }
+        sketch->entities = entities;
+        sketch->entity_capacity = capacity;
+    }
+    if (sketch->variable_count + count > sketch->variable_capacity) {
+        size_t capacity = sketch->variable_capacity ? sketch->variable_capacity*2 : 128;
+        double *values = capacity < OPENCAD_SKETCH_NONE ? realloc(sketch->values, capacity*sizeof(*values)) : NULL;
+        if (values) sketch->values = values;
+        bool *fixed = values ? realloc(sketch->fixed, capacity*sizeof(*fixed)) : NULL;
+        if (fixed) sketch->fixed = fixed;
+        if (!values || !fixed) {
+            sketch->failed = true;
+            return OPENCAD_SKETCH_NONE;
+        }
+        sketch->variable_capacity = capacity;
+    }
+    entity.variable = count ? (uint32_t) sketch->variable_count : OPENCAD_SKETCH_NONE;
+    for (size_t i = 0; i < count; ++i) {
+        sketch->values[sketch->variable_count] = values[i];
+        sketch->fixed[sketch->variable_count++] = false;
+    }
+    sketch->entities[sketch->entity_count] = entity;
+    return (uint32_t) sketch->entity_count++;
+}
+
+/**
+ * Checks that an entity exists and is of one of two kinds.
+ */
+static bool opencad_sketch_is(const Opencad_Sketch *sketch, uint32_t entity, Opencad_Sketch_Kind kind, Opencad_Sketch_Kind other)
+{
+    if (entity >= sketch->entity_count) return false;
+    Opencad_Sketch_Kind k = sketch->entities[entity].kind;
+    return k == kind || k == other;
+}
+
+/**
+ * Adds a point.
+ * @param sketch The sketch.
+ * @param position The initial position.
+ * @return The point, or OPENCAD_SKETCH_NONE if out of memory.
+ */
+uint32_t opencad_sketch_point(Opencad_Sketch *sketch, Opencad_Vec2 position)
+{
+    const double values[2] = {position.x, position.y};
+    return opencad_sketch_push(sketch, (Opencad_Sketch_Entity) { .kind = OPENCAD_SKETCH_POINT }, values, 2);
+}
+
+/**
+ * Adds a line segment between two points.
+ * @param sketch The sketch.
+ * @param a The start point.
+ * @param b The end point.
+ * @return The line, or OPENCAD_SKETCH_NONE if out of memory or a or b is not a point.
+ */
+uint32_t opencad_sketch_line(Opencad_Sketch *sketch, uint32_t a, uint32_t b)
+{
+    if (!opencad_sketch_is(sketch, a, OPENCAD_SKETCH_POINT, OPENCAD_SKETCH_POINT) ||
+        !opencad_sketch_is(sketch, b, OPENCAD_SKETCH_POINT, OPENCAD_SKETCH_POINT) || a == b) return OPENCAD_SKETCH_NONE;
+    return opencad_sketch_push(sketch, (Opencad_Sketch_Entity) { .kind = OPENCAD_SKETCH_LINE, .a = a, .b = b }, NULL, 0);
+}
+
+/**
+ * Adds a circle.
+ * @param sketch The sketch.
+ * @param center The center point.
+ * @param radius The initial radius.
+ * @return The circle, or OPENCAD_SKETCH_NONE if out of memory or center is not a point.
+ */
+uint32_t opencad_sketch_circle(Opencad_Sketch *sketch, uint32_t center, float radius)
+{
+    if (!opencad_sketch_is(sketch, center, OPENCAD_SKETCH_POINT, OPENCAD_SKETCH_POINT)) return OPENCAD_SKETCH_NONE;
+    const double value = radius;
+    return opencad_sketch_push(sketch, (Opencad_Sketch_Entity) { .kind = OPENCAD_SKETCH_CIRCLE, .a = center }, &value, 1);
+}
+
+/**
+ * Adds a constraint between entities, see Opencad_Sketch_Constraint_Kind for what each kind relates.
+ * @param sketch The sketch.
+ * @param kind The kind of constraint.
+ * @param a The first entity.
+ * @param b The second entity, ignored by constraints on a single entity.
+ * @param value The distance or radius, ignored by the other kinds.
+ * @return The constraint, or OPENCAD_SKETCH_NONE if out of memory or the entities do not fit the kind.
+ */
+uint32_t opencad_sketch_constrain(Opencad_Sketch *sketch, Opencad_Sketch_Constraint_Kind kind, uint32_t a, uint32_t b, double value)
+{
+    const Opencad_Sketch_Kind P = OPENCAD_SKETCH_POINT, L = OPENCAD_SKETCH_LINE, C = OPENCAD_SKETCH_CIRCLE, A = OPENCAD_SKETCH_ARC;
+    bool valid = false;
+    switch (kind) {
+    case OPENCAD_SKETCH_COINCIDENT:
+        valid = opencad_sketch_is(sketch, a, P, P) && opencad_sketch_is(sketch, b, P, P);
+        break;
+    case OPENCAD_SKETCH_HORIZONTAL:
+    case OPENCAD_SKETCH_VERTICAL:
+        valid = opencad_sketch_is(sketch, a, L, L);
+        break;
+    case OPENCAD_SKETCH_PARALLEL:
+    case OPENCAD_SKETCH_PERPENDICULAR:
+        valid = opencad_sketch_is(sketch, a, L, L) && opencad_sketch_is(sketch, b, L, L);
+        break;
+    case OPENCAD_SKETCH_TANGENT:
+        valid = (opencad_sketch_is(sketch, a, L, L) || opencad_sketch_is(sketch, a, C, A)) && opencad_sketch_is(sketch, b, C, A);
+        break;
+    case OPENCAD_SKETCH_DISTANCE:
+        valid = opencad_sketch_is(sketch, a, P, P) && opencad_sketch_is(sketch, b, P, L);
+        break;
+    case OPENCAD_SKETCH_RADIUS:
+        valid = opencad_sketch_is(sketch, a, C, A);
+        break;
+    case OPENCAD_SKETCH_EQUAL:
+        valid = (opencad_sketch_is(sketch, a, L, L) && opencad_sketch_is(sketch, b, L, L)) ||
+                (opencad_sketch_is(sketch, a, C, A) && opencad_sketch_is(sketch, b, C, A));
+        break;
+    case OPENCAD_SKETCH_ON:
+        valid = opencad_sketch_is(sketch, a, P, P) && (opencad_sketch_is(sketch, b, L, L) || opencad_sketch_is(sketch, b, C, A));
+        break;
+    default:
+        break;
+    }
+    // Constraints on a single entity refer to it twice, those on two need two different ones.
+    bool unary = kind == OPENCAD_SKETCH_HORIZONTAL || kind == OPENCAD_SKETCH_VERTICAL || kind == OPENCAD_SKETCH_RADIUS;
+    if (!valid || (a == b && !unary) || sketch->failed) return OPENCAD_SKETCH_NONE;
+    if (unary) b = a;
+
+    if (sketch->constraint_count == sketch->constraint_capacity) {
+        size_t capacity = sketch->constraint_capacity ? sketch->constraint_capacity*2 : 64;
+        Opencad_Sketch_Constraint *constraints = capacity < OPENCAD_SKETCH_NONE ? realloc(sketch->constraints, capacity*sizeof(*constraints)) : NULL;
+        if (constraints == NULL) {
+            sketch->failed = true;
+            return OPENCAD_SKETCH_NONE;
+        }
+        sketch->constraints = constraints;
+        sketch->constraint_capacity = capacity;
+    }
+    sketch->constraints[sketch->constraint_count] = (Opencad_Sketch_Constraint) { .kind = kind, .a = a, .b = b, .value = value };
+    return (uint32_t) sketch->constraint_count++;
+}
+
+/**
+ * Adds a counter-clockwise arc, constraining its end points to lie on it. The initial radius is the
+ * distance from the center to the start point.
+ * @param sketch The sketch.
+ * @param center The center point.
+ * @param start The start point.
+ * @param end The end point.
+ * @return The arc, or OPENCAD_SKETCH_NONE if out of memory or an argument is not a point.
+ */
+uint32_t opencad_sketch_arc(Opencad_Sketch *sketch, uint32_t center, uint32_t start, uint32_t end)
+{
+    if (!opencad_sketch_is(sketch, center, OPENCAD_SKETCH_POINT, OPENCAD_SKETCH_POINT) ||
+        !opencad_sketch_is(sketch, start, OPENCAD_SKETCH_POINT, OPENCAD_SKETCH_POINT) ||
+        !opencad_sketch_is(sketch, end, OPENCAD_SKETCH_POINT, OPENCAD_SKETCH_POINT)) return OPENCAD_SKETCH_NONE;
+    const double *c = &sketch->values[sketch->entities[center].variable];
+    const double *s = &sketch->values[sketch->entities[start].variable];
+    const double radius = sqrt((s[0] - c[0])*(s[0] - c[0]) + (s[1] - c[1])*(s[1] - c[1]));
+    uint32_t arc = opencad_sketch_push(sketch, (Opencad_Sketch_Entity) {
+        .kind = OPENCAD_SKETCH_ARC,
+        .a = center,
+        .b = start,
+        .c = end,
+    }, &radius, 1);
+    uint32_t on_start = opencad_sketch_constrain(sketch, OPENCAD_SKETCH_ON, start, arc, 0.0);
+    uint32_t on_end = opencad_sketch_constrain(sketch, OPENCAD_SKETCH_ON, end, arc, 0.0);
+    return on_start == OPENCAD_SKETCH_NONE || on_end == OPENCAD_SKETCH_NONE ? OPENCAD_SKETCH_NONE : arc;
+}
+
+/**
+ * Fixes or frees the variables of an entity and of the points it is made of.
+ * @param sketch The sketch.
+ * @param entity The entity.
+ * @param fixed Whether opencad_sketch_solve must leave the entity where it is.
+ */
+void opencad_sketch_fix(Opencad_Sketch *sketch, uint32_t entity, bool fixed)
+{
+    if (entity >= sketch->entity_count) return;
+    const Opencad_Sketch_Entity *e = &sketch->entities[entity];
+    switch (e->kind) {
+    case OPENCAD_SKETCH_POINT:
+        sketch->fixed[e->variable] = sketch->fixed[e->variable + 1] = fixed;
+        break;
+    case OPENCAD_SKETCH_LINE:
+        opencad_sketch_fix(sketch, e->a, fixed);
+        opencad_sketch_fix(sketch, e->b, fixed);
+        break;
+    case OPENCAD_SKETCH_ARC:
+        opencad_sketch_fix(sketch, e->b, fixed);
+        opencad_sketch_fix(sketch, e->c, fixed);
+        // fallthrough
+    default:
+        opencad_sketch_fix(sketch, e->a, fixed);
+        sketch->fixed[e->variable] = fixed;
+        break;
+    }
+}
+
+/**
+ * Returns the position of a point.
+ * @param sketch The sketch.
+ * @param point The point.
+ * @return The position.
+ */
+Opencad_Vec2 opencad_sketch_position(const Opencad_Sketch *sketch, uint32_t point)
+{
+    const double *v = &sketch->values[sketch->entities[point].variable];
+    return (Opencad_Vec2) { (float) v[0], (float) v[1] };
+}
+
+/**
+ * Returns the radius of a circle or arc.
+ * @param sketch The sketch.
+ * @param round The circle or arc.
+ * @return The radius.
+ */
+float opencad_sketch_radius(const Opencad_Sketch *sketch, uint32_t round)
+{
+    return (float) sketch->values[sketch->entities[round].variable];
+}
+
+/**
+ * Lists the variables an entity's equations read: x and y of a point, the end points of a line, or the
+ * center and radius of a round.
+ * @return The number of variables.
+ */
+static size_t opencad_sketch_entity_terms(const Opencad_Sketch *sketch, uint32_t entity, uint32_t *terms)
+{
+    const Opencad_Sketch_Entity *e = &sketch->entities[entity];
+    switch (e->kind) {
+    case OPENCAD_SKETCH_POINT:
+        terms[0] = e->variable;
+        terms[1] = e->variable + 1;
+        return 2;
+    case OPENCAD_SKETCH_LINE:
+        opencad_sketch_entity_terms(sketch, e->a, terms);
+        opencad_sketch_entity_terms(sketch, e->b, terms + 2);
+        return 4;
+    default:
+        opencad_sketch_entity_terms(sketch, e->a, terms);
+        terms[2] = e->variable;
+        return 3;
+    }
+}
+
+/**
+ * Lists the variables a constraint reads, those of a followed by those of b.
+ * @return The number of variables.
+ */
+static size_t opencad_sketch_terms(const Opencad_Sketch *sketch, const Opencad_Sketch_Constraint *constraint, uint32_t *terms)
+{
+    size_t count = opencad_sketch_entity_terms(sketch, constraint->a, terms);
+    if (constraint->b != constraint->a) count += opencad_sketch_entity_terms(sketch, constraint->b, terms + count);
+    return count;
+}
+
+/**
+ * The signed distance of point p from the line through l[0..1] and l[2..3], positive on its left, with its
+ * derivatives. A degenerate line has no direction, so it is taken as distance 0 that nothing changes.
+ */
+static double opencad_sketch_line_distance(const double *p, const double *l, double *dp, double *dl)
+{
+    double ux = l[2] - l[0], uy = l[3] - l[1], wx = p[0] - l[0], wy = p[1] - l[1];
+    double uu = ux*ux + uy*uy;
+    if (uu == 0.0) {
+        dp[0] = dp[1] = dl[0] = dl[1] = dl[2] = dl[3] = 0.0;
+        return 0.0;
+    }
+    double length = sqrt(uu), distance = (ux*wy - uy*wx)/length;
+    double gux = wy/length - distance*ux/uu, guy = -wx/length - distance*uy/uu;
+    dp[0] = -uy/length;
+    dp[1] = ux/length;
+    dl[0] = -gux - dp[0];
+    dl[1] = -guy - dp[1];
+    dl[2] = gux;
+    dl[3] = guy;
+    return distance;
+}
+
+/**
+ * The distance between points a and b with its derivatives with respect to a; those with respect to b
+ * are their negation.
+ */
+static double opencad_sketch_length(const double *a, const double *b, double *da)
+{
+    double dx = a[0] - b[0], dy = a[1] - b[1], length = sqrt(dx*dx + dy*dy);
+    da[0] = length > 0.0 ? dx/length : 0.0;
+    da[1] = length > 0.0 ? dy/length : 0.0;
+    return length;
+}
+
+/**
+ * Evaluates the equations of a constraint. Distances are residuals in sketch units, and parallel and
+ * perpendicular lines the sine and cosine of their angle.
+ * @param x The variables listed by opencad_sketch_terms.
+ * @param r Receives OPENCAD_SKETCH_MAX_ROWS residuals, 0 past the constraint's equations.
+ * @param d Receives the derivatives of the residuals with respect to x.
+ */
+static void opencad_sketch_residuals(const Opencad_Sketch *sketch, const Opencad_Sketch_Constraint *constraint,
+                                     const double *x, double *r, double (*d)[OPENCAD_SKETCH_MAX_TERMS])
+{
+    memset(r, 0, OPENCAD_SKETCH_MAX_ROWS*sizeof(*r));
+    memset(d, 0, OPENCAD_SKETCH_MAX_ROWS*sizeof(*d));
+    Opencad_Sketch_Kind a = sketch->entities[constraint->a].kind, b = sketch->entities[constraint->b].kind;
+    const double value = constraint->value;
+    switch (constraint->kind) {
+    case OPENCAD_SKETCH_COINCIDENT:
+        r[0] = x[0] - x[2];
+        r[1] = x[1] - x[3];
+        d[0][0] = d[1][1] = 1.0;
+        d[0][2] = d[1][3] = -1.0;
+        break;
+    case OPENCAD_SKETCH_HORIZONTAL:
+    case OPENCAD_SKETCH_VERTICAL: {
+        int k = constraint->kind == OPENCAD_SKETCH_HORIZONTAL;
+        r[0] = x[2 + k] - x[k];
+        d[0][k] = -1.0;
+        d[0][2 + k] = 1.0;
+        break;
+    }
+    case OPENCAD_SKETCH_PARALLEL:
+    case OPENCAD_SKETCH_PERPENDICULAR: {
+        double u[2] = {x[2] - x[0], x[3] - x[1]}, v[2] = {x[6] - x[4], x[7] - x[5]};
+        double uu = u[0]*u[0] + u[1]*u[1], vv = v[0]*v[0] + v[1]*v[1], n = sqrt(uu*vv);
+        if (n == 0.0) break;
+        // c is the cross product for parallel lines and the dot product for perpendicular ones.
+        double c, cu[2], cv[2];
+        if (constraint->kind == OPENCAD_SKETCH_PARALLEL) {
+            c = u[0]*v[1] - u[1]*v[0];
+            cu[0] = v[1], cu[1] = -v[0], cv[0] = -u[1], cv[1] = u[0];
+        } else {
+            c = u[0]*v[0] + u[1]*v[1];
+            cu[0] = v[0], cu[1] = v[1], cv[0] = u[0], cv[1] = u[1];
+        }
+        r[0] = c/n;
+        for (int k = 0; k < 2; ++k) {
+            double gu = cu[k]/n - r[0]*u[k]/uu, gv = cv[k]/n - r[0]*v[k]/vv;
+            d[0][k] = -gu;
+            d[0][2 + k] = gu;
+            d[0][4 + k] = -gv;
+            d[0][6 + k] = gv;
+        }
+        break;
+    }
+    case OPENCAD_SKETCH_TANGENT:
+        if (a == OPENCAD_SKETCH_LINE) {
+            double distance = opencad_sketch_line_distance(&x[4], x, &d[0][4], d[0]);
+            double side = distance < 0.0 ? -1.0 : 1.0;
+            r[0] = side*distance - x[6];
+            for (int k = 0; k < 6; ++k) d[0][k] *= side;
+            d[0][6] = -1.0;
+        } else {
+            // Touching from outside or from inside, whichever is closer to holding.
+            double g[2], distance = opencad_sketch_length(x, &x[3], g);
+            double outside = distance - (x[2] + x[5]);
+            double side = x[2] < x[5] ? -1.0 : 1.0, inside = distance - side*(x[2] - x[5]);
+            bool out = fabs(outside) <= fabs(inside);
+            r[0] = out ? outside : inside;
+            d[0][0] = g[0], d[0][1] = g[1], d[0][3] = -g[0], d[0][4] = -g[1];
+            d[0][2] = out ? -1.0 : -side;
+            d[0][5] = out ? -1.0 : side;
+        }
+        break;
+    case OPENCAD_SKETCH_DISTANCE:
+        if (b == OPENCAD_SKETCH_POINT) {
+            r[0] = opencad_sketch_length(x, &x[2], d[0]) - value;
+            d[0][2] = -d[0][0];
+            d[0][3] = -d[0][1];
+        } else {
+            double distance = opencad_sketch_line_distance(x, &x[2], d[0], &d[0][2]);
+            double side = distance < 0.0 ? -1.0 : 1.0;
+            r[0] = side*distance - value;
+            for (int k = 0; k < 6; ++k) d[0][k] *= side;
+        }
+        break;
+    case OPENCAD_SKETCH_RADIUS:
+        r[0] = x[2] - value;
+        d[0][2] = 1.0;
+        break;
+    case OPENCAD_SKETCH_EQUAL:
+        if (a == OPENCAD_SKETCH_LINE) {
+            double gu[2], gv[2];
+            r[0] = opencad_sketch_length(&x[2], x, gu) - opencad_sketch_length(&x[6], &x[4], gv);
+            d[0][0] = -gu[0], d[0][1] = -gu[1], d[0][2] = gu[0], d[0][3] = gu[1];
+            d[0][4] = gv[0], d[0][5] = gv[1], d[0][6] = -gv[0], d[0][7] = -gv[1];
+        } else {
+            r[0] = x[2] - x[5];
+            d[0][2] = 1.0;
+            d[0][5] = -1.0;
+        }
+        break;
+    case OPENCAD_SKETCH_ON:
+        if (b == OPENCAD_SKETCH_LINE) {
+            r[0] = opencad_sketch_line_distance(x, &x[2], d[0], &d[0][2]);
+        } else {
+            r[0] = opencad_sketch_length(x, &x[2], d[0]) - x[4];
+            d[0][2] = -d[0][0];
+            d[0][3] = -d[0][1];
+            d[0][4] = -1.0;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+typedef struct {
+    Opencad_Sketch *sketch;
+    uint32_t *constraints;          // Grouped by component.
+    size_t *constraint_offsets;     // Per component, and one past the last.
+    uint32_t *variables;            // The free variables grouped by component, each group in elimination order.
+    size_t *variable_offsets;       // Per component, and one past the last.
+    uint32_t *columns;              // Per variable: its position in its group, or OPENCAD_SKETCH_NONE if not solved for.
+    size_t *first;                  // Per grouped variable: the first column of its row of the normal matrix.
+    size_t *rows;                   // Per grouped variable, and one past the last: where its row starts in the profiles.
+    double *normal;                 // The lower triangles of J^T*J per component, stored by rows from their first column.
+    double *factor;                 // Their damped Cholesky factors, stored likewise.
+    double *gradient;               // J^T*r per grouped variable.
+    double *step;                   // Per grouped variable.
+    double *saved;                  // Per grouped variable: its value before the step being tried.
+    double *residuals;              // OPENCAD_SKETCH_MAX_ROWS per grouped constraint.
+    double (*jacobian)[OPENCAD_SKETCH_MAX_TERMS];  // Likewise.
+    bool *satisfied;                // Per component.
+} Opencad_Sketch_Solver;
+
+/**
+ * Finds the representative of a variable in the union-find forest of the solver, halving paths on the way.
+ */
+static uint32_t opencad_sketch_find(uint32_t *parent, uint32_t v)
+{
+    while (parent[v] != v) {
+        parent[v] = parent[parent[v]];
+        v = parent[v];
+    }
+    return v;
+}
+
+/**
+ * The number of variables sharing constraints with a variable, counted with repetition.
+ */
+static size_t opencad_sketch_degree(const size_t *adjacency_offsets, uint32_t v)
+{
+    return adjacency_offsets[v + 1] - adjacency_offsets[v];
+}
+
+/**
+ * Evaluates the constraints of a component and their Jacobian at the current variables.
+ * @param largest Receives the largest residual.
+ * @return The sum of the squared residuals.
+ */
+static double opencad_sketch_evaluate(Opencad_Sketch_Solver *solver, size_t component, double *largest)
+{
+    const Opencad_Sketch *sketch = solver->sketch;
+    double sum = 0.0;
+    *largest = 0.0;
+    for (size_t i = solver->constraint_offsets[component]; i < solver->constraint_offsets[component + 1]; ++i) {
+        const Opencad_Sketch_Constraint *constraint = &sketch->constraints[solver->constraints[i]];
+        uint32_t terms[OPENCAD_SKETCH_MAX_TERMS];
+        double x[OPENCAD_SKETCH_MAX_TERMS];
+        size_t count = opencad_sketch_terms(sketch, constraint, terms);
+        for (size_t t = 0; t < count; ++t) x[t] = sketch->values[terms[t]];
+        double *r = &solver->residuals[i*OPENCAD_SKETCH_MAX_ROWS];
+        opencad_sketch_residuals(sketch, constraint, x, r, &solver->jacobian[i*OPENCAD_SKETCH_MAX_ROWS]);
+        for (size_t row = 0; row < OPENCAD_SKETCH_MAX_ROWS; ++row) {
+            sum += r[row]*r[row];
+            if (fabs(r[row]) > *largest) *largest = fabs(r[row]);
+        }
+    }
+    return sum;
+}
+
+/**
+ * Accumulates the normal matrix J^T*J and the gradient J^T*r of a component from the rows of its Jacobian,
+ * each of which touches only the few variables of one constraint.
+ */
+static void opencad_sketch_assemble(Opencad_Sketch_Solver *solver, size_t component)
+{
+    const Opencad_Sketch *sketch = solver->sketch;
+    const size_t v0 = solver->variable_offsets[component], v1 = solver->variable_offsets[component + 1];
+    memset(&solver->normal[solver->rows[v0]], 0, (solver->rows[v1] - solver->rows[v0])*sizeof(*solver->normal));
+    memset(&solver->gradient[v0], 0, (v1 - v0)*sizeof(*solver->gradient));
+    for (size_t i = solver->constraint_offsets[component]; i < solver->constraint_offsets[component + 1]; ++i) {
+        uint32_t terms[OPENCAD_SKETCH_MAX_TERMS];
+        size_t count = opencad_sketch_terms(sketch, &sketch->constraints[solver->constraints[i]], terms);
+        for (size_t t = 0; t < count; ++t) terms[t] = solver->columns[terms[t]];
+        for (size_t row = i*OPENCAD_SKETCH_MAX_ROWS; row < (i + 1)*OPENCAD_SKETCH_MAX_ROWS; ++row) {
+            const double *j = solver->jacobian[row];
+            for (size_t t = 0; t < count; ++t) {
+                if (terms[t] == OPENCAD_SKETCH_NONE || j[t] == 0.0) continue;
+                size_t v = v0 + terms[t];
+                solver->gradient[v] += j[t]*solver->residuals[row];
+                for (size_t u = 0; u < count; ++u) {
+                    if (terms[u] == OPENCAD_SKETCH_NONE || terms[u] > terms[t]) continue;
+                    solver->normal[solver->rows[v] + terms[u] - solver->first[v]] += j[t]*j[u];
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Factors the normal matrix of a component, damped by lambda*(diagonal + 1), in place in its profile: the
+ * fill of a Cholesky factor stays within the first nonzero of every row, which the elimination order keeps
+ * close to the diagonal.
+ * @return False if the damped matrix is not positive definite in floating point.
+ */
+static bool opencad_sketch_factor(Opencad_Sketch_Solver *solver, size_t component, double lambda)
+{
+    const size_t v0 = solver->variable_offsets[component], n = solver->variable_offsets[component + 1] - v0;
+    const size_t *first = &solver->first[v0], *rows = &solver->rows[v0];
+    const double *a = solver->normal;
+    double *l = solver->factor;
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = first[i]; j <= i; ++j) {
+            double s = a[rows[i] + j - first[i]];
+            for (size_t k = first[i] > first[j] ? first[i] : first[j]; k < j; ++k) {
+                s -= l[rows[i] + k - first[i]]*l[rows[j] + k - first[j]];
+            }
+            if (j < i) {
+                l[rows[i] + j - first[i]] = s/l[rows[j] + j - first[j]];
+                continue;
+            }
+            s += lambda*(a[rows[i] + i - first[i]] + 1.0);
+            if (!(s > 0.0)) return false;
+            l[rows[i] + i - first[i]] = sqrt(s);
+        }
+    }
+    return true;
+}
+
+/**
+ * Solves L*L^T*step = -gradient for a component by forward and back substitution.
+ */
+static void opencad_sketch_substitute(Opencad_Sketch_Solver *solver, size_t component)
+{
+    const size_t v0 = solver->variable_offsets[component], n = solver->variable_offsets[component + 1] - v0;
+    const size_t *first = &solver->first[v0], *rows = &solver->rows[v0];
+    const double *l = solver->factor, *g = &solver->gradient[v0];
+    double *x = &solver->step[v0];
+    for (size_t i = 0; i < n; ++i) {
+        double s = -g[i];
+        for (size_t k = first[i]; k < i; ++k) s -= l[rows[i] + k - first[i]]*x[k];
+        x[i] = s/l[rows[i] + i - first[i]];
+    }
+    for (size_t i = n; i-- > 0;) {
+        x[i] /= l[rows[i] + i - first[i]];
+        for (size_t k = first[i]; k < i; ++k) x[k] -= l[rows[i] + k - first[i]]*x[i];
+    }
+}
+
+/**
+ * Solves one component by Levenberg-Marquardt: Gauss-Newton steps, damped more after every step that
+ * fails to lower the squared error and less after every one that succeeds. The damping also keeps the
+ * steps of under-constrained sketches small, so they stay close to how they were drawn.
+ * @return Whether every constraint of the component holds.
+ */
+static bool opencad_sketch_solve_component(Opencad_Sketch_Solver *solver, size_t component)
+{
+    double *values = solver->sketch->values;
+    const size_t v0 = solver->variable_offsets[component], n = solver->variable_offsets[component + 1] - v0;
+    const uint32_t *variables = &solver->variables[v0];
+    double largest, cost = opencad_sketch_evaluate(solver, component, &largest);
+    double lambda = 1e-3;
+    for (size_t iteration = 0; iteration < OPENCAD_SKETCH_MAX_ITERATIONS && largest > OPENCAD_SKETCH_TOLERANCE; ++iteration) {
+        opencad_sketch_assemble(solver, component);
+        bool improved = false;
+        while (!improved && lambda < 1e16) {
+            if (!opencad_sketch_factor(solver, component, lambda)) {
+                lambda *= 10.0;
+                continue;
+            }
+            opencad_sketch_substitute(solver, component);
+            for (size_t i = 0; i < n; ++i) {
+                solver->saved[v0 + i] = values[variables[i]];
+                values[variables[i]] += solver->step[v0 + i];
+            }
+            // A rejected step clobbers the residuals and the Jacobian, but they are only read again after a step is taken.
+            double trial_largest, trial = opencad_sketch_evaluate(solver, component, &trial_largest);
+            if (trial < cost) {
+                cost = trial;
+                largest = trial_largest;
+                lambda = lambda > 1e-11 ? lambda*0.1 : 1e-12;
+                improved = true;
+            } else {
+                for (size_t i = 0; i < n; ++i) values[variables[i]] = solver->saved[v0 + i];
+                lambda *= 10.0;
+            }
+        }
+        // No damping lowers the error: a least squares compromise between conflicting constraints.
+        if (!improved) break;
+    }
+    return largest <= OPENCAD_SKETCH_TOLERANCE;
+}
+
+/**
+ * Solves a range of components.
+ */
+static void opencad_sketch_solve_task(void *ctx, size_t thread, size_t begin, size_t end)
+{
+    (void) thread;
+    Opencad_Sketch_Solver *solver = ctx;
+    for (size_t c = begin; c < end; ++c) solver->satisfied[c] = opencad_sketch_solve_component(solver, c);
+}
+
+/**
+ * Moves the entities of a sketch so its constraints hold, leaving fixed ones in place. Constraints sharing
+ * no free variables cannot affect each other, so the sketch is split into connected components that are
+ * solved in parallel, each by Levenberg-Marquardt on its sparse Jacobian. The normal equations of every
+ * step are factored in profile form, with the variables ordered by reverse Cuthill-McKee so the chains
+ * and loops sketches are made of factor with little fill. Solving from the previous solution after an
+ * edit takes only a few steps.
+ * @param sketch The sketch.
+ * @return 0, EDOM if some constraints conflict or could not be met (the sketch then holds the closest
+ * compromise found), or another error code.
+ */
+Errno opencad_sketch_solve(Opencad_Sketch *sketch)
+{
+    int result = 0;
+    Opencad_Sketch_Solver solver = { .sketch = sketch };
+    uint32_t *parent = NULL, *component = NULL, *owner = NULL, *adjacency = NULL, *queue = NULL;
+    size_t *adjacency_offsets = NULL;
+    {
+        if (sketch->failed) return_defer(ENOMEM);
+        const size_t variable_count = sketch->variable_count, constraint_count = sketch->constraint_count;
+        parent = malloc((variable_count + 1)*sizeof(*parent));
+        component = malloc((variable_count + 1)*sizeof(*component));
+        owner = malloc((constraint_count + 1)*sizeof(*owner));
+        solver.columns = malloc((variable_count + 1)*sizeof(*solver.columns));
+        solver.constraints = malloc((constraint_count + 1)*sizeof(*solver.constraints));
+        solver.constraint_offsets = calloc(constraint_count + 2, sizeof(*solver.constraint_offsets));
+        solver.variable_offsets = calloc(constraint_count + 2, sizeof(*solver.variable_offsets));
+        adjacency_offsets = calloc(variable_count + 1, sizeof(*adjacency_offsets));
+        if (!parent || !component || !owner || !solver.columns || !solver.constraints || !solver.constraint_offsets ||
+            !solver.variable_offsets || !adjacency_offsets) return_defer(ENOMEM);
+
+        // Components: free variables joined by the constraints that read them.
+        for (size_t v = 0; v < variable_count; ++v) {
+            parent[v] = (uint32_t) v;
+            component[v] = OPENCAD_SKETCH_NONE;
+            solver.columns[v] = OPENCAD_SKETCH_NONE;
+        }
+        for (size_t c = 0; c < constraint_count; ++c) {
+            uint32_t terms[OPENCAD_SKETCH_MAX_TERMS], root = OPENCAD_SKETCH_NONE;
+            size_t count = opencad_sketch_terms(sketch, &sketch->constraints[c], terms);
+            for (size_t t = 0; t < count; ++t) {
+                if (sketch->fixed[terms[t]]) continue;
+                uint32_t r = opencad_sketch_find(parent, terms[t]);
+                if (root == OPENCAD_SKETCH_NONE) root = r;
+                else parent[r] = root;
+            }
+            owner[c] = root;
+        }
+        bool unsatisfied = false;
+        size_t component_count = 0;
+        for (size_t c = 0; c < constraint_count; ++c) {
+            if (owner[c] == OPENCAD_SKETCH_NONE) {
+                // Nothing can move, so it holds or not as it is.
+                const Opencad_Sketch_Constraint *constraint = &sketch->constraints[c];
+                uint32_t terms[OPENCAD_SKETCH_MAX_TERMS];
+                double x[OPENCAD_SKETCH_MAX_TERMS], r[OPENCAD_SKETCH_MAX_ROWS], d[OPENCAD_SKETCH_MAX_ROWS][OPENCAD_SKETCH_MAX_TERMS];
+                size_t count = opencad_sketch_terms(sketch, constraint, terms);
+                for (size_t t = 0; t < count; ++t) x[t] = sketch->values[terms[t]];
+                opencad_sketch_residuals(sketch, constraint, x, r, d);
+                for (size_t row = 0; row < OPENCAD_SKETCH_MAX_ROWS; ++row) unsatisfied |= fabs(r[row]) > OPENCAD_SKETCH_TOLERANCE;
+                continue;
+            }
+            uint32_t root = opencad_sketch_find(parent, owner[c]);
+            if (component[root] == OPENCAD_SKETCH_NONE) component[root] = (uint32_t) component_count++;
+            owner[c] = component[root];
+            ++solver.constraint_offsets[owner[c] + 1];
+        }
+        for (size_t k = 0; k < component_count; ++k) solver.constraint_offsets[k + 1] += solver.constraint_offsets[k];
+        for (size_t c = 0; c < constraint_count; ++c) {
+            if (owner[c] != OPENCAD_SKETCH_NONE) solver.constraints[solver.constraint_offsets[owner[c]]++] = (uint32_t) c;
+        }
+        for (size_t k = component_count; k > 0; --k) solver.constraint_offsets[k] = solver.constraint_offsets[k - 1];
+        solver.constraint_offsets[0] = 0;
+
+        // Group the free variables, dropping those no constraint reads.
+        size_t total = 0;
+        for (size_t v = 0; v < variable_count; ++v) {
+            if (sketch->fixed[v]) continue;
+            component[v] = component[opencad_sketch_find(parent, (uint32_t) v)];
+        }
+        for (size_t v = 0; v < variable_count; ++v) {
+            if (sketch->fixed[v] || component[v] == OPENCAD_SKETCH_NONE) continue;
+            ++solver.variable_offsets[component[v] + 1];
+            ++total;
+        }
+        for (size_t k = 0; k < component_count; ++k) solver.variable_offsets[k + 1] += solver.variable_offsets[k];
+        solver.variables = malloc((total + 1)*sizeof(*solver.variables));
+        queue = malloc((total + 1)*sizeof(*queue));
+        solver.first = malloc((total + 1)*sizeof(*solver.first));
+        solver.rows = malloc((total + 1)*sizeof(*solver.rows));
+        if (!solver.variables || !queue || !solver.first || !solver.rows) return_defer(ENOMEM);
+        for (size_t v = 0; v < variable_count; ++v) {
+            if (sketch->fixed[v] || component[v] == OPENCAD_SKETCH_NONE) continue;
+            solver.variables[solver.variable_offsets[component[v]]++] = (uint32_t) v;
+        }
+        for (size_t k = component_count; k > 0; --k) solver.variable_offsets[k] = solver.variable_offsets[k - 1];
+        solver.variable_offsets[0] = 0;
+
+        // The graph of the normal matrix: free variables read by the same constraint.
+        for (size_t pass = 0; pass < 2; ++pass) {
+            if (pass == 1) {
+                for (size_t v = 0; v < variable_count; ++v) adjacency_offsets[v + 1] += adjacency_offsets[v];
+                adjacency = malloc((adjacency_offsets[variable_count] + 1)*sizeof(*adjacency));
+                if (adjacency == NULL) return_defer(ENOMEM);
+            }
+            for (size_t i = 0; i < solver.constraint_offsets[component_count]; ++i) {
+                uint32_t terms[OPENCAD_SKETCH_MAX_TERMS], free_terms[OPENCAD_SKETCH_MAX_TERMS];
+                size_t count = opencad_sketch_terms(sketch, &sketch->constraints[solver.constraints[i]], terms), free_count = 0;
+                for (size_t t = 0; t < count; ++t) {
+                    if (!sketch->fixed[terms[t]]) free_terms[free_count++] = terms[t];
+                }
+                for (size_t t = 0; t < free_count; ++t) {
+                    for (size_t u = 0; u < free_count; ++u) {
+                        if (free_terms[u] == free_terms[t]) continue;
+                        if (pass == 0) ++adjacency_offsets[free_terms[t] + 1];
+                        else adjacency[adjacency_offsets[free_terms[t]]++] = free_terms[u];
                     }
                 }
             }
         }
-    } else {
-        int x = x1;
-        if (0 <= x && x < (int) pixels_width) {
-            if (y1 > y2) OPENCAD_SWAP(int, y1, y2);
-            for (int y = y1; y <= y2; ++y) {
-                if (0 <= y && y < (int) pixels_height) {
-                    pixels[y*pixels_width + x] = color;
+        for (size_t v = variable_count; v > 0; --v) adjacency_offsets[v] = adjacency_offsets[v - 1];
+        adjacency_offsets[0] = 0;
+
+        // Reverse Cuthill-McKee per component: breadth first from a variable of least degree, visiting
+        // neighbors by increasing degree, then reversed.
+        for (size_t k = 0; k < component_count; ++k) {
+            const size_t v0 = solver.variable_offsets[k], v1 = solver.variable_offsets[k + 1];
+            size_t head = v0, tail = v0;
+            while (tail < v1) {
+                uint32_t start = OPENCAD_SKETCH_NONE;
+                for (size_t i = v0; i < v1; ++i) {
+                    uint32_t v = solver.variables[i];
+                    if (solver.columns[v] != OPENCAD_SKETCH_NONE) continue;
+                    if (start == OPENCAD_SKETCH_NONE || opencad_sketch_degree(adjacency_offsets, v) < opencad_sketch_degree(adjacency_offsets, start)) start = v;
+                }
+                solver.columns[start] = 0;
+                queue[tail++] = start;
+                for (; head < tail; ++head) {
+                    uint32_t v = queue[head];
+                    size_t begin = tail;
+                    for (size_t e = adjacency_offsets[v]; e < adjacency_offsets[v + 1]; ++e) {
+                        uint32_t w = adjacency[e];
+                        if (solver.columns[w] != OPENCAD_SKETCH_NONE) continue;
+                        solver.columns[w] = 0;
+                        size_t at = tail++;
+                        while (at > begin && opencad_sketch_degree(adjacency_offsets, queue[at - 1]) > opencad_sketch_degree(adjacency_offsets, w)) {
+                            queue[at] = queue[at - 1];
+                            --at;
+                        }
+                        queue[at] = w;
+                    }
                 }
             }
+            for (size_t i = v0; i < v1; ++i) {
+                solver.variables[i] = queue[v1 - 1 - (i - v0)];
+                solver.columns[solver.variables[i]] = (uint32_t) (i - v0);
+            }
         }
+
+        // The profile of every row: from its first nonzero column to the diagonal.
+        size_t profile = 0;
+        for (size_t i = 0; i < total; ++i) {
+            uint32_t v = solver.variables[i];
+            size_t first = solver.columns[v];
+            for (size_t e = adjacency_offsets[v]; e < adjacency_offsets[v + 1]; ++e) {
+                if (solver.columns[adjacency[e]] < first) first = solver.columns[adjacency[e]];
+            }
+            solver.first[i] = first;
+            solver.rows[i] = profile;
+            profile += solver.columns[v] - first + 1;
+        }
+        solver.rows[total] = profile;
+
+        const size_t grouped = solver.constraint_offsets[component_count];
+        solver.normal = malloc((profile + 1)*sizeof(*solver.normal));
+        solver.factor = malloc((profile + 1)*sizeof(*solver.factor));
+        solver.gradient = malloc((total + 1)*sizeof(*solver.gradient));
+        solver.step = malloc((total + 1)*sizeof(*solver.step));
+        solver.saved = malloc((total + 1)*sizeof(*solver.saved));
+        solver.residuals = malloc((grouped + 1)*OPENCAD_SKETCH_MAX_ROWS*sizeof(*solver.residuals));
+        solver.jacobian = malloc((grouped + 1)*OPENCAD_SKETCH_MAX_ROWS*sizeof(*solver.jacobian));
+        solver.satisfied = malloc((component_count + 1)*sizeof(*solver.satisfied));
+        if (!solver.normal || !solver.factor || !solver.gradient || !solver.step || !solver.saved || !solver.residuals ||
+            !solver.jacobian || !solver.satisfied) return_defer(ENOMEM);
+
+        opencad_parallel_for(component_count, 1, opencad_sketch_solve_task, &solver);
+        for (size_t k = 0; k < component_count; ++k) unsatisfied |= !solver.satisfied[k];
+        if (unsatisfied) return_defer(EDOM);
     }
+
+defer:
+    free(parent);
+    free(component);
+    free(owner);
+    free(adjacency);
+    free(adjacency_offsets);
+    free(queue);
+    free(solver.constraints);
+    free(solver.constraint_offsets);
+    free(solver.variables);
+    free(solver.variable_offsets);
+    free(solver.columns);
+    free(solver.first);
+    free(solver.rows);
+    free(solver.normal);
+    free(solver.factor);
+    free(solver.gradient);
+    free(solver.step);
+    free(solver.saved);
+    free(solver.residuals);
+    free(solver.jacobian);
+    free(solver.satisfied);
+    return result;
 }
 
 #endif // OPENCAD_C_